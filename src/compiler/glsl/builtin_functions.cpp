@@ -41,6 +41,10 @@
  *    built-in function signatures, where they're available, what types they
  *    take, and so on.
  *
+ *    Those lists are walked once at start-up to learn the built-in names;
+ *    the signatures of a function are only generated the first time it is
+ *    looked up.
+ *
  * 4. Implementations of built-in function signatures
  *
  *    A series of functions which create ir_function_signatures and emit IR
@@ -83,6 +87,7 @@
 #include <math.h>
 #include "builtin_functions.h"
 #include "util/hash_table.h"
+#include "util/set.h"
 
 #define M_PIf   ((float) M_PI)
 #define M_PI_2f ((float) M_PI_2)
@@ -874,17 +879,35 @@ public:
                                const char *name, exec_list *actual_parameters);
 
    /**
-    * A shader to hold all the built-in signatures; created by this module.
-    *
-    * This includes signatures for every built-in, regardless of version or
-    * enabled extensions.  The availability predicate associated with each
-    * signature allows matching_signature() to filter out the irrelevant ones.
+    * Look up a built-in function by name, generating its signatures if this
+    * is the first time it is asked for.
     */
-   gl_shader *shader;
+   ir_function *get_function(const char *name);
 
 private:
    void *mem_ctx;
 
+   /**
+    * A shader to hold the built-in signatures; created by this module.
+    *
+    * This includes signatures for every built-in that has been looked up so
+    * far, regardless of version or enabled extensions.  The availability
+    * predicate associated with each signature allows matching_signature() to
+    * filter out the irrelevant ones.
+    */
+   gl_shader *shader;
+
+   /** Names of all the built-in functions, generated or not. */
+   struct set *names;
+
+   /**
+    * The function create_intrinsics() and create_builtins() generate the
+    * signatures of, or NULL while they only collect the names.
+    */
+   const char *wanted;
+
+   bool generating(const char *name);
+
    void create_shader();
    void create_intrinsics();
    void create_builtins();
@@ -922,6 +945,16 @@ private:
    /** Create a new function and add the given signatures. */
    void add_function(const char *name, ...);
 
+   /**
+    * Wrapper around add_function() that leaves the signature generators
+    * alone unless \p NAME is the function being generated.
+    */
+#define ADD_FUNCTION(NAME, ...)                    \
+   do {                                            \
+      if (generating(NAME))                        \
+         add_function(NAME, __VA_ARGS__);          \
+   } while (0)
+
    typedef ir_function_signature *(builtin_builder::*image_prototype_ctr)(const glsl_type *image_type,
                                                                           unsigned num_arguments,
                                                                           unsigned flags);
@@ -1256,7 +1289,7 @@ enum image_function_flags {
  *  @{
  */
 builtin_builder::builtin_builder()
-   : shader(NULL)
+   : shader(NULL), names(NULL), wanted(NULL)
 {
    mem_ctx = NULL;
 }
@@ -1279,7 +1312,7 @@ builtin_builder::find(_mesa_glsl_parse_state *state,
     */
    state->uses_builtin_functions = true;
 
-   ir_function *f = shader->symbols->get_function(name);
+   ir_function *f = get_function(name);
    if (f == NULL)
       return NULL;
 
@@ -1301,9 +1334,44 @@ builtin_builder::initialize()
    glsl_type_singleton_init_or_ref();
 
    mem_ctx = ralloc_context(NULL);
+   names = _mesa_set_create(mem_ctx, _mesa_hash_string,
+                            _mesa_key_string_equal);
    create_shader();
+
+   /* Only collect the names here, get_function() generates the rest. */
+   wanted = NULL;
+   create_intrinsics();
+   create_builtins();
+}
+
+ir_function *
+builtin_builder::get_function(const char *name)
+{
+   ir_function *f = shader->symbols->get_function(name);
+   if (f != NULL || !_mesa_set_search(names, name))
+      return f;
+
+   /* Signature generators may look up the intrinsics they call, so this can
+    * recurse.
+    */
+   const char *outer = wanted;
+   wanted = name;
    create_intrinsics();
    create_builtins();
+   wanted = outer;
+
+   return shader->symbols->get_function(name);
+}
+
+bool
+builtin_builder::generating(const char *name)
+{
+   if (wanted == NULL) {
+      _mesa_set_add(names, name);
+      return false;
+   }
+
+   return strcmp(name, wanted) == 0;
 }
 
 void
@@ -1311,6 +1379,7 @@ builtin_builder::release()
 {
    ralloc_free(mem_ctx);
    mem_ctx = NULL;
+   names = NULL;
 
    ralloc_free(shader);
    shader = NULL;
@@ -1338,20 +1407,20 @@ builtin_builder::create_shader()
 void
 builtin_builder::create_intrinsics()
 {
-   add_function("__intrinsic_atomic_read",
+   ADD_FUNCTION("__intrinsic_atomic_read",
                 _atomic_counter_intrinsic(shader_atomic_counters,
                                           ir_intrinsic_atomic_counter_read),
                 NULL);
-   add_function("__intrinsic_atomic_increment",
+   ADD_FUNCTION("__intrinsic_atomic_increment",
                 _atomic_counter_intrinsic(shader_atomic_counters,
                                           ir_intrinsic_atomic_counter_increment),
                 NULL);
-   add_function("__intrinsic_atomic_predecrement",
+   ADD_FUNCTION("__intrinsic_atomic_predecrement",
                 _atomic_counter_intrinsic(shader_atomic_counters,
                                           ir_intrinsic_atomic_counter_predecrement),
                 NULL);
 
-   add_function("__intrinsic_atomic_add",
+   ADD_FUNCTION("__intrinsic_atomic_add",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_add),
@@ -1364,7 +1433,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_add),
                 NULL);
-   add_function("__intrinsic_atomic_min",
+   ADD_FUNCTION("__intrinsic_atomic_min",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_min),
@@ -1377,7 +1446,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_min),
                 NULL);
-   add_function("__intrinsic_atomic_max",
+   ADD_FUNCTION("__intrinsic_atomic_max",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_max),
@@ -1390,7 +1459,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_max),
                 NULL);
-   add_function("__intrinsic_atomic_and",
+   ADD_FUNCTION("__intrinsic_atomic_and",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_and),
@@ -1400,7 +1469,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_and),
                 NULL);
-   add_function("__intrinsic_atomic_or",
+   ADD_FUNCTION("__intrinsic_atomic_or",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_or),
@@ -1410,7 +1479,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_or),
                 NULL);
-   add_function("__intrinsic_atomic_xor",
+   ADD_FUNCTION("__intrinsic_atomic_xor",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_xor),
@@ -1420,7 +1489,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_xor),
                 NULL);
-   add_function("__intrinsic_atomic_exchange",
+   ADD_FUNCTION("__intrinsic_atomic_exchange",
                 _atomic_intrinsic2(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_exchange),
@@ -1433,7 +1502,7 @@ builtin_builder::create_intrinsics()
                 _atomic_counter_intrinsic1(shader_atomic_counter_ops_or_v460_desktop,
                                            ir_intrinsic_atomic_counter_exchange),
                 NULL);
-   add_function("__intrinsic_atomic_comp_swap",
+   ADD_FUNCTION("__intrinsic_atomic_comp_swap",
                 _atomic_intrinsic3(buffer_atomics_supported,
                                    glsl_type::uint_type,
                                    ir_intrinsic_generic_atomic_comp_swap),
@@ -1449,59 +1518,59 @@ builtin_builder::create_intrinsics()
 
    add_image_functions(false);
 
-   add_function("__intrinsic_memory_barrier",
+   ADD_FUNCTION("__intrinsic_memory_barrier",
                 _memory_barrier_intrinsic(shader_image_load_store,
                                           ir_intrinsic_memory_barrier),
                 NULL);
-   add_function("__intrinsic_group_memory_barrier",
+   ADD_FUNCTION("__intrinsic_group_memory_barrier",
                 _memory_barrier_intrinsic(compute_shader,
                                           ir_intrinsic_group_memory_barrier),
                 NULL);
-   add_function("__intrinsic_memory_barrier_atomic_counter",
+   ADD_FUNCTION("__intrinsic_memory_barrier_atomic_counter",
                 _memory_barrier_intrinsic(compute_shader_supported,
                                           ir_intrinsic_memory_barrier_atomic_counter),
                 NULL);
-   add_function("__intrinsic_memory_barrier_buffer",
+   ADD_FUNCTION("__intrinsic_memory_barrier_buffer",
                 _memory_barrier_intrinsic(compute_shader_supported,
                                           ir_intrinsic_memory_barrier_buffer),
                 NULL);
-   add_function("__intrinsic_memory_barrier_image",
+   ADD_FUNCTION("__intrinsic_memory_barrier_image",
                 _memory_barrier_intrinsic(compute_shader_supported,
                                           ir_intrinsic_memory_barrier_image),
                 NULL);
-   add_function("__intrinsic_memory_barrier_shared",
+   ADD_FUNCTION("__intrinsic_memory_barrier_shared",
                 _memory_barrier_intrinsic(compute_shader,
                                           ir_intrinsic_memory_barrier_shared),
                 NULL);
 
-   add_function("__intrinsic_begin_invocation_interlock",
+   ADD_FUNCTION("__intrinsic_begin_invocation_interlock",
                 _invocation_interlock_intrinsic(
                    supports_arb_fragment_shader_interlock,
                    ir_intrinsic_begin_invocation_interlock), NULL);
 
-   add_function("__intrinsic_end_invocation_interlock",
+   ADD_FUNCTION("__intrinsic_end_invocation_interlock",
                 _invocation_interlock_intrinsic(
                    supports_arb_fragment_shader_interlock,
                    ir_intrinsic_end_invocation_interlock), NULL);
 
-   add_function("__intrinsic_shader_clock",
+   ADD_FUNCTION("__intrinsic_shader_clock",
                 _shader_clock_intrinsic(shader_clock,
                                         glsl_type::uvec2_type),
                 NULL);
 
-   add_function("__intrinsic_vote_all",
+   ADD_FUNCTION("__intrinsic_vote_all",
                 _vote_intrinsic(vote_or_v460_desktop, ir_intrinsic_vote_all),
                 NULL);
-   add_function("__intrinsic_vote_any",
+   ADD_FUNCTION("__intrinsic_vote_any",
                 _vote_intrinsic(vote_or_v460_desktop, ir_intrinsic_vote_any),
                 NULL);
-   add_function("__intrinsic_vote_eq",
+   ADD_FUNCTION("__intrinsic_vote_eq",
                 _vote_intrinsic(vote_or_v460_desktop, ir_intrinsic_vote_eq),
                 NULL);
 
-   add_function("__intrinsic_ballot", _ballot_intrinsic(), NULL);
+   ADD_FUNCTION("__intrinsic_ballot", _ballot_intrinsic(), NULL);
 
-   add_function("__intrinsic_read_invocation",
+   ADD_FUNCTION("__intrinsic_read_invocation",
                 _read_invocation_intrinsic(glsl_type::float_type),
                 _read_invocation_intrinsic(glsl_type::vec2_type),
                 _read_invocation_intrinsic(glsl_type::vec3_type),
@@ -1518,7 +1587,7 @@ builtin_builder::create_intrinsics()
                 _read_invocation_intrinsic(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("__intrinsic_read_first_invocation",
+   ADD_FUNCTION("__intrinsic_read_first_invocation",
                 _read_first_invocation_intrinsic(glsl_type::float_type),
                 _read_first_invocation_intrinsic(glsl_type::vec2_type),
                 _read_first_invocation_intrinsic(glsl_type::vec3_type),
@@ -1535,7 +1604,7 @@ builtin_builder::create_intrinsics()
                 _read_first_invocation_intrinsic(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("__intrinsic_helper_invocation",
+   ADD_FUNCTION("__intrinsic_helper_invocation",
                 _helper_invocation_intrinsic(), NULL);
 }
 
@@ -1548,7 +1617,7 @@ void
 builtin_builder::create_builtins()
 {
 #define F(NAME)                                 \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
                 _##NAME(glsl_type::vec2_type),  \
                 _##NAME(glsl_type::vec3_type),  \
@@ -1556,7 +1625,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FD(NAME)                                 \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(always_available, glsl_type::float_type), \
                 _##NAME(always_available, glsl_type::vec2_type),  \
                 _##NAME(always_available, glsl_type::vec3_type),  \
@@ -1568,7 +1637,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FD130(NAME)                                 \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(v130, glsl_type::float_type), \
                 _##NAME(v130, glsl_type::vec2_type),  \
                 _##NAME(v130, glsl_type::vec3_type),                  \
@@ -1580,7 +1649,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FDGS5(NAME)                                 \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(gpu_shader5_es, glsl_type::float_type), \
                 _##NAME(gpu_shader5_es, glsl_type::vec2_type),  \
                 _##NAME(gpu_shader5_es, glsl_type::vec3_type),                  \
@@ -1592,7 +1661,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FI(NAME)                                \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(glsl_type::float_type), \
                 _##NAME(glsl_type::vec2_type),  \
                 _##NAME(glsl_type::vec3_type),  \
@@ -1604,7 +1673,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FI64(NAME)                                \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(always_available, glsl_type::float_type), \
                 _##NAME(always_available, glsl_type::vec2_type),  \
                 _##NAME(always_available, glsl_type::vec3_type),  \
@@ -1624,7 +1693,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FIUD_VEC(NAME)                                            \
-   add_function(#NAME,                                            \
+   ADD_FUNCTION(#NAME,                                            \
                 _##NAME(always_available, glsl_type::vec2_type),  \
                 _##NAME(always_available, glsl_type::vec3_type),  \
                 _##NAME(always_available, glsl_type::vec4_type),  \
@@ -1650,7 +1719,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define IU(NAME)                                \
-   add_function(#NAME,                          \
+   ADD_FUNCTION(#NAME,                          \
                 _##NAME(glsl_type::int_type),   \
                 _##NAME(glsl_type::ivec2_type), \
                 _##NAME(glsl_type::ivec3_type), \
@@ -1663,7 +1732,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FIUBD_VEC(NAME)                                           \
-   add_function(#NAME,                                            \
+   ADD_FUNCTION(#NAME,                                            \
                 _##NAME(always_available, glsl_type::vec2_type),  \
                 _##NAME(always_available, glsl_type::vec3_type),  \
                 _##NAME(always_available, glsl_type::vec4_type),  \
@@ -1694,7 +1763,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 #define FIUD2_MIXED(NAME)                                                                 \
-   add_function(#NAME,                                                                   \
+   ADD_FUNCTION(#NAME,                                                                   \
                 _##NAME(always_available, glsl_type::float_type, glsl_type::float_type), \
                 _##NAME(always_available, glsl_type::vec2_type,  glsl_type::float_type), \
                 _##NAME(always_available, glsl_type::vec3_type,  glsl_type::float_type), \
@@ -1754,7 +1823,7 @@ builtin_builder::create_builtins()
    F(asin)
    F(acos)
 
-   add_function("atan",
+   ADD_FUNCTION("atan",
                 _atan(glsl_type::float_type),
                 _atan(glsl_type::vec2_type),
                 _atan(glsl_type::vec3_type),
@@ -1795,7 +1864,7 @@ builtin_builder::create_builtins()
    FD(ceil)
    FD(fract)
 
-   add_function("truncate",
+   ADD_FUNCTION("truncate",
                 _truncate(gpu_shader4, glsl_type::float_type),
                 _truncate(gpu_shader4, glsl_type::vec2_type),
                 _truncate(gpu_shader4, glsl_type::vec3_type),
@@ -1803,7 +1872,7 @@ builtin_builder::create_builtins()
                 NULL);
 
 
-   add_function("mod",
+   ADD_FUNCTION("mod",
                 _mod(always_available, glsl_type::float_type, glsl_type::float_type),
                 _mod(always_available, glsl_type::vec2_type,  glsl_type::float_type),
                 _mod(always_available, glsl_type::vec3_type,  glsl_type::float_type),
@@ -1829,7 +1898,7 @@ builtin_builder::create_builtins()
    FIUD2_MIXED(max)
    FIUD2_MIXED(clamp)
 
-   add_function("mix",
+   ADD_FUNCTION("mix",
                 _mix_lrp(always_available, glsl_type::float_type, glsl_type::float_type),
                 _mix_lrp(always_available, glsl_type::vec2_type,  glsl_type::float_type),
                 _mix_lrp(always_available, glsl_type::vec3_type,  glsl_type::float_type),
@@ -1884,7 +1953,7 @@ builtin_builder::create_builtins()
                 _mix_sel(int64, glsl_type::u64vec4_type, glsl_type::bvec4_type),
                 NULL);
 
-   add_function("step",
+   ADD_FUNCTION("step",
                 _step(always_available, glsl_type::float_type, glsl_type::float_type),
                 _step(always_available, glsl_type::float_type, glsl_type::vec2_type),
                 _step(always_available, glsl_type::float_type, glsl_type::vec3_type),
@@ -1903,7 +1972,7 @@ builtin_builder::create_builtins()
                 _step(fp64, glsl_type::dvec4_type,  glsl_type::dvec4_type),
                 NULL);
 
-   add_function("smoothstep",
+   ADD_FUNCTION("smoothstep",
                 _smoothstep(always_available, glsl_type::float_type, glsl_type::float_type),
                 _smoothstep(always_available, glsl_type::float_type, glsl_type::vec2_type),
                 _smoothstep(always_available, glsl_type::float_type, glsl_type::vec3_type),
@@ -1927,79 +1996,79 @@ builtin_builder::create_builtins()
 
    F(floatBitsToInt)
    F(floatBitsToUint)
-   add_function("intBitsToFloat",
+   ADD_FUNCTION("intBitsToFloat",
                 _intBitsToFloat(glsl_type::int_type),
                 _intBitsToFloat(glsl_type::ivec2_type),
                 _intBitsToFloat(glsl_type::ivec3_type),
                 _intBitsToFloat(glsl_type::ivec4_type),
                 NULL);
-   add_function("uintBitsToFloat",
+   ADD_FUNCTION("uintBitsToFloat",
                 _uintBitsToFloat(glsl_type::uint_type),
                 _uintBitsToFloat(glsl_type::uvec2_type),
                 _uintBitsToFloat(glsl_type::uvec3_type),
                 _uintBitsToFloat(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("doubleBitsToInt64",
+   ADD_FUNCTION("doubleBitsToInt64",
                 _doubleBitsToInt64(int64_fp64, glsl_type::double_type),
                 _doubleBitsToInt64(int64_fp64, glsl_type::dvec2_type),
                 _doubleBitsToInt64(int64_fp64, glsl_type::dvec3_type),
                 _doubleBitsToInt64(int64_fp64, glsl_type::dvec4_type),
                 NULL);
 
-   add_function("doubleBitsToUint64",
+   ADD_FUNCTION("doubleBitsToUint64",
                 _doubleBitsToUint64(int64_fp64, glsl_type::double_type),
                 _doubleBitsToUint64(int64_fp64, glsl_type::dvec2_type),
                 _doubleBitsToUint64(int64_fp64, glsl_type::dvec3_type),
                 _doubleBitsToUint64(int64_fp64, glsl_type::dvec4_type),
                 NULL);
 
-   add_function("int64BitsToDouble",
+   ADD_FUNCTION("int64BitsToDouble",
                 _int64BitsToDouble(int64_fp64, glsl_type::int64_t_type),
                 _int64BitsToDouble(int64_fp64, glsl_type::i64vec2_type),
                 _int64BitsToDouble(int64_fp64, glsl_type::i64vec3_type),
                 _int64BitsToDouble(int64_fp64, glsl_type::i64vec4_type),
                 NULL);
 
-   add_function("uint64BitsToDouble",
+   ADD_FUNCTION("uint64BitsToDouble",
                 _uint64BitsToDouble(int64_fp64, glsl_type::uint64_t_type),
                 _uint64BitsToDouble(int64_fp64, glsl_type::u64vec2_type),
                 _uint64BitsToDouble(int64_fp64, glsl_type::u64vec3_type),
                 _uint64BitsToDouble(int64_fp64, glsl_type::u64vec4_type),
                 NULL);
 
-   add_function("packUnorm2x16",   _packUnorm2x16(shader_packing_or_es3_or_gpu_shader5),   NULL);
-   add_function("packSnorm2x16",   _packSnorm2x16(shader_packing_or_es3),                  NULL);
-   add_function("packUnorm4x8",    _packUnorm4x8(shader_packing_or_es31_or_gpu_shader5),   NULL);
-   add_function("packSnorm4x8",    _packSnorm4x8(shader_packing_or_es31_or_gpu_shader5),   NULL);
-   add_function("unpackUnorm2x16", _unpackUnorm2x16(shader_packing_or_es3_or_gpu_shader5), NULL);
-   add_function("unpackSnorm2x16", _unpackSnorm2x16(shader_packing_or_es3),                NULL);
-   add_function("unpackUnorm4x8",  _unpackUnorm4x8(shader_packing_or_es31_or_gpu_shader5), NULL);
-   add_function("unpackSnorm4x8",  _unpackSnorm4x8(shader_packing_or_es31_or_gpu_shader5), NULL);
-   add_function("packHalf2x16",    _packHalf2x16(shader_packing_or_es3),                   NULL);
-   add_function("unpackHalf2x16",  _unpackHalf2x16(shader_packing_or_es3),                 NULL);
-   add_function("packDouble2x32",    _packDouble2x32(fp64),                   NULL);
-   add_function("unpackDouble2x32",  _unpackDouble2x32(fp64),                 NULL);
-
-   add_function("packInt2x32",     _packInt2x32(int64),                    NULL);
-   add_function("unpackInt2x32",   _unpackInt2x32(int64),                  NULL);
-   add_function("packUint2x32",    _packUint2x32(int64),                   NULL);
-   add_function("unpackUint2x32",  _unpackUint2x32(int64),                 NULL);
+   ADD_FUNCTION("packUnorm2x16",   _packUnorm2x16(shader_packing_or_es3_or_gpu_shader5),   NULL);
+   ADD_FUNCTION("packSnorm2x16",   _packSnorm2x16(shader_packing_or_es3),                  NULL);
+   ADD_FUNCTION("packUnorm4x8",    _packUnorm4x8(shader_packing_or_es31_or_gpu_shader5),   NULL);
+   ADD_FUNCTION("packSnorm4x8",    _packSnorm4x8(shader_packing_or_es31_or_gpu_shader5),   NULL);
+   ADD_FUNCTION("unpackUnorm2x16", _unpackUnorm2x16(shader_packing_or_es3_or_gpu_shader5), NULL);
+   ADD_FUNCTION("unpackSnorm2x16", _unpackSnorm2x16(shader_packing_or_es3),                NULL);
+   ADD_FUNCTION("unpackUnorm4x8",  _unpackUnorm4x8(shader_packing_or_es31_or_gpu_shader5), NULL);
+   ADD_FUNCTION("unpackSnorm4x8",  _unpackSnorm4x8(shader_packing_or_es31_or_gpu_shader5), NULL);
+   ADD_FUNCTION("packHalf2x16",    _packHalf2x16(shader_packing_or_es3),                   NULL);
+   ADD_FUNCTION("unpackHalf2x16",  _unpackHalf2x16(shader_packing_or_es3),                 NULL);
+   ADD_FUNCTION("packDouble2x32",    _packDouble2x32(fp64),                   NULL);
+   ADD_FUNCTION("unpackDouble2x32",  _unpackDouble2x32(fp64),                 NULL);
+
+   ADD_FUNCTION("packInt2x32",     _packInt2x32(int64),                    NULL);
+   ADD_FUNCTION("unpackInt2x32",   _unpackInt2x32(int64),                  NULL);
+   ADD_FUNCTION("packUint2x32",    _packUint2x32(int64),                   NULL);
+   ADD_FUNCTION("unpackUint2x32",  _unpackUint2x32(int64),                 NULL);
 
    FD(length)
    FD(distance)
    FD(dot)
 
-   add_function("cross", _cross(always_available, glsl_type::vec3_type),
+   ADD_FUNCTION("cross", _cross(always_available, glsl_type::vec3_type),
                 _cross(fp64, glsl_type::dvec3_type), NULL);
 
    FD(normalize)
-   add_function("ftransform", _ftransform(), NULL);
+   ADD_FUNCTION("ftransform", _ftransform(), NULL);
    FD(faceforward)
    FD(reflect)
    FD(refract)
    // ...
-   add_function("matrixCompMult",
+   ADD_FUNCTION("matrixCompMult",
                 _matrixCompMult(always_available, glsl_type::mat2_type),
                 _matrixCompMult(always_available, glsl_type::mat3_type),
                 _matrixCompMult(always_available, glsl_type::mat4_type),
@@ -2019,7 +2088,7 @@ builtin_builder::create_builtins()
                 _matrixCompMult(fp64, glsl_type::dmat4x2_type),
                 _matrixCompMult(fp64, glsl_type::dmat4x3_type),
                 NULL);
-   add_function("outerProduct",
+   ADD_FUNCTION("outerProduct",
                 _outerProduct(v120, glsl_type::mat2_type),
                 _outerProduct(v120, glsl_type::mat3_type),
                 _outerProduct(v120, glsl_type::mat4_type),
@@ -2039,7 +2108,7 @@ builtin_builder::create_builtins()
                 _outerProduct(fp64, glsl_type::dmat4x2_type),
                 _outerProduct(fp64, glsl_type::dmat4x3_type),
                 NULL);
-   add_function("determinant",
+   ADD_FUNCTION("determinant",
                 _determinant_mat2(v120, glsl_type::mat2_type),
                 _determinant_mat3(v120, glsl_type::mat3_type),
                 _determinant_mat4(v120, glsl_type::mat4_type),
@@ -2048,7 +2117,7 @@ builtin_builder::create_builtins()
                 _determinant_mat4(fp64, glsl_type::dmat4_type),
 
                 NULL);
-   add_function("inverse",
+   ADD_FUNCTION("inverse",
                 _inverse_mat2(v140_or_es3, glsl_type::mat2_type),
                 _inverse_mat3(v140_or_es3, glsl_type::mat3_type),
                 _inverse_mat4(v140_or_es3, glsl_type::mat4_type),
@@ -2056,7 +2125,7 @@ builtin_builder::create_builtins()
                 _inverse_mat3(fp64, glsl_type::dmat3_type),
                 _inverse_mat4(fp64, glsl_type::dmat4_type),
                 NULL);
-   add_function("transpose",
+   ADD_FUNCTION("transpose",
                 _transpose(v120, glsl_type::mat2_type),
                 _transpose(v120, glsl_type::mat3_type),
                 _transpose(v120, glsl_type::mat4_type),
@@ -2083,25 +2152,25 @@ builtin_builder::create_builtins()
    FIUBD_VEC(notEqual)
    FIUBD_VEC(equal)
 
-   add_function("any",
+   ADD_FUNCTION("any",
                 _any(glsl_type::bvec2_type),
                 _any(glsl_type::bvec3_type),
                 _any(glsl_type::bvec4_type),
                 NULL);
 
-   add_function("all",
+   ADD_FUNCTION("all",
                 _all(glsl_type::bvec2_type),
                 _all(glsl_type::bvec3_type),
                 _all(glsl_type::bvec4_type),
                 NULL);
 
-   add_function("not",
+   ADD_FUNCTION("not",
                 _not(glsl_type::bvec2_type),
                 _not(glsl_type::bvec3_type),
                 _not(glsl_type::bvec4_type),
                 NULL);
 
-   add_function("textureSize",
+   ADD_FUNCTION("textureSize",
                 _textureSize(v130, glsl_type::int_type,   glsl_type::sampler1D_type),
                 _textureSize(v130, glsl_type::int_type,   glsl_type::isampler1D_type),
                 _textureSize(v130, glsl_type::int_type,   glsl_type::usampler1D_type),
@@ -2156,55 +2225,55 @@ builtin_builder::create_builtins()
                 _textureSize(texture_external_es3, glsl_type::ivec2_type, glsl_type::samplerExternalOES_type),
                 NULL);
 
-   add_function("textureSize1D",
+   ADD_FUNCTION("textureSize1D",
                 _textureSize(gpu_shader4, glsl_type::int_type,   glsl_type::sampler1D_type),
                 _textureSize(gpu_shader4_integer, glsl_type::int_type,   glsl_type::isampler1D_type),
                 _textureSize(gpu_shader4_integer, glsl_type::int_type,   glsl_type::usampler1D_type),
                 NULL);
 
-   add_function("textureSize2D",
+   ADD_FUNCTION("textureSize2D",
                 _textureSize(gpu_shader4, glsl_type::ivec2_type, glsl_type::sampler2D_type),
                 _textureSize(gpu_shader4_integer, glsl_type::ivec2_type, glsl_type::isampler2D_type),
                 _textureSize(gpu_shader4_integer, glsl_type::ivec2_type, glsl_type::usampler2D_type),
                 NULL);
 
-   add_function("textureSize3D",
+   ADD_FUNCTION("textureSize3D",
                 _textureSize(gpu_shader4, glsl_type::ivec3_type, glsl_type::sampler3D_type),
                 _textureSize(gpu_shader4_integer, glsl_type::ivec3_type, glsl_type::isampler3D_type),
                 _textureSize(gpu_shader4_integer, glsl_type::ivec3_type, glsl_type::usampler3D_type),
                 NULL);
 
-   add_function("textureSizeCube",
+   ADD_FUNCTION("textureSizeCube",
                 _textureSize(gpu_shader4, glsl_type::ivec2_type, glsl_type::samplerCube_type),
                 _textureSize(gpu_shader4_integer, glsl_type::ivec2_type, glsl_type::isamplerCube_type),
                 _textureSize(gpu_shader4_integer, glsl_type::ivec2_type, glsl_type::usamplerCube_type),
                 NULL);
 
-   add_function("textureSize1DArray",
+   ADD_FUNCTION("textureSize1DArray",
                 _textureSize(gpu_shader4_array,         glsl_type::ivec2_type, glsl_type::sampler1DArray_type),
                 _textureSize(gpu_shader4_array_integer, glsl_type::ivec2_type, glsl_type::isampler1DArray_type),
                 _textureSize(gpu_shader4_array_integer, glsl_type::ivec2_type, glsl_type::usampler1DArray_type),
                 NULL);
 
-   add_function("textureSize2DArray",
+   ADD_FUNCTION("textureSize2DArray",
                 _textureSize(gpu_shader4_array,         glsl_type::ivec3_type, glsl_type::sampler2DArray_type),
                 _textureSize(gpu_shader4_array_integer, glsl_type::ivec3_type, glsl_type::isampler2DArray_type),
                 _textureSize(gpu_shader4_array_integer, glsl_type::ivec3_type, glsl_type::usampler2DArray_type),
                 NULL);
 
-   add_function("textureSize2DRect",
+   ADD_FUNCTION("textureSize2DRect",
                 _textureSize(gpu_shader4_rect,         glsl_type::ivec2_type, glsl_type::sampler2DRect_type),
                 _textureSize(gpu_shader4_rect_integer, glsl_type::ivec2_type, glsl_type::isampler2DRect_type),
                 _textureSize(gpu_shader4_rect_integer, glsl_type::ivec2_type, glsl_type::usampler2DRect_type),
                 NULL);
 
-   add_function("textureSizeBuffer",
+   ADD_FUNCTION("textureSizeBuffer",
                 _textureSize(gpu_shader4_tbo,         glsl_type::int_type,   glsl_type::samplerBuffer_type),
                 _textureSize(gpu_shader4_tbo_integer, glsl_type::int_type,   glsl_type::isamplerBuffer_type),
                 _textureSize(gpu_shader4_tbo_integer, glsl_type::int_type,   glsl_type::usamplerBuffer_type),
                 NULL);
 
-   add_function("textureSamples",
+   ADD_FUNCTION("textureSamples",
                 _textureSamples(shader_samples, glsl_type::sampler2DMS_type),
                 _textureSamples(shader_samples, glsl_type::isampler2DMS_type),
                 _textureSamples(shader_samples, glsl_type::usampler2DMS_type),
@@ -2214,7 +2283,7 @@ builtin_builder::create_builtins()
                 _textureSamples(shader_samples, glsl_type::usampler2DMSArray_type),
                 NULL);
 
-   add_function("texture",
+   ADD_FUNCTION("texture",
                 _texture(ir_tex, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type),
                 _texture(ir_tex, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type),
                 _texture(ir_tex, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type),
@@ -2302,7 +2371,7 @@ builtin_builder::create_builtins()
                 _textureCubeArrayShadow(ir_txb, v130_or_gpu_shader4_and_tex_cube_map_array, glsl_type::samplerCubeArrayShadow_type),
                 NULL);
 
-   add_function("textureLod",
+   ADD_FUNCTION("textureLod",
                 _texture(ir_txl, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type),
                 _texture(ir_txl, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type),
                 _texture(ir_txl, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type),
@@ -2340,7 +2409,7 @@ builtin_builder::create_builtins()
                 _textureCubeArrayShadow(ir_txl, v130_or_gpu_shader4_and_tex_cube_map_array, glsl_type::samplerCubeArrayShadow_type),
                 NULL);
 
-   add_function("textureOffset",
+   ADD_FUNCTION("textureOffset",
                 _texture(ir_tex, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_tex, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_tex, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
@@ -2407,7 +2476,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, v130_or_gpu_shader4_and_tex_shadow_lod, glsl_type::float_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DOffset",
+   ADD_FUNCTION("texture1DOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
@@ -2416,7 +2485,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DOffset",
+   ADD_FUNCTION("texture2DOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
@@ -2425,7 +2494,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture3DOffset",
+   ADD_FUNCTION("texture3DOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
@@ -2434,27 +2503,27 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DRectOffset",
+   ADD_FUNCTION("texture2DRectOffset",
                 _texture(ir_tex, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::ivec4_type, glsl_type::isampler2DRect_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DRectOffset",
+   ADD_FUNCTION("shadow2DRectOffset",
                 _texture(ir_tex, gpu_shader4_rect, glsl_type::vec4_type, glsl_type::sampler2DRectShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DOffset",
+   ADD_FUNCTION("shadow1DOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txb, gpu_shader4_derivs_only, glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DOffset",
+   ADD_FUNCTION("shadow2DOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txb, gpu_shader4_derivs_only, glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DArrayOffset",
+   ADD_FUNCTION("texture1DArrayOffset",
                 _texture(ir_tex, gpu_shader4_array,                     glsl_type::vec4_type,  glsl_type::sampler1DArray_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_array_integer,             glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_array_integer,             glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
@@ -2463,7 +2532,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_array_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DArrayOffset",
+   ADD_FUNCTION("texture2DArrayOffset",
                 _texture(ir_tex, gpu_shader4_array,                     glsl_type::vec4_type,  glsl_type::sampler2DArray_type,  glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_array_integer,             glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_array_integer,             glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
@@ -2472,16 +2541,16 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_array_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DArrayOffset",
+   ADD_FUNCTION("shadow1DArrayOffset",
                 _texture(ir_tex, gpu_shader4_array,             glsl_type::vec4_type, glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txb, gpu_shader4_array_derivs_only, glsl_type::vec4_type, glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DArrayOffset",
+   ADD_FUNCTION("shadow2DArrayOffset",
                 _texture(ir_tex, gpu_shader4_array, glsl_type::vec4_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type, TEX_OFFSET),
                 NULL);
 
-   add_function("textureProj",
+   ADD_FUNCTION("textureProj",
                 _texture(ir_tex, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_tex, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_tex, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
@@ -2537,7 +2606,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, v130_derivatives_only, glsl_type::float_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texelFetch",
+   ADD_FUNCTION("texelFetch",
                 _texelFetch(v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::int_type),
                 _texelFetch(v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::int_type),
                 _texelFetch(v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::int_type),
@@ -2578,49 +2647,49 @@ builtin_builder::create_builtins()
 
                 NULL);
 
-   add_function("texelFetch1D",
+   ADD_FUNCTION("texelFetch1D",
                 _texelFetch(gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::int_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::int_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::int_type),
                 NULL);
 
-   add_function("texelFetch2D",
+   ADD_FUNCTION("texelFetch2D",
                 _texelFetch(gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::ivec2_type),
                 NULL);
 
-   add_function("texelFetch3D",
+   ADD_FUNCTION("texelFetch3D",
                 _texelFetch(gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::ivec3_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::ivec3_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::ivec3_type),
                 NULL);
 
-   add_function("texelFetch2DRect",
+   ADD_FUNCTION("texelFetch2DRect",
                 _texelFetch(gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type,  glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_rect_integer, glsl_type::ivec4_type, glsl_type::isampler2DRect_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::ivec2_type),
                 NULL);
 
-   add_function("texelFetch1DArray",
+   ADD_FUNCTION("texelFetch1DArray",
                 _texelFetch(gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler1DArray_type,  glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::ivec2_type),
                 NULL);
 
-   add_function("texelFetch2DArray",
+   ADD_FUNCTION("texelFetch2DArray",
                 _texelFetch(gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler2DArray_type,  glsl_type::ivec3_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::ivec3_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::ivec3_type),
                 NULL);
 
-   add_function("texelFetchBuffer",
+   ADD_FUNCTION("texelFetchBuffer",
                 _texelFetch(gpu_shader4_tbo,         glsl_type::vec4_type,  glsl_type::samplerBuffer_type,  glsl_type::int_type),
                 _texelFetch(gpu_shader4_tbo_integer, glsl_type::ivec4_type, glsl_type::isamplerBuffer_type, glsl_type::int_type),
                 _texelFetch(gpu_shader4_tbo_integer, glsl_type::uvec4_type, glsl_type::usamplerBuffer_type, glsl_type::int_type),
                 NULL);
 
-   add_function("texelFetchOffset",
+   ADD_FUNCTION("texelFetchOffset",
                 _texelFetch(v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::int_type, glsl_type::int_type),
                 _texelFetch(v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::int_type, glsl_type::int_type),
                 _texelFetch(v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::int_type, glsl_type::int_type),
@@ -2647,43 +2716,43 @@ builtin_builder::create_builtins()
 
                 NULL);
 
-   add_function("texelFetch1DOffset",
+   ADD_FUNCTION("texelFetch1DOffset",
                 _texelFetch(gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::int_type, glsl_type::int_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::int_type, glsl_type::int_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::int_type, glsl_type::int_type),
                 NULL);
 
-   add_function("texelFetch2DOffset",
+   ADD_FUNCTION("texelFetch2DOffset",
                 _texelFetch(gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::ivec2_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::ivec2_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::ivec2_type, glsl_type::ivec2_type),
                 NULL);
 
-   add_function("texelFetch3DOffset",
+   ADD_FUNCTION("texelFetch3DOffset",
                 _texelFetch(gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::ivec3_type, glsl_type::ivec3_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::ivec3_type, glsl_type::ivec3_type),
                 _texelFetch(gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::ivec3_type, glsl_type::ivec3_type),
                 NULL);
 
-   add_function("texelFetch2DRectOffset",
+   ADD_FUNCTION("texelFetch2DRectOffset",
                 _texelFetch(gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type,  glsl_type::ivec2_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_rect_integer, glsl_type::ivec4_type, glsl_type::isampler2DRect_type, glsl_type::ivec2_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::ivec2_type, glsl_type::ivec2_type),
                 NULL);
 
-   add_function("texelFetch1DArrayOffset",
+   ADD_FUNCTION("texelFetch1DArrayOffset",
                 _texelFetch(gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler1DArray_type,  glsl_type::ivec2_type, glsl_type::int_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::ivec2_type, glsl_type::int_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::ivec2_type, glsl_type::int_type),
                 NULL);
 
-   add_function("texelFetch2DArrayOffset",
+   ADD_FUNCTION("texelFetch2DArrayOffset",
                 _texelFetch(gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler2DArray_type,  glsl_type::ivec3_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::ivec3_type, glsl_type::ivec2_type),
                 _texelFetch(gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::ivec3_type, glsl_type::ivec2_type),
                 NULL);
 
-   add_function("textureProjOffset",
+   ADD_FUNCTION("textureProjOffset",
                 _texture(ir_tex, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
@@ -2736,7 +2805,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, v130_derivatives_only, glsl_type::float_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DProjOffset",
+   ADD_FUNCTION("texture1DProjOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
@@ -2751,7 +2820,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DProjOffset",
+   ADD_FUNCTION("texture2DProjOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
@@ -2766,7 +2835,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture3DProjOffset",
+   ADD_FUNCTION("texture3DProjOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_integer,     glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
@@ -2775,17 +2844,17 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DProjOffset",
+   ADD_FUNCTION("shadow1DProjOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txb, gpu_shader4_derivs_only, glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DProjOffset",
+   ADD_FUNCTION("shadow2DProjOffset",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txb, gpu_shader4_derivs_only, glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DRectProjOffset",
+   ADD_FUNCTION("texture2DRectProjOffset",
                 _texture(ir_tex, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type,  glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::ivec4_type, glsl_type::isampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
@@ -2794,11 +2863,11 @@ builtin_builder::create_builtins()
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DRectProjOffset",
+   ADD_FUNCTION("shadow2DRectProjOffset",
                 _texture(ir_tex, gpu_shader4_rect, glsl_type::vec4_type, glsl_type::sampler2DRectShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("textureLodOffset",
+   ADD_FUNCTION("textureLodOffset",
                 _texture(ir_txl, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txl, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txl, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
@@ -2826,49 +2895,49 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, v130_or_gpu_shader4_and_tex_shadow_lod, glsl_type::float_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DLodOffset",
+   ADD_FUNCTION("texture1DLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DLodOffset",
+   ADD_FUNCTION("texture2DLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture3DLodOffset",
+   ADD_FUNCTION("texture3DLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DLodOffset",
+   ADD_FUNCTION("shadow1DLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DLodOffset",
+   ADD_FUNCTION("shadow2DLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DArrayLodOffset",
+   ADD_FUNCTION("texture1DArrayLodOffset",
                 _texture(ir_txl, gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler1DArray_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DArrayLodOffset",
+   ADD_FUNCTION("texture2DArrayLodOffset",
                 _texture(ir_txl, gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler2DArray_type,  glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DArrayLodOffset",
+   ADD_FUNCTION("shadow1DArrayLodOffset",
                 _texture(ir_txl, gpu_shader4_array, glsl_type::vec4_type, glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("textureProjLod",
+   ADD_FUNCTION("textureProjLod",
                 _texture(ir_txl, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txl, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txl, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
@@ -2891,7 +2960,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, v130, glsl_type::float_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("textureProjLodOffset",
+   ADD_FUNCTION("textureProjLodOffset",
                 _texture(ir_txl, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
@@ -2914,7 +2983,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, v130, glsl_type::float_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DProjLodOffset",
+   ADD_FUNCTION("texture1DProjLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
@@ -2923,7 +2992,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DProjLodOffset",
+   ADD_FUNCTION("texture2DProjLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
@@ -2932,21 +3001,21 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture3DProjLodOffset",
+   ADD_FUNCTION("texture3DProjLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DProjLodOffset",
+   ADD_FUNCTION("shadow1DProjLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DProjLodOffset",
+   ADD_FUNCTION("shadow2DProjLodOffset",
                 _texture(ir_txl, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("textureGrad",
+   ADD_FUNCTION("textureGrad",
                 _texture(ir_txd, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type),
                 _texture(ir_txd, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type),
                 _texture(ir_txd, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type),
@@ -2989,7 +3058,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, v130, glsl_type::float_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type),
                 NULL);
 
-   add_function("textureGradOffset",
+   ADD_FUNCTION("textureGradOffset",
                 _texture(ir_txd, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txd, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txd, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
@@ -3023,63 +3092,63 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, v130, glsl_type::float_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DGradOffset",
+   ADD_FUNCTION("texture1DGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::float_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DGradOffset",
+   ADD_FUNCTION("texture2DGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture3DGradOffset",
+   ADD_FUNCTION("texture3DGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DRectGradOffset",
+   ADD_FUNCTION("texture2DRectGradOffset",
                 _texture(ir_txd, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::ivec4_type, glsl_type::isampler2DRect_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DRectGradOffset",
+   ADD_FUNCTION("shadow2DRectGradOffset",
                 _texture(ir_txd, gpu_shader4_rect, glsl_type::vec4_type, glsl_type::sampler2DRectShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DGradOffset",
+   ADD_FUNCTION("shadow1DGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DGradOffset",
+   ADD_FUNCTION("shadow2DGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DArrayGradOffset",
+   ADD_FUNCTION("texture1DArrayGradOffset",
                 _texture(ir_txd, gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler1DArray_type,  glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::vec2_type, TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DArrayGradOffset",
+   ADD_FUNCTION("texture2DArrayGradOffset",
                 _texture(ir_txd, gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler2DArray_type,  glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DArrayGradOffset",
+   ADD_FUNCTION("shadow1DArrayGradOffset",
                 _texture(ir_txd, gpu_shader4_array, glsl_type::vec4_type, glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DArrayGradOffset",
+   ADD_FUNCTION("shadow2DArrayGradOffset",
                 _texture(ir_txd, gpu_shader4_array, glsl_type::vec4_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type, TEX_OFFSET),
                 NULL);
 
-   add_function("textureProjGrad",
+   ADD_FUNCTION("textureProjGrad",
                 _texture(ir_txd, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txd, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txd, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
@@ -3111,7 +3180,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, v130, glsl_type::float_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("textureProjGradOffset",
+   ADD_FUNCTION("textureProjGradOffset",
                 _texture(ir_txd, v130, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, v130, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, v130, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
@@ -3143,7 +3212,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, v130, glsl_type::float_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture1DProjGradOffset",
+   ADD_FUNCTION("texture1DProjGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type,  glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec2_type, TEX_PROJECT | TEX_OFFSET),
@@ -3152,7 +3221,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler1D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DProjGradOffset",
+   ADD_FUNCTION("texture2DProjGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type,  glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
@@ -3161,13 +3230,13 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture3DProjGradOffset",
+   ADD_FUNCTION("texture3DProjGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type,  glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("texture2DRectProjGradOffset",
+   ADD_FUNCTION("texture2DRectProjGradOffset",
                 _texture(ir_txd, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type,  glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::ivec4_type, glsl_type::isampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT | TEX_OFFSET),
@@ -3176,31 +3245,31 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::uvec4_type, glsl_type::usampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DRectProjGradOffset",
+   ADD_FUNCTION("shadow2DRectProjGradOffset",
                 _texture(ir_txd, gpu_shader4_rect, glsl_type::vec4_type, glsl_type::sampler2DRectShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow1DProjGradOffset",
+   ADD_FUNCTION("shadow1DProjGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("shadow2DProjGradOffset",
+   ADD_FUNCTION("shadow2DProjGradOffset",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type, glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT | TEX_OFFSET),
                 NULL);
 
-   add_function("EmitVertex",   _EmitVertex(),   NULL);
-   add_function("EndPrimitive", _EndPrimitive(), NULL);
-   add_function("EmitStreamVertex",
+   ADD_FUNCTION("EmitVertex",   _EmitVertex(),   NULL);
+   ADD_FUNCTION("EndPrimitive", _EndPrimitive(), NULL);
+   ADD_FUNCTION("EmitStreamVertex",
                 _EmitStreamVertex(gs_streams, glsl_type::uint_type),
                 _EmitStreamVertex(gs_streams, glsl_type::int_type),
                 NULL);
-   add_function("EndStreamPrimitive",
+   ADD_FUNCTION("EndStreamPrimitive",
                 _EndStreamPrimitive(gs_streams, glsl_type::uint_type),
                 _EndStreamPrimitive(gs_streams, glsl_type::int_type),
                 NULL);
-   add_function("barrier", _barrier(), NULL);
+   ADD_FUNCTION("barrier", _barrier(), NULL);
 
-   add_function("textureQueryLOD",
+   ADD_FUNCTION("textureQueryLOD",
                 _textureQueryLod(texture_query_lod, glsl_type::sampler1D_type,  glsl_type::float_type),
                 _textureQueryLod(texture_query_lod, glsl_type::isampler1D_type, glsl_type::float_type),
                 _textureQueryLod(texture_query_lod, glsl_type::usampler1D_type, glsl_type::float_type),
@@ -3237,7 +3306,7 @@ builtin_builder::create_builtins()
                 _textureQueryLod(texture_query_lod, glsl_type::samplerCubeArrayShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("textureQueryLod",
+   ADD_FUNCTION("textureQueryLod",
                 _textureQueryLod(v400_derivatives_only, glsl_type::sampler1D_type,  glsl_type::float_type),
                 _textureQueryLod(v400_derivatives_only, glsl_type::isampler1D_type, glsl_type::float_type),
                 _textureQueryLod(v400_derivatives_only, glsl_type::usampler1D_type, glsl_type::float_type),
@@ -3274,7 +3343,7 @@ builtin_builder::create_builtins()
                 _textureQueryLod(v400_derivatives_only, glsl_type::samplerCubeArrayShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("textureQueryLevels",
+   ADD_FUNCTION("textureQueryLevels",
                 _textureQueryLevels(texture_query_levels, glsl_type::sampler1D_type),
                 _textureQueryLevels(texture_query_levels, glsl_type::sampler2D_type),
                 _textureQueryLevels(texture_query_levels, glsl_type::sampler3D_type),
@@ -3307,7 +3376,7 @@ builtin_builder::create_builtins()
 
                 NULL);
 
-   add_function("textureSamplesIdenticalEXT",
+   ADD_FUNCTION("textureSamplesIdenticalEXT",
                 _textureSamplesIdentical(texture_samples_identical, glsl_type::sampler2DMS_type,  glsl_type::ivec2_type),
                 _textureSamplesIdentical(texture_samples_identical, glsl_type::isampler2DMS_type, glsl_type::ivec2_type),
                 _textureSamplesIdentical(texture_samples_identical, glsl_type::usampler2DMS_type, glsl_type::ivec2_type),
@@ -3317,7 +3386,7 @@ builtin_builder::create_builtins()
                 _textureSamplesIdentical(texture_samples_identical_array, glsl_type::usampler2DMSArray_type, glsl_type::ivec3_type),
                 NULL);
 
-   add_function("texture1D",
+   ADD_FUNCTION("texture1D",
                 _texture(ir_tex, v110,                      glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::float_type),
                 _texture(ir_txb, v110_derivatives_only,     glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::float_type),
                 _texture(ir_tex, gpu_shader4_integer,               glsl_type::ivec4_type,  glsl_type::isampler1D_type, glsl_type::float_type),
@@ -3326,7 +3395,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only,   glsl_type::uvec4_type,  glsl_type::usampler1D_type, glsl_type::float_type),
                 NULL);
 
-   add_function("texture1DArray",
+   ADD_FUNCTION("texture1DArray",
                 _texture(ir_tex, texture_array,           glsl_type::vec4_type, glsl_type::sampler1DArray_type, glsl_type::vec2_type),
                 _texture(ir_txb, texture_array_derivs_only,glsl_type::vec4_type, glsl_type::sampler1DArray_type, glsl_type::vec2_type),
                 _texture(ir_tex, gpu_shader4_array_integer,             glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::vec2_type),
@@ -3335,7 +3404,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_array_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture1DProj",
+   ADD_FUNCTION("texture1DProj",
                 _texture(ir_tex, v110,                  glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_tex, v110,                  glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txb, v110_derivatives_only, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
@@ -3350,19 +3419,19 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type,  glsl_type::usampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture1DLod",
+   ADD_FUNCTION("texture1DLod",
                 _texture(ir_txl, tex1d_lod, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::float_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler1D_type, glsl_type::float_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler1D_type, glsl_type::float_type),
                 NULL);
 
-   add_function("texture1DArrayLod",
+   ADD_FUNCTION("texture1DArrayLod",
                 _texture(ir_txl, texture_array_lod, glsl_type::vec4_type, glsl_type::sampler1DArray_type, glsl_type::vec2_type),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler1DArray_type, glsl_type::vec2_type),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler1DArray_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture1DProjLod",
+   ADD_FUNCTION("texture1DProjLod",
                 _texture(ir_txl, tex1d_lod, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txl, tex1d_lod, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
@@ -3371,7 +3440,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture2D",
+   ADD_FUNCTION("texture2D",
                 _texture(ir_tex, always_available,        glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec2_type),
                 _texture(ir_txb, derivatives_only,        glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec2_type),
                 _texture(ir_tex, gpu_shader4_integer,             glsl_type::ivec4_type,  glsl_type::isampler2D_type, glsl_type::vec2_type),
@@ -3381,7 +3450,7 @@ builtin_builder::create_builtins()
                 _texture(ir_tex, texture_external,        glsl_type::vec4_type,  glsl_type::samplerExternalOES_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DArray",
+   ADD_FUNCTION("texture2DArray",
                 _texture(ir_tex, texture_array,           glsl_type::vec4_type, glsl_type::sampler2DArray_type, glsl_type::vec3_type),
                 _texture(ir_txb, texture_array_derivs_only, glsl_type::vec4_type, glsl_type::sampler2DArray_type, glsl_type::vec3_type),
                 _texture(ir_tex, gpu_shader4_array_integer,             glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::vec3_type),
@@ -3390,7 +3459,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_array_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture2DProj",
+   ADD_FUNCTION("texture2DProj",
                 _texture(ir_tex, always_available,        glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_tex, always_available,        glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txb, derivatives_only,        glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
@@ -3407,19 +3476,19 @@ builtin_builder::create_builtins()
                 _texture(ir_tex, texture_external,        glsl_type::vec4_type,  glsl_type::samplerExternalOES_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture2DLod",
+   ADD_FUNCTION("texture2DLod",
                 _texture(ir_txl, lod_exists_in_stage, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec2_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler2D_type, glsl_type::vec2_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler2D_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DArrayLod",
+   ADD_FUNCTION("texture2DArrayLod",
                 _texture(ir_txl, texture_array_lod, glsl_type::vec4_type, glsl_type::sampler2DArray_type, glsl_type::vec3_type),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::ivec4_type, glsl_type::isampler2DArray_type, glsl_type::vec3_type),
                 _texture(ir_txl, gpu_shader4_array_integer, glsl_type::uvec4_type, glsl_type::usampler2DArray_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture2DProjLod",
+   ADD_FUNCTION("texture2DProjLod",
                 _texture(ir_txl, lod_exists_in_stage, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_txl, lod_exists_in_stage, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
@@ -3428,7 +3497,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler2D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture3D",
+   ADD_FUNCTION("texture3D",
                 _texture(ir_tex, tex3d,                   glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec3_type),
                 _texture(ir_txb, derivatives_tex3d,       glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec3_type),
                 _texture(ir_tex, gpu_shader4_integer,             glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec3_type),
@@ -3437,7 +3506,7 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture3DProj",
+   ADD_FUNCTION("texture3DProj",
                 _texture(ir_tex, tex3d,                   glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txb, derivatives_tex3d,       glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_tex, gpu_shader4_integer,             glsl_type::ivec4_type, glsl_type::isampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
@@ -3446,19 +3515,19 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type, glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture3DLod",
+   ADD_FUNCTION("texture3DLod",
                 _texture(ir_txl, tex3d_lod, glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec3_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler3D_type, glsl_type::vec3_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler3D_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture3DProjLod",
+   ADD_FUNCTION("texture3DProjLod",
                 _texture(ir_txl, tex3d_lod, glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("textureCube",
+   ADD_FUNCTION("textureCube",
                 _texture(ir_tex, always_available,        glsl_type::vec4_type,  glsl_type::samplerCube_type, glsl_type::vec3_type),
                 _texture(ir_txb, derivatives_only,        glsl_type::vec4_type,  glsl_type::samplerCube_type, glsl_type::vec3_type),
                 _texture(ir_tex, gpu_shader4_integer,             glsl_type::ivec4_type,  glsl_type::isamplerCube_type, glsl_type::vec3_type),
@@ -3467,19 +3536,19 @@ builtin_builder::create_builtins()
                 _texture(ir_txb, gpu_shader4_integer_derivs_only, glsl_type::uvec4_type,  glsl_type::usamplerCube_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("textureCubeLod",
+   ADD_FUNCTION("textureCubeLod",
                 _texture(ir_txl, lod_exists_in_stage, glsl_type::vec4_type,  glsl_type::samplerCube_type, glsl_type::vec3_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isamplerCube_type, glsl_type::vec3_type),
                 _texture(ir_txl, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usamplerCube_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture2DRect",
+   ADD_FUNCTION("texture2DRect",
                 _texture(ir_tex, texture_rectangle, glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec2_type),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::ivec4_type,  glsl_type::isampler2DRect_type, glsl_type::vec2_type),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::uvec4_type,  glsl_type::usampler2DRect_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DRectProj",
+   ADD_FUNCTION("texture2DRectProj",
                 _texture(ir_tex, texture_rectangle, glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_tex, texture_rectangle, glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::ivec4_type,  glsl_type::isampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT),
@@ -3488,148 +3557,148 @@ builtin_builder::create_builtins()
                 _texture(ir_tex, gpu_shader4_rect_integer, glsl_type::uvec4_type,  glsl_type::usampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow1D",
+   ADD_FUNCTION("shadow1D",
                 _texture(ir_tex, v110,                  glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec3_type),
                 _texture(ir_txb, v110_derivatives_only, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DArray",
+   ADD_FUNCTION("shadow1DArray",
                 _texture(ir_tex, texture_array,    glsl_type::vec4_type,  glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type),
                 _texture(ir_txb, texture_array_derivs_only, glsl_type::vec4_type,  glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2D",
+   ADD_FUNCTION("shadow2D",
                 _texture(ir_tex, v110,                  glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec3_type),
                 _texture(ir_txb, v110_derivatives_only, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DArray",
+   ADD_FUNCTION("shadow2DArray",
                 _texture(ir_tex, texture_array,    glsl_type::vec4_type,  glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type),
                 _texture(ir_txb, texture_array_derivs_only, glsl_type::vec4_type,  glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type),
                 NULL);
 
-   add_function("shadow1DProj",
+   ADD_FUNCTION("shadow1DProj",
                 _texture(ir_tex, v110,                  glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txb, v110_derivatives_only, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DArray",
+   ADD_FUNCTION("shadow2DArray",
                 _texture(ir_tex, texture_array,    glsl_type::vec4_type,  glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type),
                 _texture(ir_txb, texture_array_derivs_only, glsl_type::vec4_type,  glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type),
                 NULL);
 
-   add_function("shadowCube",
+   ADD_FUNCTION("shadowCube",
                 _texture(ir_tex, gpu_shader4,             glsl_type::vec4_type, glsl_type::samplerCubeShadow_type, glsl_type::vec4_type),
                 _texture(ir_txb, gpu_shader4_derivs_only, glsl_type::vec4_type, glsl_type::samplerCubeShadow_type, glsl_type::vec4_type),
                 NULL);
 
-   add_function("shadow2DProj",
+   ADD_FUNCTION("shadow2DProj",
                 _texture(ir_tex, v110,                  glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txb, v110_derivatives_only, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow1DLod",
+   ADD_FUNCTION("shadow1DLod",
                 _texture(ir_txl, v110_lod, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DLod",
+   ADD_FUNCTION("shadow2DLod",
                 _texture(ir_txl, v110_lod, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DArrayLod",
+   ADD_FUNCTION("shadow1DArrayLod",
                 _texture(ir_txl, texture_array_lod, glsl_type::vec4_type, glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DProjLod",
+   ADD_FUNCTION("shadow1DProjLod",
                 _texture(ir_txl, v110_lod, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DProjLod",
+   ADD_FUNCTION("shadow2DProjLod",
                 _texture(ir_txl, v110_lod, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DRect",
+   ADD_FUNCTION("shadow2DRect",
                 _texture(ir_tex, texture_rectangle, glsl_type::vec4_type,  glsl_type::sampler2DRectShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DRectProj",
+   ADD_FUNCTION("shadow2DRectProj",
                 _texture(ir_tex, texture_rectangle, glsl_type::vec4_type,  glsl_type::sampler2DRectShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture1DGradARB",
+   ADD_FUNCTION("texture1DGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::float_type),
                 NULL);
 
-   add_function("texture1DProjGradARB",
+   ADD_FUNCTION("texture1DProjGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture2DGradARB",
+   ADD_FUNCTION("texture2DGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DProjGradARB",
+   ADD_FUNCTION("texture2DProjGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture3DGradARB",
+   ADD_FUNCTION("texture3DGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture3DProjGradARB",
+   ADD_FUNCTION("texture3DProjGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("textureCubeGradARB",
+   ADD_FUNCTION("textureCubeGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::samplerCube_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DGradARB",
+   ADD_FUNCTION("shadow1DGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DProjGradARB",
+   ADD_FUNCTION("shadow1DProjGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DGradARB",
+   ADD_FUNCTION("shadow2DGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DProjGradARB",
+   ADD_FUNCTION("shadow2DProjGradARB",
                 _texture(ir_txd, shader_texture_lod, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture2DRectGradARB",
+   ADD_FUNCTION("texture2DRectGradARB",
                 _texture(ir_txd, shader_texture_lod_and_rect, glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DRectProjGradARB",
+   ADD_FUNCTION("texture2DRectProjGradARB",
                 _texture(ir_txd, shader_texture_lod_and_rect, glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_txd, shader_texture_lod_and_rect, glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DRectGradARB",
+   ADD_FUNCTION("shadow2DRectGradARB",
                 _texture(ir_txd, shader_texture_lod_and_rect, glsl_type::vec4_type,  glsl_type::sampler2DRectShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DRectProjGradARB",
+   ADD_FUNCTION("shadow2DRectProjGradARB",
                 _texture(ir_txd, shader_texture_lod_and_rect, glsl_type::vec4_type,  glsl_type::sampler2DRectShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture4",
+   ADD_FUNCTION("texture4",
                 _texture(ir_tg4, texture_texture4, glsl_type::vec4_type, glsl_type::sampler2D_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture1DGrad",
+   ADD_FUNCTION("texture1DGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::float_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler1D_type, glsl_type::float_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler1D_type, glsl_type::float_type),
                 NULL);
 
-   add_function("texture1DProjGrad",
+   ADD_FUNCTION("texture1DProjGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler1D_type, glsl_type::vec2_type, TEX_PROJECT),
@@ -3638,19 +3707,19 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler1D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture1DArrayGrad",
+   ADD_FUNCTION("texture1DArrayGrad",
                 _texture(ir_txd, gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler1DArray_type, glsl_type::vec2_type),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::ivec4_type,  glsl_type::isampler1DArray_type, glsl_type::vec2_type),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::uvec4_type,  glsl_type::usampler1DArray_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DGrad",
+   ADD_FUNCTION("texture2DGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec2_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler2D_type, glsl_type::vec2_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler2D_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DProjGrad",
+   ADD_FUNCTION("texture2DProjGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler2D_type, glsl_type::vec3_type, TEX_PROJECT),
@@ -3659,61 +3728,61 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler2D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("texture2DArrayGrad",
+   ADD_FUNCTION("texture2DArrayGrad",
                 _texture(ir_txd, gpu_shader4_array,         glsl_type::vec4_type,  glsl_type::sampler2DArray_type, glsl_type::vec3_type),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::ivec4_type,  glsl_type::isampler2DArray_type, glsl_type::vec3_type),
                 _texture(ir_txd, gpu_shader4_array_integer, glsl_type::uvec4_type,  glsl_type::usampler2DArray_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture3DGrad",
+   ADD_FUNCTION("texture3DGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec3_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler3D_type, glsl_type::vec3_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler3D_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("texture3DProjGrad",
+   ADD_FUNCTION("texture3DProjGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usampler3D_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("textureCubeGrad",
+   ADD_FUNCTION("textureCubeGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::samplerCube_type, glsl_type::vec3_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::ivec4_type,  glsl_type::isamplerCube_type, glsl_type::vec3_type),
                 _texture(ir_txd, gpu_shader4_integer, glsl_type::uvec4_type,  glsl_type::usamplerCube_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DGrad",
+   ADD_FUNCTION("shadow1DGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow1DProjGrad",
+   ADD_FUNCTION("shadow1DProjGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler1DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow1DArrayGrad",
+   ADD_FUNCTION("shadow1DArrayGrad",
                 _texture(ir_txd, gpu_shader4_array, glsl_type::vec4_type,  glsl_type::sampler1DArrayShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DGrad",
+   ADD_FUNCTION("shadow2DGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DProjGrad",
+   ADD_FUNCTION("shadow2DProjGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::sampler2DShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DArrayGrad",
+   ADD_FUNCTION("shadow2DArrayGrad",
                 _texture(ir_txd, gpu_shader4_array, glsl_type::vec4_type,  glsl_type::sampler2DArrayShadow_type, glsl_type::vec4_type),
                 NULL);
 
-   add_function("texture2DRectGrad",
+   ADD_FUNCTION("texture2DRectGrad",
                 _texture(ir_txd, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec2_type),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::ivec4_type,  glsl_type::isampler2DRect_type, glsl_type::vec2_type),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::uvec4_type,  glsl_type::usampler2DRect_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("texture2DRectProjGrad",
+   ADD_FUNCTION("texture2DRectProjGrad",
                 _texture(ir_txd, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4_rect,         glsl_type::vec4_type,  glsl_type::sampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT),
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::ivec4_type,  glsl_type::isampler2DRect_type, glsl_type::vec3_type, TEX_PROJECT),
@@ -3722,19 +3791,19 @@ builtin_builder::create_builtins()
                 _texture(ir_txd, gpu_shader4_rect_integer, glsl_type::uvec4_type,  glsl_type::usampler2DRect_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadow2DRectGrad",
+   ADD_FUNCTION("shadow2DRectGrad",
                 _texture(ir_txd, gpu_shader4_rect, glsl_type::vec4_type,  glsl_type::sampler2DRectShadow_type, glsl_type::vec3_type),
                 NULL);
 
-   add_function("shadow2DRectProjGrad",
+   ADD_FUNCTION("shadow2DRectProjGrad",
                 _texture(ir_txd, gpu_shader4_rect, glsl_type::vec4_type,  glsl_type::sampler2DRectShadow_type, glsl_type::vec4_type, TEX_PROJECT),
                 NULL);
 
-   add_function("shadowCubeGrad",
+   ADD_FUNCTION("shadowCubeGrad",
                 _texture(ir_txd, gpu_shader4, glsl_type::vec4_type,  glsl_type::samplerCubeShadow_type, glsl_type::vec4_type),
                 NULL);
 
-   add_function("textureGather",
+   ADD_FUNCTION("textureGather",
                 _texture(ir_tg4, texture_gather_or_es31, glsl_type::vec4_type, glsl_type::sampler2D_type, glsl_type::vec2_type),
                 _texture(ir_tg4, texture_gather_or_es31, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec2_type),
                 _texture(ir_tg4, texture_gather_or_es31, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type),
@@ -3782,7 +3851,7 @@ builtin_builder::create_builtins()
                 _texture(ir_tg4, gpu_shader5, glsl_type::vec4_type, glsl_type::sampler2DRectShadow_type, glsl_type::vec2_type),
                 NULL);
 
-   add_function("textureGatherOffset",
+   ADD_FUNCTION("textureGatherOffset",
                 _texture(ir_tg4, texture_gather_only_or_es31, glsl_type::vec4_type, glsl_type::sampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tg4, texture_gather_only_or_es31, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
                 _texture(ir_tg4, texture_gather_only_or_es31, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type, TEX_OFFSET),
@@ -3831,7 +3900,7 @@ builtin_builder::create_builtins()
                 _texture(ir_tg4, es31_not_gs5, glsl_type::vec4_type, glsl_type::sampler2DArrayShadow_type, glsl_type::vec3_type, TEX_OFFSET),
                 NULL);
 
-   add_function("textureGatherOffsets",
+   ADD_FUNCTION("textureGatherOffsets",
                 _texture(ir_tg4, gpu_shader5_es, glsl_type::vec4_type, glsl_type::sampler2D_type, glsl_type::vec2_type, TEX_OFFSET_ARRAY),
                 _texture(ir_tg4, gpu_shader5_es, glsl_type::ivec4_type, glsl_type::isampler2D_type, glsl_type::vec2_type, TEX_OFFSET_ARRAY),
                 _texture(ir_tg4, gpu_shader5_es, glsl_type::uvec4_type, glsl_type::usampler2D_type, glsl_type::vec2_type, TEX_OFFSET_ARRAY),
@@ -3883,7 +3952,7 @@ builtin_builder::create_builtins()
    IU(findMSB)
    FDGS5(fma)
 
-   add_function("ldexp",
+   ADD_FUNCTION("ldexp",
                 _ldexp(glsl_type::float_type, glsl_type::int_type),
                 _ldexp(glsl_type::vec2_type,  glsl_type::ivec2_type),
                 _ldexp(glsl_type::vec3_type,  glsl_type::ivec3_type),
@@ -3894,7 +3963,7 @@ builtin_builder::create_builtins()
                 _ldexp(glsl_type::dvec4_type,  glsl_type::ivec4_type),
                 NULL);
 
-   add_function("frexp",
+   ADD_FUNCTION("frexp",
                 _frexp(glsl_type::float_type, glsl_type::int_type),
                 _frexp(glsl_type::vec2_type,  glsl_type::ivec2_type),
                 _frexp(glsl_type::vec3_type,  glsl_type::ivec3_type),
@@ -3904,137 +3973,137 @@ builtin_builder::create_builtins()
                 _dfrexp(glsl_type::dvec3_type,  glsl_type::ivec3_type),
                 _dfrexp(glsl_type::dvec4_type,  glsl_type::ivec4_type),
                 NULL);
-   add_function("uaddCarry",
+   ADD_FUNCTION("uaddCarry",
                 _uaddCarry(glsl_type::uint_type),
                 _uaddCarry(glsl_type::uvec2_type),
                 _uaddCarry(glsl_type::uvec3_type),
                 _uaddCarry(glsl_type::uvec4_type),
                 NULL);
-   add_function("usubBorrow",
+   ADD_FUNCTION("usubBorrow",
                 _usubBorrow(glsl_type::uint_type),
                 _usubBorrow(glsl_type::uvec2_type),
                 _usubBorrow(glsl_type::uvec3_type),
                 _usubBorrow(glsl_type::uvec4_type),
                 NULL);
-   add_function("imulExtended",
+   ADD_FUNCTION("imulExtended",
                 _mulExtended(glsl_type::int_type),
                 _mulExtended(glsl_type::ivec2_type),
                 _mulExtended(glsl_type::ivec3_type),
                 _mulExtended(glsl_type::ivec4_type),
                 NULL);
-   add_function("umulExtended",
+   ADD_FUNCTION("umulExtended",
                 _mulExtended(glsl_type::uint_type),
                 _mulExtended(glsl_type::uvec2_type),
                 _mulExtended(glsl_type::uvec3_type),
                 _mulExtended(glsl_type::uvec4_type),
                 NULL);
-   add_function("interpolateAtCentroid",
+   ADD_FUNCTION("interpolateAtCentroid",
                 _interpolateAtCentroid(glsl_type::float_type),
                 _interpolateAtCentroid(glsl_type::vec2_type),
                 _interpolateAtCentroid(glsl_type::vec3_type),
                 _interpolateAtCentroid(glsl_type::vec4_type),
                 NULL);
-   add_function("interpolateAtOffset",
+   ADD_FUNCTION("interpolateAtOffset",
                 _interpolateAtOffset(glsl_type::float_type),
                 _interpolateAtOffset(glsl_type::vec2_type),
                 _interpolateAtOffset(glsl_type::vec3_type),
                 _interpolateAtOffset(glsl_type::vec4_type),
                 NULL);
-   add_function("interpolateAtSample",
+   ADD_FUNCTION("interpolateAtSample",
                 _interpolateAtSample(glsl_type::float_type),
                 _interpolateAtSample(glsl_type::vec2_type),
                 _interpolateAtSample(glsl_type::vec3_type),
                 _interpolateAtSample(glsl_type::vec4_type),
                 NULL);
 
-   add_function("atomicCounter",
+   ADD_FUNCTION("atomicCounter",
                 _atomic_counter_op("__intrinsic_atomic_read",
                                    shader_atomic_counters),
                 NULL);
-   add_function("atomicCounterIncrement",
+   ADD_FUNCTION("atomicCounterIncrement",
                 _atomic_counter_op("__intrinsic_atomic_increment",
                                    shader_atomic_counters),
                 NULL);
-   add_function("atomicCounterDecrement",
+   ADD_FUNCTION("atomicCounterDecrement",
                 _atomic_counter_op("__intrinsic_atomic_predecrement",
                                    shader_atomic_counters),
                 NULL);
 
-   add_function("atomicCounterAddARB",
+   ADD_FUNCTION("atomicCounterAddARB",
                 _atomic_counter_op1("__intrinsic_atomic_add",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterSubtractARB",
+   ADD_FUNCTION("atomicCounterSubtractARB",
                 _atomic_counter_op1("__intrinsic_atomic_sub",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterMinARB",
+   ADD_FUNCTION("atomicCounterMinARB",
                 _atomic_counter_op1("__intrinsic_atomic_min",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterMaxARB",
+   ADD_FUNCTION("atomicCounterMaxARB",
                 _atomic_counter_op1("__intrinsic_atomic_max",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterAndARB",
+   ADD_FUNCTION("atomicCounterAndARB",
                 _atomic_counter_op1("__intrinsic_atomic_and",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterOrARB",
+   ADD_FUNCTION("atomicCounterOrARB",
                 _atomic_counter_op1("__intrinsic_atomic_or",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterXorARB",
+   ADD_FUNCTION("atomicCounterXorARB",
                 _atomic_counter_op1("__intrinsic_atomic_xor",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterExchangeARB",
+   ADD_FUNCTION("atomicCounterExchangeARB",
                 _atomic_counter_op1("__intrinsic_atomic_exchange",
                                     shader_atomic_counter_ops),
                 NULL);
-   add_function("atomicCounterCompSwapARB",
+   ADD_FUNCTION("atomicCounterCompSwapARB",
                 _atomic_counter_op2("__intrinsic_atomic_comp_swap",
                                     shader_atomic_counter_ops),
                 NULL);
 
-   add_function("atomicCounterAdd",
+   ADD_FUNCTION("atomicCounterAdd",
                 _atomic_counter_op1("__intrinsic_atomic_add",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterSubtract",
+   ADD_FUNCTION("atomicCounterSubtract",
                 _atomic_counter_op1("__intrinsic_atomic_sub",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterMin",
+   ADD_FUNCTION("atomicCounterMin",
                 _atomic_counter_op1("__intrinsic_atomic_min",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterMax",
+   ADD_FUNCTION("atomicCounterMax",
                 _atomic_counter_op1("__intrinsic_atomic_max",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterAnd",
+   ADD_FUNCTION("atomicCounterAnd",
                 _atomic_counter_op1("__intrinsic_atomic_and",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterOr",
+   ADD_FUNCTION("atomicCounterOr",
                 _atomic_counter_op1("__intrinsic_atomic_or",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterXor",
+   ADD_FUNCTION("atomicCounterXor",
                 _atomic_counter_op1("__intrinsic_atomic_xor",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterExchange",
+   ADD_FUNCTION("atomicCounterExchange",
                 _atomic_counter_op1("__intrinsic_atomic_exchange",
                                     v460_desktop),
                 NULL);
-   add_function("atomicCounterCompSwap",
+   ADD_FUNCTION("atomicCounterCompSwap",
                 _atomic_counter_op2("__intrinsic_atomic_comp_swap",
                                     v460_desktop),
                 NULL);
 
-   add_function("atomicAdd",
+   ADD_FUNCTION("atomicAdd",
                 _atomic_op2("__intrinsic_atomic_add",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4045,7 +4114,7 @@ builtin_builder::create_builtins()
                             shader_atomic_float_add,
                             glsl_type::float_type),
                 NULL);
-   add_function("atomicMin",
+   ADD_FUNCTION("atomicMin",
                 _atomic_op2("__intrinsic_atomic_min",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4056,7 +4125,7 @@ builtin_builder::create_builtins()
                             shader_atomic_float_minmax,
                             glsl_type::float_type),
                 NULL);
-   add_function("atomicMax",
+   ADD_FUNCTION("atomicMax",
                 _atomic_op2("__intrinsic_atomic_max",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4067,7 +4136,7 @@ builtin_builder::create_builtins()
                             shader_atomic_float_minmax,
                             glsl_type::float_type),
                 NULL);
-   add_function("atomicAnd",
+   ADD_FUNCTION("atomicAnd",
                 _atomic_op2("__intrinsic_atomic_and",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4075,7 +4144,7 @@ builtin_builder::create_builtins()
                             buffer_atomics_supported,
                             glsl_type::int_type),
                 NULL);
-   add_function("atomicOr",
+   ADD_FUNCTION("atomicOr",
                 _atomic_op2("__intrinsic_atomic_or",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4083,7 +4152,7 @@ builtin_builder::create_builtins()
                             buffer_atomics_supported,
                             glsl_type::int_type),
                 NULL);
-   add_function("atomicXor",
+   ADD_FUNCTION("atomicXor",
                 _atomic_op2("__intrinsic_atomic_xor",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4091,7 +4160,7 @@ builtin_builder::create_builtins()
                             buffer_atomics_supported,
                             glsl_type::int_type),
                 NULL);
-   add_function("atomicExchange",
+   ADD_FUNCTION("atomicExchange",
                 _atomic_op2("__intrinsic_atomic_exchange",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4102,7 +4171,7 @@ builtin_builder::create_builtins()
                             shader_atomic_float_exchange,
                             glsl_type::float_type),
                 NULL);
-   add_function("atomicCompSwap",
+   ADD_FUNCTION("atomicCompSwap",
                 _atomic_op3("__intrinsic_atomic_comp_swap",
                             buffer_atomics_supported,
                             glsl_type::uint_type),
@@ -4114,7 +4183,7 @@ builtin_builder::create_builtins()
                             glsl_type::float_type),
                 NULL);
 
-   add_function("min3",
+   ADD_FUNCTION("min3",
                 _min3(glsl_type::float_type),
                 _min3(glsl_type::vec2_type),
                 _min3(glsl_type::vec3_type),
@@ -4131,7 +4200,7 @@ builtin_builder::create_builtins()
                 _min3(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("max3",
+   ADD_FUNCTION("max3",
                 _max3(glsl_type::float_type),
                 _max3(glsl_type::vec2_type),
                 _max3(glsl_type::vec3_type),
@@ -4148,7 +4217,7 @@ builtin_builder::create_builtins()
                 _max3(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("mid3",
+   ADD_FUNCTION("mid3",
                 _mid3(glsl_type::float_type),
                 _mid3(glsl_type::vec2_type),
                 _mid3(glsl_type::vec3_type),
@@ -4167,34 +4236,34 @@ builtin_builder::create_builtins()
 
    add_image_functions(true);
 
-   add_function("memoryBarrier",
+   ADD_FUNCTION("memoryBarrier",
                 _memory_barrier("__intrinsic_memory_barrier",
                                 shader_image_load_store),
                 NULL);
-   add_function("groupMemoryBarrier",
+   ADD_FUNCTION("groupMemoryBarrier",
                 _memory_barrier("__intrinsic_group_memory_barrier",
                                 compute_shader),
                 NULL);
-   add_function("memoryBarrierAtomicCounter",
+   ADD_FUNCTION("memoryBarrierAtomicCounter",
                 _memory_barrier("__intrinsic_memory_barrier_atomic_counter",
                                 compute_shader_supported),
                 NULL);
-   add_function("memoryBarrierBuffer",
+   ADD_FUNCTION("memoryBarrierBuffer",
                 _memory_barrier("__intrinsic_memory_barrier_buffer",
                                 compute_shader_supported),
                 NULL);
-   add_function("memoryBarrierImage",
+   ADD_FUNCTION("memoryBarrierImage",
                 _memory_barrier("__intrinsic_memory_barrier_image",
                                 compute_shader_supported),
                 NULL);
-   add_function("memoryBarrierShared",
+   ADD_FUNCTION("memoryBarrierShared",
                 _memory_barrier("__intrinsic_memory_barrier_shared",
                                 compute_shader),
                 NULL);
 
-   add_function("ballotARB", _ballot(), NULL);
+   ADD_FUNCTION("ballotARB", _ballot(), NULL);
 
-   add_function("readInvocationARB",
+   ADD_FUNCTION("readInvocationARB",
                 _read_invocation(glsl_type::float_type),
                 _read_invocation(glsl_type::vec2_type),
                 _read_invocation(glsl_type::vec3_type),
@@ -4211,7 +4280,7 @@ builtin_builder::create_builtins()
                 _read_invocation(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("readFirstInvocationARB",
+   ADD_FUNCTION("readFirstInvocationARB",
                 _read_first_invocation(glsl_type::float_type),
                 _read_first_invocation(glsl_type::vec2_type),
                 _read_first_invocation(glsl_type::vec3_type),
@@ -4228,91 +4297,91 @@ builtin_builder::create_builtins()
                 _read_first_invocation(glsl_type::uvec4_type),
                 NULL);
 
-   add_function("clock2x32ARB",
+   ADD_FUNCTION("clock2x32ARB",
                 _shader_clock(shader_clock,
                               glsl_type::uvec2_type),
                 NULL);
 
-   add_function("clockARB",
+   ADD_FUNCTION("clockARB",
                 _shader_clock(shader_clock_int64,
                               glsl_type::uint64_t_type),
                 NULL);
 
-   add_function("beginInvocationInterlockARB",
+   ADD_FUNCTION("beginInvocationInterlockARB",
                 _invocation_interlock(
                    "__intrinsic_begin_invocation_interlock",
                    supports_arb_fragment_shader_interlock),
                 NULL);
 
-   add_function("endInvocationInterlockARB",
+   ADD_FUNCTION("endInvocationInterlockARB",
                 _invocation_interlock(
                    "__intrinsic_end_invocation_interlock",
                    supports_arb_fragment_shader_interlock),
                 NULL);
 
-   add_function("beginInvocationInterlockNV",
+   ADD_FUNCTION("beginInvocationInterlockNV",
                 _invocation_interlock(
                    "__intrinsic_begin_invocation_interlock",
                    supports_nv_fragment_shader_interlock),
                 NULL);
 
-   add_function("endInvocationInterlockNV",
+   ADD_FUNCTION("endInvocationInterlockNV",
                 _invocation_interlock(
                    "__intrinsic_end_invocation_interlock",
                    supports_nv_fragment_shader_interlock),
                 NULL);
 
-   add_function("anyInvocationARB",
+   ADD_FUNCTION("anyInvocationARB",
                 _vote("__intrinsic_vote_any", vote),
                 NULL);
 
-   add_function("allInvocationsARB",
+   ADD_FUNCTION("allInvocationsARB",
                 _vote("__intrinsic_vote_all", vote),
                 NULL);
 
-   add_function("allInvocationsEqualARB",
+   ADD_FUNCTION("allInvocationsEqualARB",
                 _vote("__intrinsic_vote_eq", vote),
                 NULL);
 
-   add_function("anyInvocation",
+   ADD_FUNCTION("anyInvocation",
                 _vote("__intrinsic_vote_any", v460_desktop),
                 NULL);
 
-   add_function("allInvocations",
+   ADD_FUNCTION("allInvocations",
                 _vote("__intrinsic_vote_all", v460_desktop),
                 NULL);
 
-   add_function("allInvocationsEqual",
+   ADD_FUNCTION("allInvocationsEqual",
                 _vote("__intrinsic_vote_eq", v460_desktop),
                 NULL);
 
-   add_function("helperInvocationEXT", _helper_invocation(), NULL);
+   ADD_FUNCTION("helperInvocationEXT", _helper_invocation(), NULL);
 
-   add_function("__builtin_idiv64",
+   ADD_FUNCTION("__builtin_idiv64",
                 generate_ir::idiv64(mem_ctx, integer_functions_supported),
                 NULL);
 
-   add_function("__builtin_imod64",
+   ADD_FUNCTION("__builtin_imod64",
                 generate_ir::imod64(mem_ctx, integer_functions_supported),
                 NULL);
 
-   add_function("__builtin_sign64",
+   ADD_FUNCTION("__builtin_sign64",
                 generate_ir::sign64(mem_ctx, integer_functions_supported),
                 NULL);
 
-   add_function("__builtin_udiv64",
+   ADD_FUNCTION("__builtin_udiv64",
                 generate_ir::udiv64(mem_ctx, integer_functions_supported),
                 NULL);
 
-   add_function("__builtin_umod64",
+   ADD_FUNCTION("__builtin_umod64",
                 generate_ir::umod64(mem_ctx, integer_functions_supported),
                 NULL);
 
-   add_function("__builtin_umul64",
+   ADD_FUNCTION("__builtin_umul64",
                 generate_ir::umul64(mem_ctx, integer_functions_supported),
                 NULL);
 
-   add_function("countLeadingZeros",
+   ADD_FUNCTION("countLeadingZeros",
                 _countLeadingZeros(shader_integer_functions2,
                                    glsl_type::uint_type),
                 _countLeadingZeros(shader_integer_functions2,
@@ -4323,7 +4392,7 @@ builtin_builder::create_builtins()
                                    glsl_type::uvec4_type),
                 NULL);
 
-   add_function("countTrailingZeros",
+   ADD_FUNCTION("countTrailingZeros",
                 _countTrailingZeros(shader_integer_functions2,
                                     glsl_type::uint_type),
                 _countTrailingZeros(shader_integer_functions2,
@@ -4334,7 +4403,7 @@ builtin_builder::create_builtins()
                                     glsl_type::uvec4_type),
                 NULL);
 
-   add_function("absoluteDifference",
+   ADD_FUNCTION("absoluteDifference",
                 _absoluteDifference(shader_integer_functions2,
                                     glsl_type::int_type),
                 _absoluteDifference(shader_integer_functions2,
@@ -4370,7 +4439,7 @@ builtin_builder::create_builtins()
                                     glsl_type::u64vec4_type),
                 NULL);
 
-   add_function("addSaturate",
+   ADD_FUNCTION("addSaturate",
                 _addSaturate(shader_integer_functions2,
                              glsl_type::int_type),
                 _addSaturate(shader_integer_functions2,
@@ -4406,7 +4475,7 @@ builtin_builder::create_builtins()
                              glsl_type::u64vec4_type),
                 NULL);
 
-   add_function("average",
+   ADD_FUNCTION("average",
                 _average(shader_integer_functions2,
                          glsl_type::int_type),
                 _average(shader_integer_functions2,
@@ -4442,7 +4511,7 @@ builtin_builder::create_builtins()
                          glsl_type::u64vec4_type),
                 NULL);
 
-   add_function("averageRounded",
+   ADD_FUNCTION("averageRounded",
                 _averageRounded(shader_integer_functions2,
                                 glsl_type::int_type),
                 _averageRounded(shader_integer_functions2,
@@ -4478,7 +4547,7 @@ builtin_builder::create_builtins()
                                 glsl_type::u64vec4_type),
                 NULL);
 
-   add_function("subtractSaturate",
+   ADD_FUNCTION("subtractSaturate",
                 _subtractSaturate(shader_integer_functions2,
                                   glsl_type::int_type),
                 _subtractSaturate(shader_integer_functions2,
@@ -4514,7 +4583,7 @@ builtin_builder::create_builtins()
                                   glsl_type::u64vec4_type),
                 NULL);
 
-   add_function("multiply32x16",
+   ADD_FUNCTION("multiply32x16",
                 _multiply32x16(shader_integer_functions2,
                                glsl_type::int_type),
                 _multiply32x16(shader_integer_functions2,
@@ -4610,6 +4679,9 @@ builtin_builder::add_image_function(const char *name,
       glsl_type::uimage2DMSArray_type
    };
 
+   if (!generating(name))
+      return;
+
    ir_function *f = new(mem_ctx) ir_function(name);
 
    for (unsigned i = 0; i < ARRAY_SIZE(types); ++i) {
@@ -7163,7 +7235,7 @@ builtin_builder::_atomic_counter_op(const char *intrinsic,
    MAKE_SIG(glsl_type::uint_type, avail, 1, counter);
 
    ir_variable *retval = body.make_temp(glsl_type::uint_type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7194,7 +7266,7 @@ builtin_builder::_atomic_counter_op1(const char *intrinsic,
       parameters.push_tail(new(mem_ctx) ir_dereference_variable(neg_data));
 
       ir_function *const func =
-         shader->symbols->get_function("__intrinsic_atomic_add");
+         get_function("__intrinsic_atomic_add");
       ir_instruction *const c = call(func, retval, parameters);
 
       assert(c != NULL);
@@ -7202,7 +7274,7 @@ builtin_builder::_atomic_counter_op1(const char *intrinsic,
 
       body.emit(c);
    } else {
-      body.emit(call(shader->symbols->get_function(intrinsic), retval,
+      body.emit(call(get_function(intrinsic), retval,
                      sig->parameters));
    }
 
@@ -7220,7 +7292,7 @@ builtin_builder::_atomic_counter_op2(const char *intrinsic,
    MAKE_SIG(glsl_type::uint_type, avail, 3, counter, compare, data);
 
    ir_variable *retval = body.make_temp(glsl_type::uint_type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7236,7 +7308,7 @@ builtin_builder::_atomic_op2(const char *intrinsic,
    MAKE_SIG(type, avail, 2, atomic, data);
 
    ir_variable *retval = body.make_temp(type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7253,7 +7325,7 @@ builtin_builder::_atomic_op3(const char *intrinsic,
    MAKE_SIG(type, avail, 3, atomic, data1, data2);
 
    ir_variable *retval = body.make_temp(type, "atomic_retval");
-   body.emit(call(shader->symbols->get_function(intrinsic), retval,
+   body.emit(call(get_function(intrinsic), retval,
                   sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7450,7 +7522,7 @@ builtin_builder::_image(image_prototype_ctr prototype,
 
    if (flags & IMAGE_FUNCTION_EMIT_STUB) {
       ir_factory body(&sig->body, mem_ctx);
-      ir_function *f = shader->symbols->get_function(intrinsic_name);
+      ir_function *f = get_function(intrinsic_name);
 
       if (flags & IMAGE_FUNCTION_RETURNS_VOID) {
          body.emit(call(f, NULL, sig->parameters));
@@ -7483,7 +7555,7 @@ builtin_builder::_memory_barrier(const char *intrinsic_name,
                                  builtin_available_predicate avail)
 {
    MAKE_SIG(glsl_type::void_type, avail, 0);
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   NULL, sig->parameters));
    return sig;
 }
@@ -7505,7 +7577,7 @@ builtin_builder::_ballot()
    MAKE_SIG(glsl_type::uint64_t_type, shader_ballot, 1, value);
    ir_variable *retval = body.make_temp(glsl_type::uint64_t_type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_ballot"),
+   body.emit(call(get_function("__intrinsic_ballot"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7528,7 +7600,7 @@ builtin_builder::_read_first_invocation(const glsl_type *type)
    MAKE_SIG(type, shader_ballot, 1, value);
    ir_variable *retval = body.make_temp(type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_read_first_invocation"),
+   body.emit(call(get_function("__intrinsic_read_first_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7553,7 +7625,7 @@ builtin_builder::_read_invocation(const glsl_type *type)
    MAKE_SIG(type, shader_ballot, 2, value, invocation);
    ir_variable *retval = body.make_temp(type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_read_invocation"),
+   body.emit(call(get_function("__intrinsic_read_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7572,7 +7644,7 @@ builtin_builder::_invocation_interlock(const char *intrinsic_name,
                                        builtin_available_predicate avail)
 {
    MAKE_SIG(glsl_type::void_type, avail, 0);
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   NULL, sig->parameters));
    return sig;
 }
@@ -7593,7 +7665,7 @@ builtin_builder::_shader_clock(builtin_available_predicate avail,
 
    ir_variable *retval = body.make_temp(glsl_type::uvec2_type, "clock_retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_shader_clock"),
+   body.emit(call(get_function("__intrinsic_shader_clock"),
                   retval, sig->parameters));
 
    if (type == glsl_type::uint64_t_type) {
@@ -7624,7 +7696,7 @@ builtin_builder::_vote(const char *intrinsic_name,
 
    ir_variable *retval = body.make_temp(glsl_type::bool_type, "retval");
 
-   body.emit(call(shader->symbols->get_function(intrinsic_name),
+   body.emit(call(get_function(intrinsic_name),
                   retval, sig->parameters));
    body.emit(ret(retval));
    return sig;
@@ -7645,7 +7717,7 @@ builtin_builder::_helper_invocation()
 
    ir_variable *retval = body.make_temp(glsl_type::bool_type, "retval");
 
-   body.emit(call(shader->symbols->get_function("__intrinsic_helper_invocation"),
+   body.emit(call(get_function("__intrinsic_helper_invocation"),
                   retval, sig->parameters));
    body.emit(ret(retval));
 
@@ -7702,7 +7774,7 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    ir_function *f;
    bool ret = false;
    mtx_lock(&builtins_lock);
-   f = builtins.shader->symbols->get_function(name);
+   f = builtins.get_function(name);
    if (f != NULL) {
       foreach_in_list(ir_function_signature, sig, &f->signatures) {
          if (sig->is_builtin_available(state)) {
@@ -7716,10 +7788,15 @@ _mesa_glsl_has_builtin_function(_mesa_glsl_parse_state *state, const char *name)
    return ret;
 }
 
-gl_shader *
-_mesa_glsl_get_builtin_function_shader()
+ir_function *
+_mesa_glsl_get_builtin_function(const char *name)
 {
-   return builtins.shader;
+   ir_function *f;
+   mtx_lock(&builtins_lock);
+   f = builtins.get_function(name);
+   mtx_unlock(&builtins_lock);
+
+   return f;
 }
 
 
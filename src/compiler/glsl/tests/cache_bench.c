@@ -0,0 +1,210 @@
+/*
+ * Copyright © 2015 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Put/get latency and cold start time of the disk cache, with the file per
+ * entry layout and with the single file database.
+ *
+ * Usage: cache_bench [number of entries] [entry size in bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ftw.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "util/disk_cache.h"
+#include "util/os_time.h"
+
+#ifdef ENABLE_SHADER_CACHE
+
+#define CACHE_BENCH_TMP "./cache-bench-tmp"
+
+static int
+remove_entry(const char *path,
+             const struct stat *sb,
+             int typeflag,
+             struct FTW *ftwbuf)
+{
+   int err = remove(path);
+
+   if (err)
+      fprintf(stderr, "Error removing %s: %s\n", path, strerror(errno));
+
+   return err;
+}
+
+/* Recursively remove a directory, which must begin with ".". */
+static int
+rmrf_local(const char *path)
+{
+   if (path == NULL || *path == '\0' || *path != '.')
+      return -1;
+
+   return nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Fill 'data' with noise that doesn't compress, different for each i. */
+static void
+make_entry(uint8_t *data, size_t size, unsigned i)
+{
+   uint64_t state = 0x9e3779b97f4a7c15ull ^ ((uint64_t) i * 0xbf58476d1ce4e5b9ull);
+
+   for (size_t j = 0; j < size; j++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      data[j] = state;
+   }
+}
+
+static double
+usec_since(int64_t start)
+{
+   return (os_time_get_nano() - start) / 1000.0;
+}
+
+static bool
+bench(const char *layout, unsigned num_entries, size_t entry_size)
+{
+   struct disk_cache *cache;
+   uint8_t *data = malloc(entry_size);
+   cache_key *keys = malloc(num_entries * sizeof(*keys));
+   unsigned misses = 0;
+   int64_t start;
+   double put_us, get_us, miss_us, create_us, first_get_us;
+
+   if (data == NULL || keys == NULL) {
+      free(data);
+      free(keys);
+      return false;
+   }
+
+   rmrf_local(CACHE_BENCH_TMP);
+
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   if (cache == NULL) {
+      fprintf(stderr, "%s: can't create the cache\n", layout);
+      free(data);
+      free(keys);
+      return false;
+   }
+
+   /* Puts are handed off to the cache thread, count until they are all on
+    * disk, which disk_cache_destroy() waits for.
+    */
+   for (unsigned i = 0; i < num_entries; i++) {
+      make_entry(data, entry_size, i);
+      disk_cache_compute_key(cache, data, entry_size, keys[i]);
+   }
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++) {
+      make_entry(data, entry_size, i);
+      disk_cache_put(cache, keys[i], data, entry_size, NULL);
+   }
+   disk_cache_destroy(cache);
+   put_us = usec_since(start);
+
+   /* Cold start: opening the populated cache and the first lookup. */
+   start = os_time_get_nano();
+   cache = disk_cache_create("bench", "cache_bench", 0);
+   create_us = usec_since(start);
+
+   start = os_time_get_nano();
+   free(disk_cache_get(cache, keys[num_entries / 2], NULL));
+   first_get_us = usec_since(start);
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++) {
+      size_t size;
+      void *result = disk_cache_get(cache, keys[i], &size);
+
+      if (result == NULL || size != entry_size)
+         misses++;
+      free(result);
+   }
+   get_us = usec_since(start);
+
+   start = os_time_get_nano();
+   for (unsigned i = 0; i < num_entries; i++) {
+      cache_key key;
+
+      memcpy(key, keys[i], sizeof(key));
+      key[0] ^= 0xff;
+      free(disk_cache_get(cache, key, NULL));
+   }
+   miss_us = usec_since(start);
+
+   disk_cache_destroy(cache);
+
+   printf("%s: %u entries of %zu bytes\n", layout, num_entries, entry_size);
+   printf("  put:       %8.1f us/entry\n", put_us / num_entries);
+   printf("  get hit:   %8.1f us/entry (%u not found)\n",
+          get_us / num_entries, misses);
+   printf("  get miss:  %8.1f us/entry\n", miss_us / num_entries);
+   printf("  create:    %8.1f us\n", create_us);
+   printf("  first get: %8.1f us\n", first_get_us);
+
+   free(data);
+   free(keys);
+
+   return misses == 0;
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+int
+main(int argc, char **argv)
+{
+#ifdef ENABLE_SHADER_CACHE
+   unsigned num_entries = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000;
+   size_t entry_size = argc > 2 ? strtoul(argv[2], NULL, 0) : 4096;
+   bool ok = true;
+
+   if (num_entries == 0 || entry_size == 0) {
+      fprintf(stderr, "usage: %s [entries] [entry size]\n", argv[0]);
+      return 1;
+   }
+
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_BENCH_TMP, 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1G", 1);
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "0", 1);
+   unsetenv("MESA_GLSL_CACHE_DISABLE");
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+   ok &= bench("file per entry", num_entries, entry_size);
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   ok &= bench("single file", num_entries, entry_size);
+
+   rmrf_local(CACHE_BENCH_TMP);
+
+   return ok ? 0 : 1;
+#else
+   fprintf(stderr, "built without the shader cache\n");
+   return 1;
+#endif /* ENABLE_SHADER_CACHE */
+}
@@ -37,6 +37,7 @@
 
 #include "util/mesa-sha1.h"
 #include "util/disk_cache.h"
+#include "util/disk_cache_db.h"
 
 bool error = false;
 
@@ -229,6 +230,7 @@ test_disk_cache_create(void)
    cache = disk_cache_create("test", "make_check", 0);
    expect_null(cache_exists(cache), "disk_cache_create with XDG_CACHE_HOME set "
                "with a non-existing parent directory");
+   disk_cache_destroy(cache);
 
    mkdir(CACHE_TEST_TMP, 0755);
    cache = disk_cache_create("test", "make_check", 0);
@@ -248,6 +250,7 @@ test_disk_cache_create(void)
    cache = disk_cache_create("test", "make_check", 0);
    expect_null(cache_exists(cache), "disk_cache_create with MESA_GLSL_CACHE_DIR"
                " set with a non-existing parent directory");
+   disk_cache_destroy(cache);
 
    mkdir(CACHE_TEST_TMP, 0755);
    cache = disk_cache_create("test", "make_check", 0);
@@ -493,6 +496,237 @@ test_put_key_and_get_key(void)
 
    disk_cache_destroy(cache);
 }
+
+static void
+test_single_file_put_and_get(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   uint8_t noise[800];
+   uint8_t noise_key[20];
+   uint64_t state = 0x9e3779b97f4a7c15ull;
+   char *result;
+   size_t size;
+   struct stat sb;
+   int count;
+
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+
+   cache = disk_cache_create("test", "make_check", 0);
+
+   expect_equal(stat(CACHE_TEST_TMP "/mesa-glsl-cache-dir/" CACHE_DIR_NAME
+                     "/" DISK_CACHE_DB_PACK_NAME, &sb), 0,
+                "single file cache creates the pack file");
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_null(result, "single file get of non-existent item (pointer)");
+   expect_equal(size, 0, "single file get of non-existent item (size)");
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+
+   /* disk_cache_put() hands things off to a thread give it some time to
+    * finish.
+    */
+   wait_until_file_written(cache, blob_key);
+   wait_until_file_written(cache, string_key);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "single file get of existing item (pointer)");
+   expect_equal(size, sizeof(blob), "single file get of existing item (size)");
+
+   free(result);
+
+   /* Entries must survive reopening the cache. */
+   disk_cache_destroy(cache);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, string_key, &size);
+   expect_equal_str(string, result, "single file get after reopening (pointer)");
+   expect_equal(size, sizeof(string), "single file get after reopening (size)");
+
+   free(result);
+
+   /* Set the cache size to 1KB and add an item that doesn't compress to
+    * force a compaction, which can only keep the new item.
+    */
+   disk_cache_destroy(cache);
+
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1K", 1);
+   cache = disk_cache_create("test", "make_check", 0);
+
+   for (unsigned i = 0; i < sizeof(noise); i++) {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      noise[i] = state;
+   }
+
+   disk_cache_compute_key(cache, noise, sizeof(noise), noise_key);
+   disk_cache_put(cache, noise_key, noise, sizeof(noise), NULL);
+
+   wait_until_file_written(cache, noise_key);
+
+   count = 0;
+   if (does_cache_contain(cache, blob_key))
+       count++;
+
+   if (does_cache_contain(cache, string_key))
+       count++;
+
+   expect_true(does_cache_contain(cache, noise_key),
+               "single file compaction keeps the new item");
+   expect_equal(count, 0, "single file compaction with MAX_SIZE=1K");
+
+   disk_cache_remove(cache, noise_key);
+   expect_true(!does_cache_contain(cache, noise_key),
+               "single file get of removed item");
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+}
+
+static void
+test_read_only_dbs(void)
+{
+   struct disk_cache *cache;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   char string[] = "While this string has thirty-four";
+   uint8_t string_key[20];
+   char *result;
+   size_t size;
+   struct stat sb_before, sb_after;
+
+   /* Build a database with the single file cache. */
+   setenv("MESA_DISK_CACHE_SINGLE_FILE", "true", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/prebuilt", 1);
+
+   cache = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache, blob, sizeof(blob), blob_key);
+   disk_cache_compute_key(cache, string, sizeof(string), string_key);
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob), NULL);
+   wait_until_file_written(cache, blob_key);
+
+   disk_cache_destroy(cache);
+
+   unsetenv("MESA_DISK_CACHE_SINGLE_FILE");
+
+   expect_equal(stat(CACHE_TEST_TMP "/prebuilt/" CACHE_DIR_NAME "/"
+                     DISK_CACHE_DB_PACK_NAME, &sb_before), 0,
+                "read-only db pack file written");
+
+   /* Then use it from a cache in another directory. */
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/layered", 1);
+   setenv("MESA_DISK_CACHE_READ_ONLY_DBS",
+          CACHE_TEST_TMP "/does-not-exist,"
+          CACHE_TEST_TMP "/prebuilt/" CACHE_DIR_NAME, 1);
+
+   cache = disk_cache_create("test", "make_check", 0);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_equal_str(blob, result, "get from read-only db (pointer)");
+   expect_equal(size, sizeof(blob), "get from read-only db (size)");
+
+   free(result);
+
+   /* New entries go to the writable cache, and removing an entry doesn't
+    * touch the read-only database.
+    */
+   disk_cache_put(cache, string_key, string, sizeof(string), NULL);
+   wait_until_file_written(cache, string_key);
+
+   expect_true(does_cache_contain(cache, string_key),
+               "put with read-only dbs lands in the writable cache");
+
+   disk_cache_remove(cache, blob_key);
+   expect_true(does_cache_contain(cache, blob_key),
+               "remove leaves read-only db entries alone");
+
+   disk_cache_destroy(cache);
+
+   expect_equal(stat(CACHE_TEST_TMP "/prebuilt/" CACHE_DIR_NAME "/"
+                     DISK_CACHE_DB_PACK_NAME, &sb_after), 0,
+                "read-only db pack file kept");
+   expect_equal(sb_after.st_size, sb_before.st_size,
+                "read-only db pack file not written");
+
+   unsetenv("MESA_DISK_CACHE_READ_ONLY_DBS");
+   setenv("MESA_GLSL_CACHE_DIR", CACHE_TEST_TMP "/mesa-glsl-cache-dir", 1);
+}
+
+static void
+test_memory_cache(void)
+{
+   struct disk_cache *cache_a, *cache_b;
+   char blob[] = "This is a blob of thirty-seven bytes";
+   uint8_t blob_key[20];
+   uint8_t item[1000];
+   uint8_t item_key[20];
+   struct disk_cache_stats before, after;
+   char *result;
+   size_t size;
+
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "8K", 1);
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1M", 1);
+
+   cache_a = disk_cache_create("test", "make_check", 0);
+   cache_b = disk_cache_create("test", "make_check", 0);
+
+   disk_cache_compute_key(cache_a, blob, sizeof(blob), blob_key);
+
+   /* An item put through one cache is found in memory by another one,
+    * even before it has been written to disk.
+    */
+   disk_cache_get_stats(&before);
+   disk_cache_put(cache_a, blob_key, blob, sizeof(blob), NULL);
+
+   result = disk_cache_get(cache_b, blob_key, &size);
+   expect_equal_str(blob, result, "memory cache get (pointer)");
+   expect_equal(size, sizeof(blob), "memory cache get (size)");
+   free(result);
+
+   disk_cache_get_stats(&after);
+   expect_equal(after.memory_hits - before.memory_hits, 1,
+                "memory cache hit counted");
+
+   /* The memory cache outlives cache_a, as cache_b still uses it. */
+   disk_cache_destroy(cache_a);
+
+   disk_cache_remove(cache_b, blob_key);
+   expect_true(!does_cache_contain(cache_b, blob_key),
+               "memory cache get of removed item");
+
+   /* Items are evicted to stay within the budget. */
+   for (unsigned i = 0; i < 20; i++) {
+      memset(item, i, sizeof(item));
+      disk_cache_compute_key(cache_b, item, sizeof(item), item_key);
+      disk_cache_put(cache_b, item_key, item, sizeof(item), NULL);
+   }
+
+   disk_cache_get_stats(&after);
+   expect_true(after.memory_size > 0 && after.memory_size <= 8 * 1024,
+               "memory cache stays within MESA_DISK_CACHE_MEMORY_SIZE");
+
+   disk_cache_destroy(cache_b);
+
+   disk_cache_get_stats(&after);
+   expect_equal(after.memory_size, 0,
+                "memory cache freed with the last cache");
+
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "0", 1);
+}
 #endif /* ENABLE_SHADER_CACHE */
 
 int
@@ -501,12 +735,23 @@ main(void)
 #ifdef ENABLE_SHADER_CACHE
    int err;
 
+   /* Most tests check what lands on disk, keep the in-memory cache out of
+    * their way.
+    */
+   setenv("MESA_DISK_CACHE_MEMORY_SIZE", "0", 1);
+
    test_disk_cache_create();
 
    test_put_and_get();
 
    test_put_key_and_get_key();
 
+   test_single_file_put_and_get();
+
+   test_read_only_dbs();
+
+   test_memory_cache();
+
    err = rmrf_local(CACHE_TEST_TMP);
    expect_equal(err, 0, "Removing " CACHE_TEST_TMP " again");
 #endif /* ENABLE_SHADER_CACHE */
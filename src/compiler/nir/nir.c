@@ -44,6 +44,8 @@ nir_shader_create(void *mem_ctx,
 {
    nir_shader *shader = rzalloc(mem_ctx, nir_shader);
 
+   shader->lin_ctx = linear_alloc_parent(shader, 0);
+
    exec_list_make_empty(&shader->uniforms);
    exec_list_make_empty(&shader->inputs);
    exec_list_make_empty(&shader->outputs);
@@ -211,6 +213,10 @@ nir_function_create(nir_shader *shader, const char *name)
 
 /* NOTE: if the instruction you are copying a src to is already added
  * to the IR, use nir_instr_rewrite_src() instead.
+ *
+ * Indirect sources are allocated off of the register they index rather than
+ * the instruction or if, since instructions live in the shader's linear
+ * allocator and cannot be ralloc contexts.
  */
 void nir_src_copy(nir_src *dest, const nir_src *src, void *mem_ctx)
 {
@@ -221,7 +227,7 @@ void nir_src_copy(nir_src *dest, const nir_src *src, void *mem_ctx)
       dest->reg.base_offset = src->reg.base_offset;
       dest->reg.reg = src->reg.reg;
       if (src->reg.indirect) {
-         dest->reg.indirect = ralloc(mem_ctx, nir_src);
+         dest->reg.indirect = ralloc(src->reg.reg, nir_src);
          nir_src_copy(dest->reg.indirect, src->reg.indirect, mem_ctx);
       } else {
          dest->reg.indirect = NULL;
@@ -239,7 +245,7 @@ void nir_dest_copy(nir_dest *dest, const nir_dest *src, nir_instr *instr)
    dest->reg.base_offset = src->reg.base_offset;
    dest->reg.reg = src->reg.reg;
    if (src->reg.indirect) {
-      dest->reg.indirect = ralloc(instr, nir_src);
+      dest->reg.indirect = ralloc(src->reg.reg, nir_src);
       nir_src_copy(dest->reg.indirect, src->reg.indirect, instr);
    } else {
       dest->reg.indirect = NULL;
@@ -394,10 +400,11 @@ nir_loop_create(nir_shader *shader)
 }
 
 static void
-instr_init(nir_instr *instr, nir_instr_type type)
+instr_init(nir_instr *instr, nir_instr_type type, nir_shader *shader)
 {
    instr->type = type;
    instr->block = NULL;
+   instr->lin_ctx = shader->lin_ctx;
    exec_node_init(&instr->node);
 }
 
@@ -431,12 +438,12 @@ nir_alu_instr *
 nir_alu_instr_create(nir_shader *shader, nir_op op)
 {
    unsigned num_srcs = nir_op_infos[op].num_inputs;
-   /* TODO: don't use rzalloc */
+   /* TODO: don't zero the whole instruction */
    nir_alu_instr *instr =
-      rzalloc_size(shader,
-                   sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
+      linear_zalloc_child(shader->lin_ctx,
+                          sizeof(nir_alu_instr) + num_srcs * sizeof(nir_alu_src));
 
-   instr_init(&instr->instr, nir_instr_type_alu);
+   instr_init(&instr->instr, nir_instr_type_alu, shader);
    instr->op = op;
    alu_dest_init(&instr->dest);
    for (unsigned i = 0; i < num_srcs; i++)
@@ -449,9 +456,9 @@ nir_deref_instr *
 nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 {
    nir_deref_instr *instr =
-      rzalloc_size(shader, sizeof(nir_deref_instr));
+      linear_zalloc_child(shader->lin_ctx, sizeof(nir_deref_instr));
 
-   instr_init(&instr->instr, nir_instr_type_deref);
+   instr_init(&instr->instr, nir_instr_type_deref, shader);
 
    instr->deref_type = deref_type;
    if (deref_type != nir_deref_type_var)
@@ -469,8 +476,9 @@ nir_deref_instr_create(nir_shader *shader, nir_deref_type deref_type)
 nir_jump_instr *
 nir_jump_instr_create(nir_shader *shader, nir_jump_type type)
 {
-   nir_jump_instr *instr = ralloc(shader, nir_jump_instr);
-   instr_init(&instr->instr, nir_instr_type_jump);
+   nir_jump_instr *instr =
+      linear_alloc_child(shader->lin_ctx, sizeof(nir_jump_instr));
+   instr_init(&instr->instr, nir_instr_type_jump, shader);
    instr->type = type;
    return instr;
 }
@@ -480,8 +488,9 @@ nir_load_const_instr_create(nir_shader *shader, unsigned num_components,
                             unsigned bit_size)
 {
    nir_load_const_instr *instr =
-      rzalloc_size(shader, sizeof(*instr) + num_components * sizeof(*instr->value));
-   instr_init(&instr->instr, nir_instr_type_load_const);
+      linear_zalloc_child(shader->lin_ctx,
+                          sizeof(*instr) + num_components * sizeof(*instr->value));
+   instr_init(&instr->instr, nir_instr_type_load_const, shader);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
 
@@ -492,12 +501,12 @@ nir_intrinsic_instr *
 nir_intrinsic_instr_create(nir_shader *shader, nir_intrinsic_op op)
 {
    unsigned num_srcs = nir_intrinsic_infos[op].num_srcs;
-   /* TODO: don't use rzalloc */
+   /* TODO: don't zero the whole instruction */
    nir_intrinsic_instr *instr =
-      rzalloc_size(shader,
-                  sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
+      linear_zalloc_child(shader->lin_ctx,
+                          sizeof(nir_intrinsic_instr) + num_srcs * sizeof(nir_src));
 
-   instr_init(&instr->instr, nir_instr_type_intrinsic);
+   instr_init(&instr->instr, nir_instr_type_intrinsic, shader);
    instr->intrinsic = op;
 
    if (nir_intrinsic_infos[op].has_dest)
@@ -514,10 +523,10 @@ nir_call_instr_create(nir_shader *shader, nir_function *callee)
 {
    const unsigned num_params = callee->num_params;
    nir_call_instr *instr =
-      rzalloc_size(shader, sizeof(*instr) +
-                   num_params * sizeof(instr->params[0]));
+      linear_zalloc_child(shader->lin_ctx, sizeof(*instr) +
+                          num_params * sizeof(instr->params[0]));
 
-   instr_init(&instr->instr, nir_instr_type_call);
+   instr_init(&instr->instr, nir_instr_type_call, shader);
    instr->callee = callee;
    instr->num_params = num_params;
    for (unsigned i = 0; i < num_params; i++)
@@ -537,13 +546,15 @@ static int8_t default_tg4_offsets[4][2] =
 nir_tex_instr *
 nir_tex_instr_create(nir_shader *shader, unsigned num_srcs)
 {
-   nir_tex_instr *instr = rzalloc(shader, nir_tex_instr);
-   instr_init(&instr->instr, nir_instr_type_tex);
+   nir_tex_instr *instr =
+      linear_zalloc_child(shader->lin_ctx, sizeof(nir_tex_instr));
+   instr_init(&instr->instr, nir_instr_type_tex, shader);
 
    dest_init(&instr->dest);
 
    instr->num_srcs = num_srcs;
-   instr->src = ralloc_array(instr, nir_tex_src, num_srcs);
+   instr->src = linear_alloc_child(shader->lin_ctx,
+                                   num_srcs * sizeof(nir_tex_src));
    for (unsigned i = 0; i < num_srcs; i++)
       src_init(&instr->src[i].src);
 
@@ -560,8 +571,10 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                       nir_tex_src_type src_type,
                       nir_src src)
 {
-   nir_tex_src *new_srcs = rzalloc_array(tex, nir_tex_src,
-                                         tex->num_srcs + 1);
+   /* The old array is left for nir_sweep() to reclaim. */
+   nir_tex_src *new_srcs =
+      linear_zalloc_child(tex->instr.lin_ctx,
+                          (tex->num_srcs + 1) * sizeof(nir_tex_src));
 
    for (unsigned i = 0; i < tex->num_srcs; i++) {
       new_srcs[i].src_type = tex->src[i].src_type;
@@ -569,7 +582,6 @@ nir_tex_instr_add_src(nir_tex_instr *tex,
                          &tex->src[i].src);
    }
 
-   ralloc_free(tex->src);
    tex->src = new_srcs;
 
    tex->src[tex->num_srcs].src_type = src_type;
@@ -605,19 +617,41 @@ nir_tex_instr_has_explicit_tg4_offsets(nir_tex_instr *tex)
 nir_phi_instr *
 nir_phi_instr_create(nir_shader *shader)
 {
-   nir_phi_instr *instr = ralloc(shader, nir_phi_instr);
-   instr_init(&instr->instr, nir_instr_type_phi);
+   nir_phi_instr *instr =
+      linear_alloc_child(shader->lin_ctx, sizeof(nir_phi_instr));
+   instr_init(&instr->instr, nir_instr_type_phi, shader);
 
    dest_init(&instr->dest);
    exec_list_make_empty(&instr->srcs);
    return instr;
 }
 
+/**
+ * Adds a new source to a phi instruction.
+ *
+ * This does not update the use lists of the source, which is left to
+ * nir_instr_insert() if the phi is not in the IR yet.
+ */
+nir_phi_src *
+nir_phi_instr_add_src(nir_phi_instr *instr, nir_block *pred, nir_src src)
+{
+   nir_phi_src *phi_src =
+      linear_alloc_child(instr->instr.lin_ctx, sizeof(nir_phi_src));
+
+   phi_src->pred = pred;
+   phi_src->src = src;
+   phi_src->src.parent_instr = &instr->instr;
+   exec_list_push_tail(&instr->srcs, &phi_src->node);
+
+   return phi_src;
+}
+
 nir_parallel_copy_instr *
 nir_parallel_copy_instr_create(nir_shader *shader)
 {
-   nir_parallel_copy_instr *instr = ralloc(shader, nir_parallel_copy_instr);
-   instr_init(&instr->instr, nir_instr_type_parallel_copy);
+   nir_parallel_copy_instr *instr =
+      linear_alloc_child(shader->lin_ctx, sizeof(nir_parallel_copy_instr));
+   instr_init(&instr->instr, nir_instr_type_parallel_copy, shader);
 
    exec_list_make_empty(&instr->entries);
 
@@ -629,8 +663,9 @@ nir_ssa_undef_instr_create(nir_shader *shader,
                            unsigned num_components,
                            unsigned bit_size)
 {
-   nir_ssa_undef_instr *instr = ralloc(shader, nir_ssa_undef_instr);
-   instr_init(&instr->instr, nir_instr_type_ssa_undef);
+   nir_ssa_undef_instr *instr =
+      linear_alloc_child(shader->lin_ctx, sizeof(nir_ssa_undef_instr));
+   instr_init(&instr->instr, nir_instr_type_ssa_undef, shader);
 
    nir_ssa_def_init(&instr->instr, &instr->def, num_components, bit_size, NULL);
 
@@ -1446,7 +1481,7 @@ nir_ssa_def_init(nir_instr *instr, nir_ssa_def *def,
                  unsigned num_components,
                  unsigned bit_size, const char *name)
 {
-   def->name = ralloc_strdup(instr, name);
+   def->name = linear_strdup(instr->lin_ctx, name);
    def->parent_instr = instr;
    list_inithead(&def->uses);
    list_inithead(&def->if_uses);
@@ -663,6 +663,9 @@ typedef struct nir_instr {
 
    /** generic instruction index. */
    unsigned index;
+
+   /** The nir_shader::lin_ctx this instruction was allocated from. */
+   void *lin_ctx;
 } nir_instr;
 
 static inline nir_instr *
@@ -2971,6 +2974,15 @@ typedef struct nir_shader {
     */
    void *constant_data;
    unsigned constant_data_size;
+
+   /** Linear allocator that instructions and everything hanging off of
+    * them (sources, names, ...) are allocated from.
+    *
+    * Nothing allocated from it is ever freed individually.  Removed
+    * instructions stay around until nir_sweep() copies the live ones into a
+    * fresh allocator and releases the old one as a whole.
+    */
+   void *lin_ctx;
 } nir_shader;
 
 #define nir_foreach_function(func, shader) \
@@ -3067,6 +3079,8 @@ nir_call_instr *nir_call_instr_create(nir_shader *shader,
 nir_tex_instr *nir_tex_instr_create(nir_shader *shader, unsigned num_srcs);
 
 nir_phi_instr *nir_phi_instr_create(nir_shader *shader);
+nir_phi_src *nir_phi_instr_add_src(nir_phi_instr *instr, nir_block *pred,
+                                   nir_src src);
 
 nir_parallel_copy_instr *nir_parallel_copy_instr_create(nir_shader *shader);
 
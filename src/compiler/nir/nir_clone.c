@@ -239,7 +239,7 @@ __clone_src(clone_state *state, void *ninstr_or_if,
    } else {
       nsrc->reg.reg = remap_reg(state, src->reg.reg);
       if (src->reg.indirect) {
-         nsrc->reg.indirect = ralloc(ninstr_or_if, nir_src);
+         nsrc->reg.indirect = ralloc(nsrc->reg.reg, nir_src);
          __clone_src(state, ninstr_or_if, nsrc->reg.indirect, src->reg.indirect);
       }
       nsrc->reg.base_offset = src->reg.base_offset;
@@ -258,7 +258,7 @@ __clone_dst(clone_state *state, nir_instr *ninstr,
    } else {
       ndst->reg.reg = remap_reg(state, dst->reg.reg);
       if (dst->reg.indirect) {
-         ndst->reg.indirect = ralloc(ninstr, nir_src);
+         ndst->reg.indirect = ralloc(ndst->reg.reg, nir_src);
          __clone_src(state, ninstr, ndst->reg.indirect, dst->reg.indirect);
       }
       ndst->reg.base_offset = dst->reg.base_offset;
@@ -450,23 +450,16 @@ clone_phi(clone_state *state, const nir_phi_instr *phi, nir_block *nblk)
    nir_instr_insert_after_block(nblk, &nphi->instr);
 
    foreach_list_typed(nir_phi_src, src, node, &phi->srcs) {
-      nir_phi_src *nsrc = ralloc(nphi, nir_phi_src);
-
-      /* Just copy the old source for now. */
-      memcpy(nsrc, src, sizeof(*src));
-
-      /* Since we're not letting nir_insert_instr handle use/def stuff for us,
-       * we have to set the parent_instr manually.  It doesn't really matter
-       * when we do it, so we might as well do it here.
+      /* Just copy the old source for now.  Since we're not letting
+       * nir_insert_instr handle use/def stuff for us, this also sets the
+       * parent_instr for us.
        */
-      nsrc->src.parent_instr = &nphi->instr;
+      nir_phi_src *nsrc = nir_phi_instr_add_src(nphi, src->pred, src->src);
 
       /* Stash it in the list of phi sources.  We'll walk this list and fix up
        * sources at the very end of clone_function_impl.
        */
       list_add(&nsrc->src.use_link, &state->phi_srcs);
-
-      exec_list_push_tail(&nphi->srcs, &nsrc->node);
    }
 
    return nphi;
@@ -750,6 +743,9 @@ nir_shader_clone(void *mem_ctx, const nir_shader *s)
     * will have in the list.
     */
    nir_foreach_function(fxn, s) {
+      if (!fxn->impl)
+         continue;
+
       nir_function *nfxn = remap_global(&state, fxn);
       nfxn->impl = clone_function_impl(&state, fxn->impl);
       nfxn->impl->function = nfxn;
@@ -793,7 +789,11 @@ nir_shader_replace(nir_shader *dst, nir_shader *src)
    ralloc_adopt(dead_ctx, dst);
    ralloc_free(dead_ctx);
 
-   /* Re-parent all of src's ralloc children to dst */
+   /* Re-parent all of src's ralloc children to dst.  The linear allocator
+    * remembers its ralloc parent for the buffers it has yet to allocate, so
+    * it has to be moved on its own.
+    */
+   ralloc_steal_linear_parent(dst, src->lin_ctx);
    ralloc_adopt(dst, src);
 
    memcpy(dst, src, sizeof(*dst));
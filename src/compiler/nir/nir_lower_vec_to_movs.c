@@ -94,11 +94,8 @@ insert_mov(nir_alu_instr *vec, unsigned start_idx, nir_shader *shader)
    }
 
    /* Only emit the instruction if it actually does something */
-   if (mov->dest.write_mask) {
+   if (mov->dest.write_mask)
       nir_instr_insert_before(&vec->instr, &mov->instr);
-   } else {
-      ralloc_free(mov);
-   }
 
    return channels_handled;
 }
@@ -276,7 +273,6 @@ lower_vec_to_movs_block(nir_block *block, nir_function_impl *impl)
       }
 
       nir_instr_remove(&vec->instr);
-      ralloc_free(vec);
       progress = true;
    }
 
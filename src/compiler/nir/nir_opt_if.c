@@ -478,17 +478,9 @@ opt_split_alu_of_phi(nir_builder *b, nir_loop *loop)
           * result of the new instruction from continue_block.
           */
          nir_phi_instr *const phi = nir_phi_instr_create(b->shader);
-         nir_phi_src *phi_src;
 
-         phi_src = ralloc(phi, nir_phi_src);
-         phi_src->pred = prev_block;
-         phi_src->src = nir_src_for_ssa(prev_value);
-         exec_list_push_tail(&phi->srcs, &phi_src->node);
-
-         phi_src = ralloc(phi, nir_phi_src);
-         phi_src->pred = continue_block;
-         phi_src->src = nir_src_for_ssa(alu_copy);
-         exec_list_push_tail(&phi->srcs, &phi_src->node);
+         nir_phi_instr_add_src(phi, prev_block, nir_src_for_ssa(prev_value));
+         nir_phi_instr_add_src(phi, continue_block, nir_src_for_ssa(alu_copy));
 
          nir_ssa_dest_init(&phi->instr, &phi->dest,
                            alu_copy->num_components, alu_copy->bit_size, NULL);
@@ -514,7 +506,6 @@ opt_split_alu_of_phi(nir_builder *b, nir_loop *loop)
           * remove it.
           */
          nir_instr_remove_v(&alu->instr);
-         ralloc_free(alu);
 
          progress = true;
       }
@@ -691,21 +682,13 @@ opt_simplify_bcsel_of_phi(nir_builder *b, nir_loop *loop)
        */
       nir_block *const continue_block = find_continue_block(loop);
       nir_phi_instr *const phi = nir_phi_instr_create(b->shader);
-      nir_phi_src *phi_src;
 
-      phi_src = ralloc(phi, nir_phi_src);
-      phi_src->pred = prev_block;
-      phi_src->src =
+      nir_phi_instr_add_src(phi, prev_block,
          nir_src_for_ssa(ssa_for_phi_from_block(nir_instr_as_phi(bcsel->src[entry_src].src.ssa->parent_instr),
-                                                prev_block));
-      exec_list_push_tail(&phi->srcs, &phi_src->node);
-
-      phi_src = ralloc(phi, nir_phi_src);
-      phi_src->pred = continue_block;
-      phi_src->src =
+                                                prev_block)));
+      nir_phi_instr_add_src(phi, continue_block,
          nir_src_for_ssa(ssa_for_phi_from_block(nir_instr_as_phi(bcsel->src[continue_src].src.ssa->parent_instr),
-                                                continue_block));
-      exec_list_push_tail(&phi->srcs, &phi_src->node);
+                                                continue_block)));
 
       nir_ssa_dest_init(&phi->instr,
                         &phi->dest,
@@ -734,7 +717,6 @@ opt_simplify_bcsel_of_phi(nir_builder *b, nir_loop *loop)
        * just remove it.
        */
       nir_instr_remove_v(&bcsel->instr);
-      ralloc_free(bcsel);
 
       progress = true;
    }
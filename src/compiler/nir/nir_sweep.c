@@ -30,6 +30,12 @@
  * memory - anything still connected to the program will be kept, and any dead memory
  * we dropped on the floor will be freed.
  *
+ * Instructions are bump-allocated from the shader's linear allocator and can't
+ * be freed one by one, so the live ones are copied into a fresh allocator and
+ * the old one is released as a whole.  Only the instructions move: functions,
+ * variables, registers and control flow keep their addresses, and the copies
+ * keep their pass_flags and index.
+ *
  * The expectation is that drivers should call this when finished compiling the shader
  * (after any optimization, lowering, and so on).  However, it's also fine to call it
  * earlier, and even many times, trading CPU cycles for memory savings.
@@ -40,24 +46,186 @@
 
 static void sweep_cf_node(nir_shader *nir, nir_cf_node *cf_node);
 
+static size_t
+instr_size(const nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu: {
+      const nir_alu_instr *alu = nir_instr_as_alu(instr);
+      return sizeof(*alu) + nir_op_infos[alu->op].num_inputs * sizeof(alu->src[0]);
+   }
+   case nir_instr_type_deref:
+      return sizeof(nir_deref_instr);
+   case nir_instr_type_call: {
+      const nir_call_instr *call = nir_instr_as_call(instr);
+      return sizeof(*call) + call->num_params * sizeof(call->params[0]);
+   }
+   case nir_instr_type_tex:
+      return sizeof(nir_tex_instr);
+   case nir_instr_type_intrinsic: {
+      const nir_intrinsic_instr *intrin = nir_instr_as_intrinsic(instr);
+      return sizeof(*intrin) +
+             nir_intrinsic_infos[intrin->intrinsic].num_srcs * sizeof(intrin->src[0]);
+   }
+   case nir_instr_type_load_const: {
+      const nir_load_const_instr *load = nir_instr_as_load_const(instr);
+      return sizeof(*load) + load->def.num_components * sizeof(load->value[0]);
+   }
+   case nir_instr_type_jump:
+      return sizeof(nir_jump_instr);
+   case nir_instr_type_ssa_undef:
+      return sizeof(nir_ssa_undef_instr);
+   case nir_instr_type_phi:
+      return sizeof(nir_phi_instr);
+   case nir_instr_type_parallel_copy:
+      return sizeof(nir_parallel_copy_instr);
+   default:
+      unreachable("Invalid instruction type");
+   }
+}
+
+struct sweep_instr_state {
+   nir_instr *old_instr;
+   nir_instr *instr;
+   size_t size;
+};
+
 static bool
-sweep_src_indirect(nir_src *src, void *nir)
+is_in_instr(struct sweep_instr_state *state, const void *ptr)
+{
+   return (const char *)ptr >= (const char *)state->instr &&
+          (const char *)ptr < (const char *)state->instr + state->size;
+}
+
+/* Maps a pointer into the copied instruction back to the original. */
+static void *
+old_ptr(struct sweep_instr_state *state, const void *ptr)
 {
+   return (char *)state->old_instr + ((const char *)ptr - (const char *)state->instr);
+}
+
+static bool
+sweep_src(nir_src *src, void *_state)
+{
+   struct sweep_instr_state *state = _state;
+
+   /* Indirects are visited as sources of their own.  They live off of the
+    * register they index, take them back from the rubbish.
+    */
    if (!src->is_ssa && src->reg.indirect)
-      ralloc_steal(nir, src->reg.indirect);
+      ralloc_steal(src->reg.reg, src->reg.indirect);
+
+   /* Texture and phi sources are moved along with their arrays and lists. */
+   if (is_in_instr(state, src)) {
+      nir_src *old_src = old_ptr(state, src);
+      list_replace(&old_src->use_link, &src->use_link);
+   }
+   src->parent_instr = state->instr;
+
+   return true;
+}
+
+static bool
+sweep_dest(nir_dest *dest, void *_state)
+{
+   struct sweep_instr_state *state = _state;
+
+   if (dest->is_ssa)
+      return true;
+
+   if (dest->reg.indirect)
+      ralloc_steal(dest->reg.reg, dest->reg.indirect);
+
+   /* Parallel copy entries stay where they are. */
+   if (is_in_instr(state, dest)) {
+      nir_dest *old_dest = old_ptr(state, dest);
+      list_replace(&old_dest->reg.def_link, &dest->reg.def_link);
+   }
+   dest->reg.parent_instr = state->instr;
 
    return true;
 }
 
 static bool
-sweep_dest_indirect(nir_dest *dest, void *nir)
+sweep_ssa_def(nir_ssa_def *def, void *_state)
 {
-   if (!dest->is_ssa && dest->reg.indirect)
-      ralloc_steal(nir, dest->reg.indirect);
+   struct sweep_instr_state *state = _state;
+
+   def->parent_instr = state->instr;
+   if (def->name)
+      def->name = linear_strdup(state->instr->lin_ctx, def->name);
+
+   /* Parallel copy entries stay where they are. */
+   if (!is_in_instr(state, def))
+      return true;
+
+   nir_ssa_def *old_def = old_ptr(state, def);
+
+   list_replace(&old_def->uses, &def->uses);
+   list_replace(&old_def->if_uses, &def->if_uses);
+
+   nir_foreach_use(use_src, def)
+      use_src->ssa = def;
+   nir_foreach_if_use(use_src, def)
+      use_src->ssa = def;
 
    return true;
 }
 
+/* Copies an instruction into the shader's new linear allocator and moves all
+ * the references to it over to the copy.
+ */
+static void
+sweep_instr(nir_shader *nir, nir_instr *old_instr)
+{
+   struct sweep_instr_state state = {
+      .old_instr = old_instr,
+      .size = instr_size(old_instr),
+   };
+   nir_instr *instr = state.instr = linear_alloc_child(nir->lin_ctx, state.size);
+
+   memcpy(instr, old_instr, state.size);
+   instr->lin_ctx = nir->lin_ctx;
+   exec_node_replace_with(&old_instr->node, &instr->node);
+
+   switch (instr->type) {
+   case nir_instr_type_tex: {
+      nir_tex_instr *tex = nir_instr_as_tex(instr);
+      nir_tex_src *src =
+         linear_alloc_child(nir->lin_ctx, tex->num_srcs * sizeof(*src));
+
+      memcpy(src, tex->src, tex->num_srcs * sizeof(*src));
+      for (unsigned i = 0; i < tex->num_srcs; i++)
+         list_replace(&tex->src[i].src.use_link, &src[i].src.use_link);
+      tex->src = src;
+      break;
+   }
+   case nir_instr_type_phi: {
+      nir_phi_instr *phi = nir_instr_as_phi(instr);
+
+      exec_list_move_nodes_to(&nir_instr_as_phi(old_instr)->srcs, &phi->srcs);
+      foreach_list_typed_safe(nir_phi_src, old_src, node, &phi->srcs) {
+         nir_phi_src *src = linear_alloc_child(nir->lin_ctx, sizeof(*src));
+
+         memcpy(src, old_src, sizeof(*src));
+         exec_node_replace_with(&old_src->node, &src->node);
+         list_replace(&old_src->src.use_link, &src->src.use_link);
+      }
+      break;
+   }
+   case nir_instr_type_parallel_copy:
+      exec_list_move_nodes_to(&nir_instr_as_parallel_copy(old_instr)->entries,
+                              &nir_instr_as_parallel_copy(instr)->entries);
+      break;
+   default:
+      break;
+   }
+
+   nir_foreach_src(instr, sweep_src, &state);
+   nir_foreach_dest(instr, sweep_dest, &state);
+   nir_foreach_ssa_def(instr, sweep_ssa_def, &state);
+}
+
 static void
 sweep_block(nir_shader *nir, nir_block *block)
 {
@@ -72,12 +240,8 @@ sweep_block(nir_shader *nir, nir_block *block)
    ralloc_free(block->live_out);
    block->live_out = NULL;
 
-   nir_foreach_instr(instr, block) {
-      ralloc_steal(nir, instr);
-
-      nir_foreach_src(instr, sweep_src_indirect, nir);
-      nir_foreach_dest(instr, sweep_dest_indirect, nir);
-   }
+   nir_foreach_instr_safe(instr, block)
+      sweep_instr(nir, instr);
 }
 
 static void
@@ -85,6 +249,10 @@ sweep_if(nir_shader *nir, nir_if *iff)
 {
    ralloc_steal(nir, iff);
 
+   if (!iff->condition.is_ssa && iff->condition.reg.indirect) {
+      ralloc_steal(iff->condition.reg.reg, iff->condition.reg.indirect);
+   }
+
    foreach_list_typed(nir_cf_node, cf_node, node, &iff->then_list) {
       sweep_cf_node(nir, cf_node);
    }
@@ -123,13 +291,21 @@ sweep_cf_node(nir_shader *nir, nir_cf_node *cf_node)
 }
 
 static void
-sweep_impl(nir_shader *nir, nir_function_impl *impl)
+sweep_impl(nir_shader *nir, nir_function_impl *impl, void *rubbish)
 {
    ralloc_steal(nir, impl);
 
    steal_list(nir, nir_variable, &impl->locals);
    steal_list(nir, nir_register, &impl->registers);
 
+   /* Indirect sources are allocated off of the register they index.  Assume
+    * them dead too, sweep_src() steals back the ones still in use.
+    */
+   foreach_list_typed(nir_register, reg, node, &impl->registers) {
+      ralloc_adopt(rubbish, reg);
+      ralloc_steal(reg, (char *)reg->name);
+   }
+
    foreach_list_typed(nir_cf_node, cf_node, node, &impl->body) {
       sweep_cf_node(nir, cf_node);
    }
@@ -141,13 +317,13 @@ sweep_impl(nir_shader *nir, nir_function_impl *impl)
 }
 
 static void
-sweep_function(nir_shader *nir, nir_function *f)
+sweep_function(nir_shader *nir, nir_function *f, void *rubbish)
 {
    ralloc_steal(nir, f);
    ralloc_steal(nir, f->params);
 
    if (f->impl)
-      sweep_impl(nir, f->impl);
+      sweep_impl(nir, f->impl, rubbish);
 }
 
 void
@@ -158,6 +334,11 @@ nir_sweep(nir_shader *nir)
    /* First, move ownership of all the memory to a temporary context; assume dead. */
    ralloc_adopt(rubbish, nir);
 
+   /* That includes the linear allocator, live instructions get copied into a
+    * new one.
+    */
+   nir->lin_ctx = linear_alloc_parent(nir, 0);
+
    ralloc_steal(nir, (char *)nir->info.name);
    if (nir->info.label)
       ralloc_steal(nir, (char *)nir->info.label);
@@ -172,7 +353,7 @@ nir_sweep(nir_shader *nir)
 
    /* Recurse into functions, stealing their contents back. */
    foreach_list_typed(nir_function, func, node, &nir->functions) {
-      sweep_function(nir, func);
+      sweep_function(nir, func, rubbish);
    }
 
    ralloc_steal(nir, nir->constant_data);
@@ -177,6 +177,9 @@ boolean draw_init(struct draw_context *draw)
 
    draw->floating_point_depth = false;
 
+   /* until the driver says otherwise */
+   draw->blend = TRUE;
+
    return TRUE;
 }
 
@@ -557,6 +560,18 @@ draw_enable_point_sprites(struct draw_context *draw, boolean enable)
 }
 
 
+/**
+ * Tells draw module whether blending or logic ops are enabled, which
+ * makes the order primitives get rasterized in matter.
+ */
+void
+draw_enable_blend(struct draw_context *draw, boolean enable)
+{
+   draw_do_flush( draw, DRAW_FLUSH_STATE_CHANGE );
+   draw->blend = enable;
+}
+
+
 void
 draw_set_force_passthrough( struct draw_context *draw, boolean enable )
 {
@@ -565,6 +580,42 @@ draw_set_force_passthrough( struct draw_context *draw, boolean enable )
 }
 
 
+/**
+ * Let the driver provide a cache for the compiled LLVM shader variants.
+ * The callbacks are invoked with a hash of the shader IR and variant key.
+ */
+void
+draw_set_disk_cache_callbacks(struct draw_context *draw,
+                              void *data_cookie,
+                              void (*find_shader)(void *cookie,
+                                                  struct lp_cached_code *cache,
+                                                  unsigned char ir_sha1_cache_key[20]),
+                              void (*insert_shader)(void *cookie,
+                                                    struct lp_cached_code *cache,
+                                                    unsigned char ir_sha1_cache_key[20]))
+{
+   draw->disk_cache_find_shader = find_shader;
+   draw->disk_cache_insert_shader = insert_shader;
+   draw->disk_cache_cookie = data_cookie;
+}
+
+
+/**
+ * Keep the LLVM vertex and geometry shader variants in the driver's
+ * variant cache, so they share one LRU and budget with its own shaders.
+ * The cache must outlive the draw context.
+ */
+void
+draw_set_variant_cache(struct draw_context *draw,
+                       struct lp_variant_cache *cache)
+{
+#ifdef LLVM_AVAILABLE
+   if (draw->llvm)
+      draw_llvm_set_variant_cache(draw->llvm, cache);
+#endif
+}
+
+
 
 /**
  * Allocate an extra vertex/geometry shader vertex attribute, if it doesn't
@@ -118,6 +118,8 @@ void draw_enable_line_stipple(struct draw_context *draw, boolean enable);
 
 void draw_enable_point_sprites(struct draw_context *draw, boolean enable);
 
+void draw_enable_blend(struct draw_context *draw, boolean enable);
+
 void draw_set_zs_format(struct draw_context *draw, enum pipe_format format);
 
 boolean
@@ -307,6 +309,22 @@ void draw_set_driver_clipping( struct draw_context *draw,
 void draw_set_force_passthrough( struct draw_context *draw, 
                                  boolean enable );
 
+struct lp_cached_code;
+void
+draw_set_disk_cache_callbacks(struct draw_context *draw,
+                              void *data_cookie,
+                              void (*find_shader)(void *cookie,
+                                                  struct lp_cached_code *cache,
+                                                  unsigned char ir_sha1_cache_key[20]),
+                              void (*insert_shader)(void *cookie,
+                                                    struct lp_cached_code *cache,
+                                                    unsigned char ir_sha1_cache_key[20]));
+
+struct lp_variant_cache;
+void
+draw_set_variant_cache(struct draw_context *draw,
+                       struct lp_variant_cache *cache);
+
 
 /*******************************************************************************
  * Draw statistics
@@ -586,10 +586,11 @@ draw_llvm_create(struct draw_context *draw, LLVMContextRef context)
       goto fail;
 
    llvm->nr_variants = 0;
-   make_empty_list(&llvm->vs_variants_list);
-
    llvm->nr_gs_variants = 0;
-   make_empty_list(&llvm->gs_variants_list);
+
+   lp_variant_cache_init(&llvm->own_variant_cache, 0,
+                         DRAW_MAX_SHADER_VARIANTS);
+   llvm->variant_cache = &llvm->own_variant_cache;
 
    return llvm;
 
@@ -614,6 +615,52 @@ draw_llvm_destroy(struct draw_llvm *llvm)
 }
 
 
+void
+draw_llvm_set_variant_cache(struct draw_llvm *llvm,
+                            struct lp_variant_cache *cache)
+{
+   assert(llvm->nr_variants == 0 && llvm->nr_gs_variants == 0);
+   llvm->variant_cache = cache ? cache : &llvm->own_variant_cache;
+
+   lp_variant_cache_set_max_count(llvm->variant_cache, PIPE_SHADER_VERTEX,
+                                  DRAW_MAX_SHADER_VARIANTS);
+   lp_variant_cache_set_max_count(llvm->variant_cache, PIPE_SHADER_GEOMETRY,
+                                  DRAW_MAX_SHADER_VARIANTS);
+}
+
+
+/**
+ * Variant cache callbacks.  The variants bound for the current draw may
+ * not be freed; nothing else holds on to vertex or geometry shader code,
+ * as vertices are shaded synchronously.
+ */
+static boolean
+draw_llvm_evict_variant(struct lp_variant_cache_item *item)
+{
+   struct draw_llvm *llvm = item->owner;
+   struct draw_llvm_variant *variant = item->variant;
+
+   if (variant == llvm->current_variant)
+      return FALSE;
+
+   draw_llvm_destroy_variant(variant);
+   return TRUE;
+}
+
+
+static boolean
+draw_gs_llvm_evict_variant(struct lp_variant_cache_item *item)
+{
+   struct draw_gs_llvm_variant *variant = item->variant;
+
+   if (variant == variant->shader->base.current_variant)
+      return FALSE;
+
+   draw_gs_llvm_destroy_variant(variant);
+   return TRUE;
+}
+
+
 /**
  * Create LLVM-generated code for a vertex shader.
  */
@@ -627,6 +674,9 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
       llvm_vertex_shader(llvm->draw->vs.vertex_shader);
    LLVMTypeRef vertex_header;
    char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
 
    variant = MALLOC(sizeof *variant +
                     shader->variant_key_size -
@@ -640,7 +690,18 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
    snprintf(module_name, sizeof(module_name), "draw_llvm_vs_variant%u",
             variant->shader->variants_cached);
 
-   variant->gallivm = gallivm_create(module_name, llvm->context);
+   if (llvm->draw->disk_cache_find_shader) {
+      lp_build_ir_cache_key(&shader->base.state, key,
+                            shader->variant_key_size,
+                            &num_inputs, sizeof(num_inputs),
+                            ir_sha1_cache_key);
+      llvm->draw->disk_cache_find_shader(llvm->draw->disk_cache_cookie,
+                                         &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = true;
+   }
+
+   variant->gallivm = gallivm_create(module_name, llvm->context, &cached);
 
    create_jit_types(variant);
 
@@ -664,13 +725,19 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 
    variant->jit_func = (draw_jit_vert_func)
          gallivm_jit_function(variant->gallivm, variant->function);
+   lp_variant_cache_item_init(&variant->cache_item, draw_llvm_evict_variant,
+                              PIPE_SHADER_VERTEX, variant, llvm);
+   lp_variant_cache_set_size(&variant->cache_item,
+                             gallivm_code_size(variant->gallivm));
+
+   if (needs_caching)
+      llvm->draw->disk_cache_insert_shader(llvm->draw->disk_cache_cookie,
+                                           &cached, ir_sha1_cache_key);
 
    gallivm_free_ir(variant->gallivm);
 
-   variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    /*variant->no = */shader->variants_created++;
-   variant->list_item_global.base = variant;
 
    return variant;
 }
@@ -1674,8 +1741,8 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
 
    memset(&system_values, 0, sizeof(system_values));
    memset(&outputs, 0, sizeof(outputs));
-   snprintf(func_name, sizeof(func_name), "draw_llvm_vs_variant%u",
-            variant->shader->variants_cached);
+   /* no variant number, cached code is looked up by name */
+   snprintf(func_name, sizeof(func_name), "draw_llvm_vs_variant");
 
    i = 0;
    arg_types[i++] = get_context_ptr_type(variant);       /* context */
@@ -2326,9 +2393,12 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 
    gallivm_destroy(variant->gallivm);
 
+   if (llvm->current_variant == variant)
+      llvm->current_variant = NULL;
+
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
-   remove_from_list(&variant->list_item_global);
+   lp_variant_cache_remove(&variant->cache_item);
    llvm->nr_variants--;
    FREE(variant);
 }
@@ -2566,6 +2636,9 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
       llvm_geometry_shader(llvm->draw->gs.geometry_shader);
    LLVMTypeRef vertex_header;
    char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
 
    variant = MALLOC(sizeof *variant +
                     shader->variant_key_size -
@@ -2579,7 +2652,18 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
    snprintf(module_name, sizeof(module_name), "draw_llvm_gs_variant%u",
             variant->shader->variants_cached);
 
-   variant->gallivm = gallivm_create(module_name, llvm->context);
+   if (llvm->draw->disk_cache_find_shader) {
+      lp_build_ir_cache_key(&shader->base.state, key,
+                            shader->variant_key_size,
+                            &num_outputs, sizeof(num_outputs),
+                            ir_sha1_cache_key);
+      llvm->draw->disk_cache_find_shader(llvm->draw->disk_cache_cookie,
+                                         &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = true;
+   }
+
+   variant->gallivm = gallivm_create(module_name, llvm->context, &cached);
 
    create_gs_jit_types(variant);
 
@@ -2595,13 +2679,19 @@ draw_gs_llvm_create_variant(struct draw_llvm *llvm,
 
    variant->jit_func = (draw_gs_jit_func)
          gallivm_jit_function(variant->gallivm, variant->function);
+   lp_variant_cache_item_init(&variant->cache_item, draw_gs_llvm_evict_variant,
+                              PIPE_SHADER_GEOMETRY, variant, llvm);
+   lp_variant_cache_set_size(&variant->cache_item,
+                             gallivm_code_size(variant->gallivm));
+
+   if (needs_caching)
+      llvm->draw->disk_cache_insert_shader(llvm->draw->disk_cache_cookie,
+                                           &cached, ir_sha1_cache_key);
 
    gallivm_free_ir(variant->gallivm);
 
-   variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
    /*variant->no = */shader->variants_created++;
-   variant->list_item_global.base = variant;
 
    return variant;
 }
@@ -2618,9 +2708,12 @@ draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant)
 
    gallivm_destroy(variant->gallivm);
 
+   if (variant->shader->base.current_variant == variant)
+      variant->shader->base.current_variant = NULL;
+
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
-   remove_from_list(&variant->list_item_global);
+   lp_variant_cache_remove(&variant->cache_item);
    llvm->nr_gs_variants--;
    FREE(variant);
 }
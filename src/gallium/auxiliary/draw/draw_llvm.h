@@ -35,6 +35,7 @@
 
 #include "gallivm/lp_bld_sample.h"
 #include "gallivm/lp_bld_limits.h"
+#include "gallivm/lp_bld_variant_cache.h"
 
 #include "pipe/p_context.h"
 #include "util/simple_list.h"
@@ -466,8 +467,8 @@ struct draw_llvm_variant
    struct llvm_vertex_shader *shader;
 
    struct draw_llvm *llvm;
-   struct draw_llvm_variant_list_item list_item_global;
    struct draw_llvm_variant_list_item list_item_local;
+   struct lp_variant_cache_item cache_item;
 
    /* key is variable-sized, must be last */
    struct draw_llvm_variant_key key;
@@ -492,8 +493,8 @@ struct draw_gs_llvm_variant
    struct llvm_geometry_shader *shader;
 
    struct draw_llvm *llvm;
-   struct draw_gs_llvm_variant_list_item list_item_global;
    struct draw_gs_llvm_variant_list_item list_item_local;
+   struct lp_variant_cache_item cache_item;
 
    /* key is variable-sized, must be last */
    struct draw_gs_llvm_variant_key key;
@@ -527,11 +528,18 @@ struct draw_llvm {
    struct draw_jit_context jit_context;
    struct draw_gs_jit_context gs_jit_context;
 
-   struct draw_llvm_variant_list_item vs_variants_list;
-   int nr_variants;
+   /**
+    * LRU of the variants: the driver's one if it shares it with its own
+    * shaders (draw_set_variant_cache), or own_variant_cache.
+    */
+   struct lp_variant_cache *variant_cache;
+   struct lp_variant_cache own_variant_cache;
 
-   struct draw_gs_llvm_variant_list_item gs_variants_list;
+   int nr_variants;
    int nr_gs_variants;
+
+   /** Vertex shader variant of the draw being prepared or run */
+   struct draw_llvm_variant *current_variant;
 };
 
 
@@ -556,6 +564,10 @@ draw_llvm_create(struct draw_context *draw, LLVMContextRef llvm_context);
 void
 draw_llvm_destroy(struct draw_llvm *llvm);
 
+void
+draw_llvm_set_variant_cache(struct draw_llvm *llvm,
+                            struct lp_variant_cache *cache);
+
 struct draw_llvm_variant *
 draw_llvm_create_variant(struct draw_llvm *llvm,
                          unsigned num_vertex_header_attribs,
@@ -71,6 +71,7 @@ struct tgsi_buffer;
 struct draw_pt_front_end;
 struct draw_assembler;
 struct draw_llvm;
+struct lp_cached_code;
 
 
 /**
@@ -246,6 +247,9 @@ struct draw_context
 
    boolean dump_vs;
 
+   /** Blending or logic ops make the primitive order visible */
+   boolean blend;
+
    /** Depth format and bias related settings. */
    boolean floating_point_depth;
    double mrd;  /**< minimum resolvable depth value, for polygon offset */
@@ -333,6 +337,15 @@ struct draw_context
 
    struct draw_llvm *llvm;
 
+   /** Optional driver hooks for caching compiled LLVM shader variants */
+   void *disk_cache_cookie;
+   void (*disk_cache_find_shader)(void *cookie,
+                                  struct lp_cached_code *cache,
+                                  unsigned char ir_sha1_cache_key[20]);
+   void (*disk_cache_insert_shader)(void *cookie,
+                                    struct lp_cached_code *cache,
+                                    unsigned char ir_sha1_cache_key[20]);
+
    /** Texture sampler and sampler view state.
     * Note that we have arrays indexed by shader type.  At this time
     * we only handle vertex and geometry shaders in the draw module, but
@@ -28,6 +28,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -40,6 +41,29 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/**
+ * With DRAW_THREADS=n, the vertex fetch and shading of a run is split into
+ * chunks of at least LLVM_SHADE_MIN_CHUNK vertices that are shaded by n
+ * worker threads and the calling thread.  Everything after the vertex
+ * shader still runs on the calling thread, in primitive order.
+ */
+#define LLVM_SHADE_MAX_JOBS   16
+#define LLVM_SHADE_MIN_CHUNK  256
+
+struct llvm_middle_end;
+
+struct llvm_shade_job {
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned vid_base;
+   const unsigned *elts;
+   boolean clipped;
+   struct util_queue_fence fence;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -57,6 +81,17 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /** Triangle lists get trivially rejected/culled before pipeline or emit */
+   boolean cull_tris;
+   /** PIPE_FACE_x to cull, if window coordinates can be trusted for it */
+   unsigned cull_face;
+   boolean front_ccw;
+
+   struct util_queue shade_queue;
+   boolean shade_queue_ok;
+   unsigned num_shade_threads;
+   struct llvm_shade_job shade_jobs[LLVM_SHADE_MAX_JOBS];
 };
 
 
@@ -79,7 +114,6 @@ llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
    struct draw_gs_llvm_variant_list_item *li;
    struct llvm_geometry_shader *shader = llvm_geometry_shader(gs);
    char store[DRAW_GS_LLVM_MAX_VARIANT_KEY_SIZE];
-   unsigned i;
 
    key = draw_gs_llvm_make_variant_key(llvm, store);
 
@@ -94,42 +128,23 @@ llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
    }
 
    if (variant) {
-      /* found the variant, move to head of global list (for LRU) */
-      move_to_head(&llvm->gs_variants_list, &variant->list_item_global);
+      /* found the variant, move to head of the LRU */
+      lp_variant_cache_hit(&variant->cache_item);
    }
    else {
       /* Need to create new variant */
 
-      /* First check if we've created too many variants.  If so, free
-       * 3.125% of the LRU to avoid using too much memory.
+      /* First check if the variants use too much memory.  If so, free
+       * the least recently used ones.
        */
-      if (llvm->nr_gs_variants >= DRAW_MAX_SHADER_VARIANTS) {
-         if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-            debug_printf("Evicting GS: %u gs variants,\t%u total variants\n",
-                      shader->variants_cached, llvm->nr_gs_variants);
-         }
-
-         /*
-          * XXX: should we flush here ?
-          */
-         for (i = 0; i < DRAW_MAX_SHADER_VARIANTS / 32; i++) {
-            struct draw_gs_llvm_variant_list_item *item;
-            if (is_empty_list(&llvm->gs_variants_list)) {
-               break;
-            }
-            item = last_elem(&llvm->gs_variants_list);
-            assert(item);
-            assert(item->base);
-            draw_gs_llvm_destroy_variant(item->base);
-         }
-      }
+      if (lp_variant_cache_over_budget(llvm->variant_cache))
+         lp_variant_cache_evict(llvm->variant_cache);
 
       variant = draw_gs_llvm_create_variant(llvm, gs->info.num_outputs, key);
 
       if (variant) {
          insert_at_head(&shader->variants, &variant->list_item_local);
-         insert_at_head(&llvm->gs_variants_list,
-                        &variant->list_item_global);
+         lp_variant_cache_insert(llvm->variant_cache, &variant->cache_item);
          llvm->nr_gs_variants++;
          shader->variants_cached++;
       }
@@ -201,6 +216,24 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    /* return even number */
    *max_vertices = *max_vertices & ~1;
 
+   /* Culling whole triangles needs the clipmasks of the vertices as the
+    * vertex shader left them, and for face culling window coordinates
+    * computed with a single viewport.  Unfilled and edge flagged triangles
+    * are left to the pipeline.
+    */
+   fpme->cull_tris = !gs && out_prim == PIPE_PRIM_TRIANGLES &&
+                     !vs->info.writes_viewport_index &&
+                     !draw->vs.edgeflag_output;
+   if (fpme->cull_tris && draw->clip_xy && !draw->bypass_viewport &&
+       draw->rasterizer->fill_front == PIPE_POLYGON_MODE_FILL &&
+       draw->rasterizer->fill_back == PIPE_POLYGON_MODE_FILL) {
+      fpme->cull_face = draw->rasterizer->cull_face;
+      fpme->front_ccw = draw->rasterizer->front_ccw;
+   }
+   else {
+      fpme->cull_face = PIPE_FACE_NONE;
+   }
+
    /* Find/create the vertex shader variant */
    {
       struct draw_llvm_variant_key *key;
@@ -208,7 +241,6 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       struct draw_llvm_variant_list_item *li;
       struct llvm_vertex_shader *shader = llvm_vertex_shader(vs);
       char store[DRAW_LLVM_MAX_VARIANT_KEY_SIZE];
-      unsigned i;
 
       key = draw_llvm_make_variant_key(llvm, store);
 
@@ -223,48 +255,30 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       }
 
       if (variant) {
-         /* found the variant, move to head of global list (for LRU) */
-         move_to_head(&llvm->vs_variants_list, &variant->list_item_global);
+         /* found the variant, move to head of the LRU */
+         lp_variant_cache_hit(&variant->cache_item);
       }
       else {
          /* Need to create new variant */
 
-         /* First check if we've created too many variants.  If so, free
-          * 3.125% of the LRU to avoid using too much memory.
+         /* First check if the variants use too much memory.  If so, free
+          * the least recently used ones.
           */
-         if (llvm->nr_variants >= DRAW_MAX_SHADER_VARIANTS) {
-            if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-               debug_printf("Evicting VS: %u vs variants,\t%u total variants\n",
-                         shader->variants_cached, llvm->nr_variants);
-            }
-
-            /*
-             * XXX: should we flush here ?
-             */
-            for (i = 0; i < DRAW_MAX_SHADER_VARIANTS / 32; i++) {
-               struct draw_llvm_variant_list_item *item;
-               if (is_empty_list(&llvm->vs_variants_list)) {
-                  break;
-               }
-               item = last_elem(&llvm->vs_variants_list);
-               assert(item);
-               assert(item->base);
-               draw_llvm_destroy_variant(item->base);
-            }
-         }
+         if (lp_variant_cache_over_budget(llvm->variant_cache))
+            lp_variant_cache_evict(llvm->variant_cache);
 
          variant = draw_llvm_create_variant(llvm, nr, key);
 
          if (variant) {
             insert_at_head(&shader->variants, &variant->list_item_local);
-            insert_at_head(&llvm->vs_variants_list,
-                           &variant->list_item_global);
+            lp_variant_cache_insert(llvm->variant_cache, &variant->cache_item);
             llvm->nr_variants++;
             shader->variants_cached++;
          }
       }
 
       fpme->current_variant = variant;
+      llvm->current_variant = variant;
    }
 
    if (gs) {
@@ -369,6 +383,187 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Fetch and shade count vertices with the vertex shader variant.
+ * Returns whether any vertex needs clipping.
+ */
+static boolean
+llvm_run_vs(struct llvm_middle_end *fpme,
+            struct vertex_header *verts,
+            unsigned count,
+            unsigned start_or_maxelt,
+            unsigned vid_base,
+            const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+
+   return fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                          verts,
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start_or_maxelt,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vid_base,
+                                          draw->start_instance,
+                                          elts, draw->pt.user.drawid);
+}
+
+
+static void
+llvm_shade_job_execute(void *data, int thread_index)
+{
+   struct llvm_shade_job *job = (struct llvm_shade_job *) data;
+
+   /* same floating point state as draw_vbo() sets up for its thread */
+   util_fpstate_set_denorms_to_zero(util_fpstate_get());
+
+   job->clipped = llvm_run_vs(job->fpme, job->verts, job->count,
+                              job->start_or_maxelt, job->vid_base, job->elts);
+}
+
+
+/**
+ * Like llvm_run_vs(), but split the vertices among the shading threads if
+ * there are enough of them.  The generated code processes whole vectors
+ * of vertices, so chunks start at multiples of the vector length to keep
+ * them from writing into each other's vertices.
+ */
+static boolean
+llvm_shade_vertices(struct llvm_middle_end *fpme,
+                    struct vertex_header *verts,
+                    unsigned count,
+                    unsigned start_or_maxelt,
+                    unsigned vid_base,
+                    const unsigned *elts)
+{
+   const unsigned vector_length = lp_native_vector_width / 32;
+   unsigned chunk, offset, num_jobs = 0, i;
+   boolean clipped;
+
+   if (!fpme->shade_queue_ok)
+      return llvm_run_vs(fpme, verts, count, start_or_maxelt, vid_base, elts);
+
+   chunk = DIV_ROUND_UP(count, fpme->num_shade_threads + 1);
+   chunk = align(MAX2(chunk, LLVM_SHADE_MIN_CHUNK), vector_length);
+   if (count <= chunk)
+      return llvm_run_vs(fpme, verts, count, start_or_maxelt, vid_base, elts);
+
+   for (offset = chunk; offset < count; offset += chunk) {
+      struct llvm_shade_job *job = &fpme->shade_jobs[num_jobs++];
+
+      assert(num_jobs <= LLVM_SHADE_MAX_JOBS);
+      job->fpme = fpme;
+      job->verts = (struct vertex_header *)
+         ((char *) verts + offset * fpme->vertex_size);
+      job->count = MIN2(chunk, count - offset);
+      job->vid_base = vid_base;
+      if (elts) {
+         job->start_or_maxelt = start_or_maxelt;
+         job->elts = elts + offset;
+      }
+      else {
+         job->start_or_maxelt = start_or_maxelt + offset;
+         job->elts = NULL;
+      }
+      job->clipped = FALSE;
+
+      util_queue_add_job(&fpme->shade_queue, job, &job->fence,
+                         llvm_shade_job_execute, NULL, 0);
+   }
+
+   clipped = llvm_run_vs(fpme, verts, chunk, start_or_maxelt, vid_base, elts);
+
+   for (i = 0; i < num_jobs; i++) {
+      util_queue_fence_wait(&fpme->shade_jobs[i].fence);
+      clipped |= fpme->shade_jobs[i].clipped;
+   }
+
+   return clipped;
+}
+
+
+/**
+ * Drop the triangles of a triangle list that are entirely outside one of
+ * the clip planes, and those the cull stage would cull (zero area ones
+ * counting as back facing, like in draw_pipe_cull.c), so they don't go
+ * through the pipeline or the driver's setup.
+ *
+ * The surviving triangles are written to elts.  Returns the number of
+ * elements written and sets *clipped if any of them still needs clipping.
+ */
+static unsigned
+llvm_cull_triangles(struct llvm_middle_end *fpme,
+                    const struct draw_vertex_info *vert_info,
+                    const struct draw_prim_info *prim_info,
+                    ushort *elts,
+                    boolean *clipped)
+{
+   const unsigned pos = draw_current_shader_position_output(fpme->draw);
+   /*
+    * Drivers count the triangles reaching their setup as clipper output
+    * primitives, face culled ones included, so only trivial rejects are
+    * dropped while pipeline statistics are being collected.
+    */
+   const unsigned cull_face = fpme->draw->collect_statistics ?
+                              PIPE_FACE_NONE : fpme->cull_face;
+   const unsigned stride = vert_info->stride;
+   const char *verts = (const char *) vert_info->verts;
+   unsigned count = 0, clipmask = 0, i;
+
+   for (i = 0; i + 2 < prim_info->count; i += 3) {
+      const struct vertex_header *v[3];
+      unsigned k;
+
+      for (k = 0; k < 3; k++) {
+         unsigned idx = prim_info->linear ? prim_info->start + i + k :
+                                            prim_info->elts[i + k];
+         v[k] = (const struct vertex_header *) (verts + idx * stride);
+      }
+
+      /* trivial reject */
+      if (v[0]->clipmask & v[1]->clipmask & v[2]->clipmask)
+         continue;
+
+      if (v[0]->clipmask | v[1]->clipmask | v[2]->clipmask) {
+         /* window coordinates not trustworthy, the clipper will cull */
+         clipmask = 1;
+      }
+      else if (cull_face != PIPE_FACE_NONE) {
+         const float *p0 = v[0]->data[pos];
+         const float *p1 = v[1]->data[pos];
+         const float *p2 = v[2]->data[pos];
+         const float ex = p0[0] - p2[0];
+         const float ey = p0[1] - p2[1];
+         const float fx = p1[0] - p2[0];
+         const float fy = p1[1] - p2[1];
+         const float det = ex * fy - ey * fx;
+         unsigned face;
+
+         if (det != 0.0f) {
+            const boolean ccw = det < 0.0f;
+            face = ccw == fpme->front_ccw ? PIPE_FACE_FRONT : PIPE_FACE_BACK;
+         }
+         else {
+            face = PIPE_FACE_BACK;
+         }
+
+         if (face & cull_face)
+            continue;
+      }
+
+      for (k = 0; k < 3; k++) {
+         elts[count++] = prim_info->linear ? prim_info->start + i + k :
+                                             prim_info->elts[i + k];
+      }
+   }
+
+   *clipped = clipmask != 0;
+   return count;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -384,6 +579,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    struct draw_prim_info ia_prim_info;
    struct draw_vertex_info ia_vert_info;
    const struct draw_prim_info *prim_info = in_prim_info;
+   struct draw_prim_info cull_prim_info;
+   ushort *cull_elts = NULL;
    boolean free_prim_info = FALSE;
    unsigned opt = fpme->opt;
    boolean clipped = 0;
@@ -419,17 +616,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts, draw->pt.user.drawid);
+   clipped = llvm_shade_vertices(fpme, llvm_vert_info.verts,
+                                 fetch_info->count, start_or_maxelt,
+                                 vid_base, elts);
 
    /* Finished with fetch and vs:
     */
@@ -496,6 +685,27 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                draw->vs.vertex_shader->info.writes_viewport_index)) {
          clipped = draw_pt_post_vs_run( fpme->post_vs, vert_info, prim_info );
       }
+      /*
+       * Runs are at most one vsplit segment of vertices, so the indices
+       * of the surviving triangles always fit the ushort elts.
+       */
+      if (fpme->cull_tris && prim_info->prim == PIPE_PRIM_TRIANGLES &&
+          prim_info->primitive_count == 1) {
+         assert(vert_info->count <= 65536);
+         cull_elts = MALLOC(prim_info->count * sizeof(ushort));
+         if (cull_elts) {
+            cull_prim_info = *prim_info;
+            cull_prim_info.linear = FALSE;
+            cull_prim_info.start = 0;
+            cull_prim_info.elts = cull_elts;
+            cull_prim_info.count =
+               llvm_cull_triangles(fpme, vert_info, prim_info,
+                                   cull_elts, &clipped);
+            cull_prim_info.primitive_lengths = &cull_prim_info.count;
+            prim_info = &cull_prim_info;
+         }
+      }
+
       /* "clipped" also includes non-one edgeflag */
       if (clipped) {
          opt |= PT_PIPELINE;
@@ -503,7 +713,10 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 
       /* Do we need to run the pipeline? Now will come here if clipped
        */
-      if (opt & PT_PIPELINE) {
+      if (prim_info->count == 0) {
+         /* everything culled */
+      }
+      else if (opt & PT_PIPELINE) {
          pipeline( fpme, vert_info, prim_info );
       }
       else {
@@ -511,8 +724,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       }
    }
    FREE(vert_info->verts);
+   FREE(cull_elts);
    if (free_prim_info) {
-      FREE(prim_info->primitive_lengths);
+      FREE(ia_prim_info.primitive_lengths);
    }
 }
 
@@ -628,6 +842,12 @@ static void
 llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   unsigned i;
+
+   if (fpme->shade_queue_ok)
+      util_queue_destroy(&fpme->shade_queue);
+   for (i = 0; i < ARRAY_SIZE(fpme->shade_jobs); i++)
+      util_queue_fence_destroy(&fpme->shade_jobs[i].fence);
 
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
@@ -649,6 +869,7 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   unsigned i;
 
    if (!draw->llvm)
       return NULL;
@@ -657,6 +878,18 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    if (!fpme)
       goto fail;
 
+   for (i = 0; i < ARRAY_SIZE(fpme->shade_jobs); i++)
+      util_queue_fence_init(&fpme->shade_jobs[i].fence);
+
+   /* read for each context, so benchmarks can vary it */
+   fpme->num_shade_threads = MIN2(debug_get_num_option("DRAW_THREADS", 0),
+                                  LLVM_SHADE_MAX_JOBS);
+   if (fpme->num_shade_threads) {
+      fpme->shade_queue_ok = util_queue_init(&fpme->shade_queue, "draw",
+                                             LLVM_SHADE_MAX_JOBS,
+                                             fpme->num_shade_threads, 0);
+   }
+
    fpme->base.prepare         = llvm_middle_end_prepare;
    fpme->base.bind_parameters = llvm_middle_end_bind_parameters;
    fpme->base.run             = llvm_middle_end_run;
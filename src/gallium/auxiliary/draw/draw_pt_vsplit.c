@@ -23,15 +23,30 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <inttypes.h>
+
 #include "util/u_math.h"
 #include "util/u_memory.h"
 
 #include "draw/draw_context.h"
 #include "draw/draw_private.h"
+#include "draw/draw_fs.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+/*
+ * The llvm middle end takes up to 4096 vertices per run, so segments that
+ * large let the fetch cache below catch reuse over a bigger window of an
+ * indexed draw.  Other middle ends clamp this with max_vertices.
+ */
+#define SEGMENT_SIZE 4096
+
+/*
+ * The fetch cache is direct mapped.  Only the part sized for the current
+ * segment (twice its index count, at least MIN_MAP_SIZE) is used and
+ * cleared, so small draws don't pay for clearing the whole map.
+ */
+#define MAP_SIZE     (2 * SEGMENT_SIZE)
+#define MIN_MAP_SIZE 256
 
 /* The largest possible index within an index buffer */
 #define MAX_ELT_IDX 0xffffffff
@@ -57,17 +72,45 @@ struct vsplit_frontend {
       unsigned fetches[MAP_SIZE];
       ushort draws[MAP_SIZE];
       boolean has_max_fetch;
+      unsigned map_mask;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
    } cache;
+
+   /** Optional triangle reordering of indexed draws, see DRAW_REORDER_TRIS */
+   struct {
+      boolean enabled;
+      /** the index-size specific run function the reordered draw bypasses */
+      void (*run)(struct draw_pt_front_end *frontend,
+                  unsigned start, unsigned count);
+   } reorder;
+
+   /** Indices referenced vs. vertices fetched and shaded, for indexed draws */
+   struct {
+      boolean enabled;
+      uint64_t indices;
+      uint64_t fetches;
+   } stats;
 };
 
 
+DEBUG_GET_ONCE_BOOL_OPTION(draw_reorder_tris, "DRAW_REORDER_TRIS", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vcache_stats, "DRAW_VCACHE_STATS", FALSE)
+
+
+/**
+ * Clear the part of the fetch cache needed for a segment of icount indices.
+ */
 static void
-vsplit_clear_cache(struct vsplit_frontend *vsplit)
+vsplit_clear_cache(struct vsplit_frontend *vsplit, unsigned icount)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
+   unsigned map_size = util_next_power_of_two(MAX2(icount * 2, MIN_MAP_SIZE));
+
+   map_size = MIN2(map_size, MAP_SIZE);
+   memset(vsplit->cache.fetches, 0xff,
+          map_size * sizeof(vsplit->cache.fetches[0]));
+   vsplit->cache.map_mask = map_size - 1;
    vsplit->cache.has_max_fetch = FALSE;
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
@@ -76,6 +119,11 @@ vsplit_clear_cache(struct vsplit_frontend *vsplit)
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   if (vsplit->stats.enabled) {
+      vsplit->stats.indices += vsplit->cache.num_draw_elts;
+      vsplit->stats.fetches += vsplit->cache.num_fetch_elts;
+   }
+
    vsplit->middle->run(vsplit->middle,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
@@ -89,7 +137,7 @@ vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch)
 {
    unsigned hash;
 
-   hash = fetch % MAP_SIZE;
+   hash = fetch & vsplit->cache.map_mask;
 
    /* If the value isn't in the cache or it's an overflow due to the
     * element bias */
@@ -127,7 +175,7 @@ vsplit_add_cache_ubyte(struct vsplit_frontend *vsplit, const ubyte *elts,
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
    /* unlike the uint case this can only happen with elt_bias */
    if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
+      unsigned hash = elt_idx & vsplit->cache.map_mask;
       vsplit->cache.fetches[hash] = 0;
       vsplit->cache.has_max_fetch = TRUE;
    }
@@ -144,7 +192,7 @@ vsplit_add_cache_ushort(struct vsplit_frontend *vsplit, const ushort *elts,
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
    /* unlike the uint case this can only happen with elt_bias */
    if (elt_bias && elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
+      unsigned hash = elt_idx & vsplit->cache.map_mask;
       vsplit->cache.fetches[hash] = 0;
       vsplit->cache.has_max_fetch = TRUE;
    }
@@ -169,7 +217,7 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
    elt_idx = (unsigned)((int)(DRAW_GET_IDX(elts, elt_idx)) + elt_bias);
    /* Take care for DRAW_MAX_FETCH_IDX (since cache is initialized to -1). */
    if (elt_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = elt_idx % MAP_SIZE;
+      unsigned hash = elt_idx & vsplit->cache.map_mask;
       /* force update - any value will do except DRAW_MAX_FETCH_IDX */
       vsplit->cache.fetches[hash] = 0;
       vsplit->cache.has_max_fetch = TRUE;
@@ -197,6 +245,244 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
 #include "draw_pt_vsplit_tmp.h"
 
 
+/*
+ * Vertex cache size the triangle reordering optimizes for.  Roughly what
+ * a single segment of the fetch cache can exploit without the reordered
+ * stream getting split too often.
+ */
+#define REORDER_CACHE_SIZE 32
+
+
+/**
+ * Reorder the triangles of an index list for post-transform vertex reuse,
+ * using the "Tipsify" algorithm from Sander, Nehab and Barczak, "Fast
+ * Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007.
+ *
+ * \param elts  num_tris * 3 indices, all in [0, num_verts)
+ * \param out   receives the reordered num_tris * 3 indices
+ * \return FALSE if out of memory
+ */
+static boolean
+vsplit_tipsify(const unsigned *elts, unsigned num_tris, unsigned num_verts,
+               unsigned *out)
+{
+   const unsigned num_elts = num_tris * 3;
+   unsigned *adj_offset, *adj, *live, *cache_time;
+   unsigned *dead_end, *candidates;
+   ubyte *emitted;
+   unsigned num_dead_end = 0, num_out = 0;
+   unsigned time = REORDER_CACHE_SIZE + 1;
+   unsigned cursor = 0;
+   int fan;
+   unsigned i;
+
+   adj_offset = MALLOC((num_verts + 1) * sizeof *adj_offset);
+   live = CALLOC(num_verts, sizeof *live);
+   cache_time = CALLOC(num_verts, sizeof *cache_time);
+   adj = MALLOC(num_elts * sizeof *adj);
+   dead_end = MALLOC(num_elts * sizeof *dead_end);
+   candidates = MALLOC(num_elts * sizeof *candidates);
+   emitted = CALLOC(num_tris, sizeof *emitted);
+   if (!adj_offset || !live || !cache_time || !adj || !dead_end ||
+       !candidates || !emitted) {
+      FREE(adj_offset);
+      FREE(live);
+      FREE(cache_time);
+      FREE(adj);
+      FREE(dead_end);
+      FREE(candidates);
+      FREE(emitted);
+      return FALSE;
+   }
+
+   /* vertex -> triangle adjacency, in CSR form */
+   for (i = 0; i < num_elts; i++)
+      live[elts[i]]++;
+   adj_offset[0] = 0;
+   for (i = 0; i < num_verts; i++)
+      adj_offset[i + 1] = adj_offset[i] + live[i];
+   for (i = 0; i < num_elts; i++)
+      adj[adj_offset[elts[i]]++] = i / 3;
+   for (i = num_verts; i > 0; i--)
+      adj_offset[i] = adj_offset[i - 1];
+   adj_offset[0] = 0;
+
+   fan = 0;
+   while (fan >= 0) {
+      unsigned num_candidates = 0;
+      int best_priority = -1;
+      int next = -1;
+
+      /* emit all remaining triangles around the fanning vertex */
+      for (i = adj_offset[fan]; i < adj_offset[fan + 1]; i++) {
+         const unsigned tri = adj[i];
+         unsigned k;
+
+         if (emitted[tri])
+            continue;
+         emitted[tri] = 1;
+
+         for (k = 0; k < 3; k++) {
+            const unsigned v = elts[tri * 3 + k];
+
+            out[num_out++] = v;
+            dead_end[num_dead_end++] = v;
+            candidates[num_candidates++] = v;
+            live[v]--;
+            if (time - cache_time[v] > REORDER_CACHE_SIZE)
+               cache_time[v] = time++;
+         }
+      }
+
+      /* prefer the candidate that stays in the cache the longest while
+       * its remaining triangles get emitted */
+      for (i = 0; i < num_candidates; i++) {
+         const unsigned v = candidates[i];
+         int priority = 0;
+
+         if (!live[v])
+            continue;
+         if (time - cache_time[v] + 2 * live[v] <= REORDER_CACHE_SIZE)
+            priority = time - cache_time[v];
+         if (priority > best_priority) {
+            best_priority = priority;
+            next = v;
+         }
+      }
+
+      if (next < 0) {
+         /* dead end: fall back to a recently used vertex, then to the
+          * next vertex in input order that still has triangles */
+         while (num_dead_end > 0) {
+            const unsigned v = dead_end[--num_dead_end];
+            if (live[v]) {
+               next = v;
+               break;
+            }
+         }
+         while (next < 0 && cursor < num_verts) {
+            if (live[cursor])
+               next = cursor;
+            cursor++;
+         }
+      }
+
+      fan = next;
+   }
+
+   assert(num_out == num_elts);
+
+   FREE(adj_offset);
+   FREE(live);
+   FREE(cache_time);
+   FREE(adj);
+   FREE(dead_end);
+   FREE(candidates);
+   FREE(emitted);
+   return TRUE;
+}
+
+
+/**
+ * Run function for indexed triangle lists with DRAW_REORDER_TRIS.
+ * The reordered indices are drawn through the uint path, falling back to
+ * the original order when the draw doesn't qualify.
+ */
+static void
+vsplit_run_reordered(struct draw_pt_front_end *frontend,
+                     unsigned start, unsigned count)
+{
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+   struct draw_context *draw = vsplit->draw;
+   const unsigned min_index = draw->pt.user.min_index;
+   const unsigned max_index = draw->pt.user.max_index;
+   const unsigned num_tris = count / 3;
+   const unsigned num_elts = num_tris * 3;
+   const void *saved_elts = draw->pt.user.elts;
+   const unsigned saved_elt_size = draw->pt.user.eltSize;
+   const unsigned saved_elt_max = draw->pt.user.eltMax;
+   unsigned num_verts;
+   unsigned *elts, *reordered;
+   unsigned i;
+
+   /* too small to matter, or too sparse an index range for the per-vertex
+    * arrays to be worth it */
+   if (num_tris < 2 * REORDER_CACHE_SIZE || max_index < min_index ||
+       max_index - min_index >= 4 * num_elts ||
+       start + count < start) {
+      vsplit->reorder.run(frontend, start, count);
+      return;
+   }
+   num_verts = max_index - min_index + 1;
+
+   elts = MALLOC(2 * num_elts * sizeof *elts);
+   if (!elts) {
+      vsplit->reorder.run(frontend, start, count);
+      return;
+   }
+   reordered = elts + num_elts;
+
+   for (i = 0; i < num_elts; i++) {
+      unsigned idx;
+
+      switch (saved_elt_size) {
+      case 1:
+         idx = DRAW_GET_IDX((const ubyte *) saved_elts, start + i);
+         break;
+      case 2:
+         idx = DRAW_GET_IDX((const ushort *) saved_elts, start + i);
+         break;
+      default:
+         idx = DRAW_GET_IDX((const uint *) saved_elts, start + i);
+         break;
+      }
+
+      if (idx < min_index || idx > max_index)
+         break;
+      elts[i] = idx - min_index;
+   }
+
+   if (i < num_elts ||
+       !vsplit_tipsify(elts, num_tris, num_verts, reordered)) {
+      FREE(elts);
+      vsplit->reorder.run(frontend, start, count);
+      return;
+   }
+
+   for (i = 0; i < num_elts; i++)
+      reordered[i] += min_index;
+
+   draw->pt.user.elts = reordered;
+   draw->pt.user.eltSize = 4;
+   draw->pt.user.eltMax = num_elts;
+
+   vsplit_run_uint(frontend, 0, num_elts);
+
+   draw->pt.user.elts = saved_elts;
+   draw->pt.user.eltSize = saved_elt_size;
+   draw->pt.user.eltMax = saved_elt_max;
+
+   FREE(elts);
+}
+
+
+/**
+ * Reordering changes the order triangles get rasterized, written to
+ * stream-out buffers and numbered in, so only do it when none of that
+ * shows.
+ */
+static boolean
+vsplit_can_reorder(const struct draw_context *draw)
+{
+   const struct draw_fragment_shader *fs = draw->fs.fragment_shader;
+
+   return !draw->blend &&
+          !draw->gs.geometry_shader &&
+          !draw->so.num_targets &&
+          !(fs && fs->info.uses_primid);
+}
+
+
 static void vsplit_prepare(struct draw_pt_front_end *frontend,
                            unsigned in_prim,
                            struct draw_pt_middle_end *middle,
@@ -222,6 +508,12 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
       break;
    }
 
+   if (vsplit->reorder.enabled && in_prim == PIPE_PRIM_TRIANGLES &&
+       vsplit->draw->pt.user.eltSize && vsplit_can_reorder(vsplit->draw)) {
+      vsplit->reorder.run = vsplit->base.run;
+      vsplit->base.run = vsplit_run_reordered;
+   }
+
    /* split only */
    vsplit->prim = in_prim;
 
@@ -245,6 +537,16 @@ static void vsplit_flush(struct draw_pt_front_end *frontend, unsigned flags)
 
 static void vsplit_destroy(struct draw_pt_front_end *frontend)
 {
+   struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+
+   if (vsplit->stats.enabled && vsplit->stats.indices) {
+      debug_printf("draw: %" PRIu64 " indices, %" PRIu64 " vertices shaded, "
+                   "%.1f%% of vertex shader invocations saved\n",
+                   vsplit->stats.indices, vsplit->stats.fetches,
+                   100.0 * (1.0 - (double) vsplit->stats.fetches /
+                                  vsplit->stats.indices));
+   }
+
    FREE(frontend);
 }
 
@@ -262,6 +564,8 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    vsplit->base.flush   = vsplit_flush;
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
+   vsplit->reorder.enabled = debug_get_option_draw_reorder_tris();
+   vsplit->stats.enabled = debug_get_option_draw_vcache_stats();
 
    for (i = 0; i < SEGMENT_SIZE; i++)
       vsplit->identity_draw_elts[i] = i;
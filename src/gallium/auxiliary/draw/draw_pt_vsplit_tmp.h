@@ -117,6 +117,11 @@ CONCAT(vsplit_primitive_, ELT_TYPE)(struct vsplit_frontend *vsplit,
       draw_elts = vsplit->draw_elts;
    }
 
+   if (vsplit->stats.enabled) {
+      vsplit->stats.indices += icount;
+      vsplit->stats.fetches += fetch_count;
+   }
+
    return vsplit->middle->run_linear_elts(vsplit->middle,
                                           fetch_start, fetch_count,
                                           draw_elts, icount, 0x0);
@@ -142,7 +147,7 @@ CONCAT(vsplit_segment_cache_, ELT_TYPE)(struct vsplit_frontend *vsplit,
 
    assert(icount + !!close <= vsplit->segment_size);
 
-   vsplit_clear_cache(vsplit);
+   vsplit_clear_cache(vsplit, icount + !!close);
 
    spoken = !!spoken;
    if (ibias == 0) {
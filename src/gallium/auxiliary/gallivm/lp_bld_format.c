@@ -26,7 +26,17 @@
  **************************************************************************/
 
 
+#include "util/format/u_format.h"
+#include "util/u_math.h"
+#include "util/u_string.h"
+
+#include "lp_bld_const.h"
+#include "lp_bld_flow.h"
 #include "lp_bld_format.h"
+#include "lp_bld_init.h"
+#include "lp_bld_intr.h"
+#include "lp_bld_struct.h"
+#include "lp_bld_type.h"
 
 
 
@@ -42,15 +52,308 @@ lp_build_format_cache_type(struct gallivm_state *gallivm)
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_TAGS] =
          LLVMArrayType(LLVMInt64TypeInContext(gallivm->context),
                        LP_BUILD_FORMAT_CACHE_SIZE);
-#if LP_BUILD_FORMAT_CACHE_DEBUG
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL] =
          LLVMInt64TypeInContext(gallivm->context);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS] =
          LLVMInt64TypeInContext(gallivm->context);
-#endif
 
    s = LLVMStructTypeInContext(gallivm->context, elem_types,
                                LP_BUILD_FORMAT_CACHE_MEMBER_COUNT, 0);
 
    return s;
 }
+
+
+/**
+ * Whether texels of this format can be fetched through the block cache.
+ *
+ * Besides S3TC, which has its own LLVM block decoder, this covers the
+ * 4x4 block compressed formats whose blocks the util_format code can
+ * unpack to exact 8 bit unorm values (RGTC/LATC unorm, ETC1, BPTC unorm).
+ * sRGB variants qualify through their linear counterpart, the sRGB
+ * conversion is done after the lookup.
+ */
+boolean
+lp_build_format_cache_supported(const struct util_format_description *format_desc)
+{
+   const struct util_format_description *linear_desc;
+
+   if (format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC)
+      return TRUE;
+
+   if (format_desc->layout == UTIL_FORMAT_LAYOUT_PLAIN ||
+       format_desc->layout == UTIL_FORMAT_LAYOUT_SUBSAMPLED ||
+       format_desc->block.width != 4 ||
+       format_desc->block.height != 4)
+      return FALSE;
+
+   linear_desc = util_format_description(util_format_linear(format_desc->format));
+
+   return linear_desc->unpack_rgba_8unorm &&
+          util_format_fits_8unorm(linear_desc);
+}
+
+
+/**
+ * Unpack one block into the cache, on a miss.  Called from generated code.
+ */
+static void
+format_cache_fill_block(const struct util_format_description *format_desc,
+                        const uint8_t *src,
+                        unsigned hash_index,
+                        struct lp_build_format_cache *cache)
+{
+   uint8_t rgba[4][4][4];
+   unsigned x, y;
+
+   format_desc->unpack_rgba_8unorm(&rgba[0][0][0], sizeof rgba[0],
+                                   src, 0, 4, 4);
+
+   /* the cache is indexed by i * 4 + j */
+   for (y = 0; y < 4; y++) {
+      for (x = 0; x < 4; x++) {
+         memcpy(&cache->cache_data[hash_index][x][y], rgba[y][x],
+                sizeof(uint32_t));
+      }
+   }
+
+   cache->cache_tags[hash_index] = (uintptr_t)src;
+}
+
+
+static void
+format_cache_fill_block_c(struct gallivm_state *gallivm,
+                          const struct util_format_description *format_desc,
+                          LLVMValueRef ptr_addr,
+                          LLVMValueRef hash_index,
+                          LLVMValueRef cache)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef pi8t = LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMTypeRef ret_type, function_type;
+   LLVMTypeRef arg_types[4];
+   LLVMValueRef function, args[4];
+   char name[64];
+
+   /*
+    * Function to call looks like:
+    *   fill(const format_desc *desc, const uint8_t *src, unsigned hash_index,
+    *        struct lp_build_format_cache *cache)
+    */
+   ret_type = LLVMVoidTypeInContext(gallivm->context);
+   arg_types[0] = pi8t;
+   arg_types[1] = pi8t;
+   arg_types[2] = LLVMInt32TypeInContext(gallivm->context);
+   arg_types[3] = LLVMTypeOf(cache);
+   function_type = LLVMFunctionType(ret_type, arg_types,
+                                    ARRAY_SIZE(arg_types), 0);
+
+   function = gallivm_host_symbol(gallivm, "format_cache_fill_block",
+      func_to_pointer((func_pointer) format_cache_fill_block),
+      function_type);
+
+   snprintf(name, sizeof name, "util_format_%s_description",
+            format_desc->short_name);
+   args[0] = gallivm_host_symbol(gallivm, name, format_desc,
+                                 LLVMInt8TypeInContext(gallivm->context));
+   args[1] = ptr_addr;
+   args[2] = hash_index;
+   args[3] = cache;
+
+   LLVMBuildCall(builder, function, args, ARRAY_SIZE(args), "");
+}
+
+
+static LLVMValueRef
+format_cache_lookup_pixel(struct gallivm_state *gallivm,
+                          LLVMValueRef ptr,
+                          LLVMValueRef index)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef member_ptr, indices[3];
+
+   indices[0] = lp_build_const_int32(gallivm, 0);
+   indices[1] = lp_build_const_int32(gallivm, LP_BUILD_FORMAT_CACHE_MEMBER_DATA);
+   indices[2] = index;
+   member_ptr = LLVMBuildGEP(builder, ptr, indices, ARRAY_SIZE(indices), "");
+   return LLVMBuildLoad(builder, member_ptr, "cache_data");
+}
+
+
+static LLVMValueRef
+format_cache_lookup_tag_data(struct gallivm_state *gallivm,
+                             LLVMValueRef ptr,
+                             LLVMValueRef index)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef member_ptr, indices[3];
+
+   indices[0] = lp_build_const_int32(gallivm, 0);
+   indices[1] = lp_build_const_int32(gallivm, LP_BUILD_FORMAT_CACHE_MEMBER_TAGS);
+   indices[2] = index;
+   member_ptr = LLVMBuildGEP(builder, ptr, indices, ARRAY_SIZE(indices), "");
+   return LLVMBuildLoad(builder, member_ptr, "tag_data");
+}
+
+
+static void
+format_cache_update_access(struct gallivm_state *gallivm,
+                           LLVMValueRef ptr,
+                           unsigned count,
+                           unsigned index)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef member_ptr, cache_access;
+
+   assert(index == LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL ||
+          index == LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
+
+   member_ptr = lp_build_struct_get_ptr(gallivm, ptr, index, "");
+   cache_access = LLVMBuildLoad(builder, member_ptr, "cache_access");
+   cache_access = LLVMBuildAdd(builder, cache_access,
+                               LLVMConstInt(LLVMInt64TypeInContext(gallivm->context),
+                                                                   count, 0), "");
+   LLVMBuildStore(builder, cache_access, member_ptr);
+}
+
+
+/**
+ * Fetch texels of a 4x4 block format through the block cache.
+ *
+ * The cache is direct mapped, tagged with the address of the block.  On
+ * a miss the block is decoded by fill, or by the util_format unpack
+ * function if fill is NULL, which must store the tag as well.
+ *
+ * @param n  number of pixels processed (1 or a multiple of 4)
+ * @param offset <n x i32> vector with the relative offsets of the blocks
+ * @param i  is a <n x i32> vector with the x subpixel coordinate (0..3)
+ * @param j  is a <n x i32> vector with the y subpixel coordinate (0..3)
+ * @return  a <4*n x i8> vector with the pixel RGBA values in AoS
+ */
+LLVMValueRef
+lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
+                             const struct util_format_description *format_desc,
+                             unsigned n,
+                             LLVMValueRef base_ptr,
+                             LLVMValueRef offset,
+                             LLVMValueRef i,
+                             LLVMValueRef j,
+                             LLVMValueRef cache,
+                             lp_build_format_cache_fill_func fill)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   unsigned count, low_bit, log2size;
+   LLVMValueRef color, offset_stored, addr, ptr_addrtrunc, tmp;
+   LLVMValueRef ij_index, hash_index, hash_mask, block_index;
+   LLVMTypeRef i8t = LLVMInt8TypeInContext(gallivm->context);
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef i64t = LLVMInt64TypeInContext(gallivm->context);
+   struct lp_type type;
+   struct lp_build_context bld32;
+
+   assert(format_desc->block.width == 4);
+   assert(format_desc->block.height == 4);
+
+   if (!fill)
+      fill = format_cache_fill_block_c;
+
+   memset(&type, 0, sizeof type);
+   type.width = 32;
+   type.length = n;
+
+   lp_build_context_init(&bld32, gallivm, type);
+
+   /*
+    * compute hash - we use direct mapped cache, the hash function could
+    *                be better but it needs to be simple
+    * per-element:
+    *    compare offset with offset stored at tag (hash)
+    *    if not equal extract block, store block, update tag
+    *    extract color from cache
+    *    assemble colors
+    */
+
+   low_bit = util_logbase2(format_desc->block.bits / 8);
+   log2size = util_logbase2(LP_BUILD_FORMAT_CACHE_SIZE);
+   addr = LLVMBuildPtrToInt(builder, base_ptr, i64t, "");
+   ptr_addrtrunc = LLVMBuildPtrToInt(builder, base_ptr, i32t, "");
+   ptr_addrtrunc = lp_build_broadcast_scalar(&bld32, ptr_addrtrunc);
+   /* For the hash function, first mask off the unused lowest bits. Then just
+      do some xor with address bits - only use lower 32bits */
+   ptr_addrtrunc = LLVMBuildAdd(builder, offset, ptr_addrtrunc, "");
+   ptr_addrtrunc = LLVMBuildLShr(builder, ptr_addrtrunc,
+                                 lp_build_const_int_vec(gallivm, type, low_bit), "");
+   /* This only really makes sense for size 64,128,256 */
+   hash_index = ptr_addrtrunc;
+   ptr_addrtrunc = LLVMBuildLShr(builder, ptr_addrtrunc,
+                                 lp_build_const_int_vec(gallivm, type, 2*log2size), "");
+   hash_index = LLVMBuildXor(builder, ptr_addrtrunc, hash_index, "");
+   tmp = LLVMBuildLShr(builder, hash_index,
+                       lp_build_const_int_vec(gallivm, type, log2size), "");
+   hash_index = LLVMBuildXor(builder, hash_index, tmp, "");
+
+   hash_mask = lp_build_const_int_vec(gallivm, type, LP_BUILD_FORMAT_CACHE_SIZE - 1);
+   hash_index = LLVMBuildAnd(builder, hash_index, hash_mask, "");
+   ij_index = LLVMBuildShl(builder, i, lp_build_const_int_vec(gallivm, type, 2), "");
+   ij_index = LLVMBuildAdd(builder, ij_index, j, "");
+   block_index = LLVMBuildShl(builder, hash_index,
+                              lp_build_const_int_vec(gallivm, type, 4), "");
+   block_index = LLVMBuildAdd(builder, ij_index, block_index, "");
+
+   if (n > 1) {
+      color = bld32.undef;
+      for (count = 0; count < n; count++) {
+         LLVMValueRef index, cond, colorx;
+         LLVMValueRef block_indexx, hash_indexx, addrx, offsetx, ptr_addrx;
+         struct lp_build_if_state if_ctx;
+
+         index = lp_build_const_int32(gallivm, count);
+         offsetx = LLVMBuildExtractElement(builder, offset, index, "");
+         addrx = LLVMBuildZExt(builder, offsetx, i64t, "");
+         addrx = LLVMBuildAdd(builder, addrx, addr, "");
+         block_indexx = LLVMBuildExtractElement(builder, block_index, index, "");
+         hash_indexx = LLVMBuildLShr(builder, block_indexx,
+                                     lp_build_const_int32(gallivm, 4), "");
+         offset_stored = format_cache_lookup_tag_data(gallivm, cache, hash_indexx);
+         cond = LLVMBuildICmp(builder, LLVMIntNE, offset_stored, addrx, "");
+
+         lp_build_if(&if_ctx, gallivm, cond);
+         {
+            ptr_addrx = LLVMBuildIntToPtr(builder, addrx,
+                                          LLVMPointerType(i8t, 0), "");
+            fill(gallivm, format_desc, ptr_addrx, hash_indexx, cache);
+            format_cache_update_access(gallivm, cache, 1,
+                                       LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
+         }
+         lp_build_endif(&if_ctx);
+
+         colorx = format_cache_lookup_pixel(gallivm, cache, block_indexx);
+
+         color = LLVMBuildInsertElement(builder, color, colorx,
+                                        lp_build_const_int32(gallivm, count), "");
+      }
+   }
+   else {
+      LLVMValueRef cond;
+      struct lp_build_if_state if_ctx;
+
+      tmp = LLVMBuildZExt(builder, offset, i64t, "");
+      addr = LLVMBuildAdd(builder, tmp, addr, "");
+      offset_stored = format_cache_lookup_tag_data(gallivm, cache, hash_index);
+      cond = LLVMBuildICmp(builder, LLVMIntNE, offset_stored, addr, "");
+
+      lp_build_if(&if_ctx, gallivm, cond);
+      {
+         tmp = LLVMBuildIntToPtr(builder, addr, LLVMPointerType(i8t, 0), "");
+         fill(gallivm, format_desc, tmp, hash_index, cache);
+         format_cache_update_access(gallivm, cache, 1,
+                                    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS);
+      }
+      lp_build_endif(&if_ctx);
+
+      color = format_cache_lookup_pixel(gallivm, cache, block_index);
+   }
+   format_cache_update_access(gallivm, cache, n,
+                              LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL);
+   return LLVMBuildBitCast(builder, color, LLVMVectorType(i8t, n * 4), "");
+}
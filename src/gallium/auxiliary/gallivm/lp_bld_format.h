@@ -44,11 +44,12 @@ struct lp_type;
 struct lp_build_context;
 
 
-#define LP_BUILD_FORMAT_CACHE_DEBUG 0
 /*
  * Block cache
  *
- * Optional block cache to be used when unpacking big pixel blocks.
+ * Optional per-thread cache of unpacked 4x4 blocks, for compressed formats
+ * which are expensive to decode per texel (see
+ * lp_build_format_cache_supported()).
  * Must be a power of 2
  */
 
@@ -56,32 +57,55 @@ struct lp_build_context;
 
 /*
  * Note: cache_data needs 16 byte alignment.
+ * cache_access_total/cache_access_miss count texel fetches and block
+ * misses, for tuning.
  */
 struct lp_build_format_cache
 {
    PIPE_ALIGN_VAR(16) uint32_t cache_data[LP_BUILD_FORMAT_CACHE_SIZE][4][4];
    uint64_t cache_tags[LP_BUILD_FORMAT_CACHE_SIZE];
-#if LP_BUILD_FORMAT_CACHE_DEBUG
    uint64_t cache_access_total;
    uint64_t cache_access_miss;
-#endif
 };
 
 
 enum {
    LP_BUILD_FORMAT_CACHE_MEMBER_DATA = 0,
    LP_BUILD_FORMAT_CACHE_MEMBER_TAGS,
-#if LP_BUILD_FORMAT_CACHE_DEBUG
    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL,
    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS,
-#endif
    LP_BUILD_FORMAT_CACHE_MEMBER_COUNT
 };
 
 
+/**
+ * Decode the block at ptr_addr into cache entry hash_index and tag it.
+ */
+typedef void
+(*lp_build_format_cache_fill_func)(struct gallivm_state *gallivm,
+                                   const struct util_format_description *format_desc,
+                                   LLVMValueRef ptr_addr,
+                                   LLVMValueRef hash_index,
+                                   LLVMValueRef cache);
+
+
 LLVMTypeRef
 lp_build_format_cache_type(struct gallivm_state *gallivm);
 
+boolean
+lp_build_format_cache_supported(const struct util_format_description *format_desc);
+
+LLVMValueRef
+lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
+                             const struct util_format_description *format_desc,
+                             unsigned n,
+                             LLVMValueRef base_ptr,
+                             LLVMValueRef offset,
+                             LLVMValueRef i,
+                             LLVMValueRef j,
+                             LLVMValueRef cache,
+                             lp_build_format_cache_fill_func fill);
+
 
 /*
  * AoS
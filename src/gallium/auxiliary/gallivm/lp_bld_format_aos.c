@@ -753,6 +753,33 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
        return tmp;
    }
 
+   /*
+    * Other block compressed formats, unpacked a block at a time into the
+    * cache rather than decoded again for every texel.  sRGB ones get here
+    * as their linear counterpart from lp_build_fetch_rgba_soa.
+    */
+
+   if (cache && lp_build_format_cache_supported(format_desc) &&
+       format_desc->colorspace != UTIL_FORMAT_COLORSPACE_SRGB) {
+      struct lp_type tmp_type;
+      LLVMValueRef tmp;
+
+      memset(&tmp_type, 0, sizeof tmp_type);
+      tmp_type.width = 8;
+      tmp_type.length = num_pixels * 4;
+      tmp_type.norm = TRUE;
+
+      tmp = lp_build_fetch_cached_texels(gallivm, format_desc, num_pixels,
+                                         base_ptr, offset, i, j,
+                                         cache, NULL);
+
+      lp_build_conv(gallivm,
+                    tmp_type, type,
+                    &tmp, 1, &tmp, 1);
+
+      return tmp;
+   }
+
    /*
     * Fallback to util_format_description::fetch_rgba_8unorm().
     */
@@ -794,6 +821,7 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
          LLVMTypeRef ret_type;
          LLVMTypeRef arg_types[4];
          LLVMTypeRef function_type;
+         char name[64];
 
          ret_type = LLVMVoidTypeInContext(gallivm->context);
          arg_types[0] = pi8t;
@@ -803,14 +831,12 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
          function_type = LLVMFunctionType(ret_type, arg_types,
                                           ARRAY_SIZE(arg_types), 0);
 
-         /* make const pointer for the C fetch_rgba_8unorm function */
-         function = lp_build_const_int_pointer(gallivm,
-            func_to_pointer((func_pointer) format_desc->fetch_rgba_8unorm));
-
-         /* cast the callee pointer to the function's type */
-         function = LLVMBuildBitCast(builder, function,
-                                     LLVMPointerType(function_type, 0),
-                                     "cast callee");
+         /* declare the C fetch_rgba_8unorm function */
+         snprintf(name, sizeof name, "util_format_%s_fetch_rgba_8unorm",
+                  format_desc->short_name);
+         function = gallivm_host_symbol(gallivm, name,
+            func_to_pointer((func_pointer) format_desc->fetch_rgba_8unorm),
+            function_type);
       }
 
       tmp_ptr = lp_build_alloca(gallivm, i32t, "");
@@ -898,18 +924,22 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
           */
          LLVMTypeRef ret_type;
          LLVMTypeRef arg_types[4];
+         LLVMTypeRef function_type;
+         char name[64];
 
          ret_type = LLVMVoidTypeInContext(gallivm->context);
          arg_types[0] = pf32t;
          arg_types[1] = pi8t;
          arg_types[2] = i32t;
          arg_types[3] = i32t;
+         function_type = LLVMFunctionType(ret_type, arg_types,
+                                          ARRAY_SIZE(arg_types), 0);
 
-         function = lp_build_const_func_pointer(gallivm,
-                                                func_to_pointer((func_pointer) format_desc->fetch_rgba_float),
-                                                ret_type,
-                                                arg_types, ARRAY_SIZE(arg_types),
-                                                format_desc->short_name);
+         snprintf(name, sizeof name, "util_format_%s_fetch_rgba_float",
+                  format_desc->short_name);
+         function = gallivm_host_symbol(gallivm, name,
+            func_to_pointer((func_pointer) format_desc->fetch_rgba_float),
+            function_type);
       }
 
       tmp_ptr = lp_build_alloca(gallivm, f32x4t, "");
@@ -28,11 +28,18 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_parse.h"
+#include "nir/nir_serialize.h"
+#include "util/blob.h"
+#include "util/mesa-sha1.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/os_time.h"
+#include "util/u_queue.h"
+#include "util/u_thread.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
@@ -84,6 +91,13 @@ DEBUG_GET_ONCE_FLAGS_OPTION(gallivm_debug, "GALLIVM_DEBUG", lp_bld_debug_flags,
 
 static boolean gallivm_initialized = FALSE;
 
+/**
+ * Worker threads for gallivm_compile_module_async().
+ */
+static struct util_queue compile_queue;
+static boolean compile_queue_ok = FALSE;
+static once_flag compile_queue_once = ONCE_FLAG_INIT;
+
 unsigned lp_native_vector_width;
 
 
@@ -128,14 +142,6 @@ create_pass_manager(struct gallivm_state *gallivm)
     * simple, or constant propagation into them, etc.
     */
 
-   {
-      char *td_str;
-      // New ones from the Module.
-      td_str = LLVMCopyStringRepOfTargetData(gallivm->target);
-      LLVMSetDataLayout(gallivm->module, td_str);
-      free(td_str);
-   }
-
 #if GALLIVM_HAVE_CORO
 #if LLVM_VERSION_MAJOR <= 8 && defined(PIPE_ARCH_AARCH64)
    LLVMAddFunctionAttrsPass(gallivm->cgpassmgr);
@@ -145,7 +151,7 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMAddCoroElidePass(gallivm->cgpassmgr);
 #endif
 
-   if ((gallivm_perf & GALLIVM_PERF_NO_OPT) == 0) {
+   if ((gallivm->perf & GALLIVM_PERF_NO_OPT) == 0) {
       /*
        * TODO: Evaluate passes some more - keeping in mind
        * both quality of generated code and compile times.
@@ -186,6 +192,12 @@ create_pass_manager(struct gallivm_state *gallivm)
 }
 
 
+struct gallivm_host_symbol {
+   LLVMValueRef global;
+   const void *ptr;
+};
+
+
 /**
  * Free gallivm object's LLVM allocations, but not any generated code
  * nor the gallivm object itself.
@@ -193,6 +205,9 @@ create_pass_manager(struct gallivm_state *gallivm)
 void
 gallivm_free_ir(struct gallivm_state *gallivm)
 {
+   /* Don't pull the module away from under a compile job */
+   gallivm_wait_compiled(gallivm);
+
    if (gallivm->passmgr) {
       LLVMDisposePassManager(gallivm->passmgr);
    }
@@ -219,7 +234,21 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    if (gallivm->builder)
       LLVMDisposeBuilder(gallivm->builder);
 
-   /* The LLVMContext should be owned by the parent of gallivm. */
+   util_dynarray_fini(&gallivm->host_symbols);
+
+   /* The cache keeps its object data until the engine is gone. */
+   if (gallivm->cache) {
+      if (gallivm->cache->jit_obj_cache)
+         lp_free_objcache(gallivm->cache->jit_obj_cache);
+      free(gallivm->cache->data);
+      gallivm->cache->jit_obj_cache = NULL;
+      gallivm->cache->data = NULL;
+      gallivm->cache->data_size = 0;
+   }
+
+   /* The LLVMContext is owned by the parent of gallivm, unless it's private. */
+   if (gallivm->owns_context && gallivm->context)
+      LLVMContextDispose(gallivm->context);
 
    gallivm->engine = NULL;
    gallivm->target = NULL;
@@ -229,6 +258,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->cache = NULL;
 }
 
 
@@ -255,7 +285,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
       char *error = NULL;
       int ret;
 
-      if (gallivm_perf & GALLIVM_PERF_NO_OPT) {
+      if (gallivm->perf & GALLIVM_PERF_NO_OPT) {
          optlevel = None;
       }
       else {
@@ -267,6 +297,7 @@ init_gallivm_engine(struct gallivm_state *gallivm)
                                                     gallivm->module,
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
+                                                    gallivm->cache,
                                                     &error);
       if (ret) {
          _debug_printf("%s\n", error);
@@ -309,7 +340,7 @@ fail:
  */
 static boolean
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   LLVMContextRef context)
+                   LLVMContextRef context, struct lp_cached_code *cache)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -317,7 +348,17 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    if (!lp_build_init())
       return FALSE;
 
+   util_queue_fence_init(&gallivm->compile_fence);
+
+   if (!context) {
+      context = LLVMContextCreate();
+      gallivm->owns_context = TRUE;
+   }
+
    gallivm->context = context;
+   gallivm->cache = cache;
+   gallivm->perf = gallivm_perf;
+   util_dynarray_init(&gallivm->host_symbols, NULL);
 
    if (!gallivm->context)
       goto fail;
@@ -384,8 +425,13 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
       }
    }
 
-   if (!create_pass_manager(gallivm))
-      goto fail;
+   {
+      char *td_str;
+      // New ones from the Module.
+      td_str = LLVMCopyStringRepOfTargetData(gallivm->target);
+      LLVMSetDataLayout(gallivm->module, td_str);
+      free(td_str);
+   }
 
    return TRUE;
 
@@ -437,12 +483,19 @@ lp_build_init(void)
    /* AMD Bulldozer AVX's throughput is the same as SSE2; and because using
     * 8-wide vector needs more floating ops than 4-wide (due to padding), it is
     * actually more efficient to use 4-wide vectors on this processor.
+    * Zen (family 17h) and later AMD processors with AVX2 don't have that
+    * problem, so they get 8-wide vectors like Intel ones.
+    *
+    * AVX-512 capable processors stay at 256 bits, since fragment shaders
+    * (depth/stencil swizzling and quad masks in particular) only handle
+    * 4 or 8 wide vectors.
     *
     * See also:
     * - http://www.anandtech.com/show/4955/the-bulldozer-review-amd-fx8150-tested/2
     */
    if (util_cpu_caps.has_avx &&
-       util_cpu_caps.has_intel) {
+       (util_cpu_caps.has_intel ||
+        (util_cpu_caps.has_avx2 && util_cpu_caps.x86_cpu_type >= 0x17))) {
       lp_native_vector_width = 256;
    } else {
       /* Leave it at 128, even when no SIMD extensions are available.
@@ -499,15 +552,24 @@ lp_build_init(void)
 
 /**
  * Create a new gallivm_state object.
+ * \param context  LLVM context to build the module in.  If NULL, the object
+ *                 gets a private context, which is what makes it possible to
+ *                 compile it on another thread with
+ *                 gallivm_compile_module_async().
+ * \param cache  optional cached machine code; if it holds data, the module
+ *               is not optimized nor compiled, but the object is loaded
+ *               from it instead.  Otherwise the compiled object is copied
+ *               into it.  The cache data is freed with the IR.
  */
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context)
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache)
 {
    struct gallivm_state *gallivm;
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context)) {
+      if (!init_gallivm_state(gallivm, name, context, cache)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -517,6 +579,40 @@ gallivm_create(const char *name, LLVMContextRef context)
 }
 
 
+/**
+ * Compute the key a shader variant's lp_cached_code is stored under, from
+ * the shader IR (TGSI tokens or serialized NIR), the variant key and any
+ * \p extra data the generated code depends on.
+ */
+void
+lp_build_ir_cache_key(const struct pipe_shader_state *ir,
+                      const void *key, size_t key_size,
+                      const void *extra, size_t extra_size,
+                      unsigned char ir_sha1_cache_key[20])
+{
+   struct mesa_sha1 ctx;
+
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, key, key_size);
+   if (extra_size)
+      _mesa_sha1_update(&ctx, extra, extra_size);
+
+   if (ir->type == PIPE_SHADER_IR_TGSI) {
+      _mesa_sha1_update(&ctx, ir->tokens,
+                        tgsi_num_tokens(ir->tokens) * sizeof(struct tgsi_token));
+   } else {
+      struct blob blob;
+
+      blob_init(&blob);
+      nir_serialize(&blob, ir->ir.nir, true);
+      _mesa_sha1_update(&ctx, blob.data, blob.size);
+      blob_finish(&blob);
+   }
+
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+}
+
+
 /**
  * Destroy a gallivm_state object.
  */
@@ -525,6 +621,7 @@ gallivm_destroy(struct gallivm_state *gallivm)
 {
    gallivm_free_ir(gallivm);
    gallivm_free_code(gallivm);
+   util_queue_fence_destroy(&gallivm->compile_fence);
    FREE(gallivm);
 }
 
@@ -555,22 +652,62 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 
 
 /**
- * Compile a module.
- * This does IR optimization on all functions in the module.
+ * Declare a function or data object of the host process in the module,
+ * under the given name, and return a pointer of the given type to it.
+ *
+ * Unlike an address folded into the IR with lp_build_const_int_pointer(),
+ * the symbol is only resolved when the object gets loaded, so machine code
+ * referencing it may be stored in and reloaded from a shader cache.
  */
-void
-gallivm_compile_module(struct gallivm_state *gallivm)
+LLVMValueRef
+gallivm_host_symbol(struct gallivm_state *gallivm, const char *name,
+                    const void *ptr, LLVMTypeRef type)
 {
-   LLVMValueRef func;
-   int64_t time_begin = 0;
+   LLVMValueRef global;
 
-   assert(!gallivm->compiled);
+   if (LLVMGetTypeKind(type) == LLVMFunctionTypeKind) {
+      global = LLVMGetNamedFunction(gallivm->module, name);
+      if (!global)
+         global = LLVMAddFunction(gallivm->module, name, type);
+   } else {
+      global = LLVMGetNamedGlobal(gallivm->module, name);
+      if (!global)
+         global = LLVMAddGlobal(gallivm->module, type, name);
+   }
 
-   if (gallivm->builder) {
-      LLVMDisposeBuilder(gallivm->builder);
-      gallivm->builder = NULL;
+   if (LLVMIsDeclaration(global)) {
+      bool found = false;
+
+      util_dynarray_foreach(&gallivm->host_symbols,
+                            struct gallivm_host_symbol, sym) {
+         if (sym->global == global) {
+            assert(sym->ptr == ptr);
+            found = true;
+            break;
+         }
+      }
+
+      if (!found) {
+         struct gallivm_host_symbol sym = { global, ptr };
+         util_dynarray_append(&gallivm->host_symbols,
+                              struct gallivm_host_symbol, sym);
+      }
    }
 
+   return LLVMConstBitCast(global, LLVMPointerType(type, 0));
+}
+
+
+/**
+ * Optimize the module and generate its machine code.  Only touches the
+ * gallivm object and its LLVM context, so this may run on any thread.
+ */
+static void
+compile_module(struct gallivm_state *gallivm)
+{
+   LLVMValueRef func;
+   int64_t time_begin = 0;
+
    /* Dump bitcode to a file */
    if (gallivm_debug & GALLIVM_DEBUG_DUMP_BC) {
       char filename[256];
@@ -587,6 +724,18 @@ gallivm_compile_module(struct gallivm_state *gallivm)
                    "[-mattr=<-mattr option(s)>]");
    }
 
+   if (gallivm->cache && gallivm->cache->data_size)
+      goto skip_cached;
+
+   /*
+    * The pass managers are only created now, so that gallivm->perf can
+    * still be adjusted after gallivm_create().
+    */
+   if (!create_pass_manager(gallivm)) {
+      assert(0);
+      return;
+   }
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
@@ -621,6 +770,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
                    gallivm->module_name, time_msec);
    }
 
+skip_cached:
    /* Setting the module's DataLayout to an empty string will cause the
     * ExecutionEngine to copy to the DataLayout string from its target machine
     * to the module.  As of LLVM 3.8 the module and the execution engine are
@@ -645,6 +795,22 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    }
    assert(gallivm->engine);
 
+   util_dynarray_foreach(&gallivm->host_symbols,
+                         struct gallivm_host_symbol, sym) {
+      LLVMAddGlobalMapping(gallivm->engine, sym->global, (void *)sym->ptr);
+   }
+
+   /*
+    * MC-JIT emits the object on the first symbol lookup.  Force that here,
+    * so the code generation happens on the compiling thread rather than in
+    * gallivm_jit_function().
+    */
+   func = LLVMGetFirstFunction(gallivm->module);
+   while (func && LLVMIsDeclaration(func))
+      func = LLVMGetNextFunction(func);
+   if (func)
+      LLVMGetPointerToGlobal(gallivm->engine, func);
+
    ++gallivm->compiled;
 
    if (gallivm_debug & GALLIVM_DEBUG_ASM) {
@@ -681,6 +847,99 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
 
 
+/**
+ * Compile a module.
+ * This does IR optimization on all functions in the module.
+ */
+void
+gallivm_compile_module(struct gallivm_state *gallivm)
+{
+   assert(!gallivm->compiled);
+
+   if (gallivm->builder) {
+      LLVMDisposeBuilder(gallivm->builder);
+      gallivm->builder = NULL;
+   }
+
+   compile_module(gallivm);
+}
+
+
+static void
+compile_queue_init(void)
+{
+   unsigned num_threads = MIN2(util_cpu_caps.nr_cpus, 8);
+
+   num_threads = debug_get_num_option("GALLIVM_COMPILE_THREADS", num_threads);
+   if (num_threads == 0)
+      return;
+
+   compile_queue_ok = util_queue_init(&compile_queue, "gallivm", 64,
+                                      num_threads,
+                                      UTIL_QUEUE_INIT_RESIZE_IF_FULL);
+}
+
+
+static void
+compile_module_job(void *data, int thread_index)
+{
+   compile_module((struct gallivm_state *)data);
+}
+
+
+/**
+ * Like gallivm_compile_module(), but hand the optimization and code
+ * generation to a pool of compiler threads and return right away.
+ * Use gallivm_is_compiled() / gallivm_wait_compiled() before calling
+ * gallivm_jit_function().  No IR may be built in the module after this.
+ *
+ * Only objects with a private LLVM context can be compiled concurrently,
+ * others (or all, with GALLIVM_COMPILE_THREADS=0) are compiled right here.
+ */
+void
+gallivm_compile_module_async(struct gallivm_state *gallivm)
+{
+   assert(!gallivm->compiled);
+   assert(util_queue_fence_is_signalled(&gallivm->compile_fence));
+
+   if (gallivm->builder) {
+      LLVMDisposeBuilder(gallivm->builder);
+      gallivm->builder = NULL;
+   }
+
+   call_once(&compile_queue_once, compile_queue_init);
+
+   if (!gallivm->owns_context || !compile_queue_ok) {
+      compile_module(gallivm);
+      return;
+   }
+
+   util_queue_add_job(&compile_queue, gallivm, &gallivm->compile_fence,
+                      compile_module_job, NULL, 0);
+}
+
+
+/**
+ * Whether the machine code of the module is ready, i.e.
+ * gallivm_jit_function() won't block.
+ */
+boolean
+gallivm_is_compiled(struct gallivm_state *gallivm)
+{
+   return util_queue_fence_is_signalled(&gallivm->compile_fence);
+}
+
+
+/**
+ * Wait for a gallivm_compile_module_async() job to finish.
+ */
+void
+gallivm_wait_compiled(struct gallivm_state *gallivm)
+{
+   util_queue_fence_wait(&gallivm->compile_fence);
+}
+
+
 func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func)
@@ -689,6 +948,8 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    func_pointer jit_func;
    int64_t time_begin = 0;
 
+   gallivm_wait_compiled(gallivm);
+
    assert(gallivm->compiled);
    assert(gallivm->engine);
 
@@ -708,3 +969,14 @@ gallivm_jit_function(struct gallivm_state *gallivm,
 
    return jit_func;
 }
+
+
+/**
+ * Bytes of machine code and data generated for this gallivm's module so
+ * far.  Only meaningful once the functions have been jitted.
+ */
+size_t
+gallivm_code_size(struct gallivm_state *gallivm)
+{
+   return lp_generated_code_size(gallivm->code);
+}
@@ -31,7 +31,9 @@
 
 
 #include "pipe/p_compiler.h"
+#include "util/u_dynarray.h"
 #include "util/u_pointer.h" // for func_pointer
+#include "util/u_queue.h"
 #include "lp_bld.h"
 #include <llvm-c/ExecutionEngine.h>
 
@@ -39,6 +41,26 @@
 extern "C" {
 #endif
 
+/**
+ * Machine code of a compiled module, as stored in / loaded from a shader
+ * disk cache.  When data_size is non-zero on gallivm creation, the object
+ * is loaded instead of running the optimization and code generation passes.
+ */
+struct lp_cached_code {
+   void *data;
+   size_t data_size;
+   bool dont_cache;
+   void *jit_obj_cache;
+};
+
+struct pipe_shader_state;
+
+void
+lp_build_ir_cache_key(const struct pipe_shader_state *ir,
+                      const void *key, size_t key_size,
+                      const void *extra, size_t extra_size,
+                      unsigned char ir_sha1_cache_key[20]);
+
 struct gallivm_state
 {
    char *module_name;
@@ -51,7 +73,18 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_cached_code *cache;
+   /** Host functions and data referenced by name, bound in compile */
+   struct util_dynarray host_symbols;
    unsigned compiled;
+
+   /** GALLIVM_PERF_x flags for this module, defaults to GALLIVM_PERF */
+   unsigned perf;
+
+   /** The context was created by, and is destroyed with, this object */
+   boolean owns_context;
+   /** Signalled once the module has been compiled */
+   struct util_queue_fence compile_fence;
 };
 
 
@@ -60,7 +93,8 @@ lp_build_init(void);
 
 
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context);
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache);
 
 void
 gallivm_destroy(struct gallivm_state *gallivm);
@@ -75,10 +109,26 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 void
 gallivm_compile_module(struct gallivm_state *gallivm);
 
+void
+gallivm_compile_module_async(struct gallivm_state *gallivm);
+
+boolean
+gallivm_is_compiled(struct gallivm_state *gallivm);
+
+void
+gallivm_wait_compiled(struct gallivm_state *gallivm);
+
 func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
 
+size_t
+gallivm_code_size(struct gallivm_state *gallivm);
+
+LLVMValueRef
+gallivm_host_symbol(struct gallivm_state *gallivm, const char *name,
+                    const void *ptr, LLVMTypeRef type);
+
 #ifdef __cplusplus
 }
 #endif
@@ -59,6 +59,7 @@
 #include <llvm/ADT/Triple.h>
 #include <llvm/Analysis/TargetLibraryInfo.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
 #include <llvm/Support/PrettyStackTrace.h>
@@ -88,6 +89,7 @@
 
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_init.h"
 
 namespace {
 
@@ -244,9 +246,11 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
       typedef std::vector<void *> Vec;
       Vec FunctionBody, ExceptionTable;
       BaseMemoryManager *TheMM;
+      size_t Size;  /**< bytes of code and data sections allocated */
 
       GeneratedCode(BaseMemoryManager *MM) {
          TheMM = MM;
+         Size = 0;
       }
 
       ~GeneratedCode() {
@@ -281,6 +285,32 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
          delete (GeneratedCode *) code;
       }
 
+      static size_t getGeneratedCodeSize(struct lp_generated_code *code) {
+         return code ? ((GeneratedCode *) code)->Size : 0;
+      }
+
+      virtual uint8_t *allocateCodeSection(uintptr_t Size,
+                                           unsigned Alignment,
+                                           unsigned SectionID,
+                                           llvm::StringRef SectionName) {
+         code->Size += Size;
+         return DelegatingJITMemoryManager::allocateCodeSection(Size, Alignment,
+                                                                SectionID,
+                                                                SectionName);
+      }
+
+      virtual uint8_t *allocateDataSection(uintptr_t Size,
+                                           unsigned Alignment,
+                                           unsigned SectionID,
+                                           llvm::StringRef SectionName,
+                                           bool IsReadOnly) {
+         code->Size += Size;
+         return DelegatingJITMemoryManager::allocateDataSection(Size, Alignment,
+                                                                SectionID,
+                                                                SectionName,
+                                                                IsReadOnly);
+      }
+
       virtual void deallocateFunctionBody(void *Body) {
          // remember for later deallocation
          code->FunctionBody.push_back(Body);
@@ -288,6 +318,45 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+/*
+ * Object cache handed to MCJIT for modules with a lp_cached_code.
+ * Freshly compiled object code is copied out to the cached code struct so
+ * the caller can store it, and previously stored object code is given back
+ * to MCJIT, which then skips code generation and just links and relocates
+ * the object into our memory manager.
+ */
+class LPObjectCache : public llvm::ObjectCache {
+   struct lp_cached_code *cache_out;
+
+   public:
+      LPObjectCache(struct lp_cached_code *cache) {
+         cache_out = cache;
+      }
+
+      virtual ~LPObjectCache() {
+      }
+
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         if (cache_out->data_size)
+            return;
+         cache_out->data = malloc(Obj.getBufferSize());
+         if (!cache_out->data)
+            return;
+         cache_out->data_size = Obj.getBufferSize();
+         memcpy(cache_out->data, Obj.getBufferStart(), cache_out->data_size);
+      }
+
+      virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) {
+         if (!cache_out->data_size)
+            return nullptr;
+         return llvm::MemoryBuffer::getMemBufferCopy(
+                   llvm::StringRef((const char *)cache_out->data,
+                                   cache_out->data_size));
+      }
+};
+
+
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
@@ -305,6 +374,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMModuleRef M,
                                         LLVMMCJITMemoryManagerRef CMM,
                                         unsigned OptLevel,
+                                        struct lp_cached_code *cache_out,
                                         char **OutError)
 {
    using namespace llvm;
@@ -504,6 +574,11 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT->RegisterJITEventListener(JEL);
 #endif
    if (JIT) {
+      if (cache_out) {
+         LPObjectCache *objcache = new LPObjectCache(cache_out);
+         JIT->setObjectCache(objcache);
+         cache_out->jit_obj_cache = (void *)objcache;
+      }
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -522,6 +597,17 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+
+/**
+ * Number of bytes of machine code and data the JIT allocated for this code.
+ */
+extern "C"
+size_t
+lp_generated_code_size(struct lp_generated_code *code)
+{
+   return ShaderMemoryManager::getGeneratedCodeSize(code);
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
@@ -538,6 +624,14 @@ lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr)
    delete reinterpret_cast<BaseMemoryManager*>(memorymgr);
 }
 
+extern "C"
+void
+lp_free_objcache(void *objcache_ptr)
+{
+   LPObjectCache *objcache = (LPObjectCache *)objcache_ptr;
+   delete objcache;
+}
+
 extern "C" LLVMValueRef
 lp_get_called_value(LLVMValueRef call)
 {
@@ -42,6 +42,7 @@ extern "C" {
 
 
 struct lp_generated_code;
+struct lp_cached_code;
 
 extern LLVMTargetLibraryInfoRef
 gallivm_create_target_library_info(const char *triple);
@@ -59,14 +60,21 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMModuleRef M,
                                         LLVMMCJITMemoryManagerRef MM,
                                         unsigned OptLevel,
+                                        struct lp_cached_code *cache_out,
                                         char **OutError);
 
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
+extern size_t
+lp_generated_code_size(struct lp_generated_code *code);
+
 extern LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager();
 
+extern void
+lp_free_objcache(void *objcache);
+
 extern void
 lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr);
 
@@ -118,6 +118,7 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
    state->pot_height        = util_is_power_of_two_or_zero(texture->height0);
    state->pot_depth         = util_is_power_of_two_or_zero(texture->depth0);
    state->level_zero_only   = !view->u.tex.last_level;
+   state->tiled             = !!(texture->flags & LP_RESOURCE_FLAG_TILED);
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -2058,10 +2059,53 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the x and y offsets of a texel in a LP_RESOURCE_FLAG_TILED
+ * texture.  Both stay separable, which keeps the wrap and border logic
+ * of the callers unchanged:
+ *
+ *   x_offset = (x / 4) * 16 * bpp + (x % 4) * bpp
+ *   y_offset = (y / 4) * 4 * y_stride + (y % 4) * 4 * bpp
+ */
+static void
+lp_build_sample_tiled_offset(struct lp_build_context *bld,
+                             unsigned bytes_per_texel,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef *out_x_offset,
+                             LLVMValueRef *out_y_offset)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef order = lp_build_const_int_vec(gallivm, bld->type,
+                                               LP_TEXTURE_TILE_ORDER);
+   LLVMValueRef mask = lp_build_const_int_vec(gallivm, bld->type,
+                                              LP_TEXTURE_TILE_SIZE - 1);
+   LLVMValueRef tile, sub, tmp;
+
+   tile = LLVMBuildLShr(builder, x, order, "");
+   sub = LLVMBuildAnd(builder, x, mask, "");
+   tile = lp_build_mul_imm(bld, tile, LP_TEXTURE_TILE_SIZE *
+                           LP_TEXTURE_TILE_SIZE * bytes_per_texel);
+   sub = lp_build_mul_imm(bld, sub, bytes_per_texel);
+   *out_x_offset = lp_build_add(bld, tile, sub);
+
+   tile = LLVMBuildLShr(builder, y, order, "");
+   sub = LLVMBuildAnd(builder, y, mask, "");
+   tmp = lp_build_mul(bld, tile, y_stride);
+   tile = LLVMBuildShl(builder, tmp, order, "");
+   sub = lp_build_mul_imm(bld, sub, LP_TEXTURE_TILE_SIZE * bytes_per_texel);
+   *out_y_offset = lp_build_add(bld, tile, sub);
+}
+
+
 /**
  * Compute the offset of a pixel block.
  *
  * x, y, z, y_stride, z_stride are vectors, and they refer to pixels.
+ * tiled selects the LP_RESOURCE_FLAG_TILED layout, which is only used
+ * for formats with 1x1 pixel blocks and textures with at least 2 dims.
  *
  * Returns the relative offset and i,j sub-block coordinates
  */
@@ -2073,6 +2117,7 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef z,
                        LLVMValueRef y_stride,
                        LLVMValueRef z_stride,
+                       boolean tiled,
                        LLVMValueRef *out_offset,
                        LLVMValueRef *out_i,
                        LLVMValueRef *out_j)
@@ -2080,6 +2125,26 @@ lp_build_sample_offset(struct lp_build_context *bld,
    LLVMValueRef x_stride;
    LLVMValueRef offset;
 
+   if (tiled) {
+      LLVMValueRef y_offset;
+
+      assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+      assert(y && y_stride);
+
+      lp_build_sample_tiled_offset(bld, format_desc->block.bits/8,
+                                   x, y, y_stride, &offset, &y_offset);
+      offset = lp_build_add(bld, offset, y_offset);
+      *out_i = bld->zero;
+      *out_j = bld->zero;
+
+      if (z && z_stride) {
+         offset = lp_build_add(bld, offset, lp_build_mul(bld, z, z_stride));
+      }
+
+      *out_offset = offset;
+      return;
+   }
+
    x_stride = lp_build_const_vec(bld->gallivm, bld->type,
                                  format_desc->block.bits/8);
 
@@ -55,6 +55,17 @@ struct lp_type;
 struct lp_build_context;
 
 
+/**
+ * Resource flag for textures stored in 4x4 texel tiles rather than
+ * linearly.  Tiles are laid out left to right and each tile row occupies
+ * four texel rows, so row_stride/img_stride keep their usual meaning.
+ * Within a tile texels are stored row by row.
+ */
+#define LP_RESOURCE_FLAG_TILED (PIPE_RESOURCE_FLAG_DRV_PRIV << 8)
+#define LP_TEXTURE_TILE_ORDER 2
+#define LP_TEXTURE_TILE_SIZE (1 << LP_TEXTURE_TILE_ORDER)
+
+
 /**
  * Helper struct holding all derivatives needed for sampling
  */
@@ -167,6 +178,7 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned tiled:1;         /**< LP_RESOURCE_FLAG_TILED layout */
 };
 
 
@@ -626,6 +638,7 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef z,
                        LLVMValueRef y_stride,
                        LLVMValueRef z_stride,
+                       boolean tiled,
                        LLVMValueRef *out_offset,
                        LLVMValueRef *out_i,
                        LLVMValueRef *out_j);
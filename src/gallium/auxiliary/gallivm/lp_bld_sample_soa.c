@@ -141,6 +141,7 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
                           x, y, z, y_stride, z_stride,
+                          bld->static_texture_state->tiled,
                           &offset, &i, &j);
    if (mipoffsets) {
       offset = lp_build_add(&bld->int_coord_bld, offset, mipoffsets);
@@ -2691,6 +2692,7 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
    lp_build_sample_offset(int_coord_bld,
                           bld->format_desc,
                           x, y, z, row_stride_vec, img_stride_vec,
+                          bld->static_texture_state->tiled,
                           &offset, &i, &j);
 
    if (bld->static_texture_state->target != PIPE_BUFFER) {
@@ -3135,6 +3137,11 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
          use_aos = 0;
       }
 
+      /* the AoS path computes linear offsets only */
+      if (static_texture_state->tiled) {
+         use_aos = 0;
+      }
+
       if (dims > 1) {
          use_aos &= lp_is_simple_wrap_mode(derived_sampler_state.wrap_t);
          if (dims > 2) {
@@ -3456,7 +3463,7 @@ lp_build_sample_gen_func(struct gallivm_state *gallivm,
    if (dynamic_state->cache_ptr) {
       const struct util_format_description *format_desc;
       format_desc = util_format_description(static_texture_state->format);
-      if (format_desc && format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+      if (format_desc && lp_build_format_cache_supported(format_desc)) {
          need_cache = TRUE;
       }
    }
@@ -3571,7 +3578,7 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
    if (dynamic_state->cache_ptr) {
       const struct util_format_description *format_desc;
       format_desc = util_format_description(static_texture_state->format);
-      if (format_desc && format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+      if (format_desc && lp_build_format_cache_supported(format_desc)) {
          need_cache = TRUE;
       }
    }
@@ -4096,7 +4103,7 @@ lp_build_img_op_soa(const struct lp_static_texture_state *static_texture_state,
    lp_build_sample_offset(&int_coord_bld,
                           format_desc,
                           x, y, z, row_stride_vec, img_stride_vec,
-                          &offset, &i, &j);
+                          FALSE, &offset, &i, &j);
 
    if (params->img_op == LP_IMG_LOAD) {
       struct lp_type texel_type = params->type;
@@ -0,0 +1,232 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "util/u_debug.h"
+#include "lp_bld_debug.h"
+#include "lp_bld_variant_cache.h"
+
+
+/**
+ * Initialize an empty cache, with the same max_count for every stage.
+ */
+void
+lp_variant_cache_init(struct lp_variant_cache *cache,
+                      uint64_t budget,
+                      unsigned max_count)
+{
+   unsigned stage;
+
+   list_inithead(&cache->lru);
+   cache->budget = budget;
+   for (stage = 0; stage < PIPE_SHADER_TYPES; stage++)
+      cache->max_count[stage] = max_count;
+   memset(&cache->stats, 0, sizeof cache->stats);
+}
+
+
+void
+lp_variant_cache_set_max_count(struct lp_variant_cache *cache,
+                               enum pipe_shader_type stage,
+                               unsigned max_count)
+{
+   assert(stage < PIPE_SHADER_TYPES);
+   cache->max_count[stage] = max_count;
+}
+
+
+void
+lp_variant_cache_item_init(struct lp_variant_cache_item *item,
+                           lp_variant_cache_evict_func evict,
+                           enum pipe_shader_type stage,
+                           void *variant, void *owner)
+{
+   assert(stage < PIPE_SHADER_TYPES);
+   list_inithead(&item->head);
+   item->cache = NULL;
+   item->size = 0;
+   item->evict = evict;
+   item->stage = stage;
+   item->variant = variant;
+   item->owner = owner;
+}
+
+
+/**
+ * Add a freshly compiled variant, as the most recently used one.  This
+ * counts as a miss.  Making room is left to lp_variant_cache_evict(), as
+ * only the caller knows when in-flight work has finished with the older
+ * variants.
+ */
+void
+lp_variant_cache_insert(struct lp_variant_cache *cache,
+                        struct lp_variant_cache_item *item)
+{
+   assert(!item->cache);
+
+   item->cache = cache;
+   list_add(&item->head, &cache->lru);
+
+   cache->stats.misses++;
+   cache->stats.count++;
+   cache->stats.stage_count[item->stage]++;
+   cache->stats.bytes += item->size;
+}
+
+
+/**
+ * Update the code size of a variant, which is only known once its code
+ * has been generated, possibly after it was inserted.
+ */
+void
+lp_variant_cache_set_size(struct lp_variant_cache_item *item,
+                          size_t size)
+{
+   struct lp_variant_cache *cache = item->cache;
+
+   if (cache) {
+      assert(cache->stats.bytes >= item->size);
+      cache->stats.bytes -= item->size;
+      cache->stats.bytes += size;
+   }
+   item->size = size;
+}
+
+
+/**
+ * Take a variant out of its cache, if any.  Called when the variant is
+ * destroyed, whether through eviction or because its shader is deleted.
+ */
+void
+lp_variant_cache_remove(struct lp_variant_cache_item *item)
+{
+   struct lp_variant_cache *cache = item->cache;
+
+   if (!cache)
+      return;
+
+   assert(cache->stats.count > 0);
+   assert(cache->stats.stage_count[item->stage] > 0);
+   assert(cache->stats.bytes >= item->size);
+   cache->stats.count--;
+   cache->stats.stage_count[item->stage]--;
+   cache->stats.bytes -= item->size;
+
+   list_delinit(&item->head);
+   item->cache = NULL;
+}
+
+
+/**
+ * Whether a stage reached its count cap or, for 'target', is still above
+ * the count eviction brings it down to.
+ */
+static inline boolean
+stage_over_count(const struct lp_variant_cache *cache,
+                 enum pipe_shader_type stage, boolean target)
+{
+   const unsigned max_count = cache->max_count[stage];
+   const unsigned count = cache->stats.stage_count[stage];
+
+   if (!max_count)
+      return FALSE;
+
+   return target ? count > max_count - max_count / 16 : count >= max_count;
+}
+
+
+boolean
+lp_variant_cache_over_budget(const struct lp_variant_cache *cache)
+{
+   unsigned stage;
+
+   if (cache->budget && cache->stats.bytes > cache->budget)
+      return TRUE;
+
+   for (stage = 0; stage < PIPE_SHADER_TYPES; stage++) {
+      if (stage_over_count(cache, stage, FALSE))
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+
+/**
+ * Free least recently used variants until the cache is comfortably below
+ * its limits, so that we don't end up evicting on every new variant.
+ * Variants whose owner refuses eviction (because they are still in use)
+ * are skipped.
+ *
+ * \return number of variants freed
+ */
+unsigned
+lp_variant_cache_evict(struct lp_variant_cache *cache)
+{
+   uint64_t bytes_target = cache->budget - cache->budget / 16;
+   struct list_head *pos = cache->lru.prev;
+   unsigned evicted = 0;
+
+   while (pos != &cache->lru) {
+      struct lp_variant_cache_item *item =
+         LIST_ENTRY(struct lp_variant_cache_item, pos, head);
+      /* the callback unlinks the item */
+      struct list_head *prev = pos->prev;
+      boolean over_bytes = cache->budget && cache->stats.bytes > bytes_target;
+      boolean over_count = FALSE;
+      unsigned stage;
+
+      for (stage = 0; stage < PIPE_SHADER_TYPES; stage++)
+         over_count |= stage_over_count(cache, stage, TRUE);
+
+      if (!over_bytes && !over_count)
+         break;
+
+      /* only the code size budget is shared between the stages */
+      if (!over_bytes && !stage_over_count(cache, item->stage, TRUE)) {
+         pos = prev;
+         continue;
+      }
+
+      if (item->evict(item)) {
+         assert(!item->cache);
+         cache->stats.evictions++;
+         evicted++;
+      }
+
+      pos = prev;
+   }
+
+   if (evicted && (gallivm_debug & GALLIVM_DEBUG_PERF)) {
+      debug_printf("Evicted %u shader variants, %u left using %u KB\n",
+                   evicted, cache->stats.count,
+                   (unsigned)(cache->stats.bytes / 1024));
+   }
+
+   return evicted;
+}
@@ -0,0 +1,160 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * LRU cache of JIT compiled shader variants with a budget on the bytes
+ * of generated code.
+ *
+ * The cache doesn't know about the variants themselves.  Each variant
+ * embeds a lp_variant_cache_item, and the cache calls back into the owner
+ * to free the least recently used ones.  Several shader stages, possibly
+ * owned by different modules (llvmpipe fragment/compute shaders and the
+ * draw module's vertex/geometry shaders), can share one cache, so there is
+ * a single LRU order and a single budget.  The number of variants is
+ * capped per stage, so that one stage churning through variants can't
+ * push out all the others.
+ *
+ * Not thread safe: all calls must come from the thread owning the
+ * context(s) using the cache.
+ */
+
+#ifndef LP_BLD_VARIANT_CACHE_H
+#define LP_BLD_VARIANT_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "pipe/p_defines.h"
+#include "util/list.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct lp_variant_cache;
+struct lp_variant_cache_item;
+
+
+/**
+ * Free the variant owning the item.  It must remove the item from the
+ * cache with lp_variant_cache_remove().  Return FALSE, without freeing
+ * anything, if the variant is still in use and can't be freed right now.
+ */
+typedef boolean
+(*lp_variant_cache_evict_func)(struct lp_variant_cache_item *item);
+
+
+struct lp_variant_cache_item
+{
+   struct list_head head;
+   struct lp_variant_cache *cache;  /**< NULL when not in a cache */
+   size_t size;                     /**< bytes of generated code */
+   lp_variant_cache_evict_func evict;
+   enum pipe_shader_type stage;
+   void *variant;
+   void *owner;                     /**< context the variant belongs to */
+};
+
+
+struct lp_variant_cache_stats
+{
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+   uint64_t bytes;        /**< generated code currently held */
+   unsigned count;        /**< variants currently held */
+   unsigned stage_count[PIPE_SHADER_TYPES];
+};
+
+
+struct lp_variant_cache
+{
+   struct list_head lru;  /**< most recently used first */
+   uint64_t budget;       /**< max bytes of generated code, 0 = unlimited */
+   /** max number of variants of each stage, 0 = unlimited */
+   unsigned max_count[PIPE_SHADER_TYPES];
+   struct lp_variant_cache_stats stats;
+};
+
+
+void
+lp_variant_cache_init(struct lp_variant_cache *cache,
+                      uint64_t budget,
+                      unsigned max_count);
+
+void
+lp_variant_cache_set_max_count(struct lp_variant_cache *cache,
+                               enum pipe_shader_type stage,
+                               unsigned max_count);
+
+void
+lp_variant_cache_item_init(struct lp_variant_cache_item *item,
+                           lp_variant_cache_evict_func evict,
+                           enum pipe_shader_type stage,
+                           void *variant, void *owner);
+
+void
+lp_variant_cache_insert(struct lp_variant_cache *cache,
+                        struct lp_variant_cache_item *item);
+
+void
+lp_variant_cache_set_size(struct lp_variant_cache_item *item,
+                          size_t size);
+
+void
+lp_variant_cache_remove(struct lp_variant_cache_item *item);
+
+boolean
+lp_variant_cache_over_budget(const struct lp_variant_cache *cache);
+
+unsigned
+lp_variant_cache_evict(struct lp_variant_cache *cache);
+
+
+/**
+ * Record a lookup which found an existing variant.
+ */
+static inline void
+lp_variant_cache_hit(struct lp_variant_cache_item *item)
+{
+   struct lp_variant_cache *cache = item->cache;
+
+   assert(cache);
+   cache->stats.hits++;
+   list_del(&item->head);
+   list_add(&item->head, &cache->lru);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LP_BLD_VARIANT_CACHE_H */
@@ -38,6 +38,7 @@
 #include "lp_setup.h"
 #include "lp_query.h"
 #include "lp_debug.h"
+#include "lp_state_cs.h"
 
 
 /**
@@ -52,10 +53,23 @@ llvmpipe_clear(struct pipe_context *pipe,
                unsigned stencil)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   const struct pipe_framebuffer_state *fb = &llvmpipe->framebuffer;
+   unsigned i;
 
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   /* compute dispatches in flight may still access the surfaces */
+   if (!list_is_empty(&llvmpipe->csctx->jobs)) {
+      for (i = 0; i < fb->nr_cbufs; i++) {
+         if (fb->cbufs[i])
+            lp_csctx_wait_resource(llvmpipe->csctx, fb->cbufs[i]->texture,
+                                   FALSE);
+      }
+      if (fb->zsbuf)
+         lp_csctx_wait_resource(llvmpipe->csctx, fb->zsbuf->texture, FALSE);
+   }
+
    if (LP_PERF & PERF_NO_DEPTH)
       buffers &= ~PIPE_CLEAR_DEPTHSTENCIL;
 
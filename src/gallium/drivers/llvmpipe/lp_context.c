@@ -46,6 +46,7 @@
 #include "lp_surface.h"
 #include "lp_query.h"
 #include "lp_setup.h"
+#include "lp_screen.h"
 
 /* This is only safe if there's just one concurrent context */
 #ifdef EMBEDDED_DEVICE
@@ -59,12 +60,13 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 
    lp_print_counters();
 
-   if (llvmpipe->csctx) {
-      lp_csctx_destroy(llvmpipe->csctx);
-   }
+   /* deleting the blitter's shaders waits for compute jobs */
    if (llvmpipe->blitter) {
       util_blitter_destroy(llvmpipe->blitter);
    }
+   if (llvmpipe->csctx) {
+      lp_csctx_destroy(llvmpipe->csctx);
+   }
 
    if (llvmpipe->pipe.stream_uploader)
       u_upload_destroy(llvmpipe->pipe.stream_uploader);
@@ -134,6 +136,40 @@ llvmpipe_render_condition(struct pipe_context *pipe,
    llvmpipe->render_cond_cond = condition;
 }
 
+/**
+ * Free least recently used shader variants if their generated code
+ * exceeds the budget.  Binned scenes may still run any fragment shader
+ * variant, so they need to finish first.
+ */
+void
+llvmpipe_evict_variants(struct llvmpipe_context *lp)
+{
+   if (!lp_variant_cache_over_budget(&lp->variant_cache))
+      return;
+
+   llvmpipe_finish(&lp->pipe, __FUNCTION__);
+   lp_variant_cache_evict(&lp->variant_cache);
+}
+
+
+static void
+llvmpipe_draw_find_shader(void *cookie,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20])
+{
+   lp_disk_cache_find_shader((struct llvmpipe_screen *)cookie,
+                             cache, ir_sha1_cache_key);
+}
+
+static void
+llvmpipe_draw_insert_shader(void *cookie,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20])
+{
+   lp_disk_cache_insert_shader((struct llvmpipe_screen *)cookie,
+                               cache, ir_sha1_cache_key);
+}
+
 struct pipe_context *
 llvmpipe_create_context(struct pipe_screen *screen, void *priv,
                         unsigned flags)
@@ -148,12 +184,12 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
 
    memset(llvmpipe, 0, sizeof *llvmpipe);
 
-   make_empty_list(&llvmpipe->fs_variants_list);
+   lp_variant_cache_init(&llvmpipe->variant_cache,
+                         llvmpipe_screen(screen)->variant_cache_budget,
+                         LP_MAX_SHADER_VARIANTS);
 
    make_empty_list(&llvmpipe->setup_variants_list);
 
-   make_empty_list(&llvmpipe->cs_variants_list);
-
    llvmpipe->pipe.screen = screen;
    llvmpipe->pipe.priv = priv;
 
@@ -197,6 +233,14 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->draw)
       goto fail;
 
+   if (llvmpipe_screen(screen)->disk_shader_cache)
+      draw_set_disk_cache_callbacks(llvmpipe->draw,
+                                    llvmpipe_screen(screen),
+                                    llvmpipe_draw_find_shader,
+                                    llvmpipe_draw_insert_shader);
+
+   draw_set_variant_cache(llvmpipe->draw, &llvmpipe->variant_cache);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create( &llvmpipe->pipe,
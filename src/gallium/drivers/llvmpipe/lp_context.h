@@ -34,6 +34,7 @@
 #include "pipe/p_context.h"
 
 #include "draw/draw_vertex.h"
+#include "gallivm/lp_bld_variant_cache.h"
 #include "util/u_blitter.h"
 
 #include "lp_tex_sample.h"
@@ -148,16 +149,21 @@ struct llvmpipe_context {
 
    unsigned tex_timestamp;
 
-   /** List of all fragment shader variants */
-   struct lp_fs_variant_list_item fs_variants_list;
+   /**
+    * LRU of the fragment and compute shader variants, shared with the
+    * draw module's vertex and geometry shader variants.
+    */
+   struct lp_variant_cache variant_cache;
+
    unsigned nr_fs_variants;
    unsigned nr_fs_instrs;
 
+   /** The fragment shader variant bound to setup */
+   struct lp_fragment_shader_variant *fs_variant;
+
    struct lp_setup_variant_list_item setup_variants_list;
    unsigned nr_setup_variants;
 
-   /** List of all compute shader variants */
-   struct lp_cs_variant_list_item cs_variants_list;
    unsigned nr_cs_variants;
    unsigned nr_cs_instrs;
    struct lp_cs_context *csctx;
@@ -186,6 +192,9 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
                             unsigned bytes,
                             unsigned bind_flags);
 
+void
+llvmpipe_evict_variants(struct llvmpipe_context *lp);
+
 
 static inline struct llvmpipe_context *
 llvmpipe_context( struct pipe_context *pipe )
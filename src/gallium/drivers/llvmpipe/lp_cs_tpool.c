@@ -28,9 +28,33 @@
  * based on threadpool.c but modified heavily to be compute shader tuned.
  */
 
+#include "util/u_atomic.h"
 #include "util/u_thread.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
+#include "lp_fence.h"
+
+/* Upper bound on the iterations a thread claims at once. */
+#define LP_CS_TPOOL_MAX_CHUNK 64
+
+/**
+ * Number of iterations to claim next: big chunks while plenty are left, so
+ * the atomics stay off the profile for large grids of small workgroups,
+ * down to single iterations at the end so the threads finish together.
+ */
+static unsigned
+lp_cs_tpool_chunk_size(const struct lp_cs_tpool *pool,
+                       struct lp_cs_tpool_task *task)
+{
+   unsigned start = p_atomic_read(&task->iter_start);
+
+   if (start >= task->iter_total)
+      return 1;
+
+   return CLAMP((task->iter_total - start) / (pool->num_threads * 4),
+                1, LP_CS_TPOOL_MAX_CHUNK);
+}
 
 static int
 lp_cs_tpool_worker(void *data)
@@ -43,6 +67,7 @@ lp_cs_tpool_worker(void *data)
 
    while (!pool->shutdown) {
       struct lp_cs_tpool_task *task;
+      unsigned finished = 0;
 
       while (list_is_empty(&pool->workqueue) && !pool->shutdown)
          cnd_wait(&pool->new_work, &pool->m);
@@ -52,20 +77,41 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-      unsigned this_iter = task->iter_start++;
+      task->workers++;
+      mtx_unlock(&pool->m);
 
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
+      for (;;) {
+         unsigned chunk = lp_cs_tpool_chunk_size(pool, task);
+         unsigned start = p_atomic_add_return(&task->iter_start, chunk) - chunk;
+         unsigned end;
 
-      mtx_unlock(&pool->m);
-      task->work(task->data, this_iter, &lmem);
+         if (start >= task->iter_total)
+            break;
+
+         end = MIN2(start + chunk, task->iter_total);
+         for (unsigned i = start; i < end; i++)
+            task->work(task->data, i, &lmem);
+         finished += end - start;
+      }
+
+      /*
+       * Every iteration is claimed.  The task is done once the threads
+       * still running the last ones are done with them too.
+       */
       mtx_lock(&pool->m);
-      task->iter_finished++;
-      if (task->iter_finished == task->iter_total)
+      if (!list_is_empty(&task->list))
+         list_delinit(&task->list);
+      task->iter_finished += finished;
+      task->workers--;
+      if (task->iter_finished == task->iter_total && task->workers == 0) {
          cnd_broadcast(&task->finish);
+         if (task->fence)
+            lp_fence_signal(task->fence);
+      }
    }
    mtx_unlock(&pool->m);
    FREE(lmem.local_mem_ptr);
+   align_free(lmem.cache);
    return 0;
 }
 
@@ -77,11 +123,18 @@ lp_cs_tpool_create(unsigned num_threads)
    if (!pool)
       return NULL;
 
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof *pool->threads);
+      if (!pool->threads) {
+         FREE(pool);
+         return NULL;
+      }
+   }
+
    (void) mtx_init(&pool->m, mtx_plain);
    cnd_init(&pool->new_work);
 
    list_inithead(&pool->workqueue);
-   assert (num_threads <= LP_MAX_THREADS);
    pool->num_threads = num_threads;
    for (unsigned i = 0; i < num_threads; i++)
       pool->threads[i] = u_thread_create(lp_cs_tpool_worker, pool);
@@ -105,12 +158,14 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
 struct lp_cs_tpool_task *
 lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
-                       lp_cs_tpool_task_func work, void *data, int num_iters)
+                       lp_cs_tpool_task_func work, void *data, int num_iters,
+                       struct lp_fence *fence)
 {
    struct lp_cs_tpool_task *task;
 
@@ -121,6 +176,10 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       for (unsigned t = 0; t < num_iters; t++) {
          work(data, t, &lmem);
       }
+      FREE(lmem.local_mem_ptr);
+      align_free(lmem.cache);
+      if (fence)
+         lp_fence_signal(fence);
       return NULL;
    }
    task = CALLOC_STRUCT(lp_cs_tpool_task);
@@ -131,13 +190,17 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   task->fence = fence;
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
 
    list_addtail(&task->list, &pool->workqueue);
 
-   cnd_signal(&pool->new_work);
+   if (num_iters > 1)
+      cnd_broadcast(&pool->new_work);
+   else
+      cnd_signal(&pool->new_work);
    mtx_unlock(&pool->m);
    return task;
 }
@@ -152,7 +215,7 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
       return;
 
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   while (task->iter_finished < task->iter_total || task->workers)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
@@ -28,6 +28,8 @@
  * The item is added to the work queue once, but it must execute
  * number of iterations times. This saves storing a bunch of queue
  * structs with just unique indexes in them.
+ * Threads claim iterations in chunks with atomics, the pool mutex is
+ * only taken when a thread starts and stops working on an item.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
  */
@@ -41,11 +43,14 @@
 
 #include "lp_limits.h"
 
+struct lp_fence;
+struct lp_build_format_cache;
+
 struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -54,6 +59,10 @@ struct lp_cs_tpool {
 struct lp_cs_local_mem {
    unsigned local_size;
    void *local_mem_ptr;
+
+   /* texture block cache, and the dispatch it was last used for */
+   struct lp_build_format_cache *cache;
+   unsigned cache_job;
 };
 
 typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_local_mem *lmem);
@@ -64,8 +73,10 @@ struct lp_cs_tpool_task {
    struct list_head list;
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
+   unsigned iter_start;    /**< next iteration to claim, atomic */
+   unsigned iter_finished; /**< protected by the pool mutex */
+   unsigned workers;       /**< threads working on the task */
+   struct lp_fence *fence; /**< signalled once all iterations finished */
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -73,7 +84,8 @@ void lp_cs_tpool_destroy(struct lp_cs_tpool *);
 
 struct lp_cs_tpool_task *lp_cs_tpool_queue_task(struct lp_cs_tpool *,
                                                 lp_cs_tpool_task_func func,
-                                                void *data, int num_iters);
+                                                void *data, int num_iters,
+                                                struct lp_fence *fence);
 
 void lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
                             struct lp_cs_tpool_task **task);
@@ -39,11 +39,68 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_query.h"
+#include "lp_state_cs.h"
 
 #include "draw/draw_context.h"
 
 
 
+/**
+ * Wait for the compute dispatches in flight which conflict with the
+ * resources bound for drawing.
+ */
+static void
+wait_for_compute(struct llvmpipe_context *lp,
+                 const struct pipe_draw_info *info)
+{
+   struct lp_cs_context *csctx = lp->csctx;
+   const struct pipe_framebuffer_state *fb = &lp->framebuffer;
+   unsigned sh, i;
+
+   lp_csctx_retire_jobs(csctx);
+   if (list_is_empty(&csctx->jobs))
+      return;
+
+   for (i = 0; i < lp->num_vertex_buffers; i++) {
+      if (!lp->vertex_buffer[i].is_user_buffer)
+         lp_csctx_wait_resource(csctx, lp->vertex_buffer[i].buffer.resource,
+                                TRUE);
+   }
+   if (info->index_size && !info->has_user_indices)
+      lp_csctx_wait_resource(csctx, info->index.resource, TRUE);
+
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      if (sh == PIPE_SHADER_COMPUTE)
+         continue;
+
+      for (i = 0; i < ARRAY_SIZE(lp->constants[sh]); i++)
+         lp_csctx_wait_resource(csctx, lp->constants[sh][i].buffer, TRUE);
+      for (i = 0; i < lp->num_sampler_views[sh]; i++) {
+         if (lp->sampler_views[sh][i])
+            lp_csctx_wait_resource(csctx, lp->sampler_views[sh][i]->texture,
+                                   TRUE);
+      }
+      for (i = 0; i < ARRAY_SIZE(lp->ssbos[sh]); i++)
+         lp_csctx_wait_resource(csctx, lp->ssbos[sh][i].buffer, FALSE);
+      for (i = 0; i < lp->num_images[sh]; i++)
+         lp_csctx_wait_resource(csctx, lp->images[sh][i].resource, FALSE);
+   }
+
+   for (i = 0; i < fb->nr_cbufs; i++) {
+      if (fb->cbufs[i])
+         lp_csctx_wait_resource(csctx, fb->cbufs[i]->texture, FALSE);
+   }
+   if (fb->zsbuf)
+      lp_csctx_wait_resource(csctx, fb->zsbuf->texture, FALSE);
+
+   for (i = 0; i < lp->num_so_targets; i++) {
+      if (lp->so_targets[i])
+         lp_csctx_wait_resource(csctx, lp->so_targets[i]->target.buffer,
+                                FALSE);
+   }
+}
+
+
 /**
  * Draw vertex arrays, with optional indexing, optional instancing.
  * All the other drawing functions are implemented in terms of this function.
@@ -66,9 +123,14 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
       return;
    }
 
+   /* Background compiles finish regardless of state changes */
+   llvmpipe_poll_fs_variant(lp);
+
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   wait_for_compute(lp, info);
+
    /*
     * Map vertex buffers
     */
@@ -69,9 +69,14 @@ lp_fence_create(unsigned rank)
 void
 lp_fence_destroy(struct lp_fence *fence)
 {
+   unsigned i;
+
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __FUNCTION__, fence->id);
 
+   for (i = 0; i < fence->num_deps; i++)
+      lp_fence_reference(&fence->deps[i], NULL);
+
    mtx_destroy(&fence->mutex);
    cnd_destroy(&fence->signalled);
    FREE(fence);
@@ -107,12 +112,24 @@ lp_fence_signal(struct lp_fence *fence)
 boolean
 lp_fence_signalled(struct lp_fence *f)
 {
-   return f->count == f->rank;
+   unsigned i;
+
+   if (f->count != f->rank)
+      return FALSE;
+
+   for (i = 0; i < f->num_deps; i++) {
+      if (!lp_fence_signalled(f->deps[i]))
+         return FALSE;
+   }
+
+   return TRUE;
 }
 
 void
 lp_fence_wait(struct lp_fence *f)
 {
+   unsigned i;
+
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __FUNCTION__, f->id);
 
@@ -122,6 +139,33 @@ lp_fence_wait(struct lp_fence *f)
       cnd_wait(&f->signalled, &f->mutex);
    }
    mtx_unlock(&f->mutex);
+
+   for (i = 0; i < f->num_deps; i++)
+      lp_fence_wait(f->deps[i]);
+}
+
+
+static boolean
+fence_timedwait(struct lp_fence *f, const struct timespec *ts)
+{
+   boolean result;
+   unsigned i;
+   int ret;
+
+   mtx_lock(&f->mutex);
+   assert(f->issued);
+   while (f->count < f->rank) {
+      ret = cnd_timedwait(&f->signalled, &f->mutex, ts);
+      if (ret != thrd_success)
+         break;
+   }
+   result = (f->count >= f->rank);
+   mtx_unlock(&f->mutex);
+
+   for (i = 0; result && i < f->num_deps; i++)
+      result = fence_timedwait(f->deps[i], ts);
+
+   return result;
 }
 
 
@@ -129,7 +173,6 @@ boolean
 lp_fence_timedwait(struct lp_fence *f, uint64_t timeout)
 {
    struct timespec ts;
-   int ret;
 
    timespec_get(&ts, TIME_UTC);
 
@@ -143,14 +186,23 @@ lp_fence_timedwait(struct lp_fence *f, uint64_t timeout)
    if (LP_DEBUG & DEBUG_FENCE)
       debug_printf("%s %d\n", __FUNCTION__, f->id);
 
-   mtx_lock(&f->mutex);
-   assert(f->issued);
-   while (f->count < f->rank) {
-      ret = cnd_timedwait(&f->signalled, &f->mutex, &ts);
-      if (ret != thrd_success)
-         break;
+   return fence_timedwait(f, &ts);
+}
+
+
+/**
+ * Make fence wait for dep as well.  Only to be done before the fence is
+ * handed out; dep must not have dependencies of its own, so the waits
+ * above don't go deeper than one level.
+ */
+void
+lp_fence_add_dependency(struct lp_fence *fence, struct lp_fence *dep)
+{
+   assert(fence->num_deps < ARRAY_SIZE(fence->deps));
+   assert(dep->num_deps == 0);
+
+   if (fence->num_deps < ARRAY_SIZE(fence->deps)) {
+      lp_fence_reference(&fence->deps[fence->num_deps], dep);
+      fence->num_deps++;
    }
-   const boolean result = (f->count >= f->rank);
-   mtx_unlock(&f->mutex);
-   return result;
 }
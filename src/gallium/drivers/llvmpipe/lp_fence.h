@@ -33,11 +33,19 @@
 #include "os/os_thread.h"
 #include "pipe/p_state.h"
 #include "util/u_inlines.h"
+#include "lp_limits.h"
 
 
 struct pipe_screen;
 
 
+/**
+ * Max number of other fences a fence can wait for: the compute
+ * dispatches in flight plus the last scene.
+ */
+#define LP_FENCE_MAX_DEPS (LP_MAX_COMPUTE_JOBS + 1)
+
+
 struct lp_fence
 {
    struct pipe_reference reference;
@@ -49,6 +57,10 @@ struct lp_fence
    boolean issued;
    unsigned rank;
    unsigned count;
+
+   /** Fences which must have signalled too for this one to count as such */
+   struct lp_fence *deps[LP_FENCE_MAX_DEPS];
+   unsigned num_deps;
 };
 
 
@@ -68,6 +80,9 @@ lp_fence_wait(struct lp_fence *fence);
 boolean
 lp_fence_timedwait(struct lp_fence *fence, uint64_t timeout);
 
+void
+lp_fence_add_dependency(struct lp_fence *fence, struct lp_fence *dep);
+
 void
 llvmpipe_init_screen_fence_funcs(struct pipe_screen *screen);
 
@@ -38,6 +38,8 @@
 #include "lp_flush.h"
 #include "lp_context.h"
 #include "lp_setup.h"
+#include "lp_state_cs.h"
+#include "lp_texture.h"
 
 
 /**
@@ -55,6 +57,10 @@ llvmpipe_flush( struct pipe_context *pipe,
    /* ask the setup module to flush */
    lp_setup_flush(llvmpipe->setup, fence, reason);
 
+   /* the fence must cover the compute dispatches in flight too */
+   if (fence)
+      lp_csctx_join_fence(llvmpipe->csctx, (struct lp_fence **)fence);
+
    /* Enable to dump BMPs of the color/depth buffers each frame */
    if (0) {
       static unsigned frame_no = 1;
@@ -105,6 +111,7 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
                         boolean do_not_block,
                         const char *reason)
 {
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    unsigned referenced;
 
    referenced = llvmpipe_is_resource_referenced(pipe, resource, level);
@@ -114,12 +121,13 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
 
       if (cpu_access) {
          /*
-          * Flush and wait.
+          * Flush and wait, but only for the scenes using the resource.
           */
          if (do_not_block)
             return FALSE;
 
-         llvmpipe_finish(pipe, reason);
+         llvmpipe_flush(pipe, NULL, reason);
+         lp_setup_wait_resource(llvmpipe_context(pipe)->setup, resource);
       } else {
          /*
           * Just flush.
@@ -129,5 +137,19 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
       }
    }
 
+   /*
+    * Compute dispatches are already executing, there is nothing to flush.
+    * Anything using the resource after them has to wait, though.
+    */
+   referenced = lp_csctx_is_resource_referenced(llvmpipe->csctx, resource);
+
+   if ((referenced & LP_REFERENCED_FOR_WRITE) ||
+       ((referenced & LP_REFERENCED_FOR_READ) && !read_only)) {
+      if (do_not_block)
+         return FALSE;
+
+      lp_csctx_wait_resource(llvmpipe->csctx, resource, read_only);
+   }
+
    return TRUE;
 }
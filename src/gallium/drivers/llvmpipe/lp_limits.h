@@ -65,7 +65,18 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Upper bound on rasterizer/compute threads.  Per-thread state is
+ * allocated at runtime from the actual thread count, so this is only a
+ * sanity limit.
+ */
+#define LP_MAX_THREADS 256
+
+
+/**
+ * Max samples per pixel for multisample surfaces.
+ */
+#define LP_MAX_SAMPLES 4
 
 
 /**
@@ -74,16 +85,23 @@
 #define LP_MAX_SCENE_SIZE (512 * 1024 * 1024)
 
 /**
- * Max number of shader variants (for all shaders combined,
- * per context) that will be kept around.
+ * Max number of fragment, and of compute, shader variants (for all shaders
+ * of the stage combined, per context) that will be kept around.
  */
 #define LP_MAX_SHADER_VARIANTS 1024
 
 /**
- * Max number of instructions (for all fragment shaders combined per context)
- * that will be kept around (counted in terms of llvm ir).
+ * Default budget, in megabytes, for the generated code of all shader
+ * variants (fragment, compute, vertex and geometry combined, per context).
+ * Can be changed with LP_VARIANT_CACHE_MB, 0 meaning no limit.
+ */
+#define LP_VARIANT_CACHE_MB 256
+
+/**
+ * Max number of compute shader dispatches a context keeps in flight before
+ * launch_grid waits for the oldest one.
  */
-#define LP_MAX_SHADER_INSTRUCTIONS (2048 * LP_MAX_SHADER_VARIANTS)
+#define LP_MAX_COMPUTE_JOBS 16
 
 /**
  * Max number of setup variants that will be kept around.
@@ -48,19 +48,88 @@ static struct llvmpipe_query *llvmpipe_query( struct pipe_query *p )
    return (struct llvmpipe_query *)p;
 }
 
+
+int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+#define QUERY(NAME, ENUM, UNITS, RESULT) \
+   {NAME, ENUM, {0}, UNITS, PIPE_DRIVER_QUERY_RESULT_TYPE_##RESULT, 0, 0x0}
+
+   /* events are summed over a HUD period, levels averaged */
+   static const struct pipe_driver_query_info queries[] = {
+      QUERY("variant-cache-hits", LP_QUERY_VARIANT_CACHE_HITS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64, CUMULATIVE),
+      QUERY("variant-cache-misses", LP_QUERY_VARIANT_CACHE_MISSES,
+            PIPE_DRIVER_QUERY_TYPE_UINT64, CUMULATIVE),
+      QUERY("variant-cache-evictions", LP_QUERY_VARIANT_CACHE_EVICTIONS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64, CUMULATIVE),
+      QUERY("variant-cache-bytes", LP_QUERY_VARIANT_CACHE_BYTES,
+            PIPE_DRIVER_QUERY_TYPE_BYTES, AVERAGE),
+      QUERY("variant-cache-count", LP_QUERY_VARIANT_CACHE_COUNT,
+            PIPE_DRIVER_QUERY_TYPE_UINT64, AVERAGE),
+   };
+#undef QUERY
+
+   if (!info)
+      return ARRAY_SIZE(queries);
+
+   if (index >= ARRAY_SIZE(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
+
+/**
+ * Current value of a driver specific query's counter.
+ */
+static uint64_t
+driver_query_value(struct llvmpipe_context *llvmpipe, unsigned type)
+{
+   const struct lp_variant_cache_stats *stats =
+      &llvmpipe->variant_cache.stats;
+
+   switch (type) {
+   case LP_QUERY_VARIANT_CACHE_HITS:
+      return stats->hits;
+   case LP_QUERY_VARIANT_CACHE_MISSES:
+      return stats->misses;
+   case LP_QUERY_VARIANT_CACHE_EVICTIONS:
+      return stats->evictions;
+   case LP_QUERY_VARIANT_CACHE_BYTES:
+      return stats->bytes;
+   case LP_QUERY_VARIANT_CACHE_COUNT:
+      return stats->count;
+   default:
+      assert(0);
+      return 0;
+   }
+}
+
 static struct pipe_query *
 llvmpipe_create_query(struct pipe_context *pipe, 
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (type >= LP_QUERY_VARIANT_CACHE_HITS &&
+           type <= LP_QUERY_VARIANT_CACHE_COUNT));
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* the per-thread counters follow the query in the same allocation */
+   pq = CALLOC(1, sizeof *pq + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
       pq->type = type;
+      pq->num_threads = num_threads;
+      pq->start = (uint64_t *) (pq + 1);
+      pq->end = pq->start + num_threads;
    }
 
    return (struct pipe_query *) pq;
@@ -101,6 +170,16 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    uint64_t *result = (uint64_t *)vresult;
    int i;
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      /* the counters are running totals, the others current levels */
+      if (pq->type == LP_QUERY_VARIANT_CACHE_BYTES ||
+          pq->type == LP_QUERY_VARIANT_CACHE_COUNT)
+         *result = pq->driver_end;
+      else
+         *result = pq->driver_end - pq->driver_start;
+      return true;
+   }
+
    if (pq->fence) {
       /* only have a fence if there was a scene */
       if (!lp_fence_signalled(pq->fence)) {
@@ -342,6 +421,11 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->driver_start = driver_query_value(llvmpipe, pq->type);
+      return true;
+   }
+
    /* Check if the query is already in the scene.  If so, we need to
     * flush the scene now.  Real apps shouldn't re-use a query in a
     * frame of rendering.
@@ -351,8 +435,8 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(pq->start[0]));
+   memset(pq->end, 0, pq->num_threads * sizeof(pq->end[0]));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -400,6 +484,11 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
+   if (pq->type >= PIPE_QUERY_DRIVER_SPECIFIC) {
+      pq->driver_end = driver_query_value(llvmpipe, pq->type);
+      return true;
+   }
+
    lp_setup_end_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -39,22 +39,41 @@
 
 
 struct llvmpipe_context;
+struct pipe_screen;
+struct pipe_driver_query_info;
+
+
+/** Driver specific queries, reported by llvmpipe_get_driver_query_info() */
+#define LP_QUERY_VARIANT_CACHE_HITS      (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_VARIANT_CACHE_MISSES    (PIPE_QUERY_DRIVER_SPECIFIC + 1)
+#define LP_QUERY_VARIANT_CACHE_EVICTIONS (PIPE_QUERY_DRIVER_SPECIFIC + 2)
+#define LP_QUERY_VARIANT_CACHE_BYTES     (PIPE_QUERY_DRIVER_SPECIFIC + 3)
+#define LP_QUERY_VARIANT_CACHE_COUNT     (PIPE_QUERY_DRIVER_SPECIFIC + 4)
 
 
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
    unsigned type;                   /* PIPE_QUERY_* */
    unsigned num_primitives_generated;
    unsigned num_primitives_written;
 
    struct pipe_query_data_pipeline_statistics stats;
+
+   uint64_t driver_start;           /* LP_QUERY_* values at begin/end */
+   uint64_t driver_end;
+
+   unsigned num_threads;            /* entries in start[] and end[] */
 };
 
 
 extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
+extern int llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                                          unsigned index,
+                                          struct pipe_driver_query_info *info);
+
 extern boolean llvmpipe_check_render_cond(struct llvmpipe_context *);
 
 #endif /* LP_QUERY_H */
@@ -33,6 +33,8 @@
 #include "util/u_pack_color.h"
 #include "util/u_string.h"
 #include "util/u_thread.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 
 #include "util/os_time.h"
 
@@ -44,6 +46,7 @@
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_rast_priv.h"
+#include "lp_rast_profile.h"
 #include "gallivm/lp_bld_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_scene.h"
@@ -74,10 +77,15 @@ lp_rast_begin( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * The scene itself is released by the setup code once its fence has
+ * signalled, see lp_setup_get_empty_scene().
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
+   if (rast->profile)
+      lp_rast_profile_write_scene(rast->profile);
 
    rast->curr_scene = NULL;
 }
@@ -109,6 +117,9 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->thread_data.ps_invocations = 0;
 
+   /* the depth tile is loaded from memory, nothing is known about it */
+   task->hiz_valid = FALSE;
+
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
          task->color_tiles[i] = scene->cbufs[i].map +
@@ -127,7 +138,7 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
 /**
  * Clear the rasterizer's current color tile.
  * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * Clear commands always clear all bound layers (and samples).
  */
 static void
 lp_rast_clear_color(struct lp_rasterizer_task *task,
@@ -162,7 +173,7 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
                  0,
                  task->width,
                  task->height,
-                 scene->fb_max_layer + 1,
+                 (scene->fb_max_layer + 1) * scene->fb_samples,
                  &uc);
 
    /* this will increase for each rb which probably doesn't mean much */
@@ -173,7 +184,7 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
- * Clear commands always clear all bound layers.
+ * Clear commands always clear all bound layers (and samples).
  */
 static void
 lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
@@ -203,9 +214,29 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
       uint8_t *dst_layer = task->depth_tile;
       block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
 
+      if (task->hiz_enabled) {
+         enum pipe_format format = scene->fb.zsbuf->format;
+         uint64_t depth_mask = util_pack64_mask_z(format, 0xffffffff);
+
+         if ((clear_mask64 & depth_mask) == depth_mask) {
+            const struct util_format_description *desc =
+               util_format_description(format);
+            uint64_t packed = clear_value64 & depth_mask;
+            float depth;
+
+            desc->unpack_z_float(&depth, 0, (const uint8_t *)&packed, 0, 1, 1);
+            task->hiz_zmax = depth;
+            task->hiz_valid = TRUE;
+         }
+         else if (clear_mask64 & depth_mask) {
+            task->hiz_valid = FALSE;
+         }
+      }
+
       clear_value &= clear_mask;
 
-      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
+      for (layer = 0; layer < (scene->fb_max_layer + 1) * scene->fb_samples;
+           layer++) {
          dst = dst_layer;
 
          switch (block_size) {
@@ -298,7 +329,6 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_scene *scene = task->scene;
    const struct lp_rast_shader_inputs *inputs = arg.shade_tile;
    const struct lp_rast_state *state;
-   struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
    unsigned x, y;
 
@@ -314,26 +344,51 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    if (!state) {
       return;
    }
-   variant = state->variant;
+
+   if (lp_rast_hiz_reject(task, inputs, tile_x, tile_y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_culled_64);
+      return;
+   }
+
+   if (task->hiz_tighten) {
+      /*
+       * Every pixel of the tile either takes a depth value from this
+       * triangle or already had a smaller one, so the triangle's maximum
+       * bounds the whole tile from now on.
+       */
+      float zmin, zmax;
+
+      lp_rast_depth_bounds(inputs, (float)tile_x, (float)tile_y,
+                           (float)(tile_x + task->width),
+                           (float)(tile_y + task->height),
+                           &zmin, &zmax);
+      zmax = CLAMP(zmax, 0.0f, 1.0f);
+      task->hiz_zmax = task->hiz_valid ? MIN2(task->hiz_zmax, zmax) : zmax;
+      task->hiz_valid = TRUE;
+   }
 
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
          unsigned stride[PIPE_MAX_COLOR_BUFS];
+         unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
          uint8_t *depth = NULL;
          unsigned depth_stride = 0;
+         unsigned depth_sample_stride = 0;
          unsigned i;
 
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
                stride[i] = scene->cbufs[i].stride;
+               sample_stride[i] = scene->cbufs[i].layer_stride;
                color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
                                                           tile_y + y, inputs->layer);
             }
             else {
                stride[i] = 0;
+               sample_stride[i] = 0;
                color[i] = NULL;
             }
          }
@@ -343,6 +398,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
             depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
                                                     tile_y + y, inputs->layer);
             depth_stride = scene->zsbuf.stride;
+            depth_sample_stride = scene->zsbuf.layer_stride;
          }
 
          /* Propagate non-interpolated raster state. */
@@ -350,18 +406,20 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
 
          /* run shader on 4x4 block */
          BEGIN_JIT_CALL(state, task);
-         variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                            tile_x + x, tile_y + y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            0xffff,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride);
+         state->jit_function[RAST_WHOLE]( &state->jit_context,
+                                          tile_x + x, tile_y + y,
+                                          inputs->frontfacing,
+                                          GET_A0(inputs),
+                                          GET_DADX(inputs),
+                                          GET_DADY(inputs),
+                                          color,
+                                          depth,
+                                          state->full_mask,
+                                          &task->thread_data,
+                                          stride,
+                                          depth_stride,
+                                          sample_stride,
+                                          depth_sample_stride);
          END_JIT_CALL();
       }
    }
@@ -393,20 +451,22 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
  * This is a bin command called during bin processing.
  * \param x  X position of quad in window coords
  * \param y  Y position of quad in window coords
+ * \param mask  coverage of the block, 16 bits per sample
  */
 void
-lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
-                         const struct lp_rast_shader_inputs *inputs,
-                         unsigned x, unsigned y,
-                         unsigned mask)
+lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
+                                const struct lp_rast_shader_inputs *inputs,
+                                unsigned x, unsigned y,
+                                uint64_t mask)
 {
    const struct lp_rast_state *state = task->state;
-   struct lp_fragment_shader_variant *variant = state->variant;
    const struct lp_scene *scene = task->scene;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    assert(state);
@@ -424,11 +484,13 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].layer_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -436,9 +498,12 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    /* depth buffer */
    if (scene->zsbuf.map) {
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.layer_stride;
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
    }
 
+   mask &= state->full_mask;
+
    assert(lp_check_alignment(state->jit_context.u8_blend_color, 16));
 
    /*
@@ -451,18 +516,20 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
 
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_EDGE_TEST](&state->jit_context,
-                                            x, y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            mask,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride);
+      state->jit_function[RAST_EDGE_TEST](&state->jit_context,
+                                          x, y,
+                                          inputs->frontfacing,
+                                          GET_A0(inputs),
+                                          GET_DADX(inputs),
+                                          GET_DADY(inputs),
+                                          color,
+                                          depth,
+                                          mask,
+                                          &task->thread_data,
+                                          stride,
+                                          depth_stride,
+                                          sample_stride,
+                                          depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -535,6 +602,38 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   if (task->hiz_enabled) {
+      const struct lp_fragment_shader_variant *variant = arg.state->variant;
+      const struct lp_fragment_shader_variant_key *key = &variant->key;
+      const struct tgsi_shader_info *info = &variant->shader->info.base;
+      boolean less = key->depth.enabled &&
+                     (key->depth.func == PIPE_FUNC_LESS ||
+                      key->depth.func == PIPE_FUNC_LEQUAL);
+      boolean plain = less &&
+                      !key->stencil[0].enabled &&
+                      !key->depth_clamp &&
+                      !info->writes_z;
+
+      /*
+       * Fragments which fail the depth test may only be dropped early if
+       * running the shader would have had no other effect.
+       */
+      task->hiz_cull = plain && !info->writes_memory;
+
+      task->hiz_tighten = plain &&
+                          key->depth.writemask &&
+                          !info->uses_kill &&
+                          !key->alpha.enabled &&
+                          !key->blend.alpha_to_coverage;
+
+      /*
+       * Depth writes with LESS/LEQUAL only ever lower the stored values,
+       * anything else may raise them above the bound.
+       */
+      if (key->depth.enabled && key->depth.writemask && !less)
+         task->hiz_valid = FALSE;
+   }
 }
 
 
@@ -588,7 +687,15 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
    lp_rast_triangle_32_8,
    lp_rast_triangle_32_3_4,
    lp_rast_triangle_32_3_16,
-   lp_rast_triangle_32_4_16
+   lp_rast_triangle_32_4_16,
+   lp_rast_triangle_ms_1,
+   lp_rast_triangle_ms_2,
+   lp_rast_triangle_ms_3,
+   lp_rast_triangle_ms_4,
+   lp_rast_triangle_ms_5,
+   lp_rast_triangle_ms_6,
+   lp_rast_triangle_ms_7,
+   lp_rast_triangle_ms_8
 };
 
 
@@ -603,6 +710,23 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
    if (0)
       lp_debug_bin(bin, x, y);
 
+   if (unlikely(task->bin_profile)) {
+      struct lp_rast_bin_profile *profile = task->bin_profile;
+
+      for (block = bin->head; block; block = block->next) {
+         for (k = 0; k < block->count; k++) {
+            const unsigned cmd = block->cmd[k];
+            int64_t start = os_time_get_nano();
+
+            dispatch[cmd]( task, block->arg[k] );
+
+            profile->time[cmd] += os_time_get_nano() - start;
+            profile->count[cmd]++;
+         }
+      }
+      return;
+   }
+
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
          dispatch[block->cmd[k]]( task, block->arg[k] );
@@ -612,6 +736,39 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Whether the scene's depth buffer qualifies for hierarchical Z, and the
+ * slack needed to compare depth plane bounds against stored values.
+ * Only single-layer, single-sample unorm depth is handled, for which
+ * the shader clamps depth to [0,1].
+ */
+static boolean
+hiz_enabled(const struct lp_scene *scene, float *margin)
+{
+   const struct util_format_description *desc;
+   unsigned bits;
+
+   *margin = 0.0f;
+
+   if ((LP_PERF & PERF_NO_HIZ) ||
+       !scene->fb.zsbuf ||
+       scene->fb_max_layer > 0 ||
+       scene->fb_samples > 1)
+      return FALSE;
+
+   desc = util_format_description(scene->fb.zsbuf->format);
+   if (!util_format_has_depth(desc) ||
+       desc->channel[desc->swizzle[0]].type != UTIL_FORMAT_TYPE_UNSIGNED ||
+       !desc->channel[desc->swizzle[0]].normalized)
+      return FALSE;
+
+   /* rounding to the stored value and back, with one unit to spare */
+   bits = desc->channel[desc->swizzle[0]].size;
+   *margin = 2.0f / (float)((1ULL << bits) - 1);
+   return TRUE;
+}
+
+
 /**
  * Rasterize commands for a single bin.
  * \param x, y  position of the bin's tile in the framebuffer
@@ -622,12 +779,25 @@ static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y )
 {
+   struct lp_rast_profile *profile = task->rast->profile;
+
+   if (unlikely(profile)) {
+      task->bin_profile = lp_rast_profile_begin_bin(profile,
+                                                    task->thread_index,
+                                                    x, y);
+   }
+
    lp_rast_tile_begin( task, bin, x, y );
 
    do_rasterize_bin(task, bin, x, y);
 
    lp_rast_tile_end(task);
 
+   if (task->bin_profile) {
+      lp_rast_profile_end_bin(task->bin_profile);
+      task->bin_profile = NULL;
+   }
+
 #ifdef DEBUG
    /* Debug/Perf flags:
     */
@@ -664,17 +834,20 @@ rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
    task->scene = scene;
+   task->hiz_enabled = hiz_enabled(scene, &task->hiz_margin);
+   task->hiz_valid = FALSE;
+   task->hiz_cull = FALSE;
+   task->hiz_tighten = FALSE;
 
    /* Clear the cache tags. This should not always be necessary but
       simpler for now. */
-#if LP_USE_TEXTURE_CACHE
    memset(task->thread_data.cache->cache_tags, 0,
           sizeof(task->thread_data.cache->cache_tags));
-#if LP_BUILD_FORMAT_CACHE_DEBUG
    task->thread_data.cache->cache_access_total = 0;
    task->thread_data.cache->cache_access_miss = 0;
-#endif
-#endif
+
+   if (task->rast->profile)
+      lp_rast_profile_begin_scene(task->rast->profile, task->thread_index);
 
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
@@ -691,8 +864,7 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 
 
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-   {
+   if (LP_DEBUG & DEBUG_TEX_CACHE) {
       uint64_t total, miss;
       total = task->thread_data.cache->cache_access_total;
       miss = task->thread_data.cache->cache_access_miss;
@@ -703,7 +875,9 @@ rasterize_scene(struct lp_rasterizer_task *task,
                  (float)(total - miss)/(float)total);
       }
    }
-#endif
+
+   if (task->rast->profile)
+      lp_rast_profile_end_scene(task->rast->profile, task->thread_index);
 
    if (scene->fence) {
       lp_fence_signal(scene->fence);
@@ -733,7 +907,7 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       lp_rast_begin( rast, scene );
 
-      rasterize_scene( &rast->tasks[0], scene );
+      rasterize_scene( rast->tasks[0], scene );
 
       lp_rast_end( rast );
 
@@ -749,7 +923,7 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       /* signal the threads that there's work to do */
       for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_signal(&rast->tasks[i].work_ready);
+         pipe_semaphore_signal(&rast->tasks[i]->work_ready);
       }
    }
 
@@ -757,19 +931,72 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
+/**
+ * Allocate and initialize the state of one rasterizer thread.
+ */
+static struct lp_rasterizer_task *
+create_task(struct lp_rasterizer *rast, unsigned index)
 {
-   if (rast->num_threads == 0) {
-      /* nothing to do */
+   struct lp_rasterizer_task *task;
+
+   /* cacheline aligned, tasks are written by different threads */
+   task = align_malloc(sizeof *task, 64);
+   if (!task)
+      return NULL;
+
+   memset(task, 0, sizeof *task);
+   task->rast = rast;
+   task->thread_index = index;
+   task->thread_data.cache = align_malloc(sizeof(struct lp_build_format_cache),
+                                          16);
+   if (!task->thread_data.cache) {
+      align_free(task);
+      return NULL;
    }
-   else {
-      int i;
 
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
+   pipe_semaphore_init(&task->work_ready, 0);
+   pipe_semaphore_init(&task->work_done, 0);
+
+   return task;
+}
+
+
+static void
+destroy_task(struct lp_rasterizer_task *task)
+{
+   pipe_semaphore_destroy(&task->work_ready);
+   pipe_semaphore_destroy(&task->work_done);
+   align_free(task->thread_data.cache);
+   align_free(task);
+}
+
+
+/**
+ * Pin the calling rasterizer thread according to the affinity policy.
+ */
+static void
+pin_thread(const struct lp_rasterizer *rast, unsigned index)
+{
+   const unsigned nr_cpus = MAX2(util_cpu_caps.nr_cpus, 1);
+   const unsigned cores_per_L3 =
+      CLAMP(util_cpu_caps.cores_per_L3, 1, nr_cpus);
+   const unsigned num_L3 = MAX2(nr_cpus / cores_per_L3, 1);
+
+   switch (rast->affinity) {
+   case LP_RAST_AFFINITY_COMPACT:
+      util_pin_thread_to_cpu(thrd_current(), index % nr_cpus);
+      break;
+   case LP_RAST_AFFINITY_SCATTER:
+      util_pin_thread_to_cpu(thrd_current(),
+                             (index % num_L3) * cores_per_L3 +
+                             (index / num_L3) % cores_per_L3);
+      break;
+   case LP_RAST_AFFINITY_L3:
+      util_pin_thread_to_L3(thrd_current(), index % num_L3, cores_per_L3);
+      break;
+   case LP_RAST_AFFINITY_NONE:
+   default:
+      break;
    }
 }
 
@@ -784,15 +1011,29 @@ lp_rast_finish( struct lp_rasterizer *rast )
 static int
 thread_function(void *init_data)
 {
-   struct lp_rasterizer_task *task = (struct lp_rasterizer_task *) init_data;
-   struct lp_rasterizer *rast = task->rast;
+   struct lp_rasterizer *rast = (struct lp_rasterizer *) init_data;
+   struct lp_rasterizer_task *task;
    boolean debug = false;
    char thread_name[16];
    unsigned fpstate;
+   unsigned index;
+
+   index = p_atomic_inc_return(&rast->next_thread_index) - 1;
 
-   snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
+   snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", index);
    u_thread_setname(thread_name);
 
+   /* Move to the thread's CPU(s) first, so that the task is allocated
+    * from memory local to them.
+    */
+   pin_thread(rast, index);
+
+   task = create_task(rast, index);
+   rast->tasks[index] = task;
+   pipe_semaphore_signal(&rast->threads_ready);
+   if (!task)
+      return 0;
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -838,11 +1079,8 @@ thread_function(void *init_data)
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -854,24 +1092,95 @@ thread_function(void *init_data)
 
 
 /**
- * Initialize semaphores and spawn the threads.
+ * Parse LP_THREAD_AFFINITY.
+ */
+static enum lp_rast_affinity
+get_affinity_policy(void)
+{
+   const char *policy = debug_get_option("LP_THREAD_AFFINITY", "none");
+
+   if (!strcmp(policy, "compact"))
+      return LP_RAST_AFFINITY_COMPACT;
+   if (!strcmp(policy, "scatter"))
+      return LP_RAST_AFFINITY_SCATTER;
+   if (!strcmp(policy, "l3"))
+      return LP_RAST_AFFINITY_L3;
+   if (strcmp(policy, "none"))
+      debug_printf("llvmpipe: unknown LP_THREAD_AFFINITY %s\n", policy);
+   return LP_RAST_AFFINITY_NONE;
+}
+
+
+/**
+ * Ask all threads to exit and wait for them, then free their tasks.
  */
 static void
+destroy_rast_threads(struct lp_rasterizer *rast)
+{
+   unsigned i;
+
+   /* Set exit_flag and signal each thread's work_ready semaphore.
+    * Each thread will be woken up, notice that the exit_flag is set and
+    * break out of its main loop.  The thread will then exit.
+    */
+   rast->exit_flag = TRUE;
+   for (i = 0; i < rast->num_threads; i++) {
+      if (rast->tasks[i])
+         pipe_semaphore_signal(&rast->tasks[i]->work_ready);
+   }
+
+   /* Wait for threads to terminate before cleaning up per-thread data.
+    * We don't actually call pipe_thread_wait to avoid dead lock on Windows
+    * per https://bugs.freedesktop.org/show_bug.cgi?id=76252 */
+   for (i = 0; i < rast->num_threads; i++) {
+#ifdef _WIN32
+      if (rast->tasks[i])
+         pipe_semaphore_wait(&rast->tasks[i]->work_done);
+#else
+      thrd_join(rast->threads[i], NULL);
+#endif
+   }
+
+   /* Clean up per-thread data */
+   for (i = 0; i < rast->num_threads; i++) {
+      if (rast->tasks[i]) {
+         destroy_task(rast->tasks[i]);
+         rast->tasks[i] = NULL;
+      }
+   }
+}
+
+
+/**
+ * Spawn the threads and wait for them to set up their tasks.
+ */
+static boolean
 create_rast_threads(struct lp_rasterizer *rast)
 {
+   unsigned num_threads = rast->num_threads;
    unsigned i;
 
    /* NOTE: if num_threads is zero, we won't use any threads */
-   for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_init(&rast->tasks[i].work_ready, 0);
-      pipe_semaphore_init(&rast->tasks[i].work_done, 0);
-      rast->threads[i] = u_thread_create(thread_function,
-                                            (void *) &rast->tasks[i]);
+   for (i = 0; i < num_threads; i++) {
+      rast->threads[i] = u_thread_create(thread_function, (void *) rast);
       if (!rast->threads[i]) {
          rast->num_threads = i; /* previous thread is max */
          break;
       }
    }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      pipe_semaphore_wait(&rast->threads_ready);
+   }
+
+   for (i = 0; i < rast->num_threads; i++) {
+      if (!rast->tasks[i]) {
+         destroy_rast_threads(rast);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
 }
 
 
@@ -885,7 +1194,6 @@ struct lp_rasterizer *
 lp_rast_create( unsigned num_threads )
 {
    struct lp_rasterizer *rast;
-   unsigned i;
 
    rast = CALLOC_STRUCT(lp_rasterizer);
    if (!rast) {
@@ -897,22 +1205,37 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
-   for (i = 0; i < MAX2(1, num_threads); i++) {
-      struct lp_rasterizer_task *task = &rast->tasks[i];
-      task->rast = rast;
-      task->thread_index = i;
-      task->thread_data.cache = align_malloc(sizeof(struct lp_build_format_cache),
-                                             16);
-      if (!task->thread_data.cache) {
-         goto no_thread_data_cache;
-      }
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof *rast->threads);
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
    }
 
    rast->num_threads = num_threads;
+   rast->affinity = get_affinity_policy();
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", FALSE);
 
-   create_rast_threads(rast);
+   rast->profile = lp_rast_profile_create(num_threads);
+
+#if defined(PIPE_ARCH_SSE)
+   rast->tri_32_3_masks = lp_rast_tri_32_3_choose_masks();
+#endif
+
+   if (num_threads == 0) {
+      /* rasterize in the calling thread */
+      rast->tasks[0] = create_task(rast, 0);
+      if (!rast->tasks[0]) {
+         goto no_tasks;
+      }
+   }
+   else {
+      pipe_semaphore_init(&rast->threads_ready, 0);
+      if (!create_rast_threads(rast)) {
+         pipe_semaphore_destroy(&rast->threads_ready);
+         goto no_tasks;
+      }
+   }
 
    /* for synchronizing rasterization threads */
    if (rast->num_threads > 0) {
@@ -923,13 +1246,10 @@ lp_rast_create( unsigned num_threads )
 
    return rast;
 
-no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
-      if (rast->tasks[i].thread_data.cache) {
-         align_free(rast->tasks[i].thread_data.cache);
-      }
-   }
-
+no_tasks:
+   lp_rast_profile_destroy(rast->profile);
+   FREE(rast->tasks);
+   FREE(rast->threads);
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -942,35 +1262,12 @@ no_rast:
  */
 void lp_rast_destroy( struct lp_rasterizer *rast )
 {
-   unsigned i;
-
-   /* Set exit_flag and signal each thread's work_ready semaphore.
-    * Each thread will be woken up, notice that the exit_flag is set and
-    * break out of its main loop.  The thread will then exit.
-    */
-   rast->exit_flag = TRUE;
-   for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_signal(&rast->tasks[i].work_ready);
-   }
-
-   /* Wait for threads to terminate before cleaning up per-thread data.
-    * We don't actually call pipe_thread_wait to avoid dead lock on Windows
-    * per https://bugs.freedesktop.org/show_bug.cgi?id=76252 */
-   for (i = 0; i < rast->num_threads; i++) {
-#ifdef _WIN32
-      pipe_semaphore_wait(&rast->tasks[i].work_done);
-#else
-      thrd_join(rast->threads[i], NULL);
-#endif
-   }
-
-   /* Clean up per-thread data */
-   for (i = 0; i < rast->num_threads; i++) {
-      pipe_semaphore_destroy(&rast->tasks[i].work_ready);
-      pipe_semaphore_destroy(&rast->tasks[i].work_done);
+   if (rast->num_threads > 0) {
+      destroy_rast_threads(rast);
+      pipe_semaphore_destroy(&rast->threads_ready);
    }
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
-      align_free(rast->tasks[i].thread_data.cache);
+   else {
+      destroy_task(rast->tasks[0]);
    }
 
    /* for synchronizing rasterization threads */
@@ -980,6 +1277,10 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   lp_rast_profile_destroy(rast->profile);
+
+   FREE(rast->tasks);
+   FREE(rast->threads);
    FREE(rast);
 }
 
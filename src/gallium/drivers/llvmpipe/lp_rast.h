@@ -88,6 +88,16 @@ struct lp_rast_state {
     * the tile color/z/stencil data somehow
      */
    struct lp_fragment_shader_variant *variant;
+
+   /* The variant's jit_function[] at binning time.  The variant may switch
+    * to optimized code meanwhile, the scene keeps running what it binned.
+    */
+   lp_jit_frag_func jit_function[2];
+
+   /* Coverage of a fully covered 4x4 block: 16 bits for each sample of
+    * the framebuffer the sample mask lets through.
+    */
+   uint64_t full_mask;
 };
 
 
@@ -166,9 +176,6 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
-void
-lp_rast_finish( struct lp_rasterizer *rast );
-
 
 union lp_rast_cmd_arg {
    const struct lp_rast_shader_inputs *shade_tile;
@@ -302,10 +309,21 @@ lp_rast_arg_null( void )
 #define LP_RAST_OP_TRIANGLE_32_3_4   0x1a
 #define LP_RAST_OP_TRIANGLE_32_3_16  0x1b
 #define LP_RAST_OP_TRIANGLE_32_4_16  0x1c
-
-#define LP_RAST_OP_MAX               0x1d
+#define LP_RAST_OP_MS_TRIANGLE_1     0x1d
+#define LP_RAST_OP_MS_TRIANGLE_2     0x1e
+#define LP_RAST_OP_MS_TRIANGLE_3     0x1f
+#define LP_RAST_OP_MS_TRIANGLE_4     0x20
+#define LP_RAST_OP_MS_TRIANGLE_5     0x21
+#define LP_RAST_OP_MS_TRIANGLE_6     0x22
+#define LP_RAST_OP_MS_TRIANGLE_7     0x23
+#define LP_RAST_OP_MS_TRIANGLE_8     0x24
+
+#define LP_RAST_OP_MAX               0x25
 #define LP_RAST_OP_MASK              0xff
 
+const char *
+lp_rast_cmd_name(unsigned cmd);
+
 void
 lp_debug_bins( struct lp_scene *scene );
 void
@@ -29,6 +29,7 @@
 #define LP_RAST_PRIV_H
 
 #include "util/format/u_format.h"
+#include "util/u_math.h"
 #include "util/u_thread.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
@@ -74,8 +75,41 @@ extern const struct lp_rasterizer_task *jit_task;
 
 
 struct lp_rasterizer;
+
+
+/**
+ * Coverage of one 4x4 block of a 16x16 block: block row i, column j.
+ * A set bit in mask means the pixel is outside the triangle.
+ */
+struct lp_rast_block_mask {
+   unsigned mask:16;
+   unsigned i:8;
+   unsigned j:8;
+};
+
+/**
+ * Compute the coverage of the 4x4 blocks of the 16x16 block at x, y for
+ * a 3-plane triangle with 32-bit edge values.  Blocks which are entirely
+ * outside are left out.  Returns the number of entries written to out.
+ */
+typedef unsigned
+(*lp_rast_tri_32_3_masks_func)(const struct lp_rast_plane *plane,
+                               int x, int y,
+                               struct lp_rast_block_mask out[16]);
+
 struct cmd_bin;
 
+/**
+ * How rasterizer threads are pinned to CPUs.
+ */
+enum lp_rast_affinity
+{
+   LP_RAST_AFFINITY_NONE,     /**< leave placement to the OS */
+   LP_RAST_AFFINITY_COMPACT,  /**< thread i on CPU i */
+   LP_RAST_AFFINITY_SCATTER,  /**< round-robin over the L3 domains */
+   LP_RAST_AFFINITY_L3,       /**< round-robin over L3 domains, free within */
+};
+
 /**
  * Per-thread rasterization state
  */
@@ -100,8 +134,23 @@ struct lp_rasterizer_task
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /**
+    * Hierarchical Z: a conservative upper bound of the depth values in the
+    * current tile, maintained while the tile's commands are executed.
+    * Only used for single-layer, single-sample unorm depth buffers.
+    */
+   boolean hiz_enabled;    /**< scene qualifies for hi-Z */
+   boolean hiz_valid;      /**< hiz_zmax holds a bound */
+   boolean hiz_cull;       /**< current state may be culled against hiz_zmax */
+   boolean hiz_tighten;    /**< current state writes every covered pixel */
+   float hiz_margin;       /**< depth quantization slack */
+   float hiz_zmax;
+
+   /** Record of the bin being rasterized, when profiling */
+   struct lp_rast_bin_profile *bin_profile;
+
    pipe_semaphore work_ready;
-   pipe_semaphore work_done;
+   pipe_semaphore work_done;   /**< signalled on exit, for Windows */
 };
 
 
@@ -118,25 +167,58 @@ struct lp_rasterizer
    /** The incoming queue of scenes ready to rasterize */
    struct lp_scene_queue *full_scenes;
 
+   /** Widest edge mask kernel the CPU supports, for 3-plane triangles */
+   lp_rast_tri_32_3_masks_func tri_32_3_masks;
+
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /**
+    * A task object for each rasterization thread.  These are allocated by
+    * the threads themselves, after applying the affinity policy, so that
+    * first touch puts them on the thread's own NUMA node.
+    */
+   struct lp_rasterizer_task **tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
+
+   /** Thread placement, see LP_THREAD_AFFINITY */
+   enum lp_rast_affinity affinity;
+
+   /** Index handed to the next thread starting up */
+   unsigned next_thread_index;
+
+   /** Signalled by each thread once it has set up its task */
+   pipe_semaphore threads_ready;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
+
+   /** Per bin command statistics, see LP_PROFILE */
+   struct lp_rast_profile *profile;
 };
 
 
 void
+lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
+                                const struct lp_rast_shader_inputs *inputs,
+                                unsigned x, unsigned y,
+                                uint64_t mask);
+
+
+/**
+ * Shade a 4x4 block with the same 16 bit pixel coverage for every sample.
+ */
+static inline void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask);
+                         unsigned mask)
+{
+   lp_rast_shade_quads_mask_sample(task, inputs, x, y,
+                                   (uint64_t)mask * 0x0001000100010001ULL);
+}
 
 
 /**
@@ -215,6 +297,53 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+/**
+ * Bounds of the triangle's depth plane over the pixel rectangle
+ * [x0, x1] x [y0, y1].  The bounds are widened by the rounding error of
+ * evaluating the plane, so they hold for the shader's interpolation too.
+ */
+static inline void
+lp_rast_depth_bounds(const struct lp_rast_shader_inputs *inputs,
+                     float x0, float y0, float x1, float y1,
+                     float *zmin, float *zmax)
+{
+   /* position is always input slot 0 */
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float zx0 = dzdx * x0, zx1 = dzdx * x1;
+   const float zy0 = dzdy * y0, zy1 = dzdy * y1;
+   const float eps = (fabsf(a0) + fabsf(dzdx) * x1 + fabsf(dzdy) * y1 +
+                      1.0f) * (4.0f * FLT_EPSILON);
+
+   *zmin = a0 + MIN2(zx0, zx1) + MIN2(zy0, zy1) - eps;
+   *zmax = a0 + MAX2(zx0, zx1) + MAX2(zy0, zy1) + eps;
+}
+
+
+/**
+ * Whether every fragment of the triangle inside the size x size pixel
+ * square at x, y is known to fail the depth test against the tile's
+ * hi-Z bound.
+ */
+static inline boolean
+lp_rast_hiz_reject(const struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y, unsigned size)
+{
+   float zmin, zmax;
+
+   if (!task->hiz_valid || !task->hiz_cull)
+      return FALSE;
+
+   lp_rast_depth_bounds(inputs, (float)x, (float)y,
+                        (float)(x + size), (float)(y + size),
+                        &zmin, &zmax);
+
+   return zmin > task->hiz_zmax + task->hiz_margin;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -227,22 +356,25 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
 {
    const struct lp_scene *scene = task->scene;
    const struct lp_rast_state *state = task->state;
-   struct lp_fragment_shader_variant *variant = state->variant;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].layer_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -250,6 +382,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    if (scene->zsbuf.map) {
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.layer_stride;
    }
 
    /*
@@ -262,18 +395,20 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
 
       /* run shader on 4x4 block */
       BEGIN_JIT_CALL(state, task);
-      variant->jit_function[RAST_WHOLE]( &state->jit_context,
-                                         x, y,
-                                         inputs->frontfacing,
-                                         GET_A0(inputs),
-                                         GET_DADX(inputs),
-                                         GET_DADY(inputs),
-                                         color,
-                                         depth,
-                                         0xffff,
-                                         &task->thread_data,
-                                         stride,
-                                         depth_stride);
+      state->jit_function[RAST_WHOLE]( &state->jit_context,
+                                       x, y,
+                                       inputs->frontfacing,
+                                       GET_A0(inputs),
+                                       GET_DADX(inputs),
+                                       GET_DADY(inputs),
+                                       color,
+                                       depth,
+                                       state->full_mask,
+                                       &task->thread_data,
+                                       stride,
+                                       depth_stride,
+                                       sample_stride,
+                                       depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -331,6 +466,47 @@ void lp_rast_triangle_32_3_16( struct lp_rasterizer_task *,
 void lp_rast_triangle_32_4_16( struct lp_rasterizer_task *, 
                             const union lp_rast_cmd_arg );
 
+void lp_rast_triangle_ms_1( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_2( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_3( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_4( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_5( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_6( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_7( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+void lp_rast_triangle_ms_8( struct lp_rasterizer_task *,
+                            const union lp_rast_cmd_arg );
+
+
+#if defined(PIPE_ARCH_SSE)
+unsigned
+lp_rast_tri_32_3_masks_sse(const struct lp_rast_plane *plane,
+                           int x, int y,
+                           struct lp_rast_block_mask out[16]);
+
+#if defined(HAVE_LP_RAST_AVX2)
+unsigned
+lp_rast_tri_32_3_masks_avx2(const struct lp_rast_plane *plane,
+                            int x, int y,
+                            struct lp_rast_block_mask out[16]);
+#endif
+#if defined(HAVE_LP_RAST_AVX512)
+unsigned
+lp_rast_tri_32_3_masks_avx512(const struct lp_rast_plane *plane,
+                              int x, int y,
+                              struct lp_rast_block_mask out[16]);
+#endif
+
+lp_rast_tri_32_3_masks_func
+lp_rast_tri_32_3_choose_masks(void);
+#endif /* PIPE_ARCH_SSE */
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg);
@@ -0,0 +1,285 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Rasterizer profiler, see lp_rast_profile.h.
+ */
+
+#include <stdio.h>
+
+#include "util/os_time.h"
+#include "util/u_atomic.h"
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+
+#include "lp_rast_profile.h"
+
+
+struct lp_rast_thread_profile
+{
+   /** Bins executed by the thread in the current scene */
+   struct lp_rast_bin_profile *bins;
+   unsigned num_bins;
+   unsigned max_bins;
+
+   int64_t scene_start, scene_end;
+};
+
+
+struct lp_rast_profile
+{
+   FILE *file;
+   int64_t start;             /**< time stamps are relative to this */
+   unsigned id;               /**< rasterizer number, used as trace pid */
+   unsigned num_scenes;
+   unsigned num_threads;
+   struct lp_rast_thread_profile *threads;
+};
+
+
+static unsigned lp_rast_profile_count;
+
+
+/**
+ * Open the trace file if LP_PROFILE is set, or return NULL.  The first
+ * rasterizer writes to the file named by LP_PROFILE, further ones (one
+ * per context) append their number to the name.
+ */
+struct lp_rast_profile *
+lp_rast_profile_create(unsigned num_threads)
+{
+   const char *path = debug_get_option("LP_PROFILE", NULL);
+   struct lp_rast_profile *profile;
+   char filename[1024];
+   unsigned i;
+
+   if (!path || !*path)
+      return NULL;
+
+   profile = CALLOC_STRUCT(lp_rast_profile);
+   if (!profile)
+      return NULL;
+
+   profile->num_threads = MAX2(num_threads, 1);
+   profile->threads = CALLOC(profile->num_threads,
+                             sizeof *profile->threads);
+   if (!profile->threads) {
+      FREE(profile);
+      return NULL;
+   }
+
+   profile->id = p_atomic_inc_return(&lp_rast_profile_count) - 1;
+   if (profile->id)
+      snprintf(filename, sizeof filename, "%s.%u", path, profile->id);
+   else
+      snprintf(filename, sizeof filename, "%s", path);
+
+   profile->file = fopen(filename, "w");
+   if (!profile->file) {
+      debug_printf("llvmpipe: couldn't open %s for profiling\n", filename);
+      FREE(profile->threads);
+      FREE(profile);
+      return NULL;
+   }
+
+   profile->start = os_time_get_nano();
+
+   /* JSON array format, closed on destruction.  Trace viewers also
+    * accept the file if the process exits without that. */
+   fprintf(profile->file, "[\n");
+   for (i = 0; i < profile->num_threads; i++) {
+      fprintf(profile->file,
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+              "\"args\":{\"name\":\"llvmpipe-%u\"}},\n",
+              profile->id, i, i);
+   }
+
+   return profile;
+}
+
+
+void
+lp_rast_profile_destroy(struct lp_rast_profile *profile)
+{
+   unsigned i;
+
+   if (!profile)
+      return;
+
+   /* an event without a comma after it to end the array with */
+   fprintf(profile->file,
+           "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+           "\"args\":{\"name\":\"llvmpipe rasterizer %u\"}}\n]\n",
+           profile->id, profile->id);
+   fclose(profile->file);
+
+   for (i = 0; i < profile->num_threads; i++)
+      FREE(profile->threads[i].bins);
+   FREE(profile->threads);
+   FREE(profile);
+}
+
+
+void
+lp_rast_profile_begin_scene(struct lp_rast_profile *profile,
+                            unsigned thread_index)
+{
+   struct lp_rast_thread_profile *thread = &profile->threads[thread_index];
+
+   thread->num_bins = 0;
+   thread->scene_start = os_time_get_nano();
+}
+
+
+void
+lp_rast_profile_end_scene(struct lp_rast_profile *profile,
+                          unsigned thread_index)
+{
+   profile->threads[thread_index].scene_end = os_time_get_nano();
+}
+
+
+/**
+ * Get a zeroed record for a bin, or NULL if out of memory.
+ */
+struct lp_rast_bin_profile *
+lp_rast_profile_begin_bin(struct lp_rast_profile *profile,
+                          unsigned thread_index,
+                          int x, int y)
+{
+   struct lp_rast_thread_profile *thread = &profile->threads[thread_index];
+   struct lp_rast_bin_profile *bin;
+
+   if (thread->num_bins == thread->max_bins) {
+      unsigned max_bins = MAX2(thread->max_bins * 2, 64);
+      struct lp_rast_bin_profile *bins;
+
+      bins = REALLOC(thread->bins,
+                     thread->max_bins * sizeof *bins,
+                     max_bins * sizeof *bins);
+      if (!bins)
+         return NULL;
+      thread->bins = bins;
+      thread->max_bins = max_bins;
+   }
+
+   bin = &thread->bins[thread->num_bins++];
+   memset(bin, 0, sizeof *bin);
+   bin->x = x;
+   bin->y = y;
+   bin->start = os_time_get_nano();
+   return bin;
+}
+
+
+void
+lp_rast_profile_end_bin(struct lp_rast_bin_profile *bin)
+{
+   bin->end = os_time_get_nano();
+}
+
+
+static double
+profile_us(const struct lp_rast_profile *profile, int64_t t)
+{
+   return (double)(t - profile->start) / 1000.0;
+}
+
+
+/**
+ * Write "args" members for the command counts and times, in
+ * microseconds, of the commands that were executed.
+ */
+static void
+write_cmd_args(FILE *file, const unsigned *count, const int64_t *time)
+{
+   unsigned cmd;
+
+   for (cmd = 0; cmd < LP_RAST_OP_MAX; cmd++) {
+      if (!count[cmd])
+         continue;
+      fprintf(file, ",\"%s\":{\"count\":%u,\"us\":%.3f}",
+              lp_rast_cmd_name(cmd), count[cmd],
+              (double)time[cmd] / 1000.0);
+   }
+}
+
+
+/**
+ * Append the records of the scene all threads just finished.
+ * Called by one thread once the others are done with the scene.
+ */
+void
+lp_rast_profile_write_scene(struct lp_rast_profile *profile)
+{
+   FILE *file = profile->file;
+   const unsigned scene = profile->num_scenes++;
+   unsigned i, j, cmd;
+
+   for (i = 0; i < profile->num_threads; i++) {
+      const struct lp_rast_thread_profile *thread = &profile->threads[i];
+      unsigned count[LP_RAST_OP_MAX] = { 0 };
+      int64_t time[LP_RAST_OP_MAX] = { 0 };
+      int64_t busy = 0;
+
+      for (j = 0; j < thread->num_bins; j++) {
+         const struct lp_rast_bin_profile *bin = &thread->bins[j];
+
+         fprintf(file,
+                 "{\"name\":\"bin %d,%d\",\"cat\":\"bin\",\"ph\":\"X\","
+                 "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                 "\"args\":{\"scene\":%u,\"x\":%d,\"y\":%d",
+                 bin->x, bin->y, profile->id, i,
+                 profile_us(profile, bin->start),
+                 (double)(bin->end - bin->start) / 1000.0,
+                 scene, bin->x, bin->y);
+         write_cmd_args(file, bin->count, bin->time);
+         fprintf(file, "}},\n");
+
+         for (cmd = 0; cmd < LP_RAST_OP_MAX; cmd++) {
+            count[cmd] += bin->count[cmd];
+            time[cmd] += bin->time[cmd];
+         }
+         busy += bin->end - bin->start;
+      }
+
+      /* per thread scene totals, busy vs. total time shows imbalance */
+      fprintf(file,
+              "{\"name\":\"scene %u\",\"cat\":\"scene\",\"ph\":\"X\","
+              "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+              "\"args\":{\"bins\":%u,\"busy_us\":%.3f",
+              scene, profile->id, i,
+              profile_us(profile, thread->scene_start),
+              (double)(thread->scene_end - thread->scene_start) / 1000.0,
+              thread->num_bins, (double)busy / 1000.0);
+      write_cmd_args(file, count, time);
+      fprintf(file, "}},\n");
+   }
+
+   fflush(file);
+}
@@ -0,0 +1,86 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Opt-in rasterizer profiler (LP_PROFILE).
+ *
+ * Every rasterizer thread records, for each bin it executes, the time
+ * spent and the number of commands of each type.  Once a scene is done
+ * the records are appended to a trace file in the Trace Event JSON format,
+ * which chrome://tracing, Perfetto and similar tools can load.
+ */
+
+#ifndef LP_RAST_PROFILE_H
+#define LP_RAST_PROFILE_H
+
+#include "pipe/p_compiler.h"
+#include "lp_rast.h"
+
+
+/**
+ * Time (in nanoseconds) and count of the commands of one bin.
+ */
+struct lp_rast_bin_profile
+{
+   int x, y;                /**< tile position, in pixels */
+   int64_t start, end;
+   unsigned count[LP_RAST_OP_MAX];
+   int64_t time[LP_RAST_OP_MAX];
+};
+
+
+struct lp_rast_profile;
+
+
+struct lp_rast_profile *
+lp_rast_profile_create(unsigned num_threads);
+
+void
+lp_rast_profile_destroy(struct lp_rast_profile *profile);
+
+void
+lp_rast_profile_begin_scene(struct lp_rast_profile *profile,
+                            unsigned thread_index);
+
+void
+lp_rast_profile_end_scene(struct lp_rast_profile *profile,
+                          unsigned thread_index);
+
+struct lp_rast_bin_profile *
+lp_rast_profile_begin_bin(struct lp_rast_profile *profile,
+                          unsigned thread_index,
+                          int x, int y);
+
+void
+lp_rast_profile_end_bin(struct lp_rast_bin_profile *bin);
+
+void
+lp_rast_profile_write_scene(struct lp_rast_profile *profile);
+
+
+#endif /* LP_RAST_PROFILE_H */
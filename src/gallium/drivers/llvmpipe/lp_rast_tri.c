@@ -31,6 +31,8 @@
 
 #include <limits.h>
 #include "util/u_math.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
 #include "lp_rast_priv.h"
@@ -63,6 +65,17 @@ block_full_16(struct lp_rasterizer_task *task,
 	 block_full_4(task, tri, x + ix, y + iy);
 }
 
+/**
+ * lp_sample_pos_4x in 1/FIXED_ONE pixel units.
+ */
+static const int32_t lp_sample_pos_fixed[LP_MAX_SAMPLES][2] = {
+   {  96,  32 },
+   { 224,  96 },
+   {  32, 160 },
+   { 160, 224 },
+};
+
+
 static inline unsigned
 build_mask_linear(int32_t c, int32_t dcdx, int32_t dcdy)
 {
@@ -237,17 +250,12 @@ sign_bits4(const __m128i *cstep, int cdiff)
 
 #define NR_PLANES 3
 
-void
-lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
-                         const union lp_rast_cmd_arg arg)
+unsigned
+lp_rast_tri_32_3_masks_sse(const struct lp_rast_plane *plane,
+                           int x, int y,
+                           struct lp_rast_block_mask out[16])
 {
-   const struct lp_rast_triangle *tri = arg.triangle.tri;
-   const struct lp_rast_plane *plane = GET_PLANES(tri);
-   int x = (arg.triangle.plane_mask & 0xff) + task->x;
-   int y = (arg.triangle.plane_mask >> 8) + task->y;
    unsigned i, j;
-
-   struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
    unsigned nr = 0;
 
    /* p0 and p2 are aligned, p1 is not (plane size 24 bytes). */
@@ -342,6 +350,51 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
       c = _mm_add_epi32(c, _mm_slli_epi32(dcdy, 2));
    }
 
+   return nr;
+}
+
+
+/**
+ * Pick the mask kernel for the CPU.  AVX2 is preferred: in lp_test_rast the
+ * AVX-512 kernel is slower than it, and 512-bit instructions may lower the
+ * core clock for everything else running, so that one is only used when
+ * LP_RAST_AVX512 is set.  Note gallivm clears has_avx2 when
+ * LP_NATIVE_VECTOR_WIDTH=128, which thus also applies here.
+ */
+lp_rast_tri_32_3_masks_func
+lp_rast_tri_32_3_choose_masks(void)
+{
+#if defined(HAVE_LP_RAST_AVX512)
+   if (util_cpu_caps.has_avx2 && util_cpu_caps.has_avx512f &&
+       debug_get_bool_option("LP_RAST_AVX512", FALSE))
+      return lp_rast_tri_32_3_masks_avx512;
+#endif
+#if defined(HAVE_LP_RAST_AVX2)
+   if (util_cpu_caps.has_avx2)
+      return lp_rast_tri_32_3_masks_avx2;
+#endif
+   return lp_rast_tri_32_3_masks_sse;
+}
+
+
+void
+lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
+                         const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+   const struct lp_rast_plane *plane = GET_PLANES(tri);
+   int x = (arg.triangle.plane_mask & 0xff) + task->x;
+   int y = (arg.triangle.plane_mask >> 8) + task->y;
+   struct lp_rast_block_mask out[16];
+   unsigned i, nr;
+
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
+   nr = task->rast->tri_32_3_masks(plane, x, y, out);
+
    for (i = 0; i < nr; i++)
       lp_rast_shade_quads_mask(task,
                                &tri->inputs,
@@ -534,6 +587,11 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
    unsigned nr = 0;
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    __m128i p0 = lp_plane_to_m128i(&plane[0]); /* c, dcdx, dcdy, eo */
    __m128i p1 = lp_plane_to_m128i(&plane[1]); /* c, dcdx, dcdy, eo */
    __m128i p2 = lp_plane_to_m128i(&plane[2]); /* c, dcdx, dcdy, eo */
@@ -732,6 +790,45 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 #define NR_PLANES 8
 #include "lp_rast_tri_tmp.h"
 
+/*
+ * Multisample rasterization: planes evaluated at the pixel corners, see
+ * lp_setup_bin_triangle().  Only the 4x4 block level differs.
+ */
+#define MULTISAMPLE 1
+
+#define TAG(x) x##_ms_1
+#define NR_PLANES 1
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_2
+#define NR_PLANES 2
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_3
+#define NR_PLANES 3
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_4
+#define NR_PLANES 4
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_5
+#define NR_PLANES 5
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_6
+#define NR_PLANES 6
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_7
+#define NR_PLANES 7
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_8
+#define NR_PLANES 8
+#include "lp_rast_tri_tmp.h"
+
+#undef MULTISAMPLE
 #undef RASTER_64
 
 #define TAG(x) x##_32_1
@@ -0,0 +1,118 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * AVX2 edge mask kernel for 3-plane triangles.
+ *
+ * This file is built with -mavx2 and must only be called after checking
+ * util_cpu_caps, see lp_rast_tri_32_3_choose_masks().
+ */
+
+#include <immintrin.h>
+#include "util/u_math.h"
+#include "lp_rast_priv.h"
+
+
+/**
+ * First do the trivial reject test of all sixteen 4x4 blocks at once,
+ * eight blocks per vector, then compute the masks of the remaining blocks.
+ * Each vector then holds two rows of a block, so the sign bits of the
+ * or'ed edge values are half of the block's mask.
+ */
+unsigned
+lp_rast_tri_32_3_masks_avx2(const struct lp_rast_plane *plane,
+                            int x, int y,
+                            struct lp_rast_block_mask out[16])
+{
+   const __m256i blk_x = _mm256_setr_epi32(0, 4, 8, 12, 0, 4, 8, 12);
+   const __m256i blk_y = _mm256_setr_epi32(0, 0, 0, 0, 4, 4, 4, 4);
+   const __m256i pix_x = _mm256_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3);
+   const __m256i pix_y = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+   __m256i rej_lo = _mm256_setzero_si256();
+   __m256i rej_hi = _mm256_setzero_si256();
+   __m256i span_01[3], span_23[3];
+   uint32_t c[3], dcdx[3], dcdy[3];
+   unsigned live, p;
+   unsigned nr = 0;
+
+   for (p = 0; p < 3; p++) {
+      /* unsigned arithmetic to get the wrap-around of the SSE path */
+      uint32_t rej4;
+      __m256i vdcdx, vdcdy, cblk;
+
+      dcdx[p] = -(uint32_t) plane[p].dcdx;
+      dcdy[p] = plane[p].dcdy;
+      rej4 = ((plane[p].dcdy > 0 ? plane[p].dcdy : 0) -
+              (plane[p].dcdx < 0 ? plane[p].dcdx : 0)) * 4;
+      /* -1 so we can just check the sign bit instead of <= 0 */
+      c[p] = (uint32_t) plane[p].c + dcdx[p] * x + dcdy[p] * y - 1;
+
+      vdcdx = _mm256_set1_epi32(dcdx[p]);
+      vdcdy = _mm256_set1_epi32(dcdy[p]);
+
+      cblk = _mm256_add_epi32(_mm256_set1_epi32(c[p] + rej4 + 1),
+                              _mm256_add_epi32(_mm256_mullo_epi32(blk_x, vdcdx),
+                                               _mm256_mullo_epi32(blk_y, vdcdy)));
+      rej_lo = _mm256_or_si256(rej_lo, cblk);
+      rej_hi = _mm256_or_si256(rej_hi,
+                  _mm256_add_epi32(cblk, _mm256_slli_epi32(vdcdy, 3)));
+
+      span_01[p] = _mm256_add_epi32(_mm256_mullo_epi32(pix_x, vdcdx),
+                                    _mm256_mullo_epi32(pix_y, vdcdy));
+      span_23[p] = _mm256_add_epi32(span_01[p], _mm256_slli_epi32(vdcdy, 1));
+   }
+
+   live = ~(_mm256_movemask_ps(_mm256_castsi256_ps(rej_lo)) |
+            (_mm256_movemask_ps(_mm256_castsi256_ps(rej_hi)) << 8)) & 0xffff;
+
+   while (live) {
+      unsigned b = u_bit_scan(&live);
+      unsigned i = b / 4, j = b % 4;
+      __m256i c_01 = _mm256_setzero_si256();
+      __m256i c_23 = _mm256_setzero_si256();
+      unsigned mask;
+
+      for (p = 0; p < 3; p++) {
+         __m256i cb = _mm256_set1_epi32(c[p] + 4 * j * dcdx[p] +
+                                        4 * i * dcdy[p]);
+         c_01 = _mm256_or_si256(c_01, _mm256_add_epi32(cb, span_01[p]));
+         c_23 = _mm256_or_si256(c_23, _mm256_add_epi32(cb, span_23[p]));
+      }
+
+      mask = _mm256_movemask_ps(_mm256_castsi256_ps(c_01)) |
+             (_mm256_movemask_ps(_mm256_castsi256_ps(c_23)) << 8);
+
+      out[nr].i = i;
+      out[nr].j = j;
+      out[nr].mask = mask;
+      if (mask != 0xffff)
+         nr++;
+   }
+
+   return nr;
+}
@@ -0,0 +1,114 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * AVX-512 edge mask kernel for 3-plane triangles.
+ *
+ * This file is built with -mavx512f and must only be called after
+ * checking util_cpu_caps, see lp_rast_tri_32_3_choose_masks().
+ */
+
+#include <immintrin.h>
+#include "util/u_math.h"
+#include "lp_rast_priv.h"
+
+
+/**
+ * First do the trivial reject test of all sixteen 4x4 blocks with one
+ * vector per plane, then compute the masks of the remaining blocks.  Each
+ * vector then holds a whole block, so the sign bits of the or'ed edge
+ * values are the block's mask.
+ */
+unsigned
+lp_rast_tri_32_3_masks_avx512(const struct lp_rast_plane *plane,
+                              int x, int y,
+                              struct lp_rast_block_mask out[16])
+{
+   const __m512i zero = _mm512_setzero_si512();
+   const __m512i col = _mm512_setr_epi32(0, 1, 2, 3, 0, 1, 2, 3,
+                                         0, 1, 2, 3, 0, 1, 2, 3);
+   const __m512i row = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1,
+                                         2, 2, 2, 2, 3, 3, 3, 3);
+   __m512i cblk[3], span[3];
+   uint32_t c[3], dcdx[3], dcdy[3];
+   unsigned live, p;
+   unsigned nr = 0;
+
+   for (p = 0; p < 3; p++) {
+      /* unsigned arithmetic to get the wrap-around of the SSE path */
+      uint32_t rej4;
+      __m512i vdcdx, vdcdy;
+
+      dcdx[p] = -(uint32_t) plane[p].dcdx;
+      dcdy[p] = plane[p].dcdy;
+      rej4 = ((plane[p].dcdy > 0 ? plane[p].dcdy : 0) -
+              (plane[p].dcdx < 0 ? plane[p].dcdx : 0)) * 4;
+      /* -1 so we can just check the sign bit instead of <= 0 */
+      c[p] = (uint32_t) plane[p].c + dcdx[p] * x + dcdy[p] * y - 1;
+
+      vdcdx = _mm512_set1_epi32(dcdx[p]);
+      vdcdy = _mm512_set1_epi32(dcdy[p]);
+
+      /* lane i * 4 + j is the pixel in the block, or the block in the
+       * 16x16 block
+       */
+      span[p] = _mm512_add_epi32(_mm512_mullo_epi32(col, vdcdx),
+                                 _mm512_mullo_epi32(row, vdcdy));
+      cblk[p] = _mm512_add_epi32(_mm512_set1_epi32(c[p] + rej4 + 1),
+                                 _mm512_slli_epi32(span[p], 2));
+   }
+
+   /* 0xfe: a | b | c */
+   live = ~_mm512_cmplt_epi32_mask(
+              _mm512_ternarylogic_epi32(cblk[0], cblk[1], cblk[2], 0xfe),
+              zero) & 0xffff;
+
+   while (live) {
+      unsigned b = u_bit_scan(&live);
+      unsigned i = b / 4, j = b % 4;
+      __m512i cp[3];
+      unsigned mask;
+
+      for (p = 0; p < 3; p++) {
+         cp[p] = _mm512_add_epi32(_mm512_set1_epi32(c[p] + 4 * j * dcdx[p] +
+                                                    4 * i * dcdy[p]),
+                                  span[p]);
+      }
+
+      mask = _mm512_cmplt_epi32_mask(
+                _mm512_ternarylogic_epi32(cp[0], cp[1], cp[2], 0xfe), zero);
+
+      out[nr].i = i;
+      out[nr].j = j;
+      out[nr].mask = mask;
+      if (mask != 0xffff)
+         nr++;
+   }
+
+   return nr;
+}
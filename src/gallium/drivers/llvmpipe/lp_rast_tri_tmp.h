@@ -46,6 +46,36 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
                 int x, int y,
                 const int64_t *c)
 {
+#ifdef MULTISAMPLE
+   /*
+    * The planes are evaluated at the pixel corners here, test every
+    * sample position of the 16 pixels and gather 16 bits per sample.
+    */
+   uint64_t mask = 0;
+   unsigned s;
+   int j;
+
+   for (s = 0; s < task->scene->fb_samples; s++) {
+      unsigned smask = 0xffff;
+
+      for (j = 0; j < NR_PLANES; j++) {
+         const int64_t cs = c[j] +
+            ((IMUL64(-plane[j].dcdx, lp_sample_pos_fixed[s][0]) +
+              IMUL64(plane[j].dcdy, lp_sample_pos_fixed[s][1])) >> FIXED_ORDER);
+
+         smask &= ~BUILD_MASK_LINEAR(((cs - 1) >> (int64_t)FIXED_ORDER),
+                                     -plane[j].dcdx >> FIXED_ORDER,
+                                     plane[j].dcdy >> FIXED_ORDER);
+      }
+
+      mask |= (uint64_t)smask << (16 * s);
+   }
+
+   /* Now pass to the shader:
+    */
+   if (mask)
+      lp_rast_shade_quads_mask_sample(task, &tri->inputs, x, y, mask);
+#else
    unsigned mask = 0xffff;
    int j;
 
@@ -65,6 +95,7 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
     */
    if (mask)
       lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+#endif
 }
 
 /**
@@ -191,6 +222,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       return;
    }
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, TILE_SIZE)) {
+      LP_COUNT(nr_hiz_culled_64);
+      return;
+   }
+
    outmask = 0;                 /* outside one or more trivial reject planes */
    partmask = 0;                /* outside one or more trivial accept planes */
 
@@ -301,6 +337,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       partial_mask &= ~(1 << i);
 
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -316,6 +357,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (lp_rast_hiz_reject(task, &tri->inputs, px, py, 16)) {
+         LP_COUNT(nr_hiz_culled_16);
+         continue;
+      }
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
    }
@@ -345,6 +391,11 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (lp_rast_hiz_reject(task, &tri->inputs, x, y, 16)) {
+      LP_COUNT(nr_hiz_culled_16);
+      return;
+   }
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
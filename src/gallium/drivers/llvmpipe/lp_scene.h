@@ -148,6 +148,11 @@ struct lp_scene {
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* Samples per pixel.  Each sample is stored as an image slice of its
+    * own, so the rasterizer addresses slice layer * fb_samples + sample.
+    */
+   unsigned fb_samples;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
@@ -172,8 +177,16 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /**
+    * Non-empty bins in the order they are handed out to the rasterizer
+    * threads: most expensive first, so that a few heavy tiles don't end
+    * up being started last and leave the other threads idle at the end
+    * of the scene.  Each entry holds the bin index in the low 32 bits
+    * and the inverted cost in the high bits, see lp_scene_bin_iter_begin.
+    */
+   uint64_t bin_order[TILES_X * TILES_Y];
+   unsigned num_active_bins;
+   unsigned curr_bin;   /**< next entry of bin_order, advanced atomically */
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -196,10 +209,11 @@ struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
 
 boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
-                                        boolean initializing_scene);
+                                        boolean initializing_scene,
+                                        boolean writeable);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 
 /**
@@ -39,7 +39,10 @@
 
 
 
-#define SCENE_QUEUE_SIZE 4
+/* Room for several contexts' worth of in-flight scenes (MAX_SCENES each)
+ * before lp_scene_enqueue() blocks.
+ */
+#define SCENE_QUEUE_SIZE 8
 
 
 
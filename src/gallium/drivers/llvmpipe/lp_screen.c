@@ -33,11 +33,16 @@
 #include "util/u_screen.h"
 #include "util/u_string.h"
 #include "util/format/u_format_s3tc.h"
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
+#include "util/u_atomic.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_nir.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_debug.h"
 
 #include "util/os_misc.h"
 #include "util/os_time.h"
@@ -49,6 +54,7 @@
 #include "lp_debug.h"
 #include "lp_public.h"
 #include "lp_limits.h"
+#include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
 
@@ -75,6 +81,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "cs", DEBUG_CS, NULL },
    { "tgsi_ir", DEBUG_TGSI_IR, NULL },
    { "cl", DEBUG_CL, NULL },
+   { "texcache", DEBUG_TEX_CACHE, NULL },
    DEBUG_NAMED_VALUE_END
 };
 #endif
@@ -89,6 +96,7 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -671,8 +679,21 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
           target == PIPE_TEXTURE_CUBE ||
           target == PIPE_TEXTURE_CUBE_ARRAY);
 
-   if (sample_count > 1)
-      return false;
+   if (sample_count > 1) {
+      /*
+       * Multisample surfaces can be rendered to and resolved, but the
+       * samplers can't fetch individual samples yet, so they can't be
+       * bound as textures.
+       */
+      if (!screen->msaa || sample_count != LP_MAX_SAMPLES)
+         return false;
+      if (target != PIPE_TEXTURE_2D &&
+          target != PIPE_TEXTURE_2D_ARRAY &&
+          target != PIPE_TEXTURE_RECT)
+         return false;
+      if (bind & ~(PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL))
+         return false;
+   }
 
    if (MAX2(1, sample_count) != MAX2(1, storage_sample_count))
       return false;
@@ -786,13 +807,14 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
    lp_jit_screen_cleanup(screen);
 
+   disk_cache_destroy(screen->disk_shader_cache);
+
    if(winsys->destroy)
       winsys->destroy(winsys);
 
    glsl_type_singleton_decref();
 
    mtx_destroy(&screen->rast_mutex);
-   mtx_destroy(&screen->cs_mutex);
    FREE(screen);
 }
 
@@ -843,6 +865,89 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+static void
+lp_disk_cache_create(struct llvmpipe_screen *screen)
+{
+   struct mesa_sha1 ctx;
+   unsigned char sha1[20];
+   char cache_id[20 * 2 + 1];
+
+   _mesa_sha1_init(&ctx);
+
+   if (!disk_cache_get_function_identifier(lp_disk_cache_create, &ctx) ||
+       !disk_cache_get_function_identifier(LLVMLinkInMCJIT, &ctx))
+      return;
+
+   /*
+    * The generated code depends on the host CPU features and on the
+    * code generation tuning, so make them part of the cache identity in
+    * case the cache directory is shared between different machines.
+    */
+   _mesa_sha1_update(&ctx, &util_cpu_caps, sizeof(util_cpu_caps));
+   _mesa_sha1_update(&ctx, &lp_native_vector_width,
+                     sizeof(lp_native_vector_width));
+   _mesa_sha1_update(&ctx, &gallivm_perf, sizeof(gallivm_perf));
+   _mesa_sha1_final(&ctx, sha1);
+   disk_cache_format_hex_id(cache_id, sha1, 20 * 2);
+
+   screen->disk_shader_cache = disk_cache_create("llvmpipe", cache_id, 0);
+}
+
+static struct disk_cache *
+lp_get_disk_shader_cache(struct pipe_screen *_screen)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+
+   return screen->disk_shader_cache;
+}
+
+/**
+ * Look up the machine code of a shader variant in the disk cache.
+ * On a hit the cache struct takes ownership of the returned data.
+ */
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+   size_t binary_size;
+   uint8_t *buffer;
+
+   if (!screen->disk_shader_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key, 20, sha1);
+
+   buffer = disk_cache_get(screen->disk_shader_cache, sha1, &binary_size);
+   if (!buffer) {
+      cache->data_size = 0;
+      p_atomic_inc(&screen->num_disk_shader_cache_misses);
+      return;
+   }
+   cache->data_size = binary_size;
+   cache->data = buffer;
+   p_atomic_inc(&screen->num_disk_shader_cache_hits);
+}
+
+/**
+ * Store the freshly compiled machine code of a shader variant.
+ */
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key, 20, sha1);
+   disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
+                  cache->data_size, NULL);
+}
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -891,8 +996,11 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
 
    screen->base.finalize_nir = llvmpipe_finalize_nir;
+
+   screen->base.get_disk_shader_cache = lp_get_disk_shader_cache;
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
    screen->use_tgsi = (LP_DEBUG & DEBUG_TGSI_IR);
@@ -903,6 +1011,18 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
+   /* Real multisampling, rather than the state tracker's fake MSAA */
+   screen->msaa = debug_get_bool_option("LP_MSAA", FALSE);
+   screen->async_compile = debug_get_bool_option("LP_ASYNC_COMPILE", FALSE);
+   screen->tiled_textures = debug_get_bool_option("LP_TEXTURE_TILING", FALSE);
+   screen->fs_vector_width = debug_get_num_option("LP_FS_VECTOR_WIDTH",
+                                                  lp_native_vector_width);
+   screen->fs_vector_width = screen->fs_vector_width > 128 ?
+                             lp_native_vector_width : 128;
+   screen->variant_cache_budget =
+      (uint64_t)debug_get_num_option("LP_VARIANT_CACHE_MB",
+                                     LP_VARIANT_CACHE_MB) << 20;
+
    screen->rast = lp_rast_create(screen->num_threads);
    if (!screen->rast) {
       lp_jit_screen_cleanup(screen);
@@ -918,7 +1038,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
       FREE(screen);
       return NULL;
    }
-   (void) mtx_init(&screen->cs_mutex, mtx_plain);
 
+   lp_disk_cache_create(screen);
    return &screen->base;
 }
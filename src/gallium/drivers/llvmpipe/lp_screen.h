@@ -42,6 +42,8 @@
 
 struct sw_winsys;
 struct lp_cs_tpool;
+struct lp_cached_code;
+struct disk_cache;
 
 struct llvmpipe_screen
 {
@@ -59,9 +61,27 @@ struct llvmpipe_screen
    mtx_t rast_mutex;
 
    struct lp_cs_tpool *cs_tpool;
-   mtx_t cs_mutex;
 
    bool use_tgsi;
+
+   /** Advertise 4x multisample render targets */
+   bool msaa;
+
+   /** Compile fragment shader variants in the background */
+   bool async_compile;
+
+   /** Store immutable sampled textures in 4x4 texel tiles */
+   bool tiled_textures;
+
+   /** Bits per fragment shader vector, 128 or lp_native_vector_width */
+   unsigned fs_vector_width;
+
+   /** Bytes of JIT code each context keeps in its shader variant cache */
+   uint64_t variant_cache_budget;
+
+   struct disk_cache *disk_shader_cache;
+   unsigned num_disk_shader_cache_hits;
+   unsigned num_disk_shader_cache_misses;
 };
 
 
@@ -75,4 +95,15 @@ llvmpipe_screen( struct pipe_screen *pipe )
 
 
 
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20]);
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20]);
+
+
 #endif /* LP_SCREEN_H */
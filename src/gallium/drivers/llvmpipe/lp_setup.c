@@ -82,11 +82,25 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       lp_fence_wait(setup->scene->fence);
    }
 
+   /* The rasterizer is done with the scene, release what it holds. */
+   lp_scene_end_rasterization(setup->scene);
+
    lp_scene_begin_binning(setup->scene, &setup->fb);
 
 }
 
 
+/**
+ * Standard 4x sample pattern, as fractions of a pixel.
+ */
+const float lp_sample_pos_4x[LP_MAX_SAMPLES][2] = {
+   { 0.375f, 0.125f },
+   { 0.875f, 0.375f },
+   { 0.125f, 0.625f },
+   { 0.625f, 0.875f },
+};
+
+
 static void
 first_triangle( struct lp_setup_context *setup,
                 const float (*v0)[4],
@@ -165,23 +179,16 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer: binning of the next scene overlaps
+    * rasterization of this one.  The scene is released when it comes
+    * round again in lp_setup_get_empty_scene(), after its fence
+    * signalled, and anything needing the results waits on the fences of
+    * the scenes referencing the resource (lp_setup_wait_resource).
     */
+   mtx_lock(&screen->rast_mutex);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -641,6 +648,12 @@ lp_setup_set_fs_variant( struct lp_setup_context *setup,
    /* FIXME: reference count */
 
    setup->fs.current.variant = variant;
+   if (variant) {
+      setup->fs.current.jit_function[RAST_WHOLE] =
+         variant->jit_function[RAST_WHOLE];
+      setup->fs.current.jit_function[RAST_EDGE_TEST] =
+         variant->jit_function[RAST_EDGE_TEST];
+   }
    setup->dirty |= LP_SETUP_NEW_FS;
 }
 
@@ -835,6 +848,34 @@ lp_setup_set_rasterizer_discard(struct lp_setup_context *setup,
    }
 }
 
+void
+lp_setup_set_multisample(struct lp_setup_context *setup,
+                         boolean multisample,
+                         unsigned nr_samples,
+                         unsigned sample_mask)
+{
+   uint64_t full_mask = 0;
+   unsigned s;
+
+   /* Without multisample rasterization all samples are covered alike and
+    * the sample mask doesn't apply.
+    */
+   if (!multisample)
+      sample_mask = ~0;
+
+   for (s = 0; s < nr_samples; s++) {
+      if (sample_mask & (1 << s))
+         full_mask |= (uint64_t)0xffff << (16 * s);
+   }
+
+   setup->multisample = multisample && nr_samples > 1;
+
+   if (setup->fs.current.full_mask != full_mask) {
+      setup->fs.current.full_mask = full_mask;
+      setup->dirty |= LP_SETUP_NEW_FS;
+   }
+}
+
 void 
 lp_setup_set_vertex_info(struct lp_setup_context *setup,
                          struct vertex_info *vertex_info)
@@ -1076,11 +1117,19 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
+   /* check resources referenced by the scenes still being rendered
+    * or built; a scene whose fence has signalled is done with them.
+    */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+      const struct lp_scene *scene = setup->scenes[i];
+      unsigned referenced;
+
+      if (!scene->fence || lp_fence_signalled(scene->fence))
+         continue;
+
+      referenced = lp_scene_is_resource_referenced(scene, texture);
+      if (referenced)
+         return referenced;
    }
 
    for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
@@ -1097,6 +1146,46 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
 }
 
 
+/**
+ * Wait for the flushed scenes which use the given resource.  Scenes which
+ * don't touch it are left running.
+ */
+void
+lp_setup_wait_resource( struct lp_setup_context *setup,
+                        const struct pipe_resource *texture )
+{
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene->fence && scene->fence->issued &&
+          lp_scene_is_resource_referenced(scene, texture))
+         lp_fence_wait(scene->fence);
+   }
+}
+
+
+/**
+ * Whether no scene, flushed or still being built, can reference any
+ * shader code anymore, so that variants may be freed.
+ */
+boolean
+lp_setup_is_idle( const struct lp_setup_context *setup )
+{
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+      const struct lp_scene *scene = setup->scenes[i];
+
+      if (scene->fence && !lp_fence_signalled(scene->fence))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Called by vbuf code when we're about to draw something.
  *
@@ -1287,7 +1376,32 @@ try_update_scene_state( struct lp_setup_context *setup )
             if (setup->fs.current_tex[i]) {
                if (!lp_scene_add_resource_reference(scene,
                                                     setup->fs.current_tex[i],
-                                                    new_scene)) {
+                                                    new_scene, FALSE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         /* Shader buffers and images may be written by the fragment
+          * shader, record them as such so that mapping them waits for
+          * this scene.
+          */
+         for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+            if (setup->ssbos[i].current.buffer) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->ssbos[i].current.buffer,
+                                                    new_scene, TRUE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+         for (i = 0; i < ARRAY_SIZE(setup->images); i++) {
+            if (setup->images[i].current.resource) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->images[i].current.resource,
+                                                    new_scene, TRUE)) {
                   assert(!new_scene);
                   return FALSE;
                }
@@ -1416,9 +1530,10 @@ lp_setup_destroy( struct lp_setup_context *setup )
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
+      if (scene->fence && scene->fence->issued)
          lp_fence_wait(scene->fence);
 
+      lp_scene_end_rasterization(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1473,6 +1588,8 @@ lp_setup_create( struct pipe_context *pipe,
    setup->triangle = first_triangle;
    setup->line     = first_line;
    setup->point    = first_point;
+
+   setup->fs.current.full_mask = 0xffff;
    
    setup->dirty = ~0;
 
@@ -29,6 +29,7 @@
 
 #include "pipe/p_compiler.h"
 #include "lp_jit.h"
+#include "lp_limits.h"
 
 struct draw_context;
 struct vertex_info;
@@ -47,6 +48,8 @@ struct pipe_fence_handle;
 struct lp_setup_variant;
 struct lp_setup_context;
 
+extern const float lp_sample_pos_4x[LP_MAX_SAMPLES][2];
+
 void lp_setup_reset( struct lp_setup_context *setup );
 
 struct lp_setup_context *
@@ -149,6 +152,13 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture );
 
+void
+lp_setup_wait_resource( struct lp_setup_context *setup,
+                        const struct pipe_resource *texture );
+
+boolean
+lp_setup_is_idle( const struct lp_setup_context *setup );
+
 void
 lp_setup_set_flatshade_first( struct lp_setup_context *setup, 
                               boolean flatshade_first );
@@ -157,6 +167,12 @@ void
 lp_setup_set_rasterizer_discard( struct lp_setup_context *setup, 
                                  boolean rasterizer_discard );
 
+void
+lp_setup_set_multisample( struct lp_setup_context *setup,
+                          boolean multisample,
+                          unsigned nr_samples,
+                          unsigned sample_mask );
+
 void
 lp_setup_set_vertex_info( struct lp_setup_context *setup, 
                           struct vertex_info *info );
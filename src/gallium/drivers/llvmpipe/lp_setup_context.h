@@ -55,9 +55,8 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/** Max number of scenes in flight per context */
+#define MAX_SCENES 4
 
 
 
@@ -111,6 +110,8 @@ struct lp_setup_context
    int8_t layer_slot;
    int8_t face_slot;
 
+   boolean multisample;   /**< per-sample coverage of a multisample fb */
+
    struct pipe_framebuffer_state fb;
    struct u_rect framebuffer;
    struct u_rect scissors[PIPE_MAX_VIEWPORTS];
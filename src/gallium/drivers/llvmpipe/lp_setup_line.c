@@ -568,6 +568,17 @@ try_setup_line( struct lp_setup_context *setup,
       bbox.y1--;
    }
 
+   /* The box holds the pixels whose centers are covered.  Multisample
+    * rasterization tests other positions in the pixels, grow the box by a
+    * pixel on each side to take in the pixels with only samples covered.
+    */
+   if (setup->multisample) {
+      bbox.x0--;
+      bbox.y0--;
+      bbox.x1++;
+      bbox.y1++;
+   }
+
    if (bbox.x1 < bbox.x0 ||
        bbox.y1 < bbox.y0) {
       if (0) debug_printf("empty bounding box\n");
@@ -649,7 +660,7 @@ try_setup_line( struct lp_setup_context *setup,
 
    line->inputs.disable = FALSE;
    line->inputs.opaque = FALSE;
-   line->inputs.layer = layer;
+   line->inputs.layer = layer * scene->fb_samples;
    line->inputs.viewport_index = viewport_index;
 
    /*
@@ -719,6 +730,10 @@ try_setup_line( struct lp_setup_context *setup,
     * (Or only store the c value together with a bit indicating which
     * scissor edge this is, so rasterization would treat them differently
     * (easier to evaluate) to ordinary planes.)
+    *
+    * The scissor edges lie half a pixel outside the outermost pixel
+    * centers, so they also hold for the sample positions used by
+    * multisample rasterization (see lp_setup_bin_triangle()).
     */
    if (nr_planes > 4) {
       struct lp_rast_plane *plane_s = &plane[4];
@@ -726,28 +741,28 @@ try_setup_line( struct lp_setup_context *setup,
       if (s_planes[0]) {
          plane_s->dcdx = ~0U << 8;
          plane_s->dcdy = 0;
-         plane_s->c = (1-scissor->x0) << 8;
+         plane_s->c = ((1-scissor->x0) << 8) - 128;
          plane_s->eo = 1 << 8;
          plane_s++;
       }
       if (s_planes[1]) {
          plane_s->dcdx = 1 << 8;
          plane_s->dcdy = 0;
-         plane_s->c = (scissor->x1+1) << 8;
+         plane_s->c = ((scissor->x1+1) << 8) - 128;
          plane_s->eo = 0 << 8;
          plane_s++;
       }
       if (s_planes[2]) {
          plane_s->dcdx = 0;
          plane_s->dcdy = 1 << 8;
-         plane_s->c = (1-scissor->y0) << 8;
+         plane_s->c = ((1-scissor->y0) << 8) - 128;
          plane_s->eo = 1 << 8;
          plane_s++;
       }
       if (s_planes[3]) {
          plane_s->dcdx = 0;
          plane_s->dcdy = ~0U << 8;
-         plane_s->c = (scissor->y1+1) << 8;
+         plane_s->c = ((scissor->y1+1) << 8) - 128;
          plane_s->eo = 0;
          plane_s++;
       }
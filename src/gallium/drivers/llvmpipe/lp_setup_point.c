@@ -493,30 +493,35 @@ try_setup_point( struct lp_setup_context *setup,
 
    point->inputs.disable = FALSE;
    point->inputs.opaque = FALSE;
-   point->inputs.layer = layer;
+   point->inputs.layer = layer * scene->fb_samples;
    point->inputs.viewport_index = viewport_index;
 
    {
       struct lp_rast_plane *plane = GET_PLANES(point);
 
+      /* The point covers the pixels of the bounding box.  As with the
+       * scissor planes the edges lie half a pixel outside the outermost
+       * pixel centers, so with multisampling all samples of these pixels
+       * are covered too.
+       */
       plane[0].dcdx = ~0U << 8;
       plane[0].dcdy = 0;
-      plane[0].c = (1-bbox.x0) << 8;
+      plane[0].c = ((1-bbox.x0) << 8) - 128;
       plane[0].eo = 1 << 8;
 
       plane[1].dcdx = 1 << 8;
       plane[1].dcdy = 0;
-      plane[1].c = (bbox.x1+1) << 8;
+      plane[1].c = ((bbox.x1+1) << 8) - 128;
       plane[1].eo = 0;
 
       plane[2].dcdx = 0;
       plane[2].dcdy = 1 << 8;
-      plane[2].c = (1-bbox.y0) << 8;
+      plane[2].c = ((1-bbox.y0) << 8) - 128;
       plane[2].eo = 1 << 8;
 
       plane[3].dcdx = 0;
       plane[3].dcdy = ~0U << 8;
-      plane[3].c = (bbox.y1+1) << 8;
+      plane[3].c = ((bbox.y1+1) << 8) - 128;
       plane[3].eo = 0;
    }
 
@@ -204,6 +204,18 @@ lp_rast_32_tri_tab[MAX_PLANES+1] = {
    LP_RAST_OP_TRIANGLE_32_8
 };
 
+static unsigned
+lp_rast_ms_tri_tab[MAX_PLANES+1] = {
+   0,               /* should be impossible */
+   LP_RAST_OP_MS_TRIANGLE_1,
+   LP_RAST_OP_MS_TRIANGLE_2,
+   LP_RAST_OP_MS_TRIANGLE_3,
+   LP_RAST_OP_MS_TRIANGLE_4,
+   LP_RAST_OP_MS_TRIANGLE_5,
+   LP_RAST_OP_MS_TRIANGLE_6,
+   LP_RAST_OP_MS_TRIANGLE_7,
+   LP_RAST_OP_MS_TRIANGLE_8
+};
 
 
 /**
@@ -233,8 +245,11 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
        * were just active we also can't do the optimization since to get
        * accurate query results we unfortunately need to execute the rendering
        * commands.
+       * - With multisampling the sample mask may leave some samples of the
+       * tile untouched.
        */
-      if (!scene->fb.zsbuf && scene->fb_max_layer == 0 && !scene->had_queries) {
+      if (!scene->fb.zsbuf && scene->fb_max_layer == 0 &&
+          scene->fb_samples == 1 && !scene->had_queries) {
          /*
           * All previous rendering will be overwritten so reset the bin.
           */
@@ -321,6 +336,17 @@ do_triangle_ccw(struct lp_setup_context *setup,
       bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
    }
 
+   /* The box holds the pixels whose centers are covered.  Multisample
+    * rasterization tests other positions in the pixels, grow the box by a
+    * pixel on each side to take in the pixels with only samples covered.
+    */
+   if (setup->multisample) {
+      bbox.x0--;
+      bbox.y0--;
+      bbox.x1++;
+      bbox.y1++;
+   }
+
    if (bbox.x1 < bbox.x0 ||
        bbox.y1 < bbox.y0) {
       if (0) debug_printf("empty bounding box\n");
@@ -384,7 +410,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.frontfacing = frontfacing;
    tri->inputs.disable = FALSE;
    tri->inputs.opaque = setup->fs.current.variant->opaque;
-   tri->inputs.layer = layer;
+   tri->inputs.layer = layer * scene->fb_samples;
    tri->inputs.viewport_index = viewport_index;
 
    if (0)
@@ -681,6 +707,10 @@ do_triangle_ccw(struct lp_setup_context *setup,
     * (Or only store the c value together with a bit indicating which
     * scissor edge this is, so rasterization would treat them differently
     * (easier to evaluate) to ordinary planes.)
+    *
+    * The scissor edges lie half a pixel outside the outermost pixel
+    * centers, so they also hold for the sample positions used by
+    * multisample rasterization (see lp_setup_bin_triangle()).
     */
    if (nr_planes > 3) {
       /* why not just use draw_regions */
@@ -689,28 +719,28 @@ do_triangle_ccw(struct lp_setup_context *setup,
       if (s_planes[0]) {
          plane_s->dcdx = ~0U << 8;
          plane_s->dcdy = 0;
-         plane_s->c = (1-scissor->x0) << 8;
+         plane_s->c = ((1-scissor->x0) << 8) - 128;
          plane_s->eo = 1 << 8;
          plane_s++;
       }
       if (s_planes[1]) {
          plane_s->dcdx = 1 << 8;
          plane_s->dcdy = 0;
-         plane_s->c = (scissor->x1+1) << 8;
+         plane_s->c = ((scissor->x1+1) << 8) - 128;
          plane_s->eo = 0 << 8;
          plane_s++;
       }
       if (s_planes[2]) {
          plane_s->dcdx = 0;
          plane_s->dcdy = 1 << 8;
-         plane_s->c = (1-scissor->y0) << 8;
+         plane_s->c = ((1-scissor->y0) << 8) - 128;
          plane_s->eo = 1 << 8;
          plane_s++;
       }
       if (s_planes[3]) {
          plane_s->dcdx = 0;
          plane_s->dcdy = ~0U << 8;
-         plane_s->c = (scissor->y1+1) << 8;
+         plane_s->c = ((scissor->y1+1) << 8) - 128;
          plane_s->eo = 0;
          plane_s++;
       }
@@ -789,6 +819,20 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
    u_rect_find_intersection(&setup->draw_regions[viewport_index],
                             &trimmed_box);
 
+   if (setup->multisample) {
+      struct lp_rast_plane *plane = GET_PLANES(tri);
+
+      /*
+       * The planes are set up to be evaluated at the pixel centers.  Move
+       * them by half a pixel so they get evaluated at the pixel corners
+       * instead, the multisample rasterizer adds the sample offsets to
+       * that.  dcdx and dcdy are multiples of FIXED_ONE, so this is exact.
+       */
+      for (i = 0; i < nr_planes; i++) {
+         plane[i].c += ((int64_t)plane[i].dcdx - plane[i].dcdy) / 2;
+      }
+   }
+
    /* Determine which tile(s) intersect the triangle's bounding box
     */
    if (dx < TILE_SIZE)
@@ -801,7 +845,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
       assert(iy0 == bbox->y1 / TILE_SIZE &&
 	     ix0 == bbox->x1 / TILE_SIZE);
 
-      if (nr_planes == 3) {
+      /* The small triangle paths don't handle samples. */
+      if (nr_planes == 3 && !setup->multisample) {
          if (sz < 4)
          {
             /* Triangle is contained in a single 4x4 stamp:
@@ -840,7 +885,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                                                 lp_rast_arg_triangle_contained(tri, px, py) );
          }
       }
-      else if (nr_planes == 4 && sz < 16) 
+      else if (nr_planes == 4 && sz < 16 && !setup->multisample)
       {
          px = MIN2(px, TILE_SIZE - 16);
          py = MIN2(py, TILE_SIZE - 16);
@@ -861,6 +906,7 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
        */
       return lp_scene_bin_cmd_with_state(
          scene, ix0, iy0, setup->fs.stored,
+         setup->multisample ? lp_rast_ms_tri_tab[nr_planes] :
          use_32bits ? lp_rast_32_tri_tab[nr_planes] : lp_rast_tri_tab[nr_planes],
          lp_rast_arg_triangle(tri, (1<<nr_planes)-1));
    }
@@ -936,6 +982,8 @@ lp_setup_bin_triangle(struct lp_setup_context *setup,
                
                if (!lp_scene_bin_cmd_with_state( scene, x, y,
                                                  setup->fs.stored,
+                                                 setup->multisample ?
+                                                 lp_rast_ms_tri_tab[count] :
                                                  use_32bits ?
                                                  lp_rast_32_tri_tab[count] :
                                                  lp_rast_tri_tab[count],
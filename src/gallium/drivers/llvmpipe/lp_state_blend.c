@@ -58,6 +58,31 @@ llvmpipe_create_blend_state(struct pipe_context *pipe,
 }
 
 
+/**
+ * Whether the result depends on the order fragments get written in.
+ */
+static boolean
+blend_is_order_dependent(const struct pipe_blend_state *blend)
+{
+   unsigned i;
+
+   if (!blend)
+      return FALSE;
+
+   if (blend->logicop_enable)
+      return TRUE;
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
+      if (blend->rt[i].blend_enable)
+         return TRUE;
+      if (!blend->independent_blend_enable)
+         break;
+   }
+
+   return FALSE;
+}
+
+
 static void
 llvmpipe_bind_blend_state(struct pipe_context *pipe, void *blend)
 {
@@ -70,6 +95,8 @@ llvmpipe_bind_blend_state(struct pipe_context *pipe, void *blend)
 
    llvmpipe->blend = blend;
 
+   draw_enable_blend(llvmpipe->draw, blend_is_order_dependent(blend));
+
    llvmpipe->dirty |= LP_NEW_BLEND;
 }
 
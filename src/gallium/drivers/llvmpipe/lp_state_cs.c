@@ -22,6 +22,7 @@
  * SOFTWARE.
  *
  **************************************************************************/
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/os_time.h"
@@ -36,6 +37,7 @@
 #include "gallivm/lp_bld_gather.h"
 #include "gallivm/lp_bld_coro.h"
 #include "gallivm/lp_bld_nir.h"
+#include "gallivm/lp_bld_format.h"
 #include "lp_state_cs.h"
 #include "lp_context.h"
 #include "lp_debug.h"
@@ -44,17 +46,167 @@
 #include "lp_screen.h"
 #include "lp_memory.h"
 #include "lp_cs_tpool.h"
+#include "lp_fence.h"
+#include "lp_flush.h"
+#include "lp_texture.h"
 #include "state_tracker/sw_winsys.h"
 #include "nir/nir_to_tgsi_info.h"
 #include "nir_serialize.h"
+/** Source of lp_cs_job_info::id */
+static unsigned lp_cs_job_id;
+
 struct lp_cs_job_info {
    unsigned grid_size[3];
    unsigned block_size[3];
    unsigned req_local_mem;
    unsigned work_dim;
+   unsigned id;   /**< invalidates the workers' texture caches */
    struct lp_cs_exec *current;
 };
 
+/**
+ * A dispatch in flight.  It runs on a snapshot of the bound state, so the
+ * context can go on changing bindings while the workers execute it, and
+ * holds references to every resource the shader may access.
+ */
+struct lp_cs_job {
+   struct list_head list;
+
+   struct lp_cs_exec exec;
+   struct lp_cs_job_info info;
+   struct lp_cs_tpool_task *task;
+   struct lp_fence *fence;
+
+   /* copies of the kernel arguments and of user constant buffers */
+   void *input;
+   void *user_constants[LP_MAX_TGSI_CONST_BUFFERS];
+
+   /* the first num_writes resources may be written, the rest only read */
+   struct pipe_resource **resources;
+   unsigned num_resources;
+   unsigned num_writes;
+};
+
+/**
+ * Build the shader code for one vector of invocations of a workgroup.
+ * x is the index of the vector within its row, y and z select the row.
+ * With coro_info the code runs inside a coroutine suspending at barriers,
+ * otherwise the shader must not contain any.
+ */
+static void
+generate_compute_body(struct gallivm_state *gallivm,
+                      struct lp_compute_shader *shader,
+                      struct lp_type cs_type,
+                      struct lp_build_sampler_soa *sampler,
+                      struct lp_build_image_soa *image,
+                      struct lp_build_coro_suspend_info *coro_info,
+                      LLVMValueRef context_ptr,
+                      LLVMValueRef thread_data_ptr,
+                      const LLVMValueRef invocation[3],
+                      const LLVMValueRef grid_id[3],
+                      const LLVMValueRef grid_size[3],
+                      const LLVMValueRef block_size[3],
+                      LLVMValueRef work_dim,
+                      LLVMValueRef num_x_loop,
+                      LLVMValueRef partials)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMValueRef vec_length = lp_build_const_int32(gallivm, cs_type.length);
+   LLVMValueRef consts_ptr, num_consts_ptr;
+   LLVMValueRef ssbo_ptr, num_ssbo_ptr;
+   LLVMValueRef shared_ptr;
+   LLVMValueRef kernel_args_ptr;
+   struct lp_build_mask_context mask;
+   struct lp_bld_tgsi_system_values system_values;
+   unsigned i;
+
+   memset(&system_values, 0, sizeof(system_values));
+   consts_ptr = lp_jit_cs_context_constants(gallivm, context_ptr);
+   num_consts_ptr = lp_jit_cs_context_num_constants(gallivm, context_ptr);
+   ssbo_ptr = lp_jit_cs_context_ssbos(gallivm, context_ptr);
+   num_ssbo_ptr = lp_jit_cs_context_num_ssbos(gallivm, context_ptr);
+   kernel_args_ptr = lp_jit_cs_context_kernel_args(gallivm, context_ptr);
+
+   shared_ptr = lp_jit_cs_thread_data_shared(gallivm, thread_data_ptr);
+
+   LLVMValueRef has_partials = LLVMBuildICmp(gallivm->builder, LLVMIntNE, partials, lp_build_const_int32(gallivm, 0), "");
+   LLVMValueRef tid_vals[3];
+   LLVMValueRef tids_x[LP_MAX_VECTOR_LENGTH], tids_y[LP_MAX_VECTOR_LENGTH], tids_z[LP_MAX_VECTOR_LENGTH];
+   LLVMValueRef base_val = LLVMBuildMul(gallivm->builder, invocation[0], vec_length, "");
+   for (i = 0; i < cs_type.length; i++) {
+      tids_x[i] = LLVMBuildAdd(gallivm->builder, base_val, lp_build_const_int32(gallivm, i), "");
+      tids_y[i] = invocation[1];
+      tids_z[i] = invocation[2];
+   }
+   tid_vals[0] = lp_build_gather_values(gallivm, tids_x, cs_type.length);
+   tid_vals[1] = lp_build_gather_values(gallivm, tids_y, cs_type.length);
+   tid_vals[2] = lp_build_gather_values(gallivm, tids_z, cs_type.length);
+   system_values.thread_id = LLVMGetUndef(LLVMArrayType(LLVMVectorType(int32_type, cs_type.length), 3));
+   for (i = 0; i < 3; i++)
+      system_values.thread_id = LLVMBuildInsertValue(builder, system_values.thread_id, tid_vals[i], i, "");
+
+   system_values.block_id = LLVMGetUndef(LLVMVectorType(int32_type, 3));
+   for (i = 0; i < 3; i++)
+      system_values.block_id = LLVMBuildInsertElement(builder, system_values.block_id, grid_id[i], lp_build_const_int32(gallivm, i), "");
+
+   system_values.grid_size = LLVMGetUndef(LLVMVectorType(int32_type, 3));
+   for (i = 0; i < 3; i++)
+      system_values.grid_size = LLVMBuildInsertElement(builder, system_values.grid_size, grid_size[i], lp_build_const_int32(gallivm, i), "");
+
+   system_values.work_dim = work_dim;
+
+   system_values.block_size = LLVMGetUndef(LLVMVectorType(int32_type, 3));
+   for (i = 0; i < 3; i++)
+      system_values.block_size = LLVMBuildInsertElement(builder, system_values.block_size, block_size[i], lp_build_const_int32(gallivm, i), "");
+
+   LLVMValueRef last_x_loop = LLVMBuildICmp(gallivm->builder, LLVMIntEQ, invocation[0], LLVMBuildSub(gallivm->builder, num_x_loop, lp_build_const_int32(gallivm, 1), ""), "");
+   LLVMValueRef use_partial_mask = LLVMBuildAnd(gallivm->builder, last_x_loop, has_partials, "");
+   struct lp_build_if_state if_state;
+   LLVMValueRef mask_val = lp_build_alloca(gallivm, LLVMVectorType(int32_type, cs_type.length), "mask");
+   LLVMValueRef full_mask_val = lp_build_const_int_vec(gallivm, cs_type, ~0);
+   LLVMBuildStore(gallivm->builder, full_mask_val, mask_val);
+
+   lp_build_if(&if_state, gallivm, use_partial_mask);
+   struct lp_build_loop_state mask_loop_state;
+   lp_build_loop_begin(&mask_loop_state, gallivm, partials);
+   LLVMValueRef tmask_val = LLVMBuildLoad(gallivm->builder, mask_val, "");
+   tmask_val = LLVMBuildInsertElement(gallivm->builder, tmask_val, lp_build_const_int32(gallivm, 0), mask_loop_state.counter, "");
+   LLVMBuildStore(gallivm->builder, tmask_val, mask_val);
+   lp_build_loop_end_cond(&mask_loop_state, vec_length, NULL, LLVMIntUGE);
+   lp_build_endif(&if_state);
+
+   mask_val = LLVMBuildLoad(gallivm->builder, mask_val, "");
+   lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
+
+   struct lp_build_tgsi_params params;
+   memset(&params, 0, sizeof(params));
+
+   params.type = cs_type;
+   params.mask = &mask;
+   params.consts_ptr = consts_ptr;
+   params.const_sizes_ptr = num_consts_ptr;
+   params.system_values = &system_values;
+   params.context_ptr = context_ptr;
+   params.sampler = sampler;
+   params.info = &shader->info.base;
+   params.ssbo_ptr = ssbo_ptr;
+   params.ssbo_sizes_ptr = num_ssbo_ptr;
+   params.image = image;
+   params.shared_ptr = shared_ptr;
+   params.thread_data_ptr = thread_data_ptr;
+   params.coro = coro_info;
+   params.kernel_args = kernel_args_ptr;
+
+   if (shader->base.type == PIPE_SHADER_IR_TGSI)
+      lp_build_tgsi_soa(gallivm, shader->base.tokens, &params, NULL);
+   else
+      lp_build_nir_soa(gallivm, shader->base.ir.nir, &params,
+                       NULL);
+
+   lp_build_mask_end(&mask);
+}
+
 static void
 generate_compute(struct llvmpipe_context *lp,
                  struct lp_compute_shader *shader,
@@ -75,7 +227,7 @@ generate_compute(struct llvmpipe_context *lp,
    LLVMBuilderRef builder;
    struct lp_build_sampler_soa *sampler;
    struct lp_build_image_soa *image;
-   LLVMValueRef function, coro;
+   LLVMValueRef function, coro = NULL;
    struct lp_type cs_type;
    unsigned i;
 
@@ -83,6 +235,8 @@ generate_compute(struct llvmpipe_context *lp,
     * This function has two parts
     * a) setup the coroutine execution environment loop.
     * b) build the compute shader llvm for use inside the coroutine.
+    * Shaders without barriers never suspend, for them the invocations
+    * simply run one vector after the other inside the loop instead.
     */
    assert(lp_native_vector_width / 32 >= 4);
 
@@ -92,11 +246,10 @@ generate_compute(struct llvmpipe_context *lp,
    cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    cs_type.width = 32;           /* 32-bit float */
    cs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
-   snprintf(func_name, sizeof(func_name), "cs%u_variant%u",
-            shader->no, variant->no);
+   /* no shader or variant numbers, cached code is looked up by name */
+   snprintf(func_name, sizeof(func_name), "cs_variant");
 
-   snprintf(func_name_coro, sizeof(func_name), "cs_co_%u_variant%u",
-            shader->no, variant->no);
+   snprintf(func_name_coro, sizeof(func_name), "cs_co_variant");
 
    arg_types[0] = variant->jit_cs_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* block_x_size */
@@ -118,20 +271,23 @@ generate_compute(struct llvmpipe_context *lp,
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, ARRAY_SIZE(arg_types) - 5, 0);
 
-   coro_func_type = LLVMFunctionType(LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0),
-                                     arg_types, ARRAY_SIZE(arg_types), 0);
-
    function = LLVMAddFunction(gallivm->module, func_name, func_type);
    LLVMSetFunctionCallConv(function, LLVMCCallConv);
 
-   coro = LLVMAddFunction(gallivm->module, func_name_coro, coro_func_type);
-   LLVMSetFunctionCallConv(coro, LLVMCCallConv);
+   if (shader->has_barriers) {
+      coro_func_type = LLVMFunctionType(LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0),
+                                        arg_types, ARRAY_SIZE(arg_types), 0);
+
+      coro = LLVMAddFunction(gallivm->module, func_name_coro, coro_func_type);
+      LLVMSetFunctionCallConv(coro, LLVMCCallConv);
+   }
 
    variant->function = function;
 
    for(i = 0; i < ARRAY_SIZE(arg_types); ++i) {
       if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind) {
-         lp_add_function_attr(coro, i + 1, LP_FUNC_ATTR_NOALIAS);
+         if (coro)
+            lp_add_function_attr(coro, i + 1, LP_FUNC_ATTR_NOALIAS);
          lp_add_function_attr(function, i + 1, LP_FUNC_ATTR_NOALIAS);
       }
    }
@@ -177,6 +333,42 @@ generate_compute(struct llvmpipe_context *lp,
    num_x_loop = LLVMBuildUDiv(gallivm->builder, num_x_loop, vec_length, "");
    LLVMValueRef partials = LLVMBuildURem(gallivm->builder, x_size_arg, vec_length, "");
 
+   if (!shader->has_barriers) {
+      LLVMValueRef grid_id[3] = { grid_x_arg, grid_y_arg, grid_z_arg };
+      LLVMValueRef grid_size[3] = { grid_size_x_arg, grid_size_y_arg, grid_size_z_arg };
+      LLVMValueRef block_size[3] = { x_size_arg, y_size_arg, z_size_arg };
+      LLVMValueRef invocation[3];
+
+      lp_build_loop_begin(&loop_state[2], gallivm,
+                          lp_build_const_int32(gallivm, 0)); /* z loop */
+      lp_build_loop_begin(&loop_state[1], gallivm,
+                          lp_build_const_int32(gallivm, 0)); /* y loop */
+      lp_build_loop_begin(&loop_state[0], gallivm,
+                          lp_build_const_int32(gallivm, 0)); /* x loop */
+      for (i = 0; i < 3; i++)
+         invocation[i] = loop_state[i].counter;
+      generate_compute_body(gallivm, shader, cs_type, sampler, image, NULL,
+                            context_ptr, thread_data_ptr, invocation,
+                            grid_id, grid_size, block_size, work_dim_arg,
+                            num_x_loop, partials);
+      lp_build_loop_end_cond(&loop_state[0],
+                             num_x_loop,
+                             NULL,  LLVMIntUGE);
+      lp_build_loop_end_cond(&loop_state[1],
+                             y_size_arg,
+                             NULL,  LLVMIntUGE);
+      lp_build_loop_end_cond(&loop_state[2],
+                             z_size_arg,
+                             NULL,  LLVMIntUGE);
+      LLVMBuildRetVoid(builder);
+
+      sampler->destroy(sampler);
+      image->destroy(image);
+
+      gallivm_verify_function(gallivm, function);
+      return;
+   }
+
    LLVMValueRef coro_num_hdls = LLVMBuildMul(gallivm->builder, num_x_loop, y_size_arg, "");
    coro_num_hdls = LLVMBuildMul(gallivm->builder, coro_num_hdls, z_size_arg, "");
 
@@ -290,78 +482,15 @@ generate_compute(struct llvmpipe_context *lp,
    block = LLVMAppendBasicBlockInContext(gallivm->context, coro, "entry");
    LLVMPositionBuilderAtEnd(builder, block);
    {
-      LLVMValueRef consts_ptr, num_consts_ptr;
-      LLVMValueRef ssbo_ptr, num_ssbo_ptr;
-      LLVMValueRef shared_ptr;
-      LLVMValueRef kernel_args_ptr;
-      struct lp_build_mask_context mask;
-      struct lp_bld_tgsi_system_values system_values;
-
-      memset(&system_values, 0, sizeof(system_values));
-      consts_ptr = lp_jit_cs_context_constants(gallivm, context_ptr);
-      num_consts_ptr = lp_jit_cs_context_num_constants(gallivm, context_ptr);
-      ssbo_ptr = lp_jit_cs_context_ssbos(gallivm, context_ptr);
-      num_ssbo_ptr = lp_jit_cs_context_num_ssbos(gallivm, context_ptr);
-      kernel_args_ptr = lp_jit_cs_context_kernel_args(gallivm, context_ptr);
-
-      shared_ptr = lp_jit_cs_thread_data_shared(gallivm, thread_data_ptr);
+      LLVMValueRef grid_id[3] = { grid_x_arg, grid_y_arg, grid_z_arg };
+      LLVMValueRef grid_size[3] = { grid_size_x_arg, grid_size_y_arg, grid_size_z_arg };
+      LLVMValueRef block_size[3] = { block_x_size_arg, block_y_size_arg, block_z_size_arg };
+      LLVMValueRef invocation[3] = { x_size_arg, y_size_arg, z_size_arg };
 
       /* these are coroutine entrypoint necessities */
       LLVMValueRef coro_id = lp_build_coro_id(gallivm);
       LLVMValueRef coro_hdl = lp_build_coro_begin_alloc_mem(gallivm, coro_id);
 
-      LLVMValueRef has_partials = LLVMBuildICmp(gallivm->builder, LLVMIntNE, partials, lp_build_const_int32(gallivm, 0), "");
-      LLVMValueRef tid_vals[3];
-      LLVMValueRef tids_x[LP_MAX_VECTOR_LENGTH], tids_y[LP_MAX_VECTOR_LENGTH], tids_z[LP_MAX_VECTOR_LENGTH];
-      LLVMValueRef base_val = LLVMBuildMul(gallivm->builder, x_size_arg, vec_length, "");
-      for (i = 0; i < cs_type.length; i++) {
-         tids_x[i] = LLVMBuildAdd(gallivm->builder, base_val, lp_build_const_int32(gallivm, i), "");
-         tids_y[i] = y_size_arg;
-         tids_z[i] = z_size_arg;
-      }
-      tid_vals[0] = lp_build_gather_values(gallivm, tids_x, cs_type.length);
-      tid_vals[1] = lp_build_gather_values(gallivm, tids_y, cs_type.length);
-      tid_vals[2] = lp_build_gather_values(gallivm, tids_z, cs_type.length);
-      system_values.thread_id = LLVMGetUndef(LLVMArrayType(LLVMVectorType(int32_type, cs_type.length), 3));
-      for (i = 0; i < 3; i++)
-         system_values.thread_id = LLVMBuildInsertValue(builder, system_values.thread_id, tid_vals[i], i, "");
-
-      LLVMValueRef gtids[3] = { grid_x_arg, grid_y_arg, grid_z_arg };
-      system_values.block_id = LLVMGetUndef(LLVMVectorType(int32_type, 3));
-      for (i = 0; i < 3; i++)
-         system_values.block_id = LLVMBuildInsertElement(builder, system_values.block_id, gtids[i], lp_build_const_int32(gallivm, i), "");
-
-      LLVMValueRef gstids[3] = { grid_size_x_arg, grid_size_y_arg, grid_size_z_arg };
-      system_values.grid_size = LLVMGetUndef(LLVMVectorType(int32_type, 3));
-      for (i = 0; i < 3; i++)
-         system_values.grid_size = LLVMBuildInsertElement(builder, system_values.grid_size, gstids[i], lp_build_const_int32(gallivm, i), "");
-
-      system_values.work_dim = work_dim_arg;
-
-      LLVMValueRef bsize[3] = { block_x_size_arg, block_y_size_arg, block_z_size_arg };
-      system_values.block_size = LLVMGetUndef(LLVMVectorType(int32_type, 3));
-      for (i = 0; i < 3; i++)
-         system_values.block_size = LLVMBuildInsertElement(builder, system_values.block_size, bsize[i], lp_build_const_int32(gallivm, i), "");
-
-      LLVMValueRef last_x_loop = LLVMBuildICmp(gallivm->builder, LLVMIntEQ, x_size_arg, LLVMBuildSub(gallivm->builder, num_x_loop, lp_build_const_int32(gallivm, 1), ""), "");
-      LLVMValueRef use_partial_mask = LLVMBuildAnd(gallivm->builder, last_x_loop, has_partials, "");
-      struct lp_build_if_state if_state;
-      LLVMValueRef mask_val = lp_build_alloca(gallivm, LLVMVectorType(int32_type, cs_type.length), "mask");
-      LLVMValueRef full_mask_val = lp_build_const_int_vec(gallivm, cs_type, ~0);
-      LLVMBuildStore(gallivm->builder, full_mask_val, mask_val);
-
-      lp_build_if(&if_state, gallivm, use_partial_mask);
-      struct lp_build_loop_state mask_loop_state;
-      lp_build_loop_begin(&mask_loop_state, gallivm, partials);
-      LLVMValueRef tmask_val = LLVMBuildLoad(gallivm->builder, mask_val, "");
-      tmask_val = LLVMBuildInsertElement(gallivm->builder, tmask_val, lp_build_const_int32(gallivm, 0), mask_loop_state.counter, "");
-      LLVMBuildStore(gallivm->builder, tmask_val, mask_val);
-      lp_build_loop_end_cond(&mask_loop_state, vec_length, NULL, LLVMIntUGE);
-      lp_build_endif(&if_state);
-
-      mask_val = LLVMBuildLoad(gallivm->builder, mask_val, "");
-      lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
-
       struct lp_build_coro_suspend_info coro_info;
 
       LLVMBasicBlockRef sus_block = LLVMAppendBasicBlockInContext(gallivm->context, coro, "suspend");
@@ -370,31 +499,10 @@ generate_compute(struct llvmpipe_context *lp,
       coro_info.suspend = sus_block;
       coro_info.cleanup = clean_block;
 
-      struct lp_build_tgsi_params params;
-      memset(&params, 0, sizeof(params));
-
-      params.type = cs_type;
-      params.mask = &mask;
-      params.consts_ptr = consts_ptr;
-      params.const_sizes_ptr = num_consts_ptr;
-      params.system_values = &system_values;
-      params.context_ptr = context_ptr;
-      params.sampler = sampler;
-      params.info = &shader->info.base;
-      params.ssbo_ptr = ssbo_ptr;
-      params.ssbo_sizes_ptr = num_ssbo_ptr;
-      params.image = image;
-      params.shared_ptr = shared_ptr;
-      params.coro = &coro_info;
-      params.kernel_args = kernel_args_ptr;
-
-      if (shader->base.type == PIPE_SHADER_IR_TGSI)
-         lp_build_tgsi_soa(gallivm, shader->base.tokens, &params, NULL);
-      else
-         lp_build_nir_soa(gallivm, shader->base.ir.nir, &params,
-                          NULL);
-
-      mask_val = lp_build_mask_end(&mask);
+      generate_compute_body(gallivm, shader, cs_type, sampler, image,
+                            &coro_info, context_ptr, thread_data_ptr,
+                            invocation, grid_id, grid_size, block_size,
+                            work_dim_arg, num_x_loop, partials);
 
       lp_build_coro_suspend_switch(gallivm, &coro_info, NULL, true);
       LLVMPositionBuilderAtEnd(builder, clean_block);
@@ -415,6 +523,35 @@ generate_compute(struct llvmpipe_context *lp,
    gallivm_verify_function(gallivm, function);
 }
 
+/**
+ * Whether the shader synchronizes its invocations, which requires running
+ * them as coroutines.
+ */
+static boolean
+shader_has_barriers(const struct lp_compute_shader *shader)
+{
+   const struct nir_shader *nir = shader->base.ir.nir;
+
+   if (shader->base.type == PIPE_SHADER_IR_TGSI)
+      return shader->info.base.opcode_count[TGSI_OPCODE_BARRIER] > 0;
+
+   nir_foreach_function(function, nir) {
+      if (!function->impl)
+         continue;
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block) {
+            if (instr->type == nir_instr_type_intrinsic &&
+                nir_instr_as_intrinsic(instr)->intrinsic ==
+                   nir_intrinsic_control_barrier)
+               return TRUE;
+         }
+      }
+   }
+
+   return FALSE;
+}
+
 static void *
 llvmpipe_create_compute_state(struct pipe_context *pipe,
                                      const struct pipe_compute_state *templ)
@@ -449,6 +586,8 @@ llvmpipe_create_compute_state(struct pipe_context *pipe,
    }
 
    shader->req_local_mem = templ->req_local_mem;
+   shader->req_input_mem = templ->req_input_mem;
+   shader->has_barriers = shader_has_barriers(shader);
    make_empty_list(&shader->variants);
 
    nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
@@ -472,8 +611,8 @@ llvmpipe_bind_compute_state(struct pipe_context *pipe,
 }
 
 /**
- * Remove shader variant from two lists: the shader's variant list
- * and the context's variant list.
+ * Remove shader variant from the shader's variant list and the context's
+ * variant cache, and free it.
  */
 static void
 llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
@@ -481,11 +620,12 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
 {
    if ((LP_DEBUG & DEBUG_CS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del cs #%u var %u v created %u v cached %u "
-                   "v total cached %u inst %u total inst %u\n",
+                   "v total cached %u inst %u total inst %u code %u\n",
                    variant->shader->no, variant->no,
                    variant->shader->variants_created,
                    variant->shader->variants_cached,
-                   lp->nr_cs_variants, variant->nr_instrs, lp->nr_cs_instrs);
+                   lp->nr_cs_variants, variant->nr_instrs, lp->nr_cs_instrs,
+                   (unsigned)variant->cache_item.size);
    }
 
    gallivm_destroy(variant->gallivm);
@@ -494,14 +634,37 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
 
-   /* remove from context's list */
-   remove_from_list(&variant->list_item_global);
-   lp->nr_fs_variants--;
-   lp->nr_fs_instrs -= variant->nr_instrs;
+   /* remove from context's cache */
+   lp_variant_cache_remove(&variant->cache_item);
+   lp->nr_cs_variants--;
+   lp->nr_cs_instrs -= variant->nr_instrs;
 
    FREE(variant);
 }
 
+/**
+ * Variant cache callback.  The bound variant is referenced by the next
+ * launch_grid, and dispatches in flight may still be running others.
+ */
+static boolean
+evict_cs_variant(struct lp_variant_cache_item *item)
+{
+   struct llvmpipe_context *lp = item->owner;
+   struct lp_compute_shader_variant *variant = item->variant;
+   struct lp_cs_job *job;
+
+   if (variant == lp->csctx->cs.current.variant)
+      return FALSE;
+
+   LIST_FOR_EACH_ENTRY(job, &lp->csctx->jobs, list) {
+      if (job->exec.variant == variant && !lp_fence_signalled(job->fence))
+         return FALSE;
+   }
+
+   llvmpipe_remove_cs_shader_variant(lp, variant);
+   return TRUE;
+}
+
 static void
 llvmpipe_delete_compute_state(struct pipe_context *pipe,
                               void *cs)
@@ -510,6 +673,9 @@ llvmpipe_delete_compute_state(struct pipe_context *pipe,
    struct lp_compute_shader *shader = cs;
    struct lp_cs_variant_list_item *li;
 
+   /* dispatches in flight may run any of the variants */
+   lp_csctx_finish(llvmpipe->csctx);
+
    if (llvmpipe->cs == cs)
       llvmpipe->cs = NULL;
    for (unsigned i = 0; i < shader->max_global_buffers; i++)
@@ -660,8 +826,12 @@ generate_variant(struct llvmpipe_context *lp,
                  struct lp_compute_shader *shader,
                  const struct lp_compute_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_compute_shader_variant *variant;
    char module_name[64];
+   unsigned char ir_sha1_cache_key[20];
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
 
    variant = CALLOC_STRUCT(lp_compute_shader_variant);
    if (!variant)
@@ -670,15 +840,25 @@ generate_variant(struct llvmpipe_context *lp,
    snprintf(module_name, sizeof(module_name), "cs%u_variant%u",
             shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (screen->disk_shader_cache) {
+      lp_build_ir_cache_key(&shader->base, key, shader->variant_key_size,
+                            NULL, 0, ir_sha1_cache_key);
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = true;
+   }
+
+   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
    if (!variant->gallivm) {
+      free(cached.data);
       FREE(variant);
       return NULL;
    }
 
    variant->shader = shader;
-   variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
+   lp_variant_cache_item_init(&variant->cache_item, evict_cs_variant,
+                              PIPE_SHADER_COMPUTE, variant, lp);
    variant->no = shader->variants_created++;
 
    memcpy(&variant->key, key, shader->variant_key_size);
@@ -696,6 +876,11 @@ generate_variant(struct llvmpipe_context *lp,
    variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
 
    variant->jit_function = (lp_jit_cs_func)gallivm_jit_function(variant->gallivm, variant->function);
+   lp_variant_cache_set_size(&variant->cache_item,
+                             gallivm_code_size(variant->gallivm));
+
+   if (needs_caching)
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
 
    gallivm_free_ir(variant->gallivm);
    return variant;
@@ -730,16 +915,11 @@ llvmpipe_update_cs(struct llvmpipe_context *lp)
    }
 
    if (variant) {
-      /* Move this variant to the head of the list to implement LRU
-       * deletion of shader's when we have too many.
-       */
-      move_to_head(&lp->cs_variants_list, &variant->list_item_global);
+      lp_variant_cache_hit(&variant->cache_item);
    }
    else {
       /* variant not found, create it now */
       int64_t t0, t1, dt;
-      unsigned i;
-      unsigned variants_to_cull;
 
       if (LP_DEBUG & DEBUG_CS) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
@@ -748,38 +928,11 @@ llvmpipe_update_cs(struct llvmpipe_context *lp)
                       lp->nr_cs_variants ? lp->nr_cs_instrs / lp->nr_cs_variants : 0);
       }
 
-      /* First, check if we've exceeded the max number of shader variants.
-       * If so, free 6.25% of them (the least recently used ones).
+      /* First, free the least recently used variants of any stage if the
+       * generated code exceeds the budget.
        */
-      variants_to_cull = lp->nr_cs_variants >= LP_MAX_SHADER_VARIANTS ? LP_MAX_SHADER_VARIANTS / 16 : 0;
-
-      if (variants_to_cull ||
-          lp->nr_cs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-            debug_printf("Evicting CS: %u cs variants,\t%u total variants,"
-                         "\t%u instrs,\t%u instrs/variant\n",
-                         shader->variants_cached,
-                         lp->nr_cs_variants, lp->nr_cs_instrs,
-                         lp->nr_cs_instrs / lp->nr_cs_variants);
-         }
+      llvmpipe_evict_variants(lp);
 
-         /*
-          * We need to re-check lp->nr_cs_variants because an arbitrarliy large
-          * number of shader variants (potentially all of them) could be
-          * pending for destruction on flush.
-          */
-
-         for (i = 0; i < variants_to_cull || lp->nr_cs_instrs >= LP_MAX_SHADER_INSTRUCTIONS; i++) {
-            struct lp_cs_variant_list_item *item;
-            if (is_empty_list(&lp->cs_variants_list)) {
-               break;
-            }
-            item = last_elem(&lp->cs_variants_list);
-            assert(item);
-            assert(item->base);
-            llvmpipe_remove_cs_shader_variant(lp, item->base);
-         }
-      }
       /*
        * Generate the new variant.
        */
@@ -793,7 +946,7 @@ llvmpipe_update_cs(struct llvmpipe_context *lp)
       /* Put the new variant into the list */
       if (variant) {
          insert_at_head(&shader->variants, &variant->list_item_local);
-         insert_at_head(&lp->cs_variants_list, &variant->list_item_global);
+         lp_variant_cache_insert(&lp->variant_cache, &variant->cache_item);
          lp->nr_cs_variants++;
          lp->nr_cs_instrs += variant->nr_instrs;
          shader->variants_cached++;
@@ -1139,7 +1292,11 @@ update_csctx_ssbo(struct llvmpipe_context *llvmpipe)
 static void
 llvmpipe_cs_update_derived(struct llvmpipe_context *llvmpipe, void *input)
 {
-   if (llvmpipe->cs_dirty & (LP_CSNEW_CS))
+   /* the variant key depends on the bound textures and samplers too */
+   if (llvmpipe->cs_dirty & (LP_CSNEW_CS |
+                             LP_CSNEW_SAMPLER_VIEW |
+                             LP_CSNEW_SAMPLER |
+                             LP_CSNEW_IMAGES))
       llvmpipe_update_cs(llvmpipe);
 
    if (llvmpipe->cs_dirty & LP_CSNEW_CONSTANTS) {
@@ -1195,6 +1352,31 @@ cs_exec_fn(void *init_data, int iter_idx, struct lp_cs_local_mem *lmem)
    }
    thread_data.shared = lmem->local_mem_ptr;
 
+   /* textures may have changed since the last dispatch this thread ran */
+   if (!lmem->cache) {
+      lmem->cache = align_malloc(sizeof(struct lp_build_format_cache), 16);
+      if (!lmem->cache)
+         return;
+      lmem->cache_job = job_info->id - 1;
+   }
+   if (lmem->cache_job != job_info->id) {
+      struct lp_build_format_cache *cache = lmem->cache;
+
+      if ((LP_DEBUG & DEBUG_TEX_CACHE) && cache->cache_access_total) {
+         debug_printf("cs cache access %llu miss %llu hit rate %f\n",
+                      (long long unsigned)cache->cache_access_total,
+                      (long long unsigned)cache->cache_access_miss,
+                      (float)(cache->cache_access_total -
+                              cache->cache_access_miss) /
+                      (float)cache->cache_access_total);
+      }
+      memset(cache->cache_tags, 0, sizeof(cache->cache_tags));
+      cache->cache_access_total = 0;
+      cache->cache_access_miss = 0;
+      lmem->cache_job = job_info->id;
+   }
+   thread_data.cache = lmem->cache;
+
    unsigned grid_z = iter_idx / (job_info->grid_size[0] * job_info->grid_size[1]);
    unsigned grid_y = (iter_idx - (grid_z * (job_info->grid_size[0] * job_info->grid_size[1]))) / job_info->grid_size[0];
    unsigned grid_x = (iter_idx - (grid_z * (job_info->grid_size[0] * job_info->grid_size[1])) - (grid_y * job_info->grid_size[0]));
@@ -1234,35 +1416,292 @@ fill_grid_size(struct pipe_context *pipe,
    pipe_buffer_unmap(pipe, transfer);
 }
 
+static void
+free_job(struct lp_cs_job *job)
+{
+   unsigned i;
+
+   for (i = 0; i < job->num_resources; i++)
+      pipe_resource_reference(&job->resources[i], NULL);
+   FREE(job->resources);
+
+   for (i = 0; i < ARRAY_SIZE(job->user_constants); i++)
+      FREE(job->user_constants[i]);
+   FREE(job->input);
+
+   lp_fence_reference(&job->fence, NULL);
+   FREE(job);
+}
+
+static void
+job_add_resource(struct lp_cs_job *job, struct pipe_resource *res)
+{
+   if (res)
+      pipe_resource_reference(&job->resources[job->num_resources++], res);
+}
+
+/**
+ * Snapshot the current compute state into a new job.
+ */
+static struct lp_cs_job *
+create_job(struct llvmpipe_context *llvmpipe,
+           const struct pipe_grid_info *info)
+{
+   struct lp_cs_context *csctx = llvmpipe->csctx;
+   struct lp_compute_shader *cs = llvmpipe->cs;
+   struct lp_cs_job *job;
+   unsigned max_resources;
+   unsigned i;
+
+   job = CALLOC_STRUCT(lp_cs_job);
+   if (!job)
+      return NULL;
+
+   max_resources = ARRAY_SIZE(csctx->ssbos) +
+                   ARRAY_SIZE(csctx->images) +
+                   cs->max_global_buffers +
+                   ARRAY_SIZE(csctx->cs.current_tex) +
+                   ARRAY_SIZE(csctx->constants);
+   job->resources = CALLOC(max_resources, sizeof *job->resources);
+   job->fence = lp_fence_create(1);
+   if (!job->resources || !job->fence) {
+      free_job(job);
+      return NULL;
+   }
+   job->fence->issued = TRUE;
+
+   job->exec = csctx->cs.current;
+   job->info.current = &job->exec;
+   job->info.block_size[0] = info->block[0];
+   job->info.block_size[1] = info->block[1];
+   job->info.block_size[2] = info->block[2];
+   job->info.work_dim = info->work_dim;
+   job->info.req_local_mem = cs->req_local_mem;
+   job->info.id = p_atomic_inc_return(&lp_cs_job_id);
+
+   /* resources the shader may write */
+   for (i = 0; i < ARRAY_SIZE(csctx->ssbos); i++)
+      job_add_resource(job, csctx->ssbos[i].current.buffer);
+   for (i = 0; i < ARRAY_SIZE(csctx->images); i++) {
+      if (csctx->images[i].current.access & PIPE_IMAGE_ACCESS_WRITE)
+         job_add_resource(job, csctx->images[i].current.resource);
+   }
+   for (i = 0; i < cs->max_global_buffers; i++)
+      job_add_resource(job, cs->global_buffers[i]);
+   job->num_writes = job->num_resources;
+
+   /* and those it only reads */
+   for (i = 0; i < ARRAY_SIZE(csctx->images); i++) {
+      if (!(csctx->images[i].current.access & PIPE_IMAGE_ACCESS_WRITE))
+         job_add_resource(job, csctx->images[i].current.resource);
+   }
+   for (i = 0; i < ARRAY_SIZE(csctx->cs.current_tex); i++)
+      job_add_resource(job, csctx->cs.current_tex[i]);
+   for (i = 0; i < ARRAY_SIZE(csctx->constants); i++) {
+      const struct pipe_constant_buffer *cb = &csctx->constants[i].current;
+      unsigned size = job->exec.jit_context.num_constants[i];
+
+      if (cb->buffer) {
+         job_add_resource(job, cb->buffer);
+      } else if (cb->user_buffer && size) {
+         /* user memory is only valid for the duration of the call */
+         job->user_constants[i] = MALLOC(size);
+         if (!job->user_constants[i]) {
+            free_job(job);
+            return NULL;
+         }
+         memcpy(job->user_constants[i],
+                job->exec.jit_context.constants[i], size);
+         job->exec.jit_context.constants[i] = job->user_constants[i];
+      }
+   }
+
+   if (info->input && cs->req_input_mem) {
+      job->input = MALLOC(cs->req_input_mem);
+      if (!job->input) {
+         free_job(job);
+         return NULL;
+      }
+      memcpy(job->input, info->input, cs->req_input_mem);
+      job->exec.jit_context.kernel_args = job->input;
+   }
+
+   return job;
+}
+
+static unsigned
+job_references(const struct lp_cs_job *job, const struct pipe_resource *res)
+{
+   unsigned i;
+
+   for (i = 0; i < job->num_resources; i++) {
+      if (job->resources[i] == res)
+         return i < job->num_writes ?
+            LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE :
+            LP_REFERENCED_FOR_READ;
+   }
+
+   return LP_UNREFERENCED;
+}
+
+/**
+ * Free the jobs which have finished executing.
+ */
+void
+lp_csctx_retire_jobs(struct lp_cs_context *csctx)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(csctx->pipe->screen);
+   struct lp_cs_job *job, *next;
+
+   LIST_FOR_EACH_ENTRY_SAFE(job, next, &csctx->jobs, list) {
+      if (!lp_fence_signalled(job->fence))
+         continue;
+
+      lp_cs_tpool_wait_for_task(screen->cs_tpool, &job->task);
+      list_del(&job->list);
+      csctx->num_jobs--;
+      free_job(job);
+   }
+}
+
+/**
+ * Wait for all dispatches in flight.
+ */
+void
+lp_csctx_finish(struct lp_cs_context *csctx)
+{
+   struct lp_cs_job *job;
+
+   LIST_FOR_EACH_ENTRY(job, &csctx->jobs, list)
+      lp_fence_wait(job->fence);
+
+   lp_csctx_retire_jobs(csctx);
+}
+
+/**
+ * How the dispatches in flight use a resource, as LP_REFERENCED_FOR_x flags.
+ */
+unsigned
+lp_csctx_is_resource_referenced(struct lp_cs_context *csctx,
+                                const struct pipe_resource *res)
+{
+   struct lp_cs_job *job;
+   unsigned referenced = LP_UNREFERENCED;
+
+   LIST_FOR_EACH_ENTRY(job, &csctx->jobs, list) {
+      if (!lp_fence_signalled(job->fence))
+         referenced |= job_references(job, res);
+   }
+
+   return referenced;
+}
+
+/**
+ * Wait for the dispatches which write a resource, or which access it at all
+ * unless read_only is set.
+ */
+void
+lp_csctx_wait_resource(struct lp_cs_context *csctx,
+                       const struct pipe_resource *res,
+                       boolean read_only)
+{
+   const unsigned mask = read_only ? LP_REFERENCED_FOR_WRITE :
+      LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   struct lp_cs_job *job;
+
+   if (!res || list_is_empty(&csctx->jobs))
+      return;
+
+   LIST_FOR_EACH_ENTRY(job, &csctx->jobs, list) {
+      if (job_references(job, res) & mask)
+         lp_fence_wait(job->fence);
+   }
+
+   lp_csctx_retire_jobs(csctx);
+}
+
+/**
+ * Replace a flush fence by one which also waits for the dispatches in
+ * flight.
+ */
+void
+lp_csctx_join_fence(struct lp_cs_context *csctx, struct lp_fence **fence)
+{
+   struct lp_fence *joined;
+   struct lp_cs_job *job;
+
+   lp_csctx_retire_jobs(csctx);
+   if (list_is_empty(&csctx->jobs))
+      return;
+
+   joined = lp_fence_create(0);
+   if (!joined) {
+      lp_csctx_finish(csctx);
+      return;
+   }
+   joined->issued = TRUE;
+
+   if (*fence && !lp_fence_signalled(*fence))
+      lp_fence_add_dependency(joined, *fence);
+
+   LIST_FOR_EACH_ENTRY(job, &csctx->jobs, list)
+      lp_fence_add_dependency(joined, job->fence);
+
+   lp_fence_reference(fence, NULL);
+   *fence = joined;
+}
+
 static void llvmpipe_launch_grid(struct pipe_context *pipe,
                                  const struct pipe_grid_info *info)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   struct lp_cs_job_info job_info;
-
-   memset(&job_info, 0, sizeof(job_info));
+   struct lp_cs_context *csctx = llvmpipe->csctx;
+   struct lp_cs_job *job;
+   unsigned i;
 
    llvmpipe_cs_update_derived(llvmpipe, info->input);
 
-   fill_grid_size(pipe, info, job_info.grid_size);
+   job = create_job(llvmpipe, info);
+   if (!job)
+      return;
 
-   job_info.block_size[0] = info->block[0];
-   job_info.block_size[1] = info->block[1];
-   job_info.block_size[2] = info->block[2];
-   job_info.work_dim = info->work_dim;
-   job_info.req_local_mem = llvmpipe->cs->req_local_mem;
-   job_info.current = &llvmpipe->csctx->cs.current;
+   fill_grid_size(pipe, info, job->info.grid_size);
 
-   int num_tasks = job_info.grid_size[2] * job_info.grid_size[1] * job_info.grid_size[0];
-   if (num_tasks) {
-      struct lp_cs_tpool_task *task;
-      mtx_lock(&screen->cs_mutex);
-      task = lp_cs_tpool_queue_task(screen->cs_tpool, cs_exec_fn, &job_info, num_tasks);
+   int num_tasks = job->info.grid_size[2] * job->info.grid_size[1] * job->info.grid_size[0];
+   if (!num_tasks) {
+      free_job(job);
+      return;
+   }
 
-      lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
-      mtx_unlock(&screen->cs_mutex);
+   lp_csctx_retire_jobs(csctx);
+   if (csctx->num_jobs >= LP_MAX_COMPUTE_JOBS) {
+      struct lp_cs_job *oldest = list_first_entry(&csctx->jobs,
+                                                  struct lp_cs_job, list);
+      lp_fence_wait(oldest->fence);
+      lp_csctx_retire_jobs(csctx);
    }
+
+   /*
+    * Order the dispatch after the scenes and dispatches accessing its
+    * resources in a conflicting way.  Anything else keeps running
+    * alongside it.
+    */
+   for (i = 0; i < job->num_resources; i++)
+      llvmpipe_flush_resource(pipe, job->resources[i], 0,
+                              i >= job->num_writes, TRUE, FALSE,
+                              __FUNCTION__);
+
+   job->task = lp_cs_tpool_queue_task(screen->cs_tpool, cs_exec_fn,
+                                      &job->info, num_tasks, job->fence);
+   if (!job->task && !lp_fence_signalled(job->fence)) {
+      /* out of memory, drop the dispatch */
+      lp_fence_signal(job->fence);
+   }
+
+   list_addtail(&job->list, &csctx->jobs);
+   csctx->num_jobs++;
+
    llvmpipe->pipeline_statistics.cs_invocations += num_tasks * info->block[0] * info->block[1] * info->block[2];
 }
 
@@ -1329,6 +1768,9 @@ void
 lp_csctx_destroy(struct lp_cs_context *csctx)
 {
    unsigned i;
+
+   lp_csctx_finish(csctx);
+
    for (i = 0; i < ARRAY_SIZE(csctx->cs.current_tex); i++) {
       pipe_resource_reference(&csctx->cs.current_tex[i], NULL);
    }
@@ -1350,5 +1792,6 @@ struct lp_cs_context *lp_csctx_create(struct pipe_context *pipe)
       return NULL;
 
    csctx->pipe = pipe;
+   list_inithead(&csctx->jobs);
    return csctx;
 }
@@ -28,14 +28,17 @@
 
 #include "os/os_thread.h"
 #include "util/u_thread.h"
+#include "util/list.h"
 #include "pipe/p_state.h"
 
 #include "gallivm/lp_bld.h"
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
+#include "gallivm/lp_bld_variant_cache.h"
 #include "lp_jit.h"
 #include "lp_state_fs.h"
 
 struct lp_compute_shader_variant;
+struct lp_fence;
 
 struct lp_compute_shader_variant_key
 {
@@ -67,7 +70,8 @@ struct lp_compute_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
-   struct lp_cs_variant_list_item list_item_global, list_item_local;
+   struct lp_cs_variant_list_item list_item_local;
+   struct lp_variant_cache_item cache_item;
 
    struct lp_compute_shader *shader;
 
@@ -83,6 +87,10 @@ struct lp_compute_shader {
    struct lp_tgsi_info info;
 
    uint32_t req_local_mem;
+   uint32_t req_input_mem;
+
+   /* Without barriers the invocations don't need to run as coroutines */
+   boolean has_barriers;
 
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
@@ -125,9 +133,28 @@ struct lp_cs_context {
    } images[LP_MAX_TGSI_SHADER_IMAGES];
 
    void *input;
+
+   /** dispatches in flight, oldest first */
+   struct list_head jobs;
+   unsigned num_jobs;
 };
 
 struct lp_cs_context *lp_csctx_create(struct pipe_context *pipe);
 void lp_csctx_destroy(struct lp_cs_context *csctx);
 
+void lp_csctx_retire_jobs(struct lp_cs_context *csctx);
+void lp_csctx_finish(struct lp_cs_context *csctx);
+
+unsigned
+lp_csctx_is_resource_referenced(struct lp_cs_context *csctx,
+                                const struct pipe_resource *res);
+
+void
+lp_csctx_wait_resource(struct lp_cs_context *csctx,
+                       const struct pipe_resource *res,
+                       boolean read_only);
+
+void
+lp_csctx_join_fence(struct lp_cs_context *csctx, struct lp_fence **fence);
+
 #endif
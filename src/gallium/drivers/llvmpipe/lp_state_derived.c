@@ -27,6 +27,7 @@
 
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_framebuffer.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vertex.h"
@@ -222,13 +223,19 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
        */
       boolean null_fs = !llvmpipe->fs ||
                         llvmpipe->fs->info.base.num_instructions <= 1;
+      unsigned samples =
+         util_framebuffer_get_num_samples(&llvmpipe->framebuffer);
+      boolean multisample = llvmpipe->rasterizer ?
+                            llvmpipe->rasterizer->multisample : FALSE;
       boolean discard =
-         (llvmpipe->sample_mask & 1) == 0 ||
+         (llvmpipe->sample_mask & ((1 << samples) - 1)) == 0 ||
          (llvmpipe->rasterizer ? llvmpipe->rasterizer->rasterizer_discard : FALSE) ||
          (null_fs &&
           !llvmpipe->depth_stencil->depth.enabled &&
           !llvmpipe->depth_stencil->stencil[0].enabled);
       lp_setup_set_rasterizer_discard(llvmpipe->setup, discard);
+      lp_setup_set_multisample(llvmpipe->setup, multisample, samples,
+                               llvmpipe->sample_mask);
    }
 
    if (llvmpipe->dirty & (LP_NEW_FS |
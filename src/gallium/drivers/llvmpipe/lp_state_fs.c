@@ -67,6 +67,7 @@
 #include "util/u_string.h"
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/u_framebuffer.h"
 #include "util/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -102,7 +103,9 @@
 #include "lp_tex_sample.h"
 #include "lp_flush.h"
 #include "lp_state_fs.h"
+#include "lp_screen.h"
 #include "lp_rast.h"
+#include "lp_texture.h"
 #include "nir/nir_to_tgsi_info.h"
 
 /** Fragment shader number (for debugging) */
@@ -288,6 +291,128 @@ lp_build_depth_clamp(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Pointer to the mask of sample s of the current quad group in
+ * s_mask_store, which holds num_loop masks per sample.
+ */
+static LLVMValueRef
+sample_mask_ptr(struct gallivm_state *gallivm,
+                LLVMValueRef s_mask_store,
+                LLVMValueRef num_loop,
+                LLVMValueRef loop_counter,
+                unsigned s)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef index;
+
+   index = LLVMBuildMul(builder, num_loop, lp_build_const_int32(gallivm, s), "");
+   index = LLVMBuildAdd(builder, index, loop_counter, "");
+   return LLVMBuildGEP(builder, s_mask_store, &index, 1, "s_mask_ptr");
+}
+
+
+/**
+ * Depth/stencil test, and optionally write, every sample of a multisample
+ * framebuffer for the current quad group.  Samples are stored as slices
+ * depth_sample_stride bytes apart.  The masks in s_mask_store are limited
+ * to the live pixels and updated with the test results.
+ *
+ * \param z  depth of the pixel centers
+ * \param z_sample_offset  per-sample depth offsets from the pixel center,
+ *                         NULL if all samples take the depth of the center
+ * \return mask of the pixels with any sample passing
+ */
+static LLVMValueRef
+generate_sample_depth_stencil(struct gallivm_state *gallivm,
+                              const struct lp_fragment_shader_variant_key *key,
+                              struct lp_type type,
+                              const struct util_format_description *zs_format_desc,
+                              LLVMValueRef context_ptr,
+                              LLVMValueRef thread_data_ptr,
+                              LLVMValueRef pixel_mask,
+                              LLVMValueRef s_mask_store,
+                              LLVMValueRef num_loop,
+                              LLVMValueRef loop_counter,
+                              LLVMValueRef *stencil_refs,
+                              LLVMValueRef z,
+                              const LLVMValueRef *z_sample_offset,
+                              LLVMValueRef facing,
+                              LLVMValueRef depth_ptr,
+                              LLVMValueRef depth_stride,
+                              LLVMValueRef depth_sample_stride,
+                              boolean do_write)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context f32_bld;
+   LLVMValueRef any = lp_build_zero(gallivm, lp_int_type(type));
+   unsigned s;
+
+   lp_build_context_init(&f32_bld, gallivm, type);
+
+   for (s = 0; s < key->nr_samples; s++) {
+      struct lp_build_mask_context s_mask;
+      LLVMValueRef s_mask_ptr, s_mask_val;
+      LLVMValueRef sample_depth_ptr, offset;
+      LLVMValueRef z_s = z;
+      LLVMValueRef z_fb, s_fb, z_value, s_value;
+
+      s_mask_ptr = sample_mask_ptr(gallivm, s_mask_store, num_loop,
+                                   loop_counter, s);
+      s_mask_val = LLVMBuildLoad(builder, s_mask_ptr, "");
+      s_mask_val = LLVMBuildAnd(builder, s_mask_val, pixel_mask, "");
+
+      lp_build_mask_begin(&s_mask, gallivm, type, s_mask_val);
+
+      if (z_sample_offset) {
+         z_s = lp_build_add(&f32_bld, z_s,
+                            lp_build_broadcast_scalar(&f32_bld,
+                                                      z_sample_offset[s]));
+      }
+      if (key->depth_clamp) {
+         z_s = lp_build_depth_clamp(gallivm, builder, type, context_ptr,
+                                    thread_data_ptr, z_s);
+      }
+      else if (z_sample_offset) {
+         /* the [0,1] clamp the interpolation skipped for the pixel center */
+         z_s = lp_build_clamp_zero_one_nanzero(&f32_bld, z_s);
+      }
+
+      offset = LLVMBuildMul(builder, depth_sample_stride,
+                            lp_build_const_int32(gallivm, s), "");
+      sample_depth_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+
+      lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                           zs_format_desc, key->resource_1d,
+                                           sample_depth_ptr, depth_stride,
+                                           &z_fb, &s_fb, loop_counter);
+      lp_build_depth_stencil_test(gallivm,
+                                  &key->depth,
+                                  key->stencil,
+                                  type,
+                                  zs_format_desc,
+                                  &s_mask,
+                                  stencil_refs,
+                                  z_s, z_fb, s_fb,
+                                  facing,
+                                  &z_value, &s_value,
+                                  FALSE);
+      if (do_write) {
+         lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                               zs_format_desc, key->resource_1d,
+                                               NULL, NULL, NULL, loop_counter,
+                                               sample_depth_ptr, depth_stride,
+                                               z_value, s_value);
+      }
+
+      s_mask_val = lp_build_mask_end(&s_mask);
+      LLVMBuildStore(builder, s_mask_val, s_mask_ptr);
+      any = LLVMBuildOr(builder, any, s_mask_val, "");
+   }
+
+   return any;
+}
+
+
 /**
  * Generate the fragment shader, depth/stencil test, and alpha tests.
  */
@@ -303,9 +428,12 @@ generate_fs_loop(struct gallivm_state *gallivm,
                  const struct lp_build_sampler_soa *sampler,
                  const struct lp_build_image_soa *image,
                  LLVMValueRef mask_store,
+                 LLVMValueRef s_mask_store,
                  LLVMValueRef (*out_color)[4],
                  LLVMValueRef depth_ptr,
                  LLVMValueRef depth_stride,
+                 LLVMValueRef depth_sample_stride,
+                 const LLVMValueRef *z_sample_offset,
                  LLVMValueRef facing,
                  LLVMValueRef thread_data_ptr)
 {
@@ -386,6 +514,14 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                         (key->stencil[1].enabled &&
                                          key->stencil[1].writemask))))
          depth_mode &= ~(LATE_DEPTH_WRITE | EARLY_DEPTH_WRITE);
+
+      /*
+       * The deferred depth write merges the values of whole pixels, test
+       * late instead so every sample keeps its own result.
+       */
+      if (key->nr_samples > 1 &&
+          (depth_mode & EARLY_DEPTH_TEST) && (depth_mode & LATE_DEPTH_WRITE))
+         depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
    }
    else {
       depth_mode = 0;
@@ -446,7 +582,24 @@ generate_fs_loop(struct gallivm_state *gallivm,
    lp_build_interp_soa_update_pos_dyn(interp, gallivm, loop_state.counter);
    z = interp->pos[2];
 
-   if (depth_mode & EARLY_DEPTH_TEST) {
+   if ((depth_mode & EARLY_DEPTH_TEST) && key->nr_samples > 1) {
+      LLVMValueRef any;
+
+      any = generate_sample_depth_stencil(gallivm, key, type, zs_format_desc,
+                                          context_ptr, thread_data_ptr,
+                                          lp_build_mask_value(&mask),
+                                          s_mask_store, num_loop,
+                                          loop_state.counter,
+                                          stencil_refs, z, z_sample_offset,
+                                          facing, depth_ptr, depth_stride,
+                                          depth_sample_stride,
+                                          (depth_mode & EARLY_DEPTH_WRITE) != 0);
+      lp_build_mask_update(&mask, any);
+
+      if (!simple_shader)
+         lp_build_mask_check(&mask);
+   }
+   else if (depth_mode & EARLY_DEPTH_TEST) {
       /*
        * Clamp according to ARB_depth_clamp semantics.
        */
@@ -541,7 +694,33 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                            TGSI_SEMANTIC_COLOR,
                                            0);
 
-      if (color0 != -1 && outputs[color0][3]) {
+      if (color0 != -1 && outputs[color0][3] && key->nr_samples > 1) {
+         /*
+          * Cover the first alpha * nr_samples samples of the pixel.
+          */
+         LLVMValueRef alpha = LLVMBuildLoad(builder, outputs[color0][3], "alpha");
+         struct lp_build_context f32_bld;
+         unsigned s;
+
+         lp_build_context_init(&f32_bld, gallivm, type);
+         for (s = 0; s < key->nr_samples; s++) {
+            LLVMValueRef s_mask_ptr, s_mask_val, test;
+
+            test = lp_build_cmp(&f32_bld, PIPE_FUNC_GREATER, alpha,
+                                lp_build_const_vec(gallivm, type,
+                                                   (s + 0.5) / key->nr_samples));
+            s_mask_ptr = sample_mask_ptr(gallivm, s_mask_store, num_loop,
+                                         loop_state.counter, s);
+            s_mask_val = LLVMBuildLoad(builder, s_mask_ptr, "");
+            s_mask_val = LLVMBuildAnd(builder, s_mask_val, test, "");
+            LLVMBuildStore(builder, s_mask_val, s_mask_ptr);
+
+            /* the first sample is covered whenever any is */
+            if (s == 0)
+               lp_build_mask_update(&mask, test);
+         }
+      }
+      else if (color0 != -1 && outputs[color0][3]) {
          LLVMValueRef alpha = LLVMBuildLoad(builder, outputs[color0][3], "alpha");
 
          lp_build_alpha_to_coverage(gallivm, type,
@@ -560,11 +739,36 @@ generate_fs_loop(struct gallivm_state *gallivm,
 
       assert(smaski >= 0);
       smask = LLVMBuildLoad(builder, outputs[smaski][0], "smask");
-      /*
-       * Pixel is alive according to the first sample in the mask.
-       */
       smask = LLVMBuildBitCast(builder, smask, smask_bld.vec_type, "");
-      smask = lp_build_and(&smask_bld, smask, smask_bld.one);
+      if (key->nr_samples > 1) {
+         unsigned s;
+
+         for (s = 0; s < key->nr_samples; s++) {
+            LLVMValueRef s_mask_ptr, s_mask_val, bit;
+
+            bit = lp_build_and(&smask_bld, smask,
+                               lp_build_const_int_vec(gallivm, int_type, 1 << s));
+            bit = lp_build_cmp(&smask_bld, PIPE_FUNC_NOTEQUAL, bit, smask_bld.zero);
+            s_mask_ptr = sample_mask_ptr(gallivm, s_mask_store, num_loop,
+                                         loop_state.counter, s);
+            s_mask_val = LLVMBuildLoad(builder, s_mask_ptr, "");
+            s_mask_val = LLVMBuildAnd(builder, s_mask_val, bit, "");
+            LLVMBuildStore(builder, s_mask_val, s_mask_ptr);
+         }
+
+         /*
+          * Pixel is alive if any of its samples is.
+          */
+         smask = lp_build_and(&smask_bld, smask,
+                              lp_build_const_int_vec(gallivm, int_type,
+                                                     (1 << key->nr_samples) - 1));
+      }
+      else {
+         /*
+          * Pixel is alive according to the first sample in the mask.
+          */
+         smask = lp_build_and(&smask_bld, smask, smask_bld.one);
+      }
       smask = lp_build_cmp(&smask_bld, PIPE_FUNC_NOTEQUAL, smask, smask_bld.zero);
       lp_build_mask_update(&mask, smask);
    }
@@ -579,11 +783,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                           0);
       if (pos0 != -1 && outputs[pos0][2]) {
          z = LLVMBuildLoad(builder, outputs[pos0][2], "output.z");
+         /* the shader's depth goes to all samples */
+         z_sample_offset = NULL;
       }
       /*
        * Clamp according to ARB_depth_clamp semantics.
        */
-      if (key->depth_clamp) {
+      if (key->depth_clamp && key->nr_samples == 1) {
          z = lp_build_depth_clamp(gallivm, builder, type, context_ptr,
                                   thread_data_ptr, z);
       }
@@ -597,29 +803,45 @@ generate_fs_loop(struct gallivm_state *gallivm,
          stencil_refs[1] = stencil_refs[0];
       }
 
-      lp_build_depth_stencil_load_swizzled(gallivm, type,
-                                           zs_format_desc, key->resource_1d,
-                                           depth_ptr, depth_stride,
-                                           &z_fb, &s_fb, loop_state.counter);
-
-      lp_build_depth_stencil_test(gallivm,
-                                  &key->depth,
-                                  key->stencil,
-                                  type,
-                                  zs_format_desc,
-                                  &mask,
-                                  stencil_refs,
-                                  z, z_fb, s_fb,
-                                  facing,
-                                  &z_value, &s_value,
-                                  !simple_shader);
-      /* Late Z write */
-      if (depth_mode & LATE_DEPTH_WRITE) {
-         lp_build_depth_stencil_write_swizzled(gallivm, type,
-                                               zs_format_desc, key->resource_1d,
-                                               NULL, NULL, NULL, loop_state.counter,
-                                               depth_ptr, depth_stride,
-                                               z_value, s_value);
+      if (key->nr_samples > 1) {
+         LLVMValueRef any;
+
+         any = generate_sample_depth_stencil(gallivm, key, type, zs_format_desc,
+                                             context_ptr, thread_data_ptr,
+                                             lp_build_mask_value(&mask),
+                                             s_mask_store, num_loop,
+                                             loop_state.counter,
+                                             stencil_refs, z, z_sample_offset,
+                                             facing, depth_ptr, depth_stride,
+                                             depth_sample_stride,
+                                             (depth_mode & LATE_DEPTH_WRITE) != 0);
+         lp_build_mask_update(&mask, any);
+      }
+      else {
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_state.counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     z, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     !simple_shader);
+         /* Late Z write */
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_state.counter,
+                                                  depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
       }
    }
    else if ((depth_mode & EARLY_DEPTH_TEST) &&
@@ -660,7 +882,24 @@ generate_fs_loop(struct gallivm_state *gallivm,
       }
    }
 
-   if (key->occlusion_count) {
+   if (key->occlusion_count && key->nr_samples > 1) {
+      /* count the passing samples */
+      LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
+      unsigned s;
+
+      lp_build_name(counter, "counter");
+      for (s = 0; s < key->nr_samples; s++) {
+         LLVMValueRef s_mask_ptr, s_mask_val;
+
+         s_mask_ptr = sample_mask_ptr(gallivm, s_mask_store, num_loop,
+                                      loop_state.counter, s);
+         s_mask_val = LLVMBuildLoad(builder, s_mask_ptr, "");
+         s_mask_val = LLVMBuildAnd(builder, s_mask_val,
+                                   lp_build_mask_value(&mask), "");
+         lp_build_occlusion_count(gallivm, type, s_mask_val, counter);
+      }
+   }
+   else if (key->occlusion_count) {
       LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
       lp_build_name(counter, "counter");
       lp_build_occlusion_count(gallivm, type,
@@ -1851,7 +2090,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   vector_width    = dst_type.floating ? variant->key.vector_width : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2442,9 +2681,10 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[13];
+   LLVMTypeRef arg_types[15];
    LLVMTypeRef func_type;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
    LLVMValueRef context_ptr;
    LLVMValueRef x;
@@ -2456,7 +2696,10 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef stride_ptr;
    LLVMValueRef depth_ptr;
    LLVMValueRef depth_stride;
+   LLVMValueRef color_sample_stride_ptr;
+   LLVMValueRef depth_sample_stride;
    LLVMValueRef mask_input;
+   LLVMValueRef sample_mask_input;
    LLVMValueRef thread_data_ptr;
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
@@ -2464,6 +2707,7 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_build_image_soa *image;
    struct lp_build_interp_soa_context interp;
    LLVMValueRef fs_mask[16 / 4];
+   LLVMValueRef s_mask_store = NULL;
    LLVMValueRef fs_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][16 / 4];
    LLVMValueRef function;
    LLVMValueRef facing;
@@ -2475,7 +2719,7 @@ generate_fragment(struct llvmpipe_context *lp,
    const boolean dual_source_blend = key->blend.rt[0].blend_enable &&
                                      util_blend_state_is_dual(&key->blend, 0);
 
-   assert(lp_native_vector_width / 32 >= 4);
+   assert(key->vector_width / 32 >= 4);
 
    /* Adjust color input interpolation according to flatshade state:
     */
@@ -2501,7 +2745,7 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.sign = TRUE;          /* values are signed */
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
-   fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   fs_type.length = MIN2(key->vector_width / 32, 16); /* n*4 elements per vector */
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -2519,8 +2763,12 @@ generate_fragment(struct llvmpipe_context *lp,
 
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
-   snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-            shader->no, variant->no, partial_mask ? "partial" : "whole");
+   /*
+    * The name must not depend on the shader or variant numbers, as code
+    * loaded from the disk cache is looked up by it.
+    */
+   snprintf(func_name, sizeof(func_name), "fs_variant_%s",
+            partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2531,10 +2779,12 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[6] = LLVMPointerType(fs_elem_type, 0);    /* dady */
    arg_types[7] = LLVMPointerType(LLVMPointerType(blend_vec_type, 0), 0);  /* color */
    arg_types[8] = LLVMPointerType(int8_type, 0);       /* depth */
-   arg_types[9] = int32_type;                          /* mask_input */
+   arg_types[9] = int64_type;                          /* mask_input */
    arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
    arg_types[11] = LLVMPointerType(int32_type, 0);     /* stride */
    arg_types[12] = int32_type;                         /* depth_stride */
+   arg_types[13] = LLVMPointerType(int32_type, 0);     /* color_sample_stride */
+   arg_types[14] = int32_type;                         /* depth_sample_stride */
 
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, ARRAY_SIZE(arg_types), 0);
@@ -2560,10 +2810,12 @@ generate_fragment(struct llvmpipe_context *lp,
    dady_ptr     = LLVMGetParam(function, 6);
    color_ptr_ptr = LLVMGetParam(function, 7);
    depth_ptr    = LLVMGetParam(function, 8);
-   mask_input   = LLVMGetParam(function, 9);
+   sample_mask_input = LLVMGetParam(function, 9);
    thread_data_ptr  = LLVMGetParam(function, 10);
    stride_ptr   = LLVMGetParam(function, 11);
    depth_stride = LLVMGetParam(function, 12);
+   color_sample_stride_ptr = LLVMGetParam(function, 13);
+   depth_sample_stride = LLVMGetParam(function, 14);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(x, "x");
@@ -2573,10 +2825,12 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_build_name(dady_ptr, "dady");
    lp_build_name(color_ptr_ptr, "color_ptr_ptr");
    lp_build_name(depth_ptr, "depth");
-   lp_build_name(mask_input, "mask_input");
+   lp_build_name(sample_mask_input, "mask_input");
    lp_build_name(thread_data_ptr, "thread_data");
    lp_build_name(stride_ptr, "stride_ptr");
    lp_build_name(depth_stride, "depth_stride");
+   lp_build_name(color_sample_stride_ptr, "color_sample_stride_ptr");
+   lp_build_name(depth_sample_stride, "depth_sample_stride");
 
    /*
     * Function body
@@ -2587,6 +2841,24 @@ generate_fragment(struct llvmpipe_context *lp,
    assert(builder);
    LLVMPositionBuilderAtEnd(builder, block);
 
+   /*
+    * mask_input has 16 bits per sample, a pixel is shaded if any of its
+    * samples is covered.
+    */
+   mask_input = sample_mask_input;
+   if (key->nr_samples > 1) {
+      for (i = 1; i < key->nr_samples; i++) {
+         mask_input = LLVMBuildOr(builder, mask_input,
+                                  LLVMBuildLShr(builder, sample_mask_input,
+                                                LLVMConstInt(int64_type, 16 * i, 0),
+                                                ""),
+                                  "");
+      }
+      mask_input = LLVMBuildAnd(builder, mask_input,
+                                LLVMConstInt(int64_type, 0xffff, 0), "");
+   }
+   mask_input = LLVMBuildTrunc(builder, mask_input, int32_type, "");
+
    /*
     * Must not count ps invocations if there's a null shader.
     * (It would be ok to count with null shader if there's d/s tests,
@@ -2620,6 +2892,7 @@ generate_fragment(struct llvmpipe_context *lp,
       LLVMTypeRef mask_type = lp_build_int_vec_type(gallivm, fs_type);
       LLVMValueRef mask_store = lp_build_array_alloca(gallivm, mask_type,
                                                       num_loop, "mask_store");
+      LLVMValueRef z_sample_offset[LP_MAX_SAMPLES];
       LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS];
       boolean pixel_center_integer =
          shader->info.base.properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER];
@@ -2634,7 +2907,12 @@ generate_fragment(struct llvmpipe_context *lp,
                                shader->info.base.num_inputs,
                                inputs,
                                pixel_center_integer,
-                               key->depth_clamp,
+                               /*
+                                * The pixel center may lie outside the
+                                * primitive with multisampling, so only
+                                * the per-sample depths get clamped.
+                                */
+                               key->depth_clamp || key->multisample,
                                builder, fs_type,
                                a0_ptr, dadx_ptr, dady_ptr,
                                x, y);
@@ -2655,6 +2933,67 @@ generate_fragment(struct llvmpipe_context *lp,
          LLVMBuildStore(builder, mask, mask_ptr);
       }
 
+      if (key->nr_samples > 1) {
+         /*
+          * Per-sample coverage, num_fs masks for each sample.  The depth
+          * test and the blend take these on top of the pixel masks.
+          */
+         LLVMValueRef num_masks = lp_build_const_int32(gallivm,
+                                                       num_fs * key->nr_samples);
+         unsigned s;
+
+         s_mask_store = lp_build_array_alloca(gallivm, mask_type, num_masks,
+                                              "s_mask_store");
+
+         for (s = 0; s < key->nr_samples; s++) {
+            LLVMValueRef s_mask_input;
+
+            s_mask_input = LLVMBuildLShr(builder, sample_mask_input,
+                                         LLVMConstInt(int64_type, 16 * s, 0), "");
+            s_mask_input = LLVMBuildTrunc(builder, s_mask_input, int32_type, "");
+
+            for (i = 0; i < num_fs; i++) {
+               LLVMValueRef indexi = lp_build_const_int32(gallivm,
+                                                          s * num_fs + i);
+               LLVMValueRef mask_ptr = LLVMBuildGEP(builder, s_mask_store,
+                                                    &indexi, 1, "s_mask_ptr");
+               LLVMValueRef mask = generate_quad_mask(gallivm, fs_type,
+                                                      i*fs_type.length/4,
+                                                      s_mask_input);
+               LLVMBuildStore(builder, mask, mask_ptr);
+            }
+         }
+      }
+
+      if (key->multisample) {
+         /*
+          * Depth of the samples relative to the pixel center.
+          */
+         LLVMValueRef index = lp_build_const_int32(gallivm, 2); /* pos.z */
+         LLVMValueRef dzdx = LLVMBuildLoad(builder,
+                                           LLVMBuildGEP(builder, dadx_ptr,
+                                                        &index, 1, ""),
+                                           "dzdx");
+         LLVMValueRef dzdy = LLVMBuildLoad(builder,
+                                           LLVMBuildGEP(builder, dady_ptr,
+                                                        &index, 1, ""),
+                                           "dzdy");
+         unsigned s;
+
+         for (s = 0; s < key->nr_samples; s++) {
+            LLVMValueRef dx = LLVMConstReal(fs_elem_type,
+                                            lp_sample_pos_4x[s][0] - 0.5);
+            LLVMValueRef dy = LLVMConstReal(fs_elem_type,
+                                            lp_sample_pos_4x[s][1] - 0.5);
+
+            z_sample_offset[s] =
+               LLVMBuildFAdd(builder,
+                             LLVMBuildFMul(builder, dzdx, dx, ""),
+                             LLVMBuildFMul(builder, dzdy, dy, ""),
+                             "z_sample_offset");
+         }
+      }
+
       generate_fs_loop(gallivm,
                        shader, key,
                        builder,
@@ -2665,9 +3004,12 @@ generate_fragment(struct llvmpipe_context *lp,
                        sampler,
                        image,
                        mask_store, /* output */
+                       s_mask_store, /* output */
                        color_store,
                        depth_ptr,
                        depth_stride,
+                       depth_sample_stride,
+                       key->multisample ? z_sample_offset : NULL,
                        facing,
                        thread_data_ptr);
 
@@ -2723,11 +3065,74 @@ generate_fragment(struct llvmpipe_context *lp,
                                 LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
                                 "");
 
-         generate_unswizzled_blend(gallivm, cbuf, variant,
-                                   key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
-                                   context_ptr, color_ptr, stride,
-                                   partial_mask, do_branch);
+         if (key->nr_samples > 1) {
+            /*
+             * Blend the shaded colors into every covered sample.
+             */
+            LLVMTypeRef color_ptr_type = LLVMTypeOf(color_ptr);
+            LLVMValueRef sample_stride;
+            LLVMValueRef num_loop = lp_build_const_int32(gallivm, num_fs);
+            LLVMValueRef s_fs_mask[16 / 4];
+            struct lp_build_for_loop_state sample_loop;
+
+            sample_stride = LLVMBuildLoad(builder,
+                                          LLVMBuildGEP(builder,
+                                                       color_sample_stride_ptr,
+                                                       &index, 1, ""),
+                                          "");
+
+            lp_build_for_loop_begin(&sample_loop, gallivm,
+                                    lp_build_const_int32(gallivm, 0),
+                                    LLVMIntULT,
+                                    lp_build_const_int32(gallivm,
+                                                         key->nr_samples),
+                                    lp_build_const_int32(gallivm, 1));
+            {
+               LLVMValueRef offset, sample_color_ptr;
+
+               for (i = 0; i < num_fs; i++) {
+                  LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
+                  LLVMValueRef s_mask_ptr;
+
+                  indexi = LLVMBuildAdd(builder, indexi,
+                                        LLVMBuildMul(builder,
+                                                     sample_loop.counter,
+                                                     num_loop, ""),
+                                        "");
+                  s_mask_ptr = LLVMBuildGEP(builder, s_mask_store,
+                                            &indexi, 1, "s_mask_ptr");
+                  s_fs_mask[i] = LLVMBuildAnd(builder, fs_mask[i],
+                                              LLVMBuildLoad(builder,
+                                                            s_mask_ptr, ""),
+                                              "");
+               }
+
+               offset = LLVMBuildMul(builder, sample_loop.counter,
+                                     sample_stride, "");
+               sample_color_ptr = LLVMBuildBitCast(builder, color_ptr,
+                                                   LLVMPointerType(int8_type, 0),
+                                                   "");
+               sample_color_ptr = LLVMBuildGEP(builder, sample_color_ptr,
+                                               &offset, 1, "");
+               sample_color_ptr = LLVMBuildBitCast(builder, sample_color_ptr,
+                                                   color_ptr_type, "");
+
+               generate_unswizzled_blend(gallivm, cbuf, variant,
+                                         key->cbuf_format[cbuf],
+                                         num_fs, fs_type, s_fs_mask,
+                                         fs_out_color, context_ptr,
+                                         sample_color_ptr, stride,
+                                         TRUE, do_branch);
+            }
+            lp_build_for_loop_end(&sample_loop);
+         }
+         else {
+            generate_unswizzled_blend(gallivm, cbuf, variant,
+                                      key->cbuf_format[cbuf],
+                                      num_fs, fs_type, fs_mask, fs_out_color,
+                                      context_ptr, color_ptr, stride,
+                                      partial_mask, do_branch);
+         }
       }
    }
 
@@ -2744,6 +3149,7 @@ dump_fs_variant_key(struct lp_fragment_shader_variant_key *key)
 
    debug_printf("fs variant %p:\n", (void *) key);
 
+   debug_printf("vector_width = %u\n", key->vector_width);
    if (key->flatshade) {
       debug_printf("flatshade = 1\n");
    }
@@ -2777,6 +3183,11 @@ dump_fs_variant_key(struct lp_fragment_shader_variant_key *key)
       debug_printf("occlusion_count = 1\n");
    }
 
+   if (key->nr_samples > 1) {
+      debug_printf("nr_samples = %u\n", key->nr_samples);
+      debug_printf("multisample = %u\n", key->multisample);
+   }
+
    if (key->blend.logicop_enable) {
       debug_printf("blend.logicop_func = %s\n", util_str_logicop(key->blend.logicop_func, TRUE));
    }
@@ -2860,6 +3271,160 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
 }
 
 
+/**
+ * Build the IR for the variant's functions in variant->gallivm.
+ */
+static void
+generate_variant_functions(struct llvmpipe_context *lp,
+                           struct lp_fragment_shader *shader,
+                           struct lp_fragment_shader_variant *variant)
+{
+   variant->function[RAST_EDGE_TEST] = NULL;
+   variant->function[RAST_WHOLE] = NULL;
+
+   /* The types belong to the LLVM context of the module */
+   variant->jit_context_ptr_type = NULL;
+   variant->jit_thread_data_ptr_type = NULL;
+   variant->jit_linear_context_ptr_type = NULL;
+   lp_jit_init_types(variant);
+
+   generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+
+   if (variant->opaque) {
+      /* Specialized shader, which doesn't need to read the color buffer. */
+      generate_fragment(lp, shader, variant, RAST_WHOLE);
+   }
+}
+
+
+/**
+ * Point the variant's jit functions at the compiled code of gallivm.
+ */
+static void
+jit_variant_functions(struct lp_fragment_shader_variant *variant,
+                      struct gallivm_state *gallivm,
+                      LLVMValueRef function[2])
+{
+   lp_jit_frag_func edge_test = NULL, whole;
+
+   if (function[RAST_EDGE_TEST]) {
+      edge_test = (lp_jit_frag_func)
+            gallivm_jit_function(gallivm, function[RAST_EDGE_TEST]);
+   }
+
+   if (function[RAST_WHOLE]) {
+      whole = (lp_jit_frag_func)
+            gallivm_jit_function(gallivm, function[RAST_WHOLE]);
+   } else {
+      whole = edge_test;
+   }
+
+   variant->jit_function[RAST_EDGE_TEST] = edge_test;
+   variant->jit_function[RAST_WHOLE] = whole;
+}
+
+
+/**
+ * Start compiling the optimized module of the variant in the background
+ * and compile an unoptimized version of it right away, for use meanwhile.
+ * \return  FALSE if the fallback could not be created
+ */
+static boolean
+generate_variant_async(struct llvmpipe_context *lp,
+                       struct lp_fragment_shader *shader,
+                       struct lp_fragment_shader_variant *variant,
+                       const char *module_name)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   LLVMValueRef function[2];
+
+   variant->nr_instrs += lp_build_count_ir_module(gallivm->module);
+   gallivm_compile_module_async(gallivm);
+
+   /* Keep the handles to the optimized functions, valid until free_ir */
+   function[RAST_EDGE_TEST] = variant->function[RAST_EDGE_TEST];
+   function[RAST_WHOLE] = variant->function[RAST_WHOLE];
+
+   variant->fallback_gallivm = gallivm_create(module_name, lp->context, NULL);
+   if (!variant->fallback_gallivm)
+      return FALSE;
+
+   variant->fallback_gallivm->perf |= GALLIVM_PERF_NO_OPT;
+
+   variant->gallivm = variant->fallback_gallivm;
+   generate_variant_functions(lp, shader, variant);
+   gallivm_compile_module(variant->fallback_gallivm);
+   jit_variant_functions(variant, variant->fallback_gallivm,
+                         variant->function);
+   gallivm_free_ir(variant->fallback_gallivm);
+
+   variant->gallivm = gallivm;
+   variant->function[RAST_EDGE_TEST] = function[RAST_EDGE_TEST];
+   variant->function[RAST_WHOLE] = function[RAST_WHOLE];
+   variant->compiling = TRUE;
+
+   return TRUE;
+}
+
+
+/**
+ * Bytes of machine code the variant holds on to.
+ */
+static size_t
+variant_code_size(const struct lp_fragment_shader_variant *variant)
+{
+   size_t size = gallivm_code_size(variant->gallivm);
+
+   if (variant->fallback_gallivm)
+      size += gallivm_code_size(variant->fallback_gallivm);
+
+   return size;
+}
+
+
+/**
+ * Switch a variant over to its optimized code once the background
+ * compilation is done.  Scenes binned so far keep running the fallback
+ * functions copied into their state, so the fallback module is only freed
+ * once no scene is in flight anymore.
+ */
+static void
+finish_variant(struct llvmpipe_context *lp,
+               struct lp_fragment_shader_variant *variant)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   if (variant->compiling) {
+      if (!gallivm_is_compiled(variant->gallivm))
+         return;
+
+      jit_variant_functions(variant, variant->gallivm, variant->function);
+      variant->compiling = FALSE;
+
+      if (variant->needs_caching)
+         lp_disk_cache_insert_shader(screen, &variant->cached,
+                                     variant->ir_sha1_cache_key);
+
+      gallivm_free_ir(variant->gallivm);
+
+      /* Following draws store a state with the optimized functions */
+      if (lp->fs_variant == variant)
+         lp_setup_set_fs_variant(lp->setup, variant);
+   }
+
+   if (variant->fallback_gallivm && lp_setup_is_idle(lp->setup)) {
+      gallivm_destroy(variant->fallback_gallivm);
+      variant->fallback_gallivm = NULL;
+   }
+
+   lp_variant_cache_set_size(&variant->cache_item, variant_code_size(variant));
+}
+
+
+static boolean
+evict_fs_variant(struct lp_variant_cache_item *item);
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
@@ -2869,9 +3434,11 @@ generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc = NULL;
    boolean fullcolormask;
+   boolean async;
    char module_name[64];
 
    variant = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
@@ -2882,15 +3449,34 @@ generate_variant(struct llvmpipe_context *lp,
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
             shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (screen->disk_shader_cache) {
+      lp_build_ir_cache_key(&shader->base, key, shader->variant_key_size,
+                            NULL, 0, variant->ir_sha1_cache_key);
+      lp_disk_cache_find_shader(screen, &variant->cached,
+                                variant->ir_sha1_cache_key);
+      if (!variant->cached.data_size)
+         variant->needs_caching = true;
+   }
+
+   /*
+    * Code loaded from the disk cache is quick enough to get.  Otherwise the
+    * module gets a private LLVM context, so it can be compiled on another
+    * thread.
+    */
+   async = screen->async_compile && !variant->cached.data_size;
+
+   variant->gallivm = gallivm_create(module_name, async ? NULL : lp->context,
+                                     &variant->cached);
    if (!variant->gallivm) {
+      free(variant->cached.data);
       FREE(variant);
       return NULL;
    }
 
    variant->shader = shader;
-   variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
+   lp_variant_cache_item_init(&variant->cache_item, evict_fs_variant,
+                              PIPE_SHADER_FRAGMENT, variant, lp);
    variant->no = shader->variants_created++;
 
    memcpy(&variant->key, key, shader->variant_key_size);
@@ -2920,16 +3506,17 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
+   generate_variant_functions(lp, shader, variant);
 
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
+   if (async) {
+      if (!generate_variant_async(lp, shader, variant, module_name)) {
+         gallivm_destroy(variant->gallivm);
+         FREE(variant);
+         return NULL;
       }
+      lp_variant_cache_set_size(&variant->cache_item,
+                                variant_code_size(variant));
+      return variant;
    }
 
    /*
@@ -2940,19 +3527,12 @@ generate_variant(struct llvmpipe_context *lp,
 
    variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
 
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
+   jit_variant_functions(variant, variant->gallivm, variant->function);
+   lp_variant_cache_set_size(&variant->cache_item, variant_code_size(variant));
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
-   }
+   if (variant->needs_caching)
+      lp_disk_cache_insert_shader(screen, &variant->cached,
+                                  variant->ir_sha1_cache_key);
 
    gallivm_free_ir(variant->gallivm);
 
@@ -3080,8 +3660,8 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
 
 
 /**
- * Remove shader variant from two lists: the shader's variant list
- * and the context's variant list.
+ * Remove shader variant from the shader's variant list and the context's
+ * variant cache, and free it.
  */
 static void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
@@ -3089,21 +3669,27 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
 {
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del fs #%u var %u v created %u v cached %u "
-                   "v total cached %u inst %u total inst %u\n",
+                   "v total cached %u inst %u total inst %u code %u\n",
                    variant->shader->no, variant->no,
                    variant->shader->variants_created,
                    variant->shader->variants_cached,
-                   lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
+                   lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs,
+                   (unsigned)variant->cache_item.size);
    }
 
    gallivm_destroy(variant->gallivm);
+   if (variant->fallback_gallivm)
+      gallivm_destroy(variant->fallback_gallivm);
+
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
 
-   /* remove from context's list */
-   remove_from_list(&variant->list_item_global);
+   /* remove from context's cache */
+   lp_variant_cache_remove(&variant->cache_item);
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
 
@@ -3111,6 +3697,25 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
 }
 
 
+/**
+ * Variant cache callback.  Binned scenes may reference any fragment shader
+ * variant until they have been rasterized, and the bound one will be
+ * referenced by the next draw.
+ */
+static boolean
+evict_fs_variant(struct lp_variant_cache_item *item)
+{
+   struct llvmpipe_context *lp = item->owner;
+   struct lp_fragment_shader_variant *variant = item->variant;
+
+   if (variant == lp->fs_variant || !lp_setup_is_idle(lp->setup))
+      return FALSE;
+
+   llvmpipe_remove_shader_variant(lp, variant);
+   return TRUE;
+}
+
+
 static void
 llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
 {
@@ -3241,6 +3846,10 @@ llvmpipe_set_shader_images(struct pipe_context *pipe,
    for (i = start_slot, idx = 0; i < start_slot + count; i++, idx++) {
       const struct pipe_image_view *image = images ? &images[idx] : NULL;
 
+      /* image stores write the linear layout */
+      if (image && image->resource)
+         llvmpipe_resource_detile(pipe, image->resource);
+
       util_copy_image_view(&llvmpipe->images[shader][i], image);
    }
 
@@ -3348,6 +3957,9 @@ make_variant_key(struct llvmpipe_context *lp,
    /* alpha.ref_value is passed in jit_context */
 
    key->flatshade = lp->rasterizer->flatshade;
+   key->vector_width = llvmpipe_screen(lp->pipe.screen)->fs_vector_width;
+   key->nr_samples = util_framebuffer_get_num_samples(&lp->framebuffer);
+   key->multisample = lp->rasterizer->multisample && key->nr_samples > 1;
    if (lp->active_occlusion_queries && !lp->queries_disabled) {
       key->occlusion_count = TRUE;
    }
@@ -3524,16 +4136,13 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    if (variant) {
-      /* Move this variant to the head of the list to implement LRU
-       * deletion of shader's when we have too many.
-       */
-      move_to_head(&lp->fs_variants_list, &variant->list_item_global);
+      lp_variant_cache_hit(&variant->cache_item);
+
+      finish_variant(lp, variant);
    }
    else {
       /* variant not found, create it now */
       int64_t t0, t1, dt;
-      unsigned i;
-      unsigned variants_to_cull;
 
       if (LP_DEBUG & DEBUG_FS) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
@@ -3542,47 +4151,10 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
                       lp->nr_fs_variants ? lp->nr_fs_instrs / lp->nr_fs_variants : 0);
       }
 
-      /* First, check if we've exceeded the max number of shader variants.
-       * If so, free 6.25% of them (the least recently used ones).
+      /* First, free the least recently used variants of any stage if the
+       * generated code exceeds the budget.
        */
-      variants_to_cull = lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS ? LP_MAX_SHADER_VARIANTS / 16 : 0;
-
-      if (variants_to_cull ||
-          lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         struct pipe_context *pipe = &lp->pipe;
-
-         if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-            debug_printf("Evicting FS: %u fs variants,\t%u total variants,"
-                         "\t%u instrs,\t%u instrs/variant\n",
-                         shader->variants_cached,
-                         lp->nr_fs_variants, lp->nr_fs_instrs,
-                         lp->nr_fs_instrs / lp->nr_fs_variants);
-         }
-
-         /*
-          * XXX: we need to flush the context until we have some sort of
-          * reference counting in fragment shaders as they may still be binned
-          * Flushing alone might not be sufficient we need to wait on it too.
-          */
-         llvmpipe_finish(pipe, __FUNCTION__);
-
-         /*
-          * We need to re-check lp->nr_fs_variants because an arbitrarliy large
-          * number of shader variants (potentially all of them) could be
-          * pending for destruction on flush.
-          */
-
-         for (i = 0; i < variants_to_cull || lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS; i++) {
-            struct lp_fs_variant_list_item *item;
-            if (is_empty_list(&lp->fs_variants_list)) {
-               break;
-            }
-            item = last_elem(&lp->fs_variants_list);
-            assert(item);
-            assert(item->base);
-            llvmpipe_remove_shader_variant(lp, item->base);
-         }
-      }
+      llvmpipe_evict_variants(lp);
 
       /*
        * Generate the new variant.
@@ -3597,7 +4169,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       /* Put the new variant into the list */
       if (variant) {
          insert_at_head(&shader->variants, &variant->list_item_local);
-         insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
+         lp_variant_cache_insert(&lp->variant_cache, &variant->cache_item);
          lp->nr_fs_variants++;
          lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
@@ -3605,10 +4177,24 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
 
+/**
+ * Called before each draw, to switch the bound fragment shader variant to
+ * its optimized code as soon as that is available.
+ */
+void
+llvmpipe_poll_fs_variant(struct llvmpipe_context *lp)
+{
+   if (lp->fs_variant && (lp->fs_variant->compiling ||
+                          lp->fs_variant->fallback_gallivm))
+      finish_variant(lp, lp->fs_variant);
+}
+
+
 
 
 
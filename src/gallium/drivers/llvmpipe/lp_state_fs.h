@@ -35,11 +35,14 @@
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
+#include "gallivm/lp_bld_init.h" /* for lp_cached_code */
+#include "gallivm/lp_bld_variant_cache.h"
 #include "lp_bld_interp.h" /* for struct lp_shader_input */
 
 
 struct tgsi_token;
 struct lp_fragment_shader;
+struct llvmpipe_context;
 
 
 /** Indexes into jit_function[] array */
@@ -83,6 +86,9 @@ struct lp_fragment_shader_variant_key
    unsigned occlusion_count:1;
    unsigned resource_1d:1;
    unsigned depth_clamp:1;
+   unsigned multisample:1;      /* per-sample coverage and depth */
+   unsigned nr_samples:3;       /* framebuffer samples */
+   unsigned vector_width:10;    /* bits per vector, 128 or 256 */
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -138,7 +144,20 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
-   struct lp_fs_variant_list_item list_item_global, list_item_local;
+   /**
+    * Asynchronous compilation (LP_ASYNC_COMPILE): while the optimized
+    * module in gallivm is compiled in the background, jit_function[] point
+    * at unoptimized code from fallback_gallivm.  Scenes run the functions
+    * copied into their lp_rast_state, so that is kept until they are done.
+    */
+   boolean compiling;
+   struct gallivm_state *fallback_gallivm;
+   struct lp_cached_code cached;
+   unsigned char ir_sha1_cache_key[20];
+   boolean needs_caching;
+
+   struct lp_fs_variant_list_item list_item_local;
+   struct lp_variant_cache_item cache_item;
    struct lp_fragment_shader *shader;
 
    /* For debugging/profiling purposes */
@@ -174,4 +193,7 @@ struct lp_fragment_shader
 void
 lp_debug_fs_variant(struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_poll_fs_variant(struct llvmpipe_context *lp);
+
 #endif /* LP_STATE_FS_H_ */
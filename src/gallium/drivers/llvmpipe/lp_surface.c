@@ -25,11 +25,14 @@
  * 
  **************************************************************************/
 
+#include "util/u_memory.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
+#include "util/format/u_format.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_limits.h"
+#include "lp_setup.h"
 #include "lp_surface.h"
 #include "lp_texture.h"
 #include "lp_query.h"
@@ -56,11 +59,178 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
+   /*
+    * Transfers only see sample 0, so copy between multisample resources
+    * directly.  All samples of consecutive layers are consecutive slices.
+    */
+   if (llvmpipe_resource_samples(src) > 1 &&
+       llvmpipe_resource_samples(src) == llvmpipe_resource_samples(dst)) {
+      const unsigned nr_samples = llvmpipe_resource_samples(src);
+      uint8_t *dst_map = llvmpipe_resource_map(dst, dst_level, dstz,
+                                               LP_TEX_USAGE_READ_WRITE);
+      const uint8_t *src_map = llvmpipe_resource_map(src, src_level,
+                                                     src_box->z,
+                                                     LP_TEX_USAGE_READ);
+
+      util_copy_box(dst_map, dst->format,
+                    llvmpipe_resource_stride(dst, dst_level),
+                    llvmpipe_layer_stride(dst, dst_level),
+                    dstx, dsty, 0,
+                    src_box->width, src_box->height,
+                    src_box->depth * nr_samples,
+                    src_map,
+                    llvmpipe_resource_stride(src, src_level),
+                    llvmpipe_layer_stride(src, src_level),
+                    src_box->x, src_box->y, 0);
+
+      llvmpipe_resource_unmap(src, src_level, src_box->z);
+      llvmpipe_resource_unmap(dst, dst_level, dstz);
+      return;
+   }
+
    util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
                              src, src_level, src_box);
 }
 
 
+/**
+ * Resolve a multisample resource into a single-sample one.
+ * Color samples get averaged, depth/stencil and integer formats take
+ * sample 0.  Returns FALSE for blits which need scaling, scissoring,
+ * flipping or format conversion of depth/stencil.
+ */
+static boolean
+lp_resolve_blit(struct pipe_context *pipe,
+                const struct pipe_blit_info *info)
+{
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_resource *dst = info->dst.resource;
+   const enum pipe_format src_format = info->src.format;
+   const enum pipe_format dst_format = info->dst.format;
+   const struct util_format_description *src_desc =
+      util_format_description(src_format);
+   const unsigned nr_samples = llvmpipe_resource_samples(src);
+   const int width = info->dst.box.width;
+   const int height = info->dst.box.height;
+   const boolean average =
+      !util_format_is_depth_or_stencil(src_format) &&
+      !util_format_is_pure_integer(src_format);
+   /* 8-bit unorm channels can be averaged in place, without unpacking */
+   const boolean average_8unorm =
+      average &&
+      src_format == dst_format &&
+      src_desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB &&
+      util_format_is_rgba8_variant(src_desc);
+   unsigned src_stride, dst_stride, sample_stride;
+   float *texels = NULL, *accum = NULL;
+   int x, y, z;
+   unsigned s;
+
+   if (width <= 0 || height <= 0 ||
+       info->src.box.width != width ||
+       info->src.box.height != height ||
+       info->src.box.depth != info->dst.box.depth ||
+       info->scissor_enable)
+      return FALSE;
+
+   if (!average &&
+       (src_format != dst_format ||
+        (util_format_get_mask(src_format) & ~info->mask) != 0))
+      return FALSE;
+
+   if (average && !average_8unorm) {
+      texels = MALLOC(width * 4 * sizeof(float));
+      accum = MALLOC(width * 4 * sizeof(float));
+      if (!texels || !accum) {
+         FREE(texels);
+         FREE(accum);
+         return FALSE;
+      }
+   }
+
+   /* the samples are written out linearly */
+   llvmpipe_resource_detile(pipe, dst);
+
+   llvmpipe_flush_resource(pipe,
+                           dst, info->dst.level,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve dest");
+
+   llvmpipe_flush_resource(pipe,
+                           src, info->src.level,
+                           TRUE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve src");
+
+   src_stride = llvmpipe_resource_stride(src, info->src.level);
+   dst_stride = llvmpipe_resource_stride(dst, info->dst.level);
+   sample_stride = llvmpipe_layer_stride(src, info->src.level);
+
+   for (z = 0; z < info->dst.box.depth; z++) {
+      const uint8_t *src_map =
+         llvmpipe_resource_map(src, info->src.level, info->src.box.z + z,
+                               LP_TEX_USAGE_READ);
+      uint8_t *dst_map =
+         llvmpipe_resource_map(dst, info->dst.level, info->dst.box.z + z,
+                               LP_TEX_USAGE_READ_WRITE);
+
+      if (!average) {
+         util_copy_rect(dst_map, dst_format, dst_stride,
+                        info->dst.box.x, info->dst.box.y,
+                        width, height,
+                        src_map, src_stride,
+                        info->src.box.x, info->src.box.y);
+      }
+      else if (average_8unorm) {
+         for (y = 0; y < height; y++) {
+            const uint8_t *src_row = src_map +
+               (info->src.box.y + y) * src_stride + info->src.box.x * 4;
+            uint8_t *dst_row = dst_map +
+               (info->dst.box.y + y) * dst_stride + info->dst.box.x * 4;
+
+            for (x = 0; x < width * 4; x++) {
+               unsigned sum = nr_samples / 2;
+               for (s = 0; s < nr_samples; s++)
+                  sum += src_row[s * sample_stride + x];
+               dst_row[x] = sum / nr_samples;
+            }
+         }
+      }
+      else {
+         const float scale = 1.0f / nr_samples;
+
+         for (y = 0; y < height; y++) {
+            memset(accum, 0, width * 4 * sizeof(float));
+            for (s = 0; s < nr_samples; s++) {
+               util_format_read_4f(src_format, texels, 0,
+                                   src_map + s * sample_stride, src_stride,
+                                   info->src.box.x, info->src.box.y + y,
+                                   width, 1);
+               for (x = 0; x < width * 4; x++)
+                  accum[x] += texels[x];
+            }
+            for (x = 0; x < width * 4; x++)
+               accum[x] *= scale;
+            util_format_write_4f(dst_format, accum, 0,
+                                 dst_map, dst_stride,
+                                 info->dst.box.x, info->dst.box.y + y,
+                                 width, 1);
+         }
+      }
+
+      llvmpipe_resource_unmap(src, info->src.level, info->src.box.z + z);
+      llvmpipe_resource_unmap(dst, info->dst.level, info->dst.box.z + z);
+   }
+
+   FREE(texels);
+   FREE(accum);
+   return TRUE;
+}
+
+
 static void lp_blit(struct pipe_context *pipe,
                     const struct pipe_blit_info *blit_info)
 {
@@ -71,10 +241,11 @@ static void lp_blit(struct pipe_context *pipe,
       return;
 
    if (info.src.resource->nr_samples > 1 &&
-       info.dst.resource->nr_samples <= 1 &&
-       !util_format_is_depth_or_stencil(info.src.resource->format) &&
-       !util_format_is_pure_integer(info.src.resource->format)) {
-      debug_printf("llvmpipe: color resolve unimplemented\n");
+       info.dst.resource->nr_samples <= 1) {
+      if (!lp_resolve_blit(pipe, &info))
+         debug_printf("llvmpipe: resolve unsupported %s -> %s\n",
+                      util_format_short_name(info.src.format),
+                      util_format_short_name(info.dst.format));
       return;
    }
 
@@ -141,6 +312,10 @@ llvmpipe_create_surface(struct pipe_context *pipe,
       }
    }
 
+   /* the rasterizer only renders to linear images */
+   if (llvmpipe_resource_is_texture(pt))
+      llvmpipe_resource_detile(pipe, pt);
+
    ps = CALLOC_STRUCT(pipe_surface);
    if (ps) {
       pipe_reference_init(&ps->reference, 1);
@@ -185,6 +360,38 @@ llvmpipe_surface_destroy(struct pipe_context *pipe,
 }
 
 
+/**
+ * The transfer based clear fallbacks only reach sample 0 of each layer,
+ * so replicate it to the other samples of a multisample surface.
+ */
+static void
+lp_replicate_sample0(struct pipe_surface *dst,
+                     unsigned dstx, unsigned dsty,
+                     unsigned width, unsigned height)
+{
+   struct pipe_resource *pt = dst->texture;
+   const unsigned nr_samples = llvmpipe_resource_samples(pt);
+   const unsigned level = dst->u.tex.level;
+   const unsigned stride = llvmpipe_resource_stride(pt, level);
+   const unsigned sample_stride = llvmpipe_layer_stride(pt, level);
+   unsigned layer, s;
+
+   for (layer = dst->u.tex.first_layer;
+        layer <= dst->u.tex.last_layer; layer++) {
+      uint8_t *map = llvmpipe_resource_map(pt, level, layer,
+                                           LP_TEX_USAGE_READ_WRITE);
+
+      for (s = 1; s < nr_samples; s++) {
+         util_copy_rect(map + s * sample_stride, dst->format, stride,
+                        dstx, dsty, width, height,
+                        map, stride, dstx, dsty);
+      }
+
+      llvmpipe_resource_unmap(pt, level, layer);
+   }
+}
+
+
 static void
 llvmpipe_clear_render_target(struct pipe_context *pipe,
                              struct pipe_surface *dst,
@@ -200,6 +407,9 @@ llvmpipe_clear_render_target(struct pipe_context *pipe,
 
    util_clear_render_target(pipe, dst, color,
                             dstx, dsty, width, height);
+
+   if (llvmpipe_resource_samples(dst->texture) > 1)
+      lp_replicate_sample0(dst, dstx, dsty, width, height);
 }
 
 
@@ -221,6 +431,25 @@ llvmpipe_clear_depth_stencil(struct pipe_context *pipe,
    util_clear_depth_stencil(pipe, dst, clear_flags,
                             depth, stencil,
                             dstx, dsty, width, height);
+
+   if (llvmpipe_resource_samples(dst->texture) > 1)
+      lp_replicate_sample0(dst, dstx, dsty, width, height);
+}
+
+
+static void
+llvmpipe_get_sample_position(struct pipe_context *pipe,
+                             unsigned sample_count,
+                             unsigned sample_index,
+                             float *out_value)
+{
+   if (sample_count == LP_MAX_SAMPLES && sample_index < sample_count) {
+      out_value[0] = lp_sample_pos_4x[sample_index][0];
+      out_value[1] = lp_sample_pos_4x[sample_index][1];
+   }
+   else {
+      out_value[0] = out_value[1] = 0.5f;
+   }
 }
 
 
@@ -236,4 +465,5 @@ llvmpipe_init_surface_functions(struct llvmpipe_context *lp)
    lp->pipe.resource_copy_region = lp_resource_copy;
    lp->pipe.blit = lp_blit;
    lp->pipe.flush_resource = lp_flush_resource;
+   lp->pipe.get_sample_position = llvmpipe_get_sample_position;
 }
@@ -0,0 +1,593 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Check that the compute thread pool runs every workgroup exactly once and
+ * measure its throughput for various grid and block sizes, then compare
+ * compute shaders running their invocations as coroutines with the
+ * straight loop used when the shader has no barriers.
+ *
+ * Also check that compute shader variants reloaded from the on-disk shader
+ * cache by another process give the same results.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pipe/p_config.h"
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/os_time.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_cs_tpool.h"
+#include "lp_public.h"
+#include "lp_screen.h"
+#include "lp_test.h"
+
+#if defined(PIPE_OS_LINUX)
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+
+/** Stand-in for a compute shader dispatch */
+struct bench_job {
+   unsigned block_size;
+   unsigned *hits;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "test\t"
+           "threads\t"
+           "grid\t"
+           "block\t"
+           "workgroups_per_sec\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * One workgroup: an invocation per block element, each touching the shared
+ * memory like a shader using shared variables would.
+ */
+static void
+bench_fn(void *data, int iter_idx, struct lp_cs_local_mem *lmem)
+{
+   struct bench_job *job = data;
+   unsigned size = job->block_size * sizeof(uint32_t);
+   uint32_t *shared;
+   unsigned i;
+
+   if (lmem->local_size < size) {
+      lmem->local_mem_ptr = REALLOC(lmem->local_mem_ptr, lmem->local_size,
+                                    size);
+      lmem->local_size = size;
+   }
+   shared = lmem->local_mem_ptr;
+
+   for (i = 0; i < job->block_size; i++)
+      shared[i] = iter_idx + i;
+
+   p_atomic_inc(&job->hits[iter_idx]);
+}
+
+
+/**
+ * Run a grid, returning the workgroups per second or a negative value if
+ * some workgroup did not run exactly once per repetition.
+ */
+static double
+run_grid(struct lp_cs_tpool *pool, unsigned grid, unsigned block)
+{
+   /* repeat small grids so each run does a similar amount of work */
+   const unsigned reps = MAX2(1, (1 << 20) / (grid * block));
+   struct bench_job job;
+   int64_t start, end;
+   unsigned r, i;
+   boolean success = TRUE;
+
+   job.block_size = block;
+   job.hits = CALLOC(grid, sizeof *job.hits);
+   if (!job.hits)
+      return -1.0;
+
+   start = os_time_get_nano();
+   for (r = 0; r < reps; r++) {
+      struct lp_cs_tpool_task *task;
+
+      task = lp_cs_tpool_queue_task(pool, bench_fn, &job, grid, NULL);
+      lp_cs_tpool_wait_for_task(pool, &task);
+   }
+   end = os_time_get_nano();
+
+   for (i = 0; i < grid; i++) {
+      if (job.hits[i] != reps)
+         success = FALSE;
+   }
+
+   FREE(job.hits);
+
+   if (!success)
+      return -1.0;
+
+   return (double) grid * reps / MAX2(end - start, 1) * 1e9;
+}
+
+
+static boolean
+test_tpool(unsigned verbose, FILE *fp,
+           unsigned max_threads,
+           const unsigned *grids, unsigned num_grids,
+           const unsigned *blocks, unsigned num_blocks)
+{
+   boolean success = TRUE;
+   unsigned threads, g, b;
+   double *base;
+
+   base = CALLOC(num_grids * num_blocks, sizeof *base);
+   if (!base)
+      return FALSE;
+
+   for (threads = 1; ; threads = MIN2(threads * 2, max_threads)) {
+      struct lp_cs_tpool *pool = lp_cs_tpool_create(threads);
+
+      if (!pool) {
+         success = FALSE;
+         break;
+      }
+
+      for (g = 0; g < num_grids; g++) {
+         for (b = 0; b < num_blocks; b++) {
+            double rate = run_grid(pool, grids[g], blocks[b]);
+            double *ref = &base[g * num_blocks + b];
+
+            if (rate < 0.0) {
+               if (verbose)
+                  printf("%u threads, grid %u, block %u: "
+                         "workgroups lost or run twice\n",
+                         threads, grids[g], blocks[b]);
+               success = FALSE;
+               continue;
+            }
+
+            if (threads == 1)
+               *ref = rate;
+
+            if (verbose)
+               printf("%u threads, grid %u, block %u: "
+                      "%.0f workgroups/s (x%.2f)\n",
+                      threads, grids[g], blocks[b], rate,
+                      *ref > 0.0 ? rate / *ref : 0.0);
+
+            if (fp) {
+               fprintf(fp, "pass\ttpool\t%u\t%u\t%u\t%.0f\n",
+                       threads, grids[g], blocks[b], rate);
+               fflush(fp);
+            }
+         }
+      }
+
+      lp_cs_tpool_destroy(pool);
+
+      if (threads == max_threads)
+         break;
+   }
+
+   FREE(base);
+
+   return success;
+}
+
+
+/**
+ * Each invocation stores its global index at that index.  The barrier at
+ * the end has no effect on the result, it only forces coroutines.
+ */
+static void *
+create_shader(struct pipe_context *ctx, unsigned block, boolean barrier)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_compute_state state;
+   char text[1024];
+
+   snprintf(text, sizeof(text),
+            "COMP\n"
+            "DCL SV[0], BLOCK_ID[0]\n"
+            "DCL SV[1], THREAD_ID[0]\n"
+            "DCL BUFFER[0]\n"
+            "DCL TEMP[0..1]\n"
+            "IMM[0] UINT32 { %u, 4, 0, 0 }\n"
+            "  UMAD TEMP[0].x, SV[0].xxxx, IMM[0].xxxx, SV[1].xxxx\n"
+            "  UMUL TEMP[1].x, TEMP[0].xxxx, IMM[0].yyyy\n"
+            "  STORE BUFFER[0].x, TEMP[1].xxxx, TEMP[0].xxxx\n"
+            "%s"
+            "  END\n",
+            block, barrier ? "  BARRIER\n" : "");
+
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof(state));
+   state.ir_type = PIPE_SHADER_IR_TGSI;
+   state.prog = tokens;
+
+   return ctx->create_compute_state(ctx, &state);
+}
+
+
+static void
+finish(struct pipe_context *ctx)
+{
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_fence_handle *fence = NULL;
+
+   ctx->flush(ctx, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+}
+
+
+/**
+ * Dispatch the shader over the buffer, returning the workgroups per second
+ * or a negative value if the buffer content is wrong.
+ */
+static double
+run_shader(struct pipe_context *ctx, struct pipe_resource *buf,
+           unsigned grid, unsigned block, boolean barrier)
+{
+   const unsigned reps = 16;
+   struct pipe_shader_buffer sb;
+   struct pipe_grid_info info;
+   struct pipe_transfer *transfer;
+   const uint32_t *data;
+   boolean success = TRUE;
+   int64_t start, end;
+   unsigned r, i;
+   void *cs;
+
+   cs = create_shader(ctx, block, barrier);
+   if (!cs)
+      return -1.0;
+
+   memset(&sb, 0, sizeof(sb));
+   sb.buffer = buf;
+   sb.buffer_size = buf->width0;
+   ctx->set_shader_buffers(ctx, PIPE_SHADER_COMPUTE, 0, 1, &sb, 1);
+   ctx->bind_compute_state(ctx, cs);
+
+   memset(&info, 0, sizeof(info));
+   info.work_dim = 1;
+   info.block[0] = block;
+   info.block[1] = 1;
+   info.block[2] = 1;
+   info.grid[0] = grid;
+   info.grid[1] = 1;
+   info.grid[2] = 1;
+
+   /* compile */
+   ctx->launch_grid(ctx, &info);
+   finish(ctx);
+
+   start = os_time_get_nano();
+   for (r = 0; r < reps; r++)
+      ctx->launch_grid(ctx, &info);
+   finish(ctx);
+   end = os_time_get_nano();
+
+   data = pipe_buffer_map(ctx, buf, PIPE_TRANSFER_READ, &transfer);
+   for (i = 0; i < grid * block; i++) {
+      if (data[i] != i) {
+         success = FALSE;
+         break;
+      }
+   }
+   pipe_buffer_unmap(ctx, transfer);
+
+   ctx->bind_compute_state(ctx, NULL);
+   ctx->set_shader_buffers(ctx, PIPE_SHADER_COMPUTE, 0, 1, NULL, 0);
+   ctx->delete_compute_state(ctx, cs);
+
+   if (!success)
+      return -1.0;
+
+   return (double) grid * reps / MAX2(end - start, 1) * 1e9;
+}
+
+
+static boolean
+test_shaders(unsigned verbose, FILE *fp,
+             const unsigned *blocks, unsigned num_blocks)
+{
+   const unsigned invocations = 1 << 20;
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *ctx;
+   struct pipe_resource *buf;
+   boolean success = TRUE;
+   unsigned b;
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+
+   ctx = screen->context_create(screen, NULL, 0);
+   buf = pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER,
+                            PIPE_USAGE_DEFAULT, invocations * 4);
+   if (!ctx || !buf) {
+      success = FALSE;
+      goto out;
+   }
+
+   for (b = 0; b < num_blocks; b++) {
+      unsigned block = blocks[b];
+      unsigned grid = invocations / block;
+      double coro, straight;
+
+      coro = run_shader(ctx, buf, grid, block, TRUE);
+      straight = run_shader(ctx, buf, grid, block, FALSE);
+
+      if (coro < 0.0 || straight < 0.0) {
+         if (verbose)
+            printf("shader, block %u: wrong results\n", block);
+         success = FALSE;
+         continue;
+      }
+
+      if (verbose)
+         printf("shader, grid %u, block %u: %.0f workgroups/s with "
+                "coroutines, %.0f without (x%.2f)\n",
+                grid, block, coro, straight, straight / coro);
+
+      if (fp) {
+         unsigned threads = llvmpipe_screen(screen)->num_threads;
+
+         fprintf(fp, "pass\tcoro\t%u\t%u\t%u\t%.0f\n",
+                 threads, grid, block, coro);
+         fprintf(fp, "pass\tstraight\t%u\t%u\t%u\t%.0f\n",
+                 threads, grid, block, straight);
+         fflush(fp);
+      }
+   }
+
+out:
+   pipe_resource_reference(&buf, NULL);
+   if (ctx)
+      ctx->destroy(ctx);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+#if defined(PIPE_OS_LINUX)
+
+/*
+ * Set in the processes test_disk_cache() starts: "miss" for the one that
+ * fills the cache, "hit" for the one that must load every variant from it.
+ */
+#define CACHE_RUN_ENV "LP_TEST_CS_CACHE_RUN"
+
+
+/**
+ * Body of the child processes: run a shader with and without coroutines,
+ * as the former is what calls back into the driver to allocate its frames.
+ */
+static boolean
+run_cached_shaders(boolean expect_hits)
+{
+   const unsigned grid = 64, block = 64;
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *ctx;
+   struct pipe_resource *buf;
+   struct llvmpipe_screen *lp_screen;
+   boolean success;
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+   lp_screen = llvmpipe_screen(screen);
+
+   ctx = screen->context_create(screen, NULL, 0);
+   buf = pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER,
+                            PIPE_USAGE_DEFAULT, grid * block * 4);
+
+   success = ctx && buf && lp_screen->disk_shader_cache &&
+             run_shader(ctx, buf, grid, block, TRUE) >= 0.0 &&
+             run_shader(ctx, buf, grid, block, FALSE) >= 0.0;
+
+   if (expect_hits)
+      success = success && lp_screen->num_disk_shader_cache_misses == 0 &&
+                lp_screen->num_disk_shader_cache_hits == 2;
+   else
+      success = success && lp_screen->num_disk_shader_cache_hits == 0;
+
+   pipe_resource_reference(&buf, NULL);
+   if (ctx)
+      ctx->destroy(ctx);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+static int
+remove_cache_file(const char *path, const struct stat *sb, int flag,
+                  struct FTW *ftwbuf)
+{
+   return remove(path);
+}
+
+
+/**
+ * Compile shaders into an empty cache in one process, then load them back
+ * in a fresh one.  Exec'ing again gives the second process a different
+ * address space layout, so any host address baked into the cached code
+ * makes it crash or compute garbage.
+ */
+static boolean
+test_disk_cache(unsigned verbose, FILE *fp)
+{
+   const char *run_env = getenv(CACHE_RUN_ENV);
+   char dir[] = "/tmp/lp_test_cs_cache_XXXXXX";
+   boolean success = TRUE;
+   unsigned run;
+
+   if (run_env)
+      exit(run_cached_shaders(strcmp(run_env, "hit") == 0) ? 0 : 1);
+
+   if (!mkdtemp(dir))
+      return FALSE;
+
+   setenv("MESA_GLSL_CACHE_DIR", dir, 1);
+   unsetenv("MESA_GLSL_CACHE_DISABLE");
+
+   for (run = 0; run < 2 && success; run++) {
+      int status = 0;
+      pid_t pid = fork();
+
+      if (pid == 0) {
+         setenv(CACHE_RUN_ENV, run ? "hit" : "miss", 1);
+         execl("/proc/self/exe", "lp_test_cs", (char *)NULL);
+         _exit(127);
+      }
+
+      success = pid > 0 && waitpid(pid, &status, 0) == pid &&
+                WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+      if (verbose)
+         printf("disk cache, %s run: %s\n", run ? "second" : "first",
+                success ? "ok" : "failed");
+   }
+
+   unsetenv("MESA_GLSL_CACHE_DIR");
+   nftw(dir, remove_cache_file, 16, FTW_DEPTH | FTW_PHYS);
+
+   if (fp) {
+      fprintf(fp, "%s\tdisk_cache\t\t\t\t\n", success ? "pass" : "fail");
+      fflush(fp);
+   }
+
+   return success;
+}
+
+#else
+
+static boolean
+test_disk_cache(unsigned verbose, FILE *fp)
+{
+   return TRUE;
+}
+
+#endif
+
+
+static unsigned
+max_threads(void)
+{
+   return CLAMP(util_cpu_caps.nr_cpus, 1, LP_MAX_THREADS);
+}
+
+
+static const unsigned block_sizes[] = { 1, 64, 1024 };
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   static const unsigned grids[] = { 1 << 10, 1 << 14, 1 << 17, 1 << 20 };
+
+   boolean success;
+
+   success = test_disk_cache(verbose, fp);
+
+   success = test_tpool(verbose, fp, max_threads(),
+                        grids, ARRAY_SIZE(grids),
+                        block_sizes, ARRAY_SIZE(block_sizes)) && success;
+
+   return test_shaders(verbose, fp, block_sizes,
+                       ARRAY_SIZE(block_sizes)) && success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   unsigned grid = CLAMP(n, 1, 1 << 20);
+   boolean success;
+
+   success = test_disk_cache(verbose, fp);
+
+   success = test_tpool(verbose, fp, max_threads(),
+                        &grid, 1,
+                        block_sizes, ARRAY_SIZE(block_sizes)) && success;
+
+   return test_shaders(verbose, fp, block_sizes,
+                       ARRAY_SIZE(block_sizes)) && success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   static const unsigned grid = 1 << 10;
+   static const unsigned block = 1;
+   static const unsigned shader_block = 64;
+
+   return test_disk_cache(verbose, fp) &&
+          test_tpool(verbose, fp, max_threads(), &grid, 1, &block, 1) &&
+          test_shaders(verbose, fp, &shader_block, 1);
+}
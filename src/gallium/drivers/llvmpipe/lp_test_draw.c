@@ -0,0 +1,500 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Measure the vertex throughput of the draw module, in triangles per
+ * second, against the number of DRAW_THREADS vertex shading threads, and
+ * check that every thread count streams out the same vertices.
+ *
+ * Rasterization is discarded, so this covers vertex fetch, shading,
+ * clipping and emit up to triangle setup.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_simple_shaders.h"
+#include "util/os_time.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+enum shader_kind {
+   SHADER_PASSTHROUGH,
+   SHADER_ALU,
+};
+
+
+static const char *shader_names[] = {
+   "passthrough",
+   "alu",
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "shader\t"
+           "triangles\t"
+           "threads\t"
+           "triangles_per_sec\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * The passthrough shader copies the position and a color.  The ALU one
+ * transforms the position by a matrix and runs a dependent chain of 32
+ * MADs to compute the color.
+ */
+static void *
+create_vs(struct pipe_context *ctx, enum shader_kind kind)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_shader_state state;
+   char text[4096];
+   char *p = text;
+   unsigned i;
+
+   p += sprintf(p,
+                "VERT\n"
+                "DCL IN[0]\n"
+                "DCL IN[1]\n"
+                "DCL OUT[0], POSITION\n"
+                "DCL OUT[1], GENERIC[0]\n"
+                "DCL TEMP[0..1]\n"
+                "IMM[0] FLT32 { 0.5, 0.25, 0.75, 1.0 }\n"
+                "IMM[1] FLT32 { 0.0, 0.5, 0.0, 0.0 }\n"
+                "IMM[2] FLT32 { 0.5, 0.0, 0.0, 0.0 }\n"
+                "IMM[3] FLT32 { 0.0, 0.0, 1.0, 0.0 }\n"
+                "IMM[4] FLT32 { 0.25, -0.25, 0.0, 1.0 }\n");
+
+   switch (kind) {
+   case SHADER_PASSTHROUGH:
+      p += sprintf(p,
+                   "  MOV OUT[0], IN[0]\n"
+                   "  MOV OUT[1], IN[1]\n");
+      break;
+   case SHADER_ALU:
+      p += sprintf(p,
+                   "  DP4 TEMP[0].x, IN[0], IMM[1]\n"
+                   "  DP4 TEMP[0].y, IN[0], IMM[2]\n"
+                   "  DP4 TEMP[0].z, IN[0], IMM[3]\n"
+                   "  DP4 TEMP[0].w, IN[0], IMM[4]\n"
+                   "  MOV OUT[0], TEMP[0]\n"
+                   "  MOV TEMP[1], IN[1]\n");
+      for (i = 0; i < 32; i++)
+         p += sprintf(p, "  MAD TEMP[1], TEMP[1], IMM[0].wzyx, IN[0]\n");
+      p += sprintf(p, "  FRC OUT[1], TEMP[1]\n");
+      break;
+   }
+
+   sprintf(p, "  END\n");
+
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof(state));
+   state.tokens = tokens;
+   state.stream_output.num_outputs = 1;
+   state.stream_output.stride[0] = 4;
+   state.stream_output.output[0].register_index = 0;
+   state.stream_output.output[0].num_components = 4;
+
+   return ctx->create_vs_state(ctx, &state);
+}
+
+
+static void
+finish(struct pipe_context *ctx)
+{
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_fence_handle *fence = NULL;
+
+   ctx->flush(ctx, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+}
+
+
+/**
+ * An indexed grid of grid x grid quads covering the viewport, with the
+ * triangles going down the columns.
+ */
+static void
+create_mesh(unsigned grid, float **verts, unsigned **indices)
+{
+   const unsigned row = grid + 1;
+   float *v = MALLOC(row * row * 8 * sizeof(float));
+   unsigned *ib = MALLOC(grid * grid * 6 * sizeof(unsigned));
+   unsigned x, y, i;
+
+   *verts = v;
+   *indices = ib;
+   if (!v || !ib)
+      return;
+
+   for (y = 0; y < row; y++) {
+      for (x = 0; x < row; x++) {
+         *v++ = x * 2.0f / grid - 1.0f;
+         *v++ = y * 2.0f / grid - 1.0f;
+         *v++ = 0.5f;
+         *v++ = 1.0f;
+         *v++ = (float) x / grid;
+         *v++ = (float) y / grid;
+         *v++ = 0.0f;
+         *v++ = 1.0f;
+      }
+   }
+
+   for (x = 0, i = 0; x < grid; x++) {
+      for (y = 0; y < grid; y++) {
+         const unsigned a = y * row + x;
+
+         ib[i++] = a;
+         ib[i++] = a + 1;
+         ib[i++] = a + row;
+         ib[i++] = a + 1;
+         ib[i++] = a + row + 1;
+         ib[i++] = a + row;
+      }
+   }
+}
+
+
+static void
+draw_mesh(struct pipe_context *ctx, unsigned grid, const unsigned *indices)
+{
+   struct pipe_draw_info info;
+
+   memset(&info, 0, sizeof(info));
+   info.mode = PIPE_PRIM_TRIANGLES;
+   info.index_size = 4;
+   info.has_user_indices = true;
+   info.index.user = indices;
+   info.count = grid * grid * 6;
+   info.instance_count = 1;
+   info.min_index = 0;
+   info.max_index = (grid + 1) * (grid + 1) - 1;
+   ctx->draw_vbo(ctx, &info);
+}
+
+
+/**
+ * Draw the mesh with each shader on a context with the given number of
+ * vertex shading threads.  The triangle rates go to rates[], and the
+ * streamed out positions of a first draw to results[], which the caller
+ * frees.
+ */
+static boolean
+run_draw(unsigned threads, unsigned grid,
+         const float *verts, const unsigned *indices,
+         double rates[ARRAY_SIZE(shader_names)],
+         float *results[ARRAY_SIZE(shader_names)])
+{
+   const unsigned num_tris = grid * grid * 2;
+   const unsigned so_size = num_tris * 3 * 4 * sizeof(float);
+   const unsigned reps = MAX2(4 * 1024 * 1024 / num_tris, 4);
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *ctx;
+   struct pipe_resource *so_buf = NULL;
+   struct pipe_stream_output_target *so_target = NULL;
+   struct pipe_framebuffer_state fb;
+   struct pipe_blend_state blend;
+   struct pipe_rasterizer_state rast;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_vertex_element velems[2];
+   struct pipe_vertex_buffer vb;
+   struct pipe_viewport_state vp;
+   void *blend_cso = NULL, *rast_cso = NULL, *dsa_cso = NULL;
+   void *velems_cso = NULL, *fs = NULL;
+   char threads_str[16];
+   boolean success = TRUE;
+   unsigned s, r;
+
+   /* picked up when the context creates its draw module */
+   snprintf(threads_str, sizeof(threads_str), "%u", threads);
+   setenv("DRAW_THREADS", threads_str, 1);
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+
+   ctx = screen->context_create(screen, NULL, 0);
+   unsetenv("DRAW_THREADS");
+   if (!ctx) {
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   so_buf = pipe_buffer_create(screen, PIPE_BIND_STREAM_OUTPUT,
+                               PIPE_USAGE_STAGING, so_size);
+   if (so_buf)
+      so_target = ctx->create_stream_output_target(ctx, so_buf, 0, so_size);
+   if (!so_target) {
+      success = FALSE;
+      goto out;
+   }
+
+   memset(&fb, 0, sizeof(fb));
+   fb.width = 1024;
+   fb.height = 1024;
+   ctx->set_framebuffer_state(ctx, &fb);
+
+   memset(&blend, 0, sizeof(blend));
+   blend_cso = ctx->create_blend_state(ctx, &blend);
+   ctx->bind_blend_state(ctx, blend_cso);
+
+   memset(&rast, 0, sizeof(rast));
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast.rasterizer_discard = 1;
+   rast_cso = ctx->create_rasterizer_state(ctx, &rast);
+   ctx->bind_rasterizer_state(ctx, rast_cso);
+
+   memset(&dsa, 0, sizeof(dsa));
+   dsa_cso = ctx->create_depth_stencil_alpha_state(ctx, &dsa);
+   ctx->bind_depth_stencil_alpha_state(ctx, dsa_cso);
+
+   fs = util_make_empty_fragment_shader(ctx);
+   ctx->bind_fs_state(ctx, fs);
+
+   memset(velems, 0, sizeof(velems));
+   for (s = 0; s < ARRAY_SIZE(velems); s++) {
+      velems[s].src_offset = s * 4 * sizeof(float);
+      velems[s].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   }
+   velems_cso = ctx->create_vertex_elements_state(ctx, ARRAY_SIZE(velems),
+                                                  velems);
+   ctx->bind_vertex_elements_state(ctx, velems_cso);
+
+   memset(&vb, 0, sizeof(vb));
+   vb.stride = 8 * sizeof(float);
+   vb.is_user_buffer = true;
+   vb.buffer.user = verts;
+   ctx->set_vertex_buffers(ctx, 0, 1, &vb);
+
+   memset(&vp, 0, sizeof(vp));
+   vp.scale[0] = vp.translate[0] = fb.width / 2.0f;
+   vp.scale[1] = vp.translate[1] = fb.height / 2.0f;
+   vp.scale[2] = vp.translate[2] = 0.5f;
+   ctx->set_viewport_states(ctx, 0, 1, &vp);
+
+   for (s = 0; s < ARRAY_SIZE(shader_names); s++) {
+      struct pipe_transfer *transfer;
+      const unsigned offset = 0;
+      const float *map;
+      int64_t start, end;
+      void *vs;
+
+      rates[s] = -1.0;
+
+      vs = create_vs(ctx, s);
+      if (!vs) {
+         success = FALSE;
+         continue;
+      }
+      ctx->bind_vs_state(ctx, vs);
+
+      /* compile, and stream out the positions to compare */
+      ctx->set_stream_output_targets(ctx, 1, &so_target, &offset);
+      draw_mesh(ctx, grid, indices);
+      ctx->set_stream_output_targets(ctx, 0, NULL, NULL);
+      finish(ctx);
+
+      results[s] = MALLOC(so_size);
+      map = pipe_buffer_map(ctx, so_buf, PIPE_TRANSFER_READ, &transfer);
+      if (results[s] && map)
+         memcpy(results[s], map, so_size);
+      else
+         success = FALSE;
+      if (map)
+         pipe_buffer_unmap(ctx, transfer);
+
+      start = os_time_get_nano();
+      for (r = 0; r < reps; r++)
+         draw_mesh(ctx, grid, indices);
+      finish(ctx);
+      end = os_time_get_nano();
+
+      rates[s] = (double) num_tris * reps / MAX2(end - start, 1) * 1e9;
+
+      ctx->bind_vs_state(ctx, NULL);
+      ctx->delete_vs_state(ctx, vs);
+   }
+
+out:
+   ctx->bind_fs_state(ctx, NULL);
+   if (fs)
+      ctx->delete_fs_state(ctx, fs);
+   if (velems_cso)
+      ctx->delete_vertex_elements_state(ctx, velems_cso);
+   if (dsa_cso)
+      ctx->delete_depth_stencil_alpha_state(ctx, dsa_cso);
+   if (rast_cso)
+      ctx->delete_rasterizer_state(ctx, rast_cso);
+   if (blend_cso)
+      ctx->delete_blend_state(ctx, blend_cso);
+   if (so_target)
+      ctx->stream_output_target_destroy(ctx, so_target);
+   pipe_resource_reference(&so_buf, NULL);
+   ctx->destroy(ctx);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+static boolean
+test_draw(unsigned verbose, FILE *fp,
+          const unsigned *grids, unsigned num_grids)
+{
+   static const unsigned thread_counts[] = { 0, 1, 2, 3, 4, 6, 8, 12, 16 };
+   unsigned num_counts = 0;
+   boolean success = TRUE;
+   unsigned i, t, s;
+
+   /* up to one thread per core besides the calling thread, and at least
+    * one so the threaded path always runs */
+   while (num_counts < ARRAY_SIZE(thread_counts) &&
+          thread_counts[num_counts] <= MAX2(util_cpu_caps.nr_cpus - 1, 1))
+      num_counts++;
+
+   for (i = 0; i < num_grids; i++) {
+      const unsigned num_tris = grids[i] * grids[i] * 2;
+      double rates[ARRAY_SIZE(thread_counts)][ARRAY_SIZE(shader_names)];
+      float *results[ARRAY_SIZE(thread_counts)][ARRAY_SIZE(shader_names)];
+      float *verts;
+      unsigned *indices;
+
+      memset(results, 0, sizeof(results));
+
+      create_mesh(grids[i], &verts, &indices);
+      if (!verts || !indices) {
+         FREE(verts);
+         FREE(indices);
+         return FALSE;
+      }
+
+      for (t = 0; t < num_counts; t++) {
+         if (!run_draw(thread_counts[t], grids[i], verts, indices,
+                       rates[t], results[t]))
+            success = FALSE;
+      }
+
+      for (s = 0; s < ARRAY_SIZE(shader_names); s++) {
+         for (t = 0; t < num_counts; t++) {
+            const boolean match = rates[t][s] >= 0.0 &&
+               results[0][s] && results[t][s] &&
+               memcmp(results[0][s], results[t][s],
+                      num_tris * 3 * 4 * sizeof(float)) == 0;
+
+            if (verbose) {
+               printf("%s, %u triangles, %u threads: %.0f triangles/s "
+                      "(x%.2f)%s\n",
+                      shader_names[s], num_tris, thread_counts[t],
+                      rates[t][s],
+                      rates[0][s] > 0.0 ? rates[t][s] / rates[0][s] : 0.0,
+                      match ? "" : ", results differ");
+            }
+
+            if (fp) {
+               fprintf(fp, "%s\t%s\t%u\t%u\t%.0f\n",
+                       match ? "pass" : "fail", shader_names[s], num_tris,
+                       thread_counts[t], rates[t][s]);
+               fflush(fp);
+            }
+
+            if (!match)
+               success = FALSE;
+         }
+
+         for (t = 0; t < num_counts; t++)
+            FREE(results[t][s]);
+      }
+
+      FREE(verts);
+      FREE(indices);
+   }
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   static const unsigned grids[] = { 16, 64, 256 };
+
+   return test_draw(verbose, fp, grids, ARRAY_SIZE(grids));
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   unsigned grid = util_next_power_of_two(CLAMP(n / 8, 8, 512));
+
+   return test_draw(verbose, fp, &grid, 1);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   static const unsigned grid = 64;
+
+   return test_draw(verbose, fp, &grid, 1);
+}
@@ -0,0 +1,547 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Measure the single threaded fill rate, in pixels per second, of fragment
+ * shaders of increasing complexity with each fragment shader vector width
+ * the host supports, and check that all widths render the same image.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_sampler.h"
+#include "util/u_simple_shaders.h"
+#include "util/os_time.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_screen.h"
+#include "lp_test.h"
+
+
+#define TEX_SIZE 256
+
+
+enum shader_kind {
+   SHADER_CONSTANT,
+   SHADER_COLOR,
+   SHADER_ALU,
+   SHADER_TEXTURE,
+};
+
+
+static const char *shader_names[] = {
+   "constant",
+   "color",
+   "alu",
+   "texture",
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "shader\t"
+           "size\t"
+           "vector_width\t"
+           "pixels_per_sec\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * All shaders take a color in GENERIC[0] and texture coordinates in
+ * GENERIC[1].  The ALU one runs a dependent chain of 16 MADs on them.
+ */
+static void *
+create_fs(struct pipe_context *ctx, enum shader_kind kind)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_shader_state state;
+   char text[2048];
+   char *p = text;
+   unsigned i;
+
+   p += sprintf(p,
+                "FRAG\n"
+                "DCL IN[0], GENERIC[0], PERSPECTIVE\n"
+                "DCL IN[1], GENERIC[1], PERSPECTIVE\n"
+                "DCL OUT[0], COLOR\n"
+                "DCL SAMP[0]\n"
+                "DCL SVIEW[0], 2D, FLOAT\n"
+                "DCL TEMP[0..1]\n"
+                "IMM[0] FLT32 { 0.5, 0.25, 0.75, 1.0 }\n");
+
+   switch (kind) {
+   case SHADER_CONSTANT:
+      p += sprintf(p, "  MOV OUT[0], IMM[0]\n");
+      break;
+   case SHADER_COLOR:
+      p += sprintf(p, "  MOV OUT[0], IN[0]\n");
+      break;
+   case SHADER_ALU:
+      p += sprintf(p, "  MOV TEMP[0], IN[0]\n");
+      for (i = 0; i < 16; i++)
+         p += sprintf(p, "  MAD TEMP[0], TEMP[0], IMM[0].wzyx, IN[1]\n");
+      p += sprintf(p, "  FRC OUT[0], TEMP[0]\n");
+      break;
+   case SHADER_TEXTURE:
+      p += sprintf(p,
+                   "  TEX TEMP[1], IN[1], SAMP[0], 2D\n"
+                   "  MUL OUT[0], TEMP[1], IN[0]\n");
+      break;
+   }
+
+   sprintf(p, "  END\n");
+
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof(state));
+   state.tokens = tokens;
+
+   return ctx->create_fs_state(ctx, &state);
+}
+
+
+static void
+finish(struct pipe_context *ctx)
+{
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_fence_handle *fence = NULL;
+
+   ctx->flush(ctx, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+}
+
+
+static struct pipe_resource *
+create_texture(struct pipe_screen *screen, unsigned size, unsigned bind)
+{
+   struct pipe_resource templ;
+
+   memset(&templ, 0, sizeof(templ));
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+   templ.width0 = size;
+   templ.height0 = size;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = bind;
+   templ.usage = PIPE_USAGE_DEFAULT;
+
+   return screen->resource_create(screen, &templ);
+}
+
+
+static void
+fill_texture(struct pipe_context *ctx, struct pipe_resource *tex)
+{
+   uint32_t *data = MALLOC(TEX_SIZE * TEX_SIZE * 4);
+   struct pipe_box box;
+   unsigned i;
+
+   if (!data)
+      return;
+
+   for (i = 0; i < TEX_SIZE * TEX_SIZE; i++)
+      data[i] = i * 2654435761u;
+
+   u_box_2d(0, 0, TEX_SIZE, TEX_SIZE, &box);
+   ctx->texture_subdata(ctx, tex, 0, PIPE_TRANSFER_WRITE, &box,
+                        data, TEX_SIZE * 4, 0);
+   FREE(data);
+}
+
+
+/**
+ * Draw a screen covering quad, with the colors and texture coordinates
+ * varying across it.
+ */
+static void
+draw_quad(struct pipe_context *ctx)
+{
+   static const float verts[4][3][4] = {
+      { { -1, -1, 0, 1 }, { 1, 0, 0, 1 }, { 0, 0, 0, 1 } },
+      { {  1, -1, 0, 1 }, { 0, 1, 0, 1 }, { 3, 0, 0, 1 } },
+      { { -1,  1, 0, 1 }, { 0, 0, 1, 1 }, { 0, 3, 0, 1 } },
+      { {  1,  1, 0, 1 }, { 1, 1, 1, 1 }, { 3, 3, 0, 1 } },
+   };
+   struct pipe_vertex_buffer vb;
+   struct pipe_draw_info info;
+
+   memset(&vb, 0, sizeof(vb));
+   vb.stride = sizeof(verts[0]);
+   vb.is_user_buffer = true;
+   vb.buffer.user = verts;
+   ctx->set_vertex_buffers(ctx, 0, 1, &vb);
+
+   memset(&info, 0, sizeof(info));
+   info.mode = PIPE_PRIM_TRIANGLE_STRIP;
+   info.count = 4;
+   info.instance_count = 1;
+   info.max_index = ~0;
+   ctx->draw_vbo(ctx, &info);
+}
+
+
+/**
+ * Render size x size pixels with every shader on a single threaded
+ * screen with the given fragment shader vector width.  The fill rates go
+ * to rates[] and the images to images[], which the caller frees.
+ */
+static boolean
+run_fill(unsigned vector_width, unsigned size,
+         double rates[ARRAY_SIZE(shader_names)],
+         uint32_t *images[ARRAY_SIZE(shader_names)])
+{
+   const unsigned reps = MAX2(4096 * 4096 / (size * size), 4);
+   static const enum tgsi_semantic vs_names[] = {
+      TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_GENERIC, TGSI_SEMANTIC_GENERIC
+   };
+   static const uint vs_indices[] = { 0, 0, 1 };
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *ctx;
+   struct pipe_resource *rt = NULL, *tex = NULL;
+   struct pipe_surface surf_templ, *surf = NULL;
+   struct pipe_sampler_view view_templ, *view = NULL;
+   struct pipe_framebuffer_state fb;
+   struct pipe_blend_state blend;
+   struct pipe_rasterizer_state rast;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_sampler_state sampler;
+   struct pipe_vertex_element velems[3];
+   struct pipe_viewport_state vp;
+   void *blend_cso = NULL, *rast_cso = NULL, *dsa_cso = NULL;
+   void *sampler_cso = NULL, *velems_cso = NULL, *vs = NULL;
+   void *sampler_null = NULL;
+   struct pipe_sampler_view *view_null = NULL;
+   char width_str[16];
+   boolean success = TRUE;
+   unsigned s, r;
+
+   /* both are picked when the screen is created */
+   snprintf(width_str, sizeof(width_str), "%u", vector_width);
+   setenv("LP_FS_VECTOR_WIDTH", width_str, 1);
+   setenv("LP_NUM_THREADS", "0", 1);
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+
+   ctx = screen->context_create(screen, NULL, 0);
+   if (!ctx) {
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   rt = create_texture(screen, size, PIPE_BIND_RENDER_TARGET);
+   tex = create_texture(screen, TEX_SIZE, PIPE_BIND_SAMPLER_VIEW);
+   if (!rt || !tex) {
+      success = FALSE;
+      goto out;
+   }
+
+   memset(&surf_templ, 0, sizeof(surf_templ));
+   surf_templ.format = rt->format;
+   surf = ctx->create_surface(ctx, rt, &surf_templ);
+
+   fill_texture(ctx, tex);
+   u_sampler_view_default_template(&view_templ, tex, tex->format);
+   view = ctx->create_sampler_view(ctx, tex, &view_templ);
+   if (!surf || !view) {
+      success = FALSE;
+      goto out;
+   }
+
+   memset(&fb, 0, sizeof(fb));
+   fb.width = size;
+   fb.height = size;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = surf;
+   ctx->set_framebuffer_state(ctx, &fb);
+
+   memset(&blend, 0, sizeof(blend));
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_cso = ctx->create_blend_state(ctx, &blend);
+   ctx->bind_blend_state(ctx, blend_cso);
+
+   memset(&rast, 0, sizeof(rast));
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast_cso = ctx->create_rasterizer_state(ctx, &rast);
+   ctx->bind_rasterizer_state(ctx, rast_cso);
+
+   memset(&dsa, 0, sizeof(dsa));
+   dsa_cso = ctx->create_depth_stencil_alpha_state(ctx, &dsa);
+   ctx->bind_depth_stencil_alpha_state(ctx, dsa_cso);
+
+   memset(&sampler, 0, sizeof(sampler));
+   sampler.wrap_s = PIPE_TEX_WRAP_REPEAT;
+   sampler.wrap_t = PIPE_TEX_WRAP_REPEAT;
+   sampler.wrap_r = PIPE_TEX_WRAP_REPEAT;
+   sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+   sampler.normalized_coords = 1;
+   sampler_cso = ctx->create_sampler_state(ctx, &sampler);
+   ctx->bind_sampler_states(ctx, PIPE_SHADER_FRAGMENT, 0, 1, &sampler_cso);
+   ctx->set_sampler_views(ctx, PIPE_SHADER_FRAGMENT, 0, 1, &view);
+
+   memset(velems, 0, sizeof(velems));
+   for (s = 0; s < ARRAY_SIZE(velems); s++) {
+      velems[s].src_offset = s * 4 * sizeof(float);
+      velems[s].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   }
+   velems_cso = ctx->create_vertex_elements_state(ctx, ARRAY_SIZE(velems),
+                                                  velems);
+   ctx->bind_vertex_elements_state(ctx, velems_cso);
+
+   memset(&vp, 0, sizeof(vp));
+   vp.scale[0] = vp.translate[0] = size / 2.0f;
+   vp.scale[1] = vp.translate[1] = size / 2.0f;
+   vp.scale[2] = vp.translate[2] = 0.5f;
+   ctx->set_viewport_states(ctx, 0, 1, &vp);
+
+   vs = util_make_vertex_passthrough_shader(ctx, ARRAY_SIZE(vs_names),
+                                            vs_names, vs_indices, false);
+   ctx->bind_vs_state(ctx, vs);
+
+   for (s = 0; s < ARRAY_SIZE(shader_names); s++) {
+      struct pipe_transfer *transfer;
+      const uint8_t *map;
+      int64_t start, end;
+      unsigned y;
+      void *fs;
+
+      rates[s] = -1.0;
+
+      fs = create_fs(ctx, s);
+      if (!fs) {
+         success = FALSE;
+         continue;
+      }
+      ctx->bind_fs_state(ctx, fs);
+
+      /* compile */
+      draw_quad(ctx);
+      finish(ctx);
+
+      start = os_time_get_nano();
+      for (r = 0; r < reps; r++) {
+         draw_quad(ctx);
+         ctx->flush(ctx, NULL, 0);
+      }
+      finish(ctx);
+      end = os_time_get_nano();
+
+      rates[s] = (double) size * size * reps / MAX2(end - start, 1) * 1e9;
+
+      images[s] = MALLOC(size * size * 4);
+      map = pipe_transfer_map(ctx, rt, 0, 0, PIPE_TRANSFER_READ,
+                              0, 0, size, size, &transfer);
+      if (images[s] && map) {
+         for (y = 0; y < size; y++)
+            memcpy(images[s] + y * size, map + y * transfer->stride, size * 4);
+      }
+      else {
+         success = FALSE;
+      }
+      if (map)
+         pipe_transfer_unmap(ctx, transfer);
+
+      ctx->bind_fs_state(ctx, NULL);
+      ctx->delete_fs_state(ctx, fs);
+   }
+
+out:
+   ctx->bind_sampler_states(ctx, PIPE_SHADER_FRAGMENT, 0, 1, &sampler_null);
+   ctx->set_sampler_views(ctx, PIPE_SHADER_FRAGMENT, 0, 1, &view_null);
+   ctx->bind_vs_state(ctx, NULL);
+   if (vs)
+      ctx->delete_vs_state(ctx, vs);
+   if (velems_cso)
+      ctx->delete_vertex_elements_state(ctx, velems_cso);
+   if (sampler_cso)
+      ctx->delete_sampler_state(ctx, sampler_cso);
+   if (dsa_cso)
+      ctx->delete_depth_stencil_alpha_state(ctx, dsa_cso);
+   if (rast_cso)
+      ctx->delete_rasterizer_state(ctx, rast_cso);
+   if (blend_cso)
+      ctx->delete_blend_state(ctx, blend_cso);
+   pipe_sampler_view_reference(&view, NULL);
+   pipe_surface_reference(&surf, NULL);
+   pipe_resource_reference(&tex, NULL);
+   pipe_resource_reference(&rt, NULL);
+   ctx->destroy(ctx);
+   screen->destroy(screen);
+
+   unsetenv("LP_FS_VECTOR_WIDTH");
+   unsetenv("LP_NUM_THREADS");
+
+   return success;
+}
+
+
+/**
+ * Compare the images of two widths, allowing for one unit of rounding
+ * difference per channel.
+ */
+static boolean
+compare_images(const uint32_t *a, const uint32_t *b, unsigned size)
+{
+   const uint8_t *pa = (const uint8_t *) a;
+   const uint8_t *pb = (const uint8_t *) b;
+   unsigned i;
+
+   for (i = 0; i < size * size * 4; i++) {
+      if (abs((int) pa[i] - (int) pb[i]) > 1)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static boolean
+test_fill(unsigned verbose, FILE *fp,
+          const unsigned *sizes, unsigned num_sizes)
+{
+   unsigned widths[2];
+   unsigned num_widths = 0;
+   boolean success = TRUE;
+   unsigned i, w, s;
+
+   /* 128 bits, and the native width when that is wider */
+   widths[num_widths++] = 128;
+   if (lp_native_vector_width > 128)
+      widths[num_widths++] = lp_native_vector_width;
+
+   for (i = 0; i < num_sizes; i++) {
+      double rates[ARRAY_SIZE(widths)][ARRAY_SIZE(shader_names)];
+      uint32_t *images[ARRAY_SIZE(widths)][ARRAY_SIZE(shader_names)];
+
+      memset(images, 0, sizeof(images));
+
+      for (w = 0; w < num_widths; w++) {
+         if (!run_fill(widths[w], sizes[i], rates[w], images[w]))
+            success = FALSE;
+      }
+
+      for (s = 0; s < ARRAY_SIZE(shader_names); s++) {
+         boolean match = TRUE;
+
+         for (w = 0; w < num_widths; w++) {
+            match = match && rates[w][s] >= 0.0 && images[w][s] &&
+                    compare_images(images[0][s], images[w][s], sizes[i]);
+         }
+
+         if (verbose) {
+            printf("%s, %ux%u:", shader_names[s], sizes[i], sizes[i]);
+            for (w = 0; w < num_widths; w++) {
+               printf(" %.0f pixels/s at %u bits%s", rates[w][s], widths[w],
+                      w + 1 < num_widths ? "," : "");
+            }
+            if (num_widths > 1 && rates[0][s] > 0.0)
+               printf(" (x%.2f)", rates[num_widths - 1][s] / rates[0][s]);
+            printf("%s\n", match ? "" : ", images differ");
+         }
+
+         if (fp) {
+            for (w = 0; w < num_widths; w++) {
+               fprintf(fp, "%s\t%s\t%u\t%u\t%.0f\n",
+                       match ? "pass" : "fail", shader_names[s], sizes[i],
+                       widths[w], rates[w][s]);
+            }
+            fflush(fp);
+         }
+
+         if (!match)
+            success = FALSE;
+
+         for (w = 0; w < num_widths; w++)
+            FREE(images[w][s]);
+      }
+   }
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   static const unsigned sizes[] = { 64, 256, 1024 };
+
+   return test_fill(verbose, fp, sizes, ARRAY_SIZE(sizes));
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   unsigned size = util_next_power_of_two(CLAMP(n / 4, 16, 2048));
+
+   return test_fill(verbose, fp, &size, 1);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   static const unsigned size = 256;
+
+   return test_fill(verbose, fp, &size, 1);
+}
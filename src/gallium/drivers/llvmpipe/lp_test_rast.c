@@ -0,0 +1,578 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Check the triangle edge mask kernels against each other and measure
+ * their throughput, then measure how rasterization scales with the
+ * number of rasterizer threads.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "util/os_time.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_rast_priv.h"
+#include "lp_test.h"
+
+
+struct masks_kernel {
+   const char *name;
+   lp_rast_tri_32_3_masks_func func;
+   boolean supported;
+};
+
+
+/** A 16x16 block position and the planes of one triangle */
+struct tri_case {
+   PIPE_ALIGN_VAR(16) struct lp_rast_plane plane[3];
+   int x, y;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "kernel\t"
+           "mtris_per_sec\n");
+
+   fflush(fp);
+}
+
+
+#if defined(PIPE_ARCH_SSE)
+
+static unsigned
+get_kernels(struct masks_kernel *kernels)
+{
+   unsigned n = 0;
+
+   kernels[n].name = "sse";
+   kernels[n].func = lp_rast_tri_32_3_masks_sse;
+   kernels[n].supported = TRUE;
+   n++;
+#if defined(HAVE_LP_RAST_AVX2)
+   kernels[n].name = "avx2";
+   kernels[n].func = lp_rast_tri_32_3_masks_avx2;
+   kernels[n].supported = util_cpu_caps.has_avx2;
+   n++;
+#endif
+#if defined(HAVE_LP_RAST_AVX512)
+   kernels[n].name = "avx512";
+   kernels[n].func = lp_rast_tri_32_3_masks_avx512;
+   kernels[n].supported = util_cpu_caps.has_avx2 && util_cpu_caps.has_avx512f;
+   n++;
+#endif
+   return n;
+}
+
+
+/**
+ * Make up a triangle touching the 16x16 block, with edge functions in
+ * 8-bit subpixel precision like setup produces.
+ */
+static void
+random_tri(struct tri_case *tri)
+{
+   int vx[3], vy[3];
+   unsigned i;
+
+   tri->x = 16 * (rand() % 4);
+   tri->y = 16 * (rand() % 4);
+
+   for (i = 0; i < 3; i++) {
+      vx[i] = tri->x * 256 + rand() % (48 * 256) - 16 * 256;
+      vy[i] = tri->y * 256 + rand() % (48 * 256) - 16 * 256;
+   }
+
+   for (i = 0; i < 3; i++) {
+      unsigned j = (i + 1) % 3;
+      struct lp_rast_plane *plane = &tri->plane[i];
+
+      plane->dcdx = vy[i] - vy[j];
+      plane->dcdy = vx[j] - vx[i];
+      /* edge value at pixel (0, 0), scaled back to whole pixels */
+      plane->c = ((int64_t) plane->dcdx * vx[i] +
+                  (int64_t) plane->dcdy * vy[i]) >> 8;
+      plane->eo = 0;
+   }
+}
+
+
+static boolean
+compare_masks(unsigned verbose, const char *name,
+              const struct lp_rast_block_mask *ref, unsigned ref_nr,
+              const struct lp_rast_block_mask *out, unsigned nr)
+{
+   unsigned i;
+
+   if (nr != ref_nr) {
+      if (verbose)
+         printf("%s: %u blocks, expected %u\n", name, nr, ref_nr);
+      return FALSE;
+   }
+
+   for (i = 0; i < nr; i++) {
+      if (out[i].i != ref[i].i || out[i].j != ref[i].j ||
+          out[i].mask != ref[i].mask) {
+         if (verbose)
+            printf("%s: block %u,%u mask 0x%04x, expected %u,%u 0x%04x\n",
+                   name, out[i].i, out[i].j, out[i].mask,
+                   ref[i].i, ref[i].j, ref[i].mask);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+static boolean
+test_kernels(unsigned verbose, FILE *fp, unsigned long n)
+{
+   struct masks_kernel kernels[3];
+   unsigned num_kernels = get_kernels(kernels);
+   struct tri_case *tris;
+   struct lp_rast_block_mask ref[16], out[16];
+   boolean success = TRUE;
+   unsigned long t;
+   unsigned k;
+
+   tris = align_malloc(n * sizeof *tris, 16);
+   if (!tris)
+      return FALSE;
+
+   for (t = 0; t < n; t++)
+      random_tri(&tris[t]);
+
+   /* correctness: every kernel must agree with the SSE one */
+   for (t = 0; t < n; t++) {
+      const struct tri_case *tri = &tris[t];
+      unsigned ref_nr = kernels[0].func(tri->plane, tri->x, tri->y, ref);
+
+      for (k = 1; k < num_kernels; k++) {
+         unsigned nr;
+
+         if (!kernels[k].supported)
+            continue;
+
+         nr = kernels[k].func(tri->plane, tri->x, tri->y, out);
+         if (!compare_masks(verbose, kernels[k].name, ref, ref_nr, out, nr))
+            success = FALSE;
+      }
+   }
+
+   /* throughput */
+   for (k = 0; k < num_kernels; k++) {
+      const unsigned reps = 64;
+      unsigned r, sum = 0;
+      int64_t start, end;
+      double mtris;
+
+      if (!kernels[k].supported) {
+         if (verbose)
+            printf("%s: not supported by this CPU\n", kernels[k].name);
+         continue;
+      }
+
+      start = os_time_get_nano();
+      for (r = 0; r < reps; r++) {
+         for (t = 0; t < n; t++) {
+            const struct tri_case *tri = &tris[t];
+            sum += kernels[k].func(tri->plane, tri->x, tri->y, out);
+         }
+      }
+      end = os_time_get_nano();
+
+      mtris = (double) n * reps / MAX2(end - start, 1) * 1e3;
+
+      if (verbose)
+         printf("%s: %.2f Mtris/s (%u blocks)\n", kernels[k].name, mtris, sum);
+
+      if (fp) {
+         fprintf(fp, "%s\t%s\t%.2f\n",
+                 success ? "pass" : "fail", kernels[k].name, mtris);
+         fflush(fp);
+      }
+   }
+
+   align_free(tris);
+
+   return success;
+}
+
+#else
+
+static boolean
+test_kernels(unsigned verbose, FILE *fp, unsigned long n)
+{
+   if (verbose)
+      printf("no SIMD edge mask kernels on this architecture\n");
+   return TRUE;
+}
+
+#endif
+
+
+#define SCALING_SIZE 1024
+
+
+/**
+ * Random triangles of up to a quarter of the render target in size, with
+ * vertex colors.
+ */
+static float *
+create_scene(unsigned num_tris)
+{
+   float *verts = MALLOC(num_tris * 3 * 8 * sizeof(float));
+   float *v = verts;
+   unsigned t, i;
+
+   if (!verts)
+      return NULL;
+
+   srand(1);
+   for (t = 0; t < num_tris; t++) {
+      const float cx = (rand() % 2048) / 1024.0f - 1.0f;
+      const float cy = (rand() % 2048) / 1024.0f - 1.0f;
+
+      for (i = 0; i < 3; i++) {
+         *v++ = cx + (rand() % 1024) / 2048.0f - 0.25f;
+         *v++ = cy + (rand() % 1024) / 2048.0f - 0.25f;
+         *v++ = 0.5f;
+         *v++ = 1.0f;
+         *v++ = (rand() % 256) / 255.0f;
+         *v++ = (rand() % 256) / 255.0f;
+         *v++ = (rand() % 256) / 255.0f;
+         *v++ = 1.0f;
+      }
+   }
+
+   return verts;
+}
+
+
+static void
+finish(struct pipe_context *ctx)
+{
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_fence_handle *fence = NULL;
+
+   ctx->flush(ctx, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+}
+
+
+/**
+ * Render the scene a number of times on a screen with the given number
+ * of rasterizer threads.  Returns the frames per second, or a negative
+ * value on failure, and the last image in image.
+ */
+static double
+run_scene(unsigned threads, const float *verts, unsigned num_tris,
+          uint32_t *image)
+{
+   const unsigned reps = 8;
+   static const enum tgsi_semantic vs_names[] = {
+      TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR
+   };
+   static const uint vs_indices[] = { 0, 0 };
+   union pipe_color_union clear_color;
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *ctx;
+   struct pipe_resource templ, *rt = NULL;
+   struct pipe_surface surf_templ, *surf = NULL;
+   struct pipe_framebuffer_state fb;
+   struct pipe_blend_state blend;
+   struct pipe_rasterizer_state rast;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_vertex_element velems[2];
+   struct pipe_vertex_buffer vb;
+   struct pipe_viewport_state vp;
+   struct pipe_draw_info info;
+   struct pipe_transfer *transfer;
+   void *blend_cso, *rast_cso, *dsa_cso, *velems_cso, *vs, *fs;
+   const uint8_t *map;
+   char threads_str[16];
+   double fps = -1.0;
+   int64_t start, end;
+   unsigned r, y;
+
+   /* the rasterizer threads are created with the screen */
+   snprintf(threads_str, sizeof(threads_str), "%u", threads);
+   setenv("LP_NUM_THREADS", threads_str, 1);
+   winsys = null_sw_create();
+   screen = winsys ? llvmpipe_create_screen(winsys) : NULL;
+   unsetenv("LP_NUM_THREADS");
+   if (!screen) {
+      if (winsys)
+         winsys->destroy(winsys);
+      return -1.0;
+   }
+
+   ctx = screen->context_create(screen, NULL, 0);
+   if (!ctx) {
+      screen->destroy(screen);
+      return -1.0;
+   }
+
+   memset(&templ, 0, sizeof(templ));
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templ.width0 = SCALING_SIZE;
+   templ.height0 = SCALING_SIZE;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_RENDER_TARGET;
+   rt = screen->resource_create(screen, &templ);
+   if (rt) {
+      memset(&surf_templ, 0, sizeof(surf_templ));
+      surf_templ.format = templ.format;
+      surf = ctx->create_surface(ctx, rt, &surf_templ);
+   }
+   if (!surf) {
+      pipe_resource_reference(&rt, NULL);
+      ctx->destroy(ctx);
+      screen->destroy(screen);
+      return -1.0;
+   }
+
+   memset(&fb, 0, sizeof(fb));
+   fb.width = SCALING_SIZE;
+   fb.height = SCALING_SIZE;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = surf;
+   ctx->set_framebuffer_state(ctx, &fb);
+
+   /* blend so that every triangle touches every covered pixel */
+   memset(&blend, 0, sizeof(blend));
+   blend.rt[0].blend_enable = 1;
+   blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_ZERO;
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_cso = ctx->create_blend_state(ctx, &blend);
+   ctx->bind_blend_state(ctx, blend_cso);
+
+   memset(&rast, 0, sizeof(rast));
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast_cso = ctx->create_rasterizer_state(ctx, &rast);
+   ctx->bind_rasterizer_state(ctx, rast_cso);
+
+   memset(&dsa, 0, sizeof(dsa));
+   dsa_cso = ctx->create_depth_stencil_alpha_state(ctx, &dsa);
+   ctx->bind_depth_stencil_alpha_state(ctx, dsa_cso);
+
+   memset(velems, 0, sizeof(velems));
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = 4 * sizeof(float);
+   velems_cso = ctx->create_vertex_elements_state(ctx, 2, velems);
+   ctx->bind_vertex_elements_state(ctx, velems_cso);
+
+   memset(&vb, 0, sizeof(vb));
+   vb.stride = 8 * sizeof(float);
+   vb.is_user_buffer = true;
+   vb.buffer.user = verts;
+   ctx->set_vertex_buffers(ctx, 0, 1, &vb);
+
+   memset(&vp, 0, sizeof(vp));
+   vp.scale[0] = vp.translate[0] = SCALING_SIZE / 2.0f;
+   vp.scale[1] = vp.translate[1] = SCALING_SIZE / 2.0f;
+   vp.scale[2] = vp.translate[2] = 0.5f;
+   ctx->set_viewport_states(ctx, 0, 1, &vp);
+
+   vs = util_make_vertex_passthrough_shader(ctx, 2, vs_names, vs_indices,
+                                            false);
+   fs = util_make_fragment_passthrough_shader(ctx, TGSI_SEMANTIC_COLOR,
+                                              TGSI_INTERPOLATE_PERSPECTIVE,
+                                              false);
+   ctx->bind_vs_state(ctx, vs);
+   ctx->bind_fs_state(ctx, fs);
+
+   memset(&info, 0, sizeof(info));
+   info.mode = PIPE_PRIM_TRIANGLES;
+   info.count = num_tris * 3;
+   info.instance_count = 1;
+   info.max_index = ~0;
+
+   memset(&clear_color, 0, sizeof(clear_color));
+
+   /* compile */
+   ctx->clear(ctx, PIPE_CLEAR_COLOR, &clear_color, 0.0, 0);
+   ctx->draw_vbo(ctx, &info);
+   finish(ctx);
+
+   start = os_time_get_nano();
+   for (r = 0; r < reps; r++) {
+      ctx->clear(ctx, PIPE_CLEAR_COLOR, &clear_color, 0.0, 0);
+      ctx->draw_vbo(ctx, &info);
+      ctx->flush(ctx, NULL, 0);
+   }
+   finish(ctx);
+   end = os_time_get_nano();
+
+   map = pipe_transfer_map(ctx, rt, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, SCALING_SIZE, SCALING_SIZE, &transfer);
+   if (map) {
+      for (y = 0; y < SCALING_SIZE; y++)
+         memcpy(image + y * SCALING_SIZE, map + y * transfer->stride,
+                SCALING_SIZE * 4);
+      pipe_transfer_unmap(ctx, transfer);
+      fps = (double) reps / MAX2(end - start, 1) * 1e9;
+   }
+
+   ctx->bind_vs_state(ctx, NULL);
+   ctx->bind_fs_state(ctx, NULL);
+   ctx->delete_vs_state(ctx, vs);
+   ctx->delete_fs_state(ctx, fs);
+   ctx->delete_vertex_elements_state(ctx, velems_cso);
+   ctx->delete_depth_stencil_alpha_state(ctx, dsa_cso);
+   ctx->delete_rasterizer_state(ctx, rast_cso);
+   ctx->delete_blend_state(ctx, blend_cso);
+   pipe_surface_reference(&surf, NULL);
+   pipe_resource_reference(&rt, NULL);
+   ctx->destroy(ctx);
+   screen->destroy(screen);
+
+   return fps;
+}
+
+
+/**
+ * Render the same scene with 1, 2, 4, ... rasterizer threads, up to the
+ * CPU count, and check that all thread counts render the same image.
+ */
+static boolean
+test_scaling(unsigned verbose, FILE *fp, unsigned num_tris)
+{
+   const unsigned max_threads = MIN2(MAX2(util_cpu_caps.nr_cpus, 2),
+                                     LP_MAX_THREADS);
+   const unsigned image_size = SCALING_SIZE * SCALING_SIZE * 4;
+   uint32_t *ref = MALLOC(image_size);
+   uint32_t *image = MALLOC(image_size);
+   float *verts = create_scene(num_tris);
+   boolean success = TRUE;
+   double base_fps = 0.0;
+   unsigned threads;
+
+   if (!ref || !image || !verts) {
+      FREE(ref);
+      FREE(image);
+      FREE(verts);
+      return FALSE;
+   }
+
+   for (threads = 1; threads <= max_threads; threads *= 2) {
+      double fps = run_scene(threads, verts, num_tris,
+                             threads == 1 ? ref : image);
+      boolean match = fps >= 0.0 &&
+                      (threads == 1 || memcmp(ref, image, image_size) == 0);
+      char name[32];
+
+      if (threads == 1)
+         base_fps = fps;
+
+      if (verbose)
+         printf("%u threads: %.2f frames/s of %u triangles (x%.2f)%s\n",
+                threads, fps, num_tris,
+                base_fps > 0.0 ? fps / base_fps : 0.0,
+                match ? "" : ", images differ");
+
+      if (fp) {
+         snprintf(name, sizeof(name), "threads%u", threads);
+         fprintf(fp, "%s\t%s\t%.2f\n",
+                 match ? "pass" : "fail", name, fps * num_tris / 1e6);
+         fflush(fp);
+      }
+
+      if (!match)
+         success = FALSE;
+
+      /* also hit the CPU count itself when it isn't a power of two */
+      if (threads < max_threads && threads * 2 > max_threads)
+         threads = max_threads / 2;
+   }
+
+   FREE(ref);
+   FREE(image);
+   FREE(verts);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = test_kernels(verbose, fp, 100000);
+
+   return test_scaling(verbose, fp, 10000) && success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   boolean success = test_kernels(verbose, fp, n);
+
+   return test_scaling(verbose, fp, MAX2(n, 16)) && success;
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   boolean success = test_kernels(verbose, fp, 1);
+
+   return test_scaling(verbose, fp, 16) && success;
+}
@@ -0,0 +1,467 @@
+/**************************************************************************
+ *
+ * Copyright 2007-2009 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Measure bilinear texture sampling throughput for various texture sizes
+ * and access patterns, with linearly stored and with tiled textures, and
+ * check that both layouts sample the same values.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_sampler.h"
+#include "util/os_time.h"
+#include "state_tracker/sw_winsys.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_screen.h"
+#include "lp_test.h"
+
+
+#define NUM_SAMPLES (1 << 18)
+#define BLOCK_SIZE 64
+
+
+enum access_pattern {
+   PATTERN_ROWS,
+   PATTERN_COLUMNS,
+   PATTERN_RANDOM,
+};
+
+
+static const char *pattern_names[] = {
+   "rows",
+   "columns",
+   "random",
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "pattern\t"
+           "size\t"
+           "layout\t"
+           "samples_per_sec\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * Each invocation loads its normalized coordinates from BUFFER[1], takes
+ * a bilinear sample from level 0 and stores it to BUFFER[0].
+ */
+static void *
+create_shader(struct pipe_context *ctx)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_compute_state state;
+   char text[1024];
+
+   snprintf(text, sizeof(text),
+            "COMP\n"
+            "DCL SV[0], BLOCK_ID[0]\n"
+            "DCL SV[1], THREAD_ID[0]\n"
+            "DCL SAMP[0]\n"
+            "DCL SVIEW[0], 2D, FLOAT\n"
+            "DCL BUFFER[0]\n"
+            "DCL BUFFER[1]\n"
+            "DCL TEMP[0..2]\n"
+            "IMM[0] UINT32 { %u, 8, 16, 0 }\n"
+            "IMM[1] FLT32 { 0.0, 0.0, 0.0, 0.0 }\n"
+            "  UMAD TEMP[0].x, SV[0].xxxx, IMM[0].xxxx, SV[1].xxxx\n"
+            "  UMUL TEMP[1].x, TEMP[0].xxxx, IMM[0].yyyy\n"
+            "  LOAD TEMP[2].xy, BUFFER[1], TEMP[1].xxxx\n"
+            "  MOV TEMP[2].zw, IMM[1].xxxx\n"
+            "  TXL TEMP[2], TEMP[2], SAMP[0], 2D\n"
+            "  UMUL TEMP[1].x, TEMP[0].xxxx, IMM[0].zzzz\n"
+            "  STORE BUFFER[0].xyzw, TEMP[1].xxxx, TEMP[2]\n"
+            "  END\n",
+            BLOCK_SIZE);
+
+   if (!tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof(state));
+   state.ir_type = PIPE_SHADER_IR_TGSI;
+   state.prog = tokens;
+
+   return ctx->create_compute_state(ctx, &state);
+}
+
+
+static void
+finish(struct pipe_context *ctx)
+{
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_fence_handle *fence = NULL;
+
+   ctx->flush(ctx, &fence, 0);
+   screen->fence_finish(screen, NULL, fence, PIPE_TIMEOUT_INFINITE);
+   screen->fence_reference(screen, &fence, NULL);
+}
+
+
+/**
+ * Fill the coordinate buffer.  Coordinates sit a quarter texel off the
+ * texel centers so every sample blends four texels.
+ */
+static void
+fill_coords(struct pipe_context *ctx, struct pipe_resource *coords,
+            enum access_pattern pattern, unsigned size)
+{
+   struct pipe_transfer *transfer;
+   float *data;
+   unsigned i;
+
+   data = pipe_buffer_map(ctx, coords, PIPE_TRANSFER_WRITE |
+                          PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE, &transfer);
+
+   for (i = 0; i < NUM_SAMPLES; i++) {
+      unsigned x, y;
+
+      switch (pattern) {
+      case PATTERN_ROWS:
+         x = i % size;
+         y = (i / size) % size;
+         break;
+      case PATTERN_COLUMNS:
+         x = (i / size) % size;
+         y = i % size;
+         break;
+      case PATTERN_RANDOM:
+      default:
+         x = (i * 747796405u + 2891336453u) >> 8;
+         y = (x * 747796405u + 2891336453u) >> 8;
+         x %= size;
+         y %= size;
+         break;
+      }
+
+      data[i * 2 + 0] = (x + 0.25f) / size;
+      data[i * 2 + 1] = (y + 0.25f) / size;
+   }
+
+   pipe_buffer_unmap(ctx, transfer);
+}
+
+
+static struct pipe_resource *
+create_texture(struct pipe_screen *screen, unsigned size)
+{
+   struct pipe_resource templ;
+
+   memset(&templ, 0, sizeof(templ));
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+   templ.width0 = size;
+   templ.height0 = size;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_SAMPLER_VIEW;
+   templ.usage = PIPE_USAGE_DEFAULT;
+
+   return screen->resource_create(screen, &templ);
+}
+
+
+/**
+ * Upload the same pseudo random texels for either layout, one row at a
+ * time.
+ */
+static void
+fill_texture(struct pipe_context *ctx, struct pipe_resource *tex)
+{
+   unsigned size = tex->width0;
+   uint32_t *row = MALLOC(size * 4);
+   struct pipe_box box;
+   unsigned x, y;
+
+   if (!row)
+      return;
+
+   for (y = 0; y < size; y++) {
+      for (x = 0; x < size; x++)
+         row[x] = (x + y * size) * 2654435761u;
+
+      u_box_2d(0, y, size, 1, &box);
+      ctx->texture_subdata(ctx, tex, 0, PIPE_TRANSFER_WRITE, &box,
+                           row, size * 4, 0);
+   }
+
+   FREE(row);
+}
+
+
+/**
+ * Sample a size x size texture stored in the given layout, returning the
+ * samples per second or a negative value on failure.  The samples are
+ * copied to results.
+ */
+static double
+run_sample(struct pipe_context *ctx, void *cs,
+           struct pipe_resource *coords, struct pipe_resource *out,
+           unsigned size, boolean tiled, float *results)
+{
+   const unsigned reps = 8;
+   struct pipe_screen *screen = ctx->screen;
+   struct pipe_resource *tex;
+   struct pipe_sampler_view templ, *view;
+   struct pipe_shader_buffer sb[2];
+   struct pipe_grid_info info;
+   struct pipe_transfer *transfer;
+   const float *data;
+   int64_t start, end;
+   unsigned r;
+
+   llvmpipe_screen(screen)->tiled_textures = tiled;
+   tex = create_texture(screen, size);
+   llvmpipe_screen(screen)->tiled_textures = FALSE;
+   if (!tex)
+      return -1.0;
+
+   fill_texture(ctx, tex);
+
+   u_sampler_view_default_template(&templ, tex, tex->format);
+   view = ctx->create_sampler_view(ctx, tex, &templ);
+   if (!view) {
+      pipe_resource_reference(&tex, NULL);
+      return -1.0;
+   }
+   ctx->set_sampler_views(ctx, PIPE_SHADER_COMPUTE, 0, 1, &view);
+
+   memset(sb, 0, sizeof(sb));
+   sb[0].buffer = out;
+   sb[0].buffer_size = out->width0;
+   sb[1].buffer = coords;
+   sb[1].buffer_size = coords->width0;
+   ctx->set_shader_buffers(ctx, PIPE_SHADER_COMPUTE, 0, 2, sb, 1);
+   ctx->bind_compute_state(ctx, cs);
+
+   memset(&info, 0, sizeof(info));
+   info.work_dim = 1;
+   info.block[0] = BLOCK_SIZE;
+   info.block[1] = 1;
+   info.block[2] = 1;
+   info.grid[0] = NUM_SAMPLES / BLOCK_SIZE;
+   info.grid[1] = 1;
+   info.grid[2] = 1;
+
+   /* compile */
+   ctx->launch_grid(ctx, &info);
+   finish(ctx);
+
+   start = os_time_get_nano();
+   for (r = 0; r < reps; r++)
+      ctx->launch_grid(ctx, &info);
+   finish(ctx);
+   end = os_time_get_nano();
+
+   data = pipe_buffer_map(ctx, out, PIPE_TRANSFER_READ, &transfer);
+   memcpy(results, data, NUM_SAMPLES * 4 * sizeof(float));
+   pipe_buffer_unmap(ctx, transfer);
+
+   pipe_sampler_view_reference(&view, NULL);
+   ctx->set_sampler_views(ctx, PIPE_SHADER_COMPUTE, 0, 1, &view);
+   ctx->set_shader_buffers(ctx, PIPE_SHADER_COMPUTE, 0, 2, NULL, 0);
+   pipe_resource_reference(&tex, NULL);
+
+   return (double) NUM_SAMPLES * reps / MAX2(end - start, 1) * 1e9;
+}
+
+
+/**
+ * Compare the samples of both layouts.  Linear textures may be filtered
+ * by the 8 bit AoS path while tiled ones always use the SoA path, so
+ * allow for one unit of rounding difference.
+ */
+static boolean
+compare_results(const float *a, const float *b)
+{
+   unsigned i;
+
+   for (i = 0; i < NUM_SAMPLES * 4; i++) {
+      if (fabsf(a[i] - b[i]) > 1.5f / 255.0f)
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+static boolean
+test_sampling(unsigned verbose, FILE *fp,
+              const unsigned *sizes, unsigned num_sizes)
+{
+   struct sw_winsys *winsys;
+   struct pipe_screen *screen;
+   struct pipe_context *ctx;
+   struct pipe_resource *coords = NULL, *out = NULL;
+   struct pipe_sampler_state sampler;
+   float *linear_results = NULL, *tiled_results = NULL;
+   void *cs = NULL, *samp = NULL, *samp_null;
+   boolean success = TRUE;
+   unsigned s, p;
+
+   winsys = null_sw_create();
+   if (!winsys)
+      return FALSE;
+
+   screen = llvmpipe_create_screen(winsys);
+   if (!screen) {
+      winsys->destroy(winsys);
+      return FALSE;
+   }
+
+   ctx = screen->context_create(screen, NULL, 0);
+   if (!ctx) {
+      success = FALSE;
+      goto out;
+   }
+
+   coords = pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER,
+                               PIPE_USAGE_DEFAULT, NUM_SAMPLES * 8);
+   out = pipe_buffer_create(screen, PIPE_BIND_SHADER_BUFFER,
+                            PIPE_USAGE_DEFAULT, NUM_SAMPLES * 16);
+   linear_results = MALLOC(NUM_SAMPLES * 16);
+   tiled_results = MALLOC(NUM_SAMPLES * 16);
+   cs = create_shader(ctx);
+   if (!coords || !out || !linear_results || !tiled_results || !cs) {
+      success = FALSE;
+      goto out;
+   }
+
+   memset(&sampler, 0, sizeof(sampler));
+   sampler.wrap_s = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler.wrap_t = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler.wrap_r = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler.min_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler.mag_img_filter = PIPE_TEX_FILTER_LINEAR;
+   sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+   sampler.normalized_coords = 1;
+   samp = ctx->create_sampler_state(ctx, &sampler);
+   ctx->bind_sampler_states(ctx, PIPE_SHADER_COMPUTE, 0, 1, &samp);
+
+   for (s = 0; s < num_sizes; s++) {
+      for (p = 0; p < ARRAY_SIZE(pattern_names); p++) {
+         double linear, tiled;
+         boolean match;
+
+         fill_coords(ctx, coords, p, sizes[s]);
+
+         linear = run_sample(ctx, cs, coords, out, sizes[s], FALSE,
+                             linear_results);
+         tiled = run_sample(ctx, cs, coords, out, sizes[s], TRUE,
+                            tiled_results);
+         match = linear >= 0.0 && tiled >= 0.0 &&
+                 compare_results(linear_results, tiled_results);
+
+         if (verbose)
+            printf("%s, %ux%u: %.0f samples/s linear, %.0f tiled (x%.2f)%s\n",
+                   pattern_names[p], sizes[s], sizes[s], linear, tiled,
+                   linear > 0.0 ? tiled / linear : 0.0,
+                   match ? "" : ", results differ");
+
+         if (fp) {
+            fprintf(fp, "%s\t%s\t%u\tlinear\t%.0f\n",
+                    match ? "pass" : "fail", pattern_names[p], sizes[s],
+                    linear);
+            fprintf(fp, "%s\t%s\t%u\ttiled\t%.0f\n",
+                    match ? "pass" : "fail", pattern_names[p], sizes[s],
+                    tiled);
+            fflush(fp);
+         }
+
+         if (!match)
+            success = FALSE;
+      }
+   }
+
+out:
+   FREE(linear_results);
+   FREE(tiled_results);
+   pipe_resource_reference(&coords, NULL);
+   pipe_resource_reference(&out, NULL);
+   if (ctx) {
+      samp_null = NULL;
+      ctx->bind_sampler_states(ctx, PIPE_SHADER_COMPUTE, 0, 1, &samp_null);
+      ctx->bind_compute_state(ctx, NULL);
+      if (samp)
+         ctx->delete_sampler_state(ctx, samp);
+      if (cs)
+         ctx->delete_compute_state(ctx, cs);
+      ctx->destroy(ctx);
+   }
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   static const unsigned sizes[] = { 256, 1024, 4096 };
+
+   return test_sampling(verbose, fp, sizes, ARRAY_SIZE(sizes));
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   unsigned size = util_next_power_of_two(CLAMP(n, 4, 4096));
+
+   return test_sampling(verbose, fp, &size, 1);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   static const unsigned size = 256;
+
+   return test_sampling(verbose, fp, &size, 1);
+}
@@ -42,6 +42,7 @@
 
 #include "pipe/p_defines.h"
 #include "pipe/p_shader_tokens.h"
+#include "util/format/u_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_type.h"
@@ -312,19 +313,23 @@ LP_LLVM_IMAGE_MEMBER(base_ptr,   LP_JIT_IMAGE_BASE, TRUE)
 LP_LLVM_IMAGE_MEMBER(row_stride, LP_JIT_IMAGE_ROW_STRIDE, TRUE)
 LP_LLVM_IMAGE_MEMBER(img_stride, LP_JIT_IMAGE_IMG_STRIDE, TRUE)
 
-#if LP_USE_TEXTURE_CACHE
 static LLVMValueRef
 lp_llvm_texture_cache_ptr(const struct lp_sampler_dynamic_state *base,
                           struct gallivm_state *gallivm,
                           LLVMValueRef thread_data_ptr,
                           unsigned unit)
 {
-   /* We use the same cache for all units */
-   (void)unit;
+   const struct llvmpipe_sampler_dynamic_state *state =
+      (const struct llvmpipe_sampler_dynamic_state *)base;
+   enum pipe_format format = state->static_state[unit].texture_state.format;
+
+   if (!LP_USE_TEXTURE_CACHE &&
+       util_format_description(format)->layout == UTIL_FORMAT_LAYOUT_S3TC)
+      return NULL;
 
+   /* We use the same cache for all units */
    return lp_jit_thread_data_cache(gallivm, thread_data_ptr);
 }
-#endif
 
 
 static void
@@ -406,9 +411,7 @@ lp_llvm_sampler_soa_create(const struct lp_sampler_static_state *static_state)
    sampler->dynamic_state.base.lod_bias = lp_llvm_sampler_lod_bias;
    sampler->dynamic_state.base.border_color = lp_llvm_sampler_border_color;
 
-#if LP_USE_TEXTURE_CACHE
    sampler->dynamic_state.base.cache_ptr = lp_llvm_texture_cache_ptr;
-#endif
 
    sampler->dynamic_state.static_state = static_state;
 
@@ -36,7 +36,9 @@ struct lp_sampler_static_state;
 struct lp_image_static_state;
 
 /**
- * Whether texture cache is used for s3tc textures.
+ * Whether texture cache is used for s3tc textures.  The other block
+ * compressed formats always use it, but the s3tc block decoder is fast
+ * enough without.
  */
 #define LP_USE_TEXTURE_CACHE 0
 
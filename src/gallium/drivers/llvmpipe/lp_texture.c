@@ -42,6 +42,9 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_transfer.h"
+#include "util/u_box.h"
+
+#include "draw/draw_context.h"
 
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -146,6 +149,9 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       else
          num_slices = 1;
 
+      /* Every sample of a multisample resource gets a slice of its own */
+      num_slices *= llvmpipe_resource_samples(pt);
+
       /* if img_stride * num_slices_faces > LP_MAX_TEXTURE_SIZE */
       mipsize = (uint64_t)lpr->img_stride[level] * num_slices;
       if (mipsize > LP_MAX_TEXTURE_SIZE) {
@@ -236,6 +242,32 @@ llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
 }
 
 
+/**
+ * Whether a texture can use the LP_RESOURCE_FLAG_TILED layout.  Only
+ * textures that are never written by shaders or shared are eligible, since
+ * everything but the texture samplers and transfers assumes linear images.
+ * Render targets qualify too, they are detiled once a surface gets created
+ * for them (see llvmpipe_resource_detile()).
+ */
+static boolean
+llvmpipe_can_tile_texture(const struct llvmpipe_screen *screen,
+                          const struct pipe_resource *templat)
+{
+   const struct util_format_description *desc =
+      util_format_description(templat->format);
+
+   return screen->tiled_textures &&
+          (templat->bind & PIPE_BIND_SAMPLER_VIEW) &&
+          !(templat->bind & ~(PIPE_BIND_SAMPLER_VIEW |
+                              PIPE_BIND_RENDER_TARGET)) &&
+          templat->usage != PIPE_USAGE_STAGING &&
+          templat->nr_samples <= 1 &&
+          !llvmpipe_resource_is_1d(templat) &&
+          desc->layout == UTIL_FORMAT_LAYOUT_PLAIN &&
+          desc->block.width == 1 && desc->block.height == 1;
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_create_front(struct pipe_screen *_screen,
                                const struct pipe_resource *templat,
@@ -262,6 +294,8 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
       }
       else {
          /* texture map */
+         if (llvmpipe_can_tile_texture(screen, templat))
+            lpr->base.flags |= LP_RESOURCE_FLAG_TILED;
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
       }
@@ -391,6 +425,8 @@ llvmpipe_resource_map(struct pipe_resource *resource,
    }
    else if (llvmpipe_resource_is_texture(resource)) {
 
+      /* for multisample resources this is sample 0 of the layer */
+      layer *= llvmpipe_resource_samples(resource);
       map = llvmpipe_get_texture_image_address(lpr, layer, level);
       return map;
    }
@@ -504,6 +540,104 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Copy a box between an image of a LP_RESOURCE_FLAG_TILED texture and
+ * a linear buffer, in runs of at most one tile row.
+ */
+static void
+llvmpipe_copy_tiled_box(struct llvmpipe_resource *lpr,
+                        unsigned level,
+                        const struct pipe_box *box,
+                        ubyte *linear,
+                        unsigned stride,
+                        unsigned layer_stride,
+                        boolean to_tiled)
+{
+   const unsigned bpp = util_format_get_blocksize(lpr->base.format);
+   const unsigned row_stride = lpr->row_stride[level];
+   int x, y, z;
+
+   for (z = 0; z < box->depth; z++) {
+      ubyte *image = llvmpipe_get_texture_image_address(lpr, box->z + z,
+                                                        level);
+
+      for (y = 0; y < box->height; y++) {
+         ubyte *row = linear + z * layer_stride + y * stride;
+
+         for (x = 0; x < box->width; ) {
+            unsigned tx = box->x + x;
+            unsigned ty = box->y + y;
+            unsigned run = MIN2(LP_TEXTURE_TILE_SIZE -
+                                   (tx & (LP_TEXTURE_TILE_SIZE - 1)),
+                                box->width - x);
+            ubyte *tiled = image + llvmpipe_tiled_offset(tx, ty,
+                                                         row_stride, bpp);
+
+            if (to_tiled)
+               memcpy(tiled, row + x * bpp, run * bpp);
+            else
+               memcpy(row + x * bpp, tiled, run * bpp);
+
+            x += run;
+         }
+      }
+   }
+}
+
+
+/**
+ * Switch a LP_RESOURCE_FLAG_TILED texture back to the linear layout, in
+ * place.  This is done before anything renders to the texture, as the
+ * rasterizer only handles linear images.
+ */
+void
+llvmpipe_resource_detile(struct pipe_context *pipe,
+                         struct pipe_resource *resource)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   ubyte *linear;
+   unsigned level;
+
+   if (!llvmpipe_resource_is_tiled(resource))
+      return;
+
+   /* queued draws may still sample the texture in its tiled layout */
+   llvmpipe_flush_resource(pipe, resource, 0, FALSE, TRUE, FALSE,
+                           __FUNCTION__);
+
+   /* the first level has the largest images and the most of them */
+   linear = MALLOC(lpr->img_stride[0] * util_num_layers(resource, 0));
+   if (!linear)
+      return;
+
+   for (level = 0; level <= resource->last_level; level++) {
+      const unsigned num_layers = util_num_layers(resource, level);
+      struct pipe_box box;
+
+      u_box_3d(0, 0, 0,
+               u_minify(resource->width0, level),
+               u_minify(resource->height0, level),
+               num_layers, &box);
+
+      llvmpipe_copy_tiled_box(lpr, level, &box, linear,
+                              lpr->row_stride[level],
+                              lpr->img_stride[level], FALSE);
+      memcpy(llvmpipe_get_texture_image_address(lpr, 0, level), linear,
+             lpr->img_stride[level] * num_layers);
+   }
+
+   FREE(linear);
+
+   resource->flags &= ~LP_RESOURCE_FLAG_TILED;
+
+   /* shaders sampling the texture need new variants */
+   draw_flush(llvmpipe->draw);
+   llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+   llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+}
+
+
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -567,12 +701,45 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
    pt->box = *box;
    pt->level = level;
    pt->stride = lpr->row_stride[level];
-   pt->layer_stride = lpr->img_stride[level];
+   pt->layer_stride = lpr->img_stride[level] *
+                      llvmpipe_resource_samples(resource);
    pt->usage = usage;
    *transfer = pt;
 
    assert(level < LP_MAX_TEXTURE_LEVELS);
 
+   if (llvmpipe_resource_is_tiled(resource)) {
+      /*
+       * Hand out a linear copy of the box, which unmap puts back in
+       * place.
+       */
+      const unsigned bpp = util_format_get_blocksize(resource->format);
+
+      pt->stride = box->width * bpp;
+      pt->layer_stride = pt->stride * box->height;
+      lpt->staging = MALLOC(pt->layer_stride * box->depth);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      /* writes that don't discard the box may leave parts of it alone */
+      if ((usage & PIPE_TRANSFER_READ) ||
+          !(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         llvmpipe_copy_tiled_box(lpr, level, box, lpt->staging,
+                                 pt->stride, pt->layer_stride, FALSE);
+      }
+
+      if (usage & PIPE_TRANSFER_WRITE) {
+         screen->timestamp++;
+      }
+
+      return lpt->staging;
+   }
+
    /*
    printf("tex_transfer_map(%d, %d  %d x %d of %d x %d,  usage %d )\n",
           transfer->x, transfer->y, transfer->width, transfer->height,
@@ -623,16 +790,28 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
-   assert(transfer->resource);
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
 
-   llvmpipe_resource_unmap(transfer->resource,
-                           transfer->level,
-                           transfer->box.z);
+   assert(transfer->resource);
 
-   /* Effectively do the texture_update work here - if texture images
-    * needed post-processing to put them into hardware layout, this is
-    * where it would happen.  For llvmpipe, nothing to do.
+   /* Effectively do the texture_update work here - tiled textures get
+    * the linear copy of the mapped box put back into their layout.
     */
+   if (lpt->staging) {
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         llvmpipe_copy_tiled_box(llvmpipe_resource(transfer->resource),
+                                 transfer->level, &transfer->box,
+                                 lpt->staging, transfer->stride,
+                                 transfer->layer_stride, TRUE);
+      }
+      FREE(lpt->staging);
+   }
+   else {
+      llvmpipe_resource_unmap(transfer->resource,
+                              transfer->level,
+                              transfer->box.z);
+   }
+
    assert (transfer->resource);
    pipe_resource_reference(&transfer->resource, NULL);
    FREE(transfer);
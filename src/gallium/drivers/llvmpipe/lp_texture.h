@@ -31,6 +31,7 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "gallivm/lp_bld_sample.h"
 #include "lp_limits.h"
 
 
@@ -102,6 +103,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the mapped box, for LP_RESOURCE_FLAG_TILED textures */
+   void *staging;
 };
 
 
@@ -175,6 +179,22 @@ llvmpipe_resource_is_1d(const struct pipe_resource *resource)
 }
 
 
+/**
+ * Number of samples stored per pixel.
+ * Multisample resources keep every sample in an image slice of its own,
+ * so sample s of layer l lives in slice l * nr_samples + s.
+ */
+static inline unsigned
+llvmpipe_resource_samples(const struct pipe_resource *resource)
+{
+   return MAX2(resource->nr_samples, 1);
+}
+
+
+/**
+ * Stride between image slices.  For multisample resources this is the
+ * distance between two samples of the same layer.
+ */
 static inline unsigned
 llvmpipe_layer_stride(struct pipe_resource *resource,
                       unsigned level)
@@ -195,6 +215,35 @@ llvmpipe_resource_stride(struct pipe_resource *resource,
 }
 
 
+static inline boolean
+llvmpipe_resource_is_tiled(const struct pipe_resource *resource)
+{
+   return !!(resource->flags & LP_RESOURCE_FLAG_TILED);
+}
+
+
+/**
+ * Byte offset of texel (x, y) within an image of a LP_RESOURCE_FLAG_TILED
+ * texture.  This must match lp_build_sample_offset().
+ */
+static inline unsigned
+llvmpipe_tiled_offset(unsigned x, unsigned y,
+                      unsigned row_stride, unsigned bpp)
+{
+   const unsigned mask = LP_TEXTURE_TILE_SIZE - 1;
+
+   return (y >> LP_TEXTURE_TILE_ORDER) * row_stride * LP_TEXTURE_TILE_SIZE +
+          (x >> LP_TEXTURE_TILE_ORDER) * bpp * LP_TEXTURE_TILE_SIZE *
+             LP_TEXTURE_TILE_SIZE +
+          ((y & mask) * LP_TEXTURE_TILE_SIZE + (x & mask)) * bpp;
+}
+
+
+void
+llvmpipe_resource_detile(struct pipe_context *pipe,
+                         struct pipe_resource *resource);
+
+
 void *
 llvmpipe_resource_map(struct pipe_resource *resource,
                       unsigned level,
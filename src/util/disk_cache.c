@@ -46,7 +46,11 @@
 
 #include "util/crc32.h"
 #include "util/debug.h"
+#include "util/hash_table.h"
+#include "util/list.h"
+#include "util/os_time.h"
 #include "util/rand_xor.h"
+#include "util/simple_mtx.h"
 #include "util/u_atomic.h"
 #include "util/u_queue.h"
 #include "util/mesa-sha1.h"
@@ -55,6 +59,7 @@
 #include "main/errors.h"
 
 #include "disk_cache.h"
+#include "disk_cache_db.h"
 
 /* Number of bits to mask off from a cache key to get an index. */
 #define CACHE_INDEX_KEY_BITS 16
@@ -79,6 +84,12 @@
  */
 #define CACHE_VERSION 1
 
+/* Maximum number of read-only databases (see MESA_DISK_CACHE_READ_ONLY_DBS) */
+#define MAX_READ_ONLY_DBS 8
+
+/* Default size of the in-memory cache (see MESA_DISK_CACHE_MEMORY_SIZE) */
+#define MEMORY_CACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+
 /* 3 is the recomended level, with 22 as the absolute maximum */
 #define ZSTD_COMPRESSION_LEVEL 3
 
@@ -106,10 +117,23 @@ struct disk_cache {
    /* Maximum size of all cached objects (in bytes). */
    uint64_t max_size;
 
+   /* Entries are stored in a single pack file rather than a file each. */
+   bool single_file;
+   struct disk_cache_db db;
+
+   /* Prebuilt databases that are searched before the writable cache. */
+   struct disk_cache_db read_only_dbs[MAX_READ_ONLY_DBS];
+   unsigned num_read_only_dbs;
+
    /* Driver cache keys. */
    uint8_t *driver_keys_blob;
    size_t driver_keys_blob_size;
 
+   /* Hash of the driver keys, telling apart the entries that caches of
+    * different drivers have in the in-memory cache.
+    */
+   uint8_t driver_keys_id[8];
+
    disk_cache_put_cb blob_put_cb;
    disk_cache_get_cb blob_get_cb;
 };
@@ -163,6 +187,77 @@ mkdir_if_needed(const char *path)
    return -1;
 }
 
+/* Open the read-only databases listed in MESA_DISK_CACHE_READ_ONLY_DBS, a
+ * comma-separated list of directories, each holding a pack and an index
+ * file written by the single file cache. Directories which don't hold a
+ * usable database are skipped.
+ */
+static void
+open_read_only_dbs(struct disk_cache *cache, void *ctx)
+{
+   const char *list = getenv("MESA_DISK_CACHE_READ_ONLY_DBS");
+   if (list == NULL)
+      return;
+
+   char *dirs = ralloc_strdup(ctx, list);
+   if (dirs == NULL)
+      return;
+
+   char *save_ptr;
+   for (char *dir = strtok_r(dirs, ",", &save_ptr); dir != NULL;
+        dir = strtok_r(NULL, ",", &save_ptr)) {
+      if (cache->num_read_only_dbs == MAX_READ_ONLY_DBS) {
+         fprintf(stderr, "Mesa: Too many read-only shader cache databases, "
+                 "ignoring %s.\n", dir);
+         break;
+      }
+
+      struct disk_cache_db *db =
+         &cache->read_only_dbs[cache->num_read_only_dbs];
+      if (disk_cache_db_open_read_only(db, cache, dir))
+         cache->num_read_only_dbs++;
+   }
+}
+
+/* Parse a size given as a number optionally followed by K, M or G, (with
+ * gigabytes assumed when there is no suffix).
+ *
+ * Returns 'default_size' if the variable is unset or not a number.
+ */
+static uint64_t
+get_size_env(const char *name, uint64_t default_size)
+{
+   const char *str = getenv(name);
+   uint64_t size;
+   char *end;
+
+   if (str == NULL)
+      return default_size;
+
+   size = strtoul(str, &end, 10);
+   if (end == str)
+      return default_size;
+
+   switch (*end) {
+   case 'K':
+   case 'k':
+      size *= 1024;
+      break;
+   case 'M':
+   case 'm':
+      size *= 1024*1024;
+      break;
+   case '\0':
+   case 'G':
+   case 'g':
+   default:
+      size *= 1024*1024*1024;
+      break;
+   }
+
+   return size;
+}
+
 /* Concatenate an existing path and a new name to form a new path.  If the new
  * path does not exist as a directory, create it then return the resulting
  * name of the new path (ralloc'ed off of 'ctx').
@@ -196,13 +291,243 @@ do {                                       \
    _dst += _src_size;                      \
 } while (0);
 
+/* The in-memory cache holds decompressed items in front of the disk. It is
+ * shared by all the caches of the process, and lives for as long as any of
+ * them does.
+ */
+#define MEMORY_CACHE_KEY_SIZE (CACHE_KEY_SIZE + 8)
+
+struct memory_cache_item {
+   struct list_head link;
+
+   /* The cache key followed by the driver_keys_id of the cache. */
+   uint8_t key[MEMORY_CACHE_KEY_SIZE];
+
+   size_t size;
+   uint8_t data[];
+};
+
+static struct {
+   simple_mtx_t mtx;
+   unsigned num_users;
+
+   struct hash_table *table;
+
+   /* Least recently used items first. */
+   struct list_head lru;
+
+   uint64_t size;
+   uint64_t max_size;
+} memory_cache = { _SIMPLE_MTX_INITIALIZER_NP };
+
+static struct disk_cache_stats stats;
+
+static uint32_t
+memory_cache_hash(const void *key)
+{
+   const uint8_t *bytes = key;
+   uint32_t hash, id;
+
+   /* Cache keys are SHA-1 hashes already. */
+   memcpy(&hash, bytes, sizeof(hash));
+   memcpy(&id, bytes + CACHE_KEY_SIZE, sizeof(id));
+
+   return hash ^ id;
+}
+
+static bool
+memory_cache_key_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, MEMORY_CACHE_KEY_SIZE) == 0;
+}
+
+static void
+memory_cache_key(struct disk_cache *cache, const cache_key key,
+                 uint8_t *memory_key)
+{
+   memcpy(memory_key, key, CACHE_KEY_SIZE);
+   memcpy(memory_key + CACHE_KEY_SIZE, cache->driver_keys_id,
+          sizeof(cache->driver_keys_id));
+}
+
+static void
+memory_cache_ref(void)
+{
+   simple_mtx_lock(&memory_cache.mtx);
+
+   if (memory_cache.num_users++ == 0) {
+      memory_cache.max_size = get_size_env("MESA_DISK_CACHE_MEMORY_SIZE",
+                                            MEMORY_CACHE_DEFAULT_SIZE);
+      list_inithead(&memory_cache.lru);
+
+      if (memory_cache.max_size) {
+         memory_cache.table = _mesa_hash_table_create(NULL,
+                                                      memory_cache_hash,
+                                                      memory_cache_key_equal);
+         if (memory_cache.table == NULL)
+            memory_cache.max_size = 0;
+      }
+   }
+
+   simple_mtx_unlock(&memory_cache.mtx);
+}
+
+static void
+memory_cache_unref(void)
+{
+   simple_mtx_lock(&memory_cache.mtx);
+
+   if (--memory_cache.num_users == 0) {
+      if (env_var_as_boolean("MESA_DISK_CACHE_STATS", false)) {
+         fprintf(stderr, "disk_cache: %" PRIu64 " memory hits, %" PRIu64
+                 " memory misses, %" PRIu64 " disk hits, %.3f ms "
+                 "decompressing, %" PRIu64 " bytes in memory\n",
+                 stats.memory_hits, stats.memory_misses, stats.disk_hits,
+                 stats.decompress_ns / 1000000.0, memory_cache.size);
+      }
+
+      list_for_each_entry_safe(struct memory_cache_item, item,
+                               &memory_cache.lru, link)
+         free(item);
+
+      _mesa_hash_table_destroy(memory_cache.table, NULL);
+      memory_cache.table = NULL;
+      memory_cache.size = 0;
+      memory_cache.max_size = 0;
+   }
+
+   simple_mtx_unlock(&memory_cache.mtx);
+}
+
+/* Returns a malloc'ed copy of the item, (or NULL if it isn't in memory). */
+static void *
+memory_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   uint8_t memory_key[MEMORY_CACHE_KEY_SIZE];
+   void *data = NULL;
+
+   /* Only changes when no cache is alive. */
+   if (memory_cache.max_size == 0)
+      return NULL;
+
+   memory_cache_key(cache, key, memory_key);
+
+   simple_mtx_lock(&memory_cache.mtx);
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(memory_cache.table, memory_key);
+   if (entry) {
+      struct memory_cache_item *item = entry->data;
+
+      list_del(&item->link);
+      list_addtail(&item->link, &memory_cache.lru);
+
+      data = malloc(item->size);
+      if (data) {
+         memcpy(data, item->data, item->size);
+         if (size)
+            *size = item->size;
+      }
+   }
+
+   simple_mtx_unlock(&memory_cache.mtx);
+
+   return data;
+}
+
+static void
+memory_cache_put(struct disk_cache *cache, const cache_key key,
+                 const void *data, size_t size)
+{
+   /* Don't let a single item flush a large part of the cache. */
+   if (memory_cache.max_size == 0 || size > memory_cache.max_size / 8)
+      return;
+
+   struct memory_cache_item *item = malloc(sizeof(*item) + size);
+   if (item == NULL)
+      return;
+
+   memory_cache_key(cache, key, item->key);
+   item->size = size;
+   memcpy(item->data, data, size);
+
+   simple_mtx_lock(&memory_cache.mtx);
+
+   if (_mesa_hash_table_search(memory_cache.table, item->key)) {
+      simple_mtx_unlock(&memory_cache.mtx);
+      free(item);
+      return;
+   }
+
+   /* Evict the least recently used items to make room. */
+   while (memory_cache.size + size > memory_cache.max_size) {
+      struct memory_cache_item *lru =
+         list_first_entry(&memory_cache.lru, struct memory_cache_item, link);
+
+      _mesa_hash_table_remove(memory_cache.table,
+                              _mesa_hash_table_search(memory_cache.table,
+                                                      lru->key));
+      list_del(&lru->link);
+      memory_cache.size -= lru->size;
+      free(lru);
+   }
+
+   if (_mesa_hash_table_insert(memory_cache.table, item->key, item)) {
+      list_addtail(&item->link, &memory_cache.lru);
+      memory_cache.size += size;
+   } else {
+      free(item);
+   }
+
+   simple_mtx_unlock(&memory_cache.mtx);
+}
+
+static void
+memory_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+   uint8_t memory_key[MEMORY_CACHE_KEY_SIZE];
+
+   if (memory_cache.max_size == 0)
+      return;
+
+   memory_cache_key(cache, key, memory_key);
+
+   simple_mtx_lock(&memory_cache.mtx);
+
+   struct hash_entry *entry =
+      _mesa_hash_table_search(memory_cache.table, memory_key);
+   if (entry) {
+      struct memory_cache_item *item = entry->data;
+
+      _mesa_hash_table_remove(memory_cache.table, entry);
+      list_del(&item->link);
+      memory_cache.size -= item->size;
+      free(item);
+   }
+
+   simple_mtx_unlock(&memory_cache.mtx);
+}
+
+void
+disk_cache_get_stats(struct disk_cache_stats *out)
+{
+   out->memory_hits = p_atomic_read(&stats.memory_hits);
+   out->memory_misses = p_atomic_read(&stats.memory_misses);
+   out->disk_hits = p_atomic_read(&stats.disk_hits);
+   out->decompress_ns = p_atomic_read(&stats.decompress_ns);
+
+   simple_mtx_lock(&memory_cache.mtx);
+   out->memory_size = memory_cache.size;
+   simple_mtx_unlock(&memory_cache.mtx);
+}
+
 struct disk_cache *
 disk_cache_create(const char *gpu_name, const char *driver_id,
                   uint64_t driver_flags)
 {
    void *local;
    struct disk_cache *cache = NULL;
-   char *path, *max_size_str;
+   char *path;
    uint64_t max_size;
    int fd = -1;
    struct stat sb;
@@ -341,41 +666,21 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    cache->size = (uint64_t *) cache->index_mmap;
    cache->stored_keys = cache->index_mmap + sizeof(uint64_t);
 
-   max_size = 0;
-
-   max_size_str = getenv("MESA_GLSL_CACHE_MAX_SIZE");
-   if (max_size_str) {
-      char *end;
-      max_size = strtoul(max_size_str, &end, 10);
-      if (end == max_size_str) {
-         max_size = 0;
-      } else {
-         switch (*end) {
-         case 'K':
-         case 'k':
-            max_size *= 1024;
-            break;
-         case 'M':
-         case 'm':
-            max_size *= 1024*1024;
-            break;
-         case '\0':
-         case 'G':
-         case 'g':
-         default:
-            max_size *= 1024*1024*1024;
-            break;
-         }
-      }
-   }
-
    /* Default to 1GB for maximum cache size. */
+   max_size = get_size_env("MESA_GLSL_CACHE_MAX_SIZE", 0);
    if (max_size == 0) {
       max_size = 1024*1024*1024;
    }
 
    cache->max_size = max_size;
 
+   /* If the database cannot be opened, the cache falls back to storing each
+    * entry in a file of its own.
+    */
+   if (env_var_as_boolean("MESA_DISK_CACHE_SINGLE_FILE", false))
+      cache->single_file = disk_cache_db_open(&cache->db, cache, cache->path,
+                                              max_size);
+
    /* 4 threads were chosen below because just about all modern CPUs currently
     * available that run Mesa have *at least* 4 cores. For these CPUs allowing
     * more threads can result in the queue being processed faster, thus
@@ -398,6 +703,9 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    if (fd != -1)
       close(fd);
 
+   /* The prebuilt databases are usable even if the writable cache isn't. */
+   open_read_only_dbs(cache, local);
+
    cache->driver_keys_blob_size = cv_size;
 
    /* Create driver id keys */
@@ -428,9 +736,17 @@ disk_cache_create(const char *gpu_name, const char *driver_id,
    DRV_KEY_CPY(drv_key_blob, &ptr_size, ptr_size_size)
    DRV_KEY_CPY(drv_key_blob, &driver_flags, driver_flags_size)
 
+   unsigned char driver_keys_sha1[20];
+   _mesa_sha1_compute(cache->driver_keys_blob, cache->driver_keys_blob_size,
+                      driver_keys_sha1);
+   memcpy(cache->driver_keys_id, driver_keys_sha1,
+          sizeof(cache->driver_keys_id));
+
    /* Seed our rand function */
    s_rand_xorshift128plus(cache->seed_xorshift128plus, true);
 
+   memory_cache_ref();
+
    ralloc_free(local);
 
    return cache;
@@ -450,6 +766,16 @@ disk_cache_destroy(struct disk_cache *cache)
       util_queue_finish(&cache->cache_queue);
       util_queue_destroy(&cache->cache_queue);
       munmap(cache->index_mmap, cache->index_mmap_size);
+
+      if (cache->single_file)
+         disk_cache_db_close(&cache->db);
+   }
+
+   if (cache) {
+      for (unsigned i = 0; i < cache->num_read_only_dbs; i++)
+         disk_cache_db_close(&cache->read_only_dbs[i]);
+
+      memory_cache_unref();
    }
 
    ralloc_free(cache);
@@ -684,6 +1010,13 @@ disk_cache_remove(struct disk_cache *cache, const cache_key key)
 {
    struct stat sb;
 
+   memory_cache_remove(cache, key);
+
+   if (cache->single_file) {
+      disk_cache_db_remove(&cache->db, key);
+      return;
+   }
+
    char *filename = get_cache_file(cache, key);
    if (filename == NULL) {
       return;
@@ -829,6 +1162,43 @@ deflate_and_write_to_disk(const void *in_data, size_t in_data_size, int dest,
 # endif
 }
 
+static size_t
+deflate_bound(size_t in_data_size)
+{
+#ifdef HAVE_ZSTD
+   return ZSTD_compressBound(in_data_size);
+#else
+   return compressBound(in_data_size);
+#endif
+}
+
+/**
+ * Compresses cache entry into 'out', which must be able to hold
+ * deflate_bound(in_data_size) bytes. Returns the compressed size, (or 0 on
+ * any error).
+ */
+static size_t
+deflate_to_memory(const void *in_data, size_t in_data_size,
+                  void *out, size_t out_size)
+{
+#ifdef HAVE_ZSTD
+   size_t ret = ZSTD_compress(out, out_size, in_data, in_data_size,
+                              ZSTD_COMPRESSION_LEVEL);
+   if (ZSTD_isError(ret))
+      return 0;
+   return ret;
+#else
+   uLongf compressed_size = out_size;
+
+   /* Produces the same zlib stream deflate_and_write_to_disk() does. */
+   int ret = compress2(out, &compressed_size, in_data, in_data_size,
+                       Z_BEST_COMPRESSION);
+   if (ret != Z_OK)
+      return 0;
+   return compressed_size;
+#endif
+}
+
 static struct disk_cache_put_job *
 create_put_job(struct disk_cache *cache, const cache_key key,
                const void *data, size_t size,
@@ -890,6 +1260,56 @@ struct cache_entry_file_data {
    uint32_t uncompressed_size;
 };
 
+/* Lays out the cache entry in memory exactly as cache_put() writes it to
+ * its own file, and appends it to the single file database.
+ */
+static void
+cache_put_db(struct disk_cache_put_job *dc_job)
+{
+   struct disk_cache *cache = dc_job->cache;
+   struct cache_item_metadata *md = &dc_job->cache_item_metadata;
+
+   size_t md_size = sizeof(uint32_t);
+   if (md->type == CACHE_ITEM_TYPE_GLSL)
+      md_size += sizeof(uint32_t) + md->num_keys * sizeof(cache_key);
+
+   size_t header_size = cache->driver_keys_blob_size + md_size +
+                        sizeof(struct cache_entry_file_data);
+   size_t out_size = deflate_bound(dc_job->size);
+
+   uint8_t *cache_item = malloc(header_size + out_size);
+   if (cache_item == NULL)
+      return;
+
+   uint8_t *ptr = cache_item;
+   memcpy(ptr, cache->driver_keys_blob, cache->driver_keys_blob_size);
+   ptr += cache->driver_keys_blob_size;
+
+   memcpy(ptr, &md->type, sizeof(uint32_t));
+   ptr += sizeof(uint32_t);
+
+   if (md->type == CACHE_ITEM_TYPE_GLSL) {
+      memcpy(ptr, &md->num_keys, sizeof(uint32_t));
+      ptr += sizeof(uint32_t);
+      memcpy(ptr, md->keys[0], md->num_keys * sizeof(cache_key));
+      ptr += md->num_keys * sizeof(cache_key);
+   }
+
+   struct cache_entry_file_data cf_data;
+   cf_data.crc32 = util_hash_crc32(dc_job->data, dc_job->size);
+   cf_data.uncompressed_size = dc_job->size;
+   memcpy(ptr, &cf_data, sizeof(cf_data));
+   ptr += sizeof(cf_data);
+
+   size_t compressed_size = deflate_to_memory(dc_job->data, dc_job->size,
+                                              ptr, out_size);
+   if (compressed_size)
+      disk_cache_db_put(&cache->db, dc_job->key, cache_item,
+                        header_size + compressed_size);
+
+   free(cache_item);
+}
+
 static void
 cache_put(void *job, int thread_index)
 {
@@ -900,6 +1320,11 @@ cache_put(void *job, int thread_index)
    char *filename = NULL, *filename_tmp = NULL;
    struct disk_cache_put_job *dc_job = (struct disk_cache_put_job *) job;
 
+   if (dc_job->cache->single_file) {
+      cache_put_db(dc_job);
+      return;
+   }
+
    filename = get_cache_file(dc_job->cache, dc_job->key);
    if (filename == NULL)
       goto done;
@@ -1071,6 +1496,11 @@ disk_cache_put(struct disk_cache *cache, const cache_key key,
    if (cache->path_init_failed)
       return;
 
+   /* Other contexts of the process can find the item right away, without
+    * waiting for it to be written.
+    */
+   memory_cache_put(cache, key, data, size);
+
    struct disk_cache_put_job *dc_job =
       create_put_job(cache, key, data, size, cache_item_metadata);
 
@@ -1125,86 +1555,39 @@ inflate_cache_data(uint8_t *in_data, size_t in_data_size,
 #endif
 }
 
-void *
-disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+/**
+ * Checks the header of a cache entry read back into memory, and returns the
+ * decompressed data, (or NULL if the entry is invalid).
+ */
+static void *
+parse_and_validate_cache_item(struct disk_cache *cache, uint8_t *cache_item,
+                              size_t cache_item_size, size_t *size)
 {
-   int fd = -1, ret;
-   struct stat sb;
-   char *filename = NULL;
-   uint8_t *data = NULL;
    uint8_t *uncompressed_data = NULL;
-   uint8_t *file_header = NULL;
-
-   if (size)
-      *size = 0;
-
-   if (cache->blob_get_cb) {
-      /* This is what Android EGL defines as the maxValueSize in egl_cache_t
-       * class implementation.
-       */
-      const signed long max_blob_size = 64 * 1024;
-      void *blob = malloc(max_blob_size);
-      if (!blob)
-         return NULL;
-
-      signed long bytes =
-         cache->blob_get_cb(key, CACHE_KEY_SIZE, blob, max_blob_size);
-
-      if (!bytes) {
-         free(blob);
-         return NULL;
-      }
-
-      if (size)
-         *size = bytes;
-      return blob;
-   }
-
-   filename = get_cache_file(cache, key);
-   if (filename == NULL)
-      goto fail;
-
-   fd = open(filename, O_RDONLY | O_CLOEXEC);
-   if (fd == -1)
-      goto fail;
-
-   if (fstat(fd, &sb) == -1)
-      goto fail;
-
-   data = malloc(sb.st_size);
-   if (data == NULL)
-      goto fail;
 
    size_t ck_size = cache->driver_keys_blob_size;
-   file_header = malloc(ck_size);
-   if (!file_header)
-      goto fail;
-
-   if (sb.st_size < ck_size)
-      goto fail;
-
-   ret = read_all(fd, file_header, ck_size);
-   if (ret == -1)
+   if (cache_item_size < ck_size)
       goto fail;
 
    /* Check for extremely unlikely hash collisions */
-   if (memcmp(cache->driver_keys_blob, file_header, ck_size) != 0) {
+   if (memcmp(cache->driver_keys_blob, cache_item, ck_size) != 0) {
       assert(!"Mesa cache keys mismatch!");
       goto fail;
    }
 
    size_t cache_item_md_size = sizeof(uint32_t);
    uint32_t md_type;
-   ret = read_all(fd, &md_type, cache_item_md_size);
-   if (ret == -1)
+   if (cache_item_size < ck_size + cache_item_md_size)
       goto fail;
+   memcpy(&md_type, cache_item + ck_size, sizeof(uint32_t));
 
    if (md_type == CACHE_ITEM_TYPE_GLSL) {
       uint32_t num_keys;
-      cache_item_md_size += sizeof(uint32_t);
-      ret = read_all(fd, &num_keys, sizeof(uint32_t));
-      if (ret == -1)
+      if (cache_item_size < ck_size + cache_item_md_size + sizeof(uint32_t))
          goto fail;
+      memcpy(&num_keys, cache_item + ck_size + cache_item_md_size,
+             sizeof(uint32_t));
+      cache_item_md_size += sizeof(uint32_t);
 
       /* The cache item metadata is currently just used for distributing
        * precompiled shaders, they are not used by Mesa so just skip them for
@@ -1213,29 +1596,31 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
        * validation.
        */
       cache_item_md_size += num_keys * sizeof(cache_key);
-      ret = lseek(fd, num_keys * sizeof(cache_key), SEEK_CUR);
-      if (ret == -1)
-         goto fail;
    }
 
    /* Load the CRC that was created when the file was written. */
    struct cache_entry_file_data cf_data;
    size_t cf_data_size = sizeof(cf_data);
-   ret = read_all(fd, &cf_data, cf_data_size);
-   if (ret == -1)
+   if (cache_item_size < ck_size + cache_item_md_size + cf_data_size)
       goto fail;
+   memcpy(&cf_data, cache_item + ck_size + cache_item_md_size, cf_data_size);
 
-   /* Load the actual cache data. */
-   size_t cache_data_size =
-      sb.st_size - cf_data_size - ck_size - cache_item_md_size;
-   ret = read_all(fd, data, cache_data_size);
-   if (ret == -1)
-      goto fail;
+   /* Locate the actual cache data. */
+   size_t header_size = ck_size + cache_item_md_size + cf_data_size;
+   size_t cache_data_size = cache_item_size - header_size;
 
    /* Uncompress the cache data */
    uncompressed_data = malloc(cf_data.uncompressed_size);
-   if (!inflate_cache_data(data, cache_data_size, uncompressed_data,
-                           cf_data.uncompressed_size))
+   if (!uncompressed_data)
+      goto fail;
+
+   int64_t start = os_time_get_nano();
+   bool inflated = inflate_cache_data(cache_item + header_size,
+                                      cache_data_size, uncompressed_data,
+                                      cf_data.uncompressed_size);
+   p_atomic_add(&stats.decompress_ns, os_time_get_nano() - start);
+
+   if (!inflated)
       goto fail;
 
    /* Check the data for corruption */
@@ -1243,29 +1628,148 @@ disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
                                         cf_data.uncompressed_size))
       goto fail;
 
-   free(data);
-   free(filename);
-   free(file_header);
-   close(fd);
-
    if (size)
       *size = cf_data.uncompressed_size;
 
    return uncompressed_data;
 
+ fail:
+   free(uncompressed_data);
+
+   return NULL;
+}
+
+/**
+ * Reads an item from the read-only databases or the writable cache.
+ */
+static void *
+load_cache_item(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   int fd = -1, ret;
+   struct stat sb;
+   char *filename = NULL;
+   uint8_t *data = NULL;
+   uint8_t *uncompressed_data = NULL;
+
+   /* Look into the prebuilt databases first, a miss there costs no system
+    * call.
+    */
+   for (unsigned i = 0; i < cache->num_read_only_dbs; i++) {
+      size_t cache_item_size;
+
+      data = disk_cache_db_get(&cache->read_only_dbs[i], key,
+                               &cache_item_size);
+      if (data == NULL)
+         continue;
+
+      uncompressed_data = parse_and_validate_cache_item(cache, data,
+                                                        cache_item_size,
+                                                        size);
+      free(data);
+      data = NULL;
+
+      if (uncompressed_data)
+         return uncompressed_data;
+   }
+
+   if (cache->single_file) {
+      size_t cache_item_size;
+
+      data = disk_cache_db_get(&cache->db, key, &cache_item_size);
+      if (data == NULL)
+         return NULL;
+
+      uncompressed_data = parse_and_validate_cache_item(cache, data,
+                                                        cache_item_size,
+                                                        size);
+      free(data);
+
+      return uncompressed_data;
+   }
+
+   filename = get_cache_file(cache, key);
+   if (filename == NULL)
+      goto fail;
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      goto fail;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   data = malloc(sb.st_size);
+   if (data == NULL)
+      goto fail;
+
+   ret = read_all(fd, data, sb.st_size);
+   if (ret == -1)
+      goto fail;
+
+   uncompressed_data = parse_and_validate_cache_item(cache, data, sb.st_size,
+                                                     size);
+
  fail:
    if (data)
       free(data);
-   if (uncompressed_data)
-      free(uncompressed_data);
    if (filename)
       free(filename);
-   if (file_header)
-      free(file_header);
    if (fd != -1)
       close(fd);
 
-   return NULL;
+   return uncompressed_data;
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   void *data;
+   size_t data_size = 0;
+
+   if (size)
+      *size = 0;
+
+   if (cache->blob_get_cb) {
+      /* This is what Android EGL defines as the maxValueSize in egl_cache_t
+       * class implementation.
+       */
+      const signed long max_blob_size = 64 * 1024;
+      void *blob = malloc(max_blob_size);
+      if (!blob)
+         return NULL;
+
+      signed long bytes =
+         cache->blob_get_cb(key, CACHE_KEY_SIZE, blob, max_blob_size);
+
+      if (!bytes) {
+         free(blob);
+         return NULL;
+      }
+
+      if (size)
+         *size = bytes;
+      return blob;
+   }
+
+   data = memory_cache_get(cache, key, size);
+   if (data) {
+      p_atomic_inc(&stats.memory_hits);
+      return data;
+   }
+
+   p_atomic_inc(&stats.memory_misses);
+
+   data = load_cache_item(cache, key, &data_size);
+   if (data == NULL)
+      return NULL;
+
+   p_atomic_inc(&stats.disk_hits);
+   memory_cache_put(cache, key, data, data_size);
+
+   if (size)
+      *size = data_size;
+
+   return data;
 }
 
 void
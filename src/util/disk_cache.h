@@ -32,6 +32,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <sys/stat.h>
 #include "util/mesa-sha1.h"
 
@@ -76,6 +77,24 @@ struct cache_item_metadata {
 
 struct disk_cache;
 
+/* Process-wide counters of disk_cache_get(). */
+struct disk_cache_stats {
+   /* Items returned from the in-memory cache. */
+   uint64_t memory_hits;
+
+   /* Lookups that missed in memory and went to disk. */
+   uint64_t memory_misses;
+
+   /* Items found on disk. */
+   uint64_t disk_hits;
+
+   /* Time spent decompressing items read from disk. */
+   uint64_t decompress_ns;
+
+   /* Bytes currently held by the in-memory cache. */
+   uint64_t memory_size;
+};
+
 static inline char *
 disk_cache_format_hex_id(char *buf, const uint8_t *hex_id, unsigned size)
 {
@@ -246,6 +265,9 @@ void
 disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
                          disk_cache_get_cb get);
 
+void
+disk_cache_get_stats(struct disk_cache_stats *stats);
+
 #else
 
 static inline struct disk_cache *
@@ -306,6 +328,12 @@ disk_cache_set_callbacks(struct disk_cache *cache, disk_cache_put_cb put,
    return;
 }
 
+static inline void
+disk_cache_get_stats(struct disk_cache_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+}
+
 #endif /* ENABLE_SHADER_CACHE */
 
 #ifdef __cplusplus
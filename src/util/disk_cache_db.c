@@ -0,0 +1,789 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_SHADER_CACHE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "util/macros.h"
+#include "util/ralloc.h"
+
+#include "disk_cache.h"
+#include "disk_cache_db.h"
+
+/* "MCDB" */
+#define DB_MAGIC 0x4244434d
+
+/* Should be bumped whenever the layout of the index or pack file changes,
+ * existing databases are then discarded.
+ */
+#define DB_VERSION 1
+
+/* Number of slots of the index hash table, must be a power of two. */
+#define DB_INDEX_ENTRIES (1 << 17)
+#define DB_INDEX_MASK (DB_INDEX_ENTRIES - 1)
+
+/* The pack is compacted once this many slots (counting removed entries)
+ * are in use, which keeps the probe sequences short. Compaction then keeps
+ * at most DB_INDEX_MAX_KEEP entries.
+ */
+#define DB_INDEX_MAX_USED (DB_INDEX_ENTRIES / 4 * 3)
+#define DB_INDEX_MAX_KEEP (DB_INDEX_ENTRIES / 2)
+
+struct disk_cache_db_index_header {
+   uint32_t magic;
+   uint32_t version;
+
+   /* Bumped each time the pack file is replaced. */
+   uint64_t generation;
+
+   /* End of the last record of the pack file. */
+   uint64_t pack_size;
+
+   /* Number of used slots, including removed entries. */
+   uint32_t num_used;
+   uint32_t pad;
+};
+
+struct disk_cache_db_index_entry {
+   /* The first 8 bytes of the cache key, 0 for an empty slot. */
+   uint64_t key;
+
+   /* Location of the record within the pack file. A size of 0 marks an
+    * entry that was removed, the slot is reused if the key is put again.
+    */
+   uint64_t offset;
+   uint32_t size;
+
+   /* Time of the last access in seconds, used to pick the entries that
+    * survive a compaction.
+    */
+   uint32_t atime;
+};
+
+struct db_pack_header {
+   uint32_t magic;
+   uint32_t version;
+   uint64_t generation;
+};
+
+struct db_record_header {
+   uint32_t magic;
+
+   /* Size of the data following the header. */
+   uint32_t size;
+
+   uint8_t key[CACHE_KEY_SIZE];
+};
+
+static ssize_t
+pread_all(int fd, void *buf, size_t count, off_t offset)
+{
+   char *in = buf;
+   ssize_t read_ret;
+   size_t done;
+
+   for (done = 0; done < count; done += read_ret) {
+      read_ret = pread(fd, in + done, count - done, offset + done);
+      if (read_ret == -1 || read_ret == 0)
+         return -1;
+   }
+   return done;
+}
+
+static ssize_t
+pwrite_all(int fd, const void *buf, size_t count, off_t offset)
+{
+   const char *out = buf;
+   ssize_t written;
+   size_t done;
+
+   for (done = 0; done < count; done += written) {
+      written = pwrite(fd, out + done, count - done, offset + done);
+      if (written == -1)
+         return -1;
+   }
+   return done;
+}
+
+static uint32_t
+db_time(void)
+{
+   return (uint32_t) time(NULL);
+}
+
+static uint64_t
+db_index_key(const uint8_t *key)
+{
+   uint64_t index_key;
+
+   memcpy(&index_key, key, sizeof(index_key));
+
+   /* 0 marks an empty slot. */
+   return index_key ? index_key : 1;
+}
+
+/* Returns the slot holding 'index_key', or the empty slot where it would
+ * be inserted.
+ */
+static struct disk_cache_db_index_entry *
+db_find_slot(struct disk_cache_db *db, uint64_t index_key)
+{
+   for (unsigned i = 0; i < DB_INDEX_ENTRIES; i++) {
+      struct disk_cache_db_index_entry *entry =
+         &db->entries[(index_key + i) & DB_INDEX_MASK];
+
+      if (entry->key == index_key || entry->key == 0)
+         return entry;
+   }
+
+   return NULL;
+}
+
+/* Take the lock that serializes all writers of the database, across
+ * threads and processes.
+ */
+static bool
+db_lock(struct disk_cache_db *db)
+{
+   int err;
+
+   simple_mtx_lock(&db->mtx);
+
+   do {
+#ifdef HAVE_FLOCK
+      err = flock(db->index_fd, LOCK_EX);
+#else
+      struct flock lock = {
+         .l_start = 0,
+         .l_len = 0, /* entire file */
+         .l_type = F_WRLCK,
+         .l_whence = SEEK_SET
+      };
+      err = fcntl(db->index_fd, F_SETLKW, &lock);
+#endif
+   } while (err == -1 && errno == EINTR);
+
+   if (err == -1) {
+      simple_mtx_unlock(&db->mtx);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+db_unlock(struct disk_cache_db *db)
+{
+#ifdef HAVE_FLOCK
+   flock(db->index_fd, LOCK_UN);
+#else
+   struct flock lock = {
+      .l_start = 0,
+      .l_len = 0, /* entire file */
+      .l_type = F_UNLCK,
+      .l_whence = SEEK_SET
+   };
+   fcntl(db->index_fd, F_SETLK, &lock);
+#endif
+
+   simple_mtx_unlock(&db->mtx);
+}
+
+/* Make pack_fd refer to the pack file of the generation recorded in the
+ * index, reopening it if another thread or process compacted the pack.
+ * Must be called with db->mtx held.
+ */
+static bool
+db_update_pack(struct disk_cache_db *db)
+{
+   struct db_pack_header pack_header;
+
+   if (db->pack_fd != -1 && db->pack_generation == db->header->generation)
+      return true;
+
+   if (db->pack_fd != -1)
+      close(db->pack_fd);
+
+   db->pack_fd = open(db->pack_path,
+                      (db->read_only ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+   if (db->pack_fd == -1)
+      return false;
+
+   if (pread_all(db->pack_fd, &pack_header, sizeof(pack_header), 0) == -1 ||
+       pack_header.magic != DB_MAGIC ||
+       pack_header.version != DB_VERSION) {
+      close(db->pack_fd);
+      db->pack_fd = -1;
+      return false;
+   }
+
+   db->pack_generation = pack_header.generation;
+
+   return true;
+}
+
+/* Create a new, empty pack file next to the current one. Returns the file
+ * descriptor, or -1 on any error.
+ */
+static int
+db_create_pack(struct disk_cache_db *db, const char *filename,
+               uint64_t generation)
+{
+   struct db_pack_header pack_header = {
+      .magic = DB_MAGIC,
+      .version = DB_VERSION,
+      .generation = generation,
+   };
+
+   int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd == -1)
+      return -1;
+
+   if (pwrite_all(fd, &pack_header, sizeof(pack_header), 0) == -1) {
+      close(fd);
+      unlink(filename);
+      return -1;
+   }
+
+   return fd;
+}
+
+/* Atomically replace the pack file with 'filename', which was created by
+ * db_create_pack().
+ */
+static bool
+db_install_pack(struct disk_cache_db *db, int fd, const char *filename,
+                uint64_t generation)
+{
+   if (rename(filename, db->pack_path) == -1) {
+      close(fd);
+      unlink(filename);
+      return false;
+   }
+
+   if (db->pack_fd != -1)
+      close(db->pack_fd);
+
+   db->pack_fd = fd;
+   db->pack_generation = generation;
+
+   return true;
+}
+
+/* Empty the hash table. Only the slots in use are written, so pages of the
+ * index that were never touched don't need to be backed by the file system.
+ */
+static void
+db_clear_index(struct disk_cache_db *db)
+{
+   for (unsigned i = 0; i < DB_INDEX_ENTRIES; i++) {
+      if (db->entries[i].key)
+         memset(&db->entries[i], 0, sizeof(db->entries[i]));
+   }
+}
+
+/* Throw away all entries. Must be called with the database locked. */
+static bool
+db_reset(struct disk_cache_db *db)
+{
+   char *filename;
+
+   uint64_t generation = MAX2(db->header->generation, db->pack_generation) + 1;
+
+   if (asprintf(&filename, "%s.tmp", db->pack_path) == -1)
+      return false;
+
+   int fd = db_create_pack(db, filename, generation);
+   bool ret = fd != -1 && db_install_pack(db, fd, filename, generation);
+
+   free(filename);
+
+   if (!ret)
+      return false;
+
+   db_clear_index(db);
+   db->header->version = DB_VERSION;
+   db->header->pack_size = sizeof(struct db_pack_header);
+   db->header->num_used = 0;
+   db->header->generation = generation;
+   db->header->magic = DB_MAGIC;
+
+   return true;
+}
+
+static int
+compare_entries_by_atime(const void *a, const void *b)
+{
+   const struct disk_cache_db_index_entry *ea = a;
+   const struct disk_cache_db_index_entry *eb = b;
+
+   /* Most recently used first, ties go to the most recently added. */
+   if (ea->atime != eb->atime)
+      return ea->atime > eb->atime ? -1 : 1;
+   if (ea->offset != eb->offset)
+      return ea->offset > eb->offset ? -1 : 1;
+   return 0;
+}
+
+static int
+compare_entries_by_offset(const void *a, const void *b)
+{
+   const struct disk_cache_db_index_entry *ea = a;
+   const struct disk_cache_db_index_entry *eb = b;
+
+   if (ea->offset != eb->offset)
+      return ea->offset < eb->offset ? -1 : 1;
+   return 0;
+}
+
+/* Copy the most recently used entries into a new pack file, leaving room
+ * for 'reserve' more bytes within three quarters of the maximum size.
+ * Space held by removed and evicted entries is reclaimed on the way. Must
+ * be called with the database locked.
+ */
+static bool
+db_compact(struct disk_cache_db *db, uint64_t reserve)
+{
+   struct disk_cache_db_index_entry *live;
+   unsigned num_live = 0, num_kept = 0;
+   uint8_t *buf = NULL;
+   size_t buf_size = 0;
+   char *filename = NULL;
+   int fd = -1;
+   bool ret = false;
+
+   live = malloc(db->header->num_used * sizeof(*live));
+   if (db->header->num_used && live == NULL)
+      return false;
+
+   for (unsigned i = 0; i < DB_INDEX_ENTRIES; i++) {
+      if (db->entries[i].key && db->entries[i].size &&
+          num_live < db->header->num_used)
+         live[num_live++] = db->entries[i];
+   }
+
+   uint64_t budget = db->max_size / 4 * 3;
+   budget -= MIN2(budget, sizeof(struct db_pack_header) + reserve);
+
+   qsort(live, num_live, sizeof(*live), compare_entries_by_atime);
+
+   uint64_t kept_size = 0;
+   while (num_kept < num_live && num_kept < DB_INDEX_MAX_KEEP &&
+          kept_size + live[num_kept].size <= budget) {
+      kept_size += live[num_kept].size;
+      num_kept++;
+   }
+
+   /* Keep the records in their original order, so the copy below reads
+    * the old pack file sequentially.
+    */
+   qsort(live, num_kept, sizeof(*live), compare_entries_by_offset);
+
+   uint64_t generation = db->header->generation + 1;
+
+   if (asprintf(&filename, "%s.tmp", db->pack_path) == -1) {
+      filename = NULL;
+      goto done;
+   }
+
+   fd = db_create_pack(db, filename, generation);
+   if (fd == -1)
+      goto done;
+
+   uint64_t offset = sizeof(struct db_pack_header);
+   unsigned num_copied = 0;
+
+   for (unsigned i = 0; i < num_kept; i++) {
+      struct db_record_header record;
+
+      if (live[i].size > buf_size) {
+         uint8_t *tmp = realloc(buf, live[i].size);
+         if (tmp == NULL)
+            continue;
+         buf = tmp;
+         buf_size = live[i].size;
+      }
+
+      if (pread_all(db->pack_fd, buf, live[i].size, live[i].offset) == -1)
+         continue;
+
+      /* Drop anything that doesn't look like the record the index
+       * expects, (it can only have been corrupted).
+       */
+      memcpy(&record, buf, sizeof(record));
+      if (record.magic != DB_MAGIC ||
+          record.size != live[i].size - sizeof(record) ||
+          db_index_key(record.key) != live[i].key)
+         continue;
+
+      if (pwrite_all(fd, buf, live[i].size, offset) == -1) {
+         close(fd);
+         unlink(filename);
+         goto done;
+      }
+
+      live[num_copied] = live[i];
+      live[num_copied].offset = offset;
+      offset += live[i].size;
+      num_copied++;
+   }
+
+   if (!db_install_pack(db, fd, filename, generation))
+      goto done;
+
+   /* Readers don't take the lock, so they may briefly miss entries while
+    * the table is being rebuilt, or find records of the old pack at new
+    * offsets. The key stored in each record catches the latter.
+    */
+   db_clear_index(db);
+   for (unsigned i = 0; i < num_copied; i++) {
+      struct disk_cache_db_index_entry *entry =
+         db_find_slot(db, live[i].key);
+
+      /* Can't happen with at most DB_INDEX_MAX_KEEP entries, but don't
+       * index records past a full table.
+       */
+      if (entry == NULL) {
+         num_copied = i;
+         break;
+      }
+
+      *entry = live[i];
+   }
+
+   db->header->pack_size = offset;
+   db->header->num_used = num_copied;
+   db->header->generation = generation;
+
+   ret = true;
+
+ done:
+   free(filename);
+   free(buf);
+   free(live);
+
+   return ret;
+}
+
+static bool
+db_init(struct disk_cache_db *db, void *mem_ctx, const char *path,
+        uint64_t max_size, bool read_only)
+{
+   memset(db, 0, sizeof(*db));
+   db->pack_fd = -1;
+   db->index_fd = -1;
+   db->max_size = max_size;
+   db->read_only = read_only;
+   simple_mtx_init(&db->mtx, mtx_plain);
+
+   db->pack_path = ralloc_asprintf(mem_ctx, "%s/%s", path,
+                                   DISK_CACHE_DB_PACK_NAME);
+   db->index_path = ralloc_asprintf(mem_ctx, "%s/%s", path,
+                                    DISK_CACHE_DB_INDEX_NAME);
+
+   return db->pack_path != NULL && db->index_path != NULL;
+}
+
+bool
+disk_cache_db_open(struct disk_cache_db *db, void *mem_ctx, const char *path,
+                   uint64_t max_size)
+{
+   struct stat sb;
+   size_t size;
+
+   if (!db_init(db, mem_ctx, path, max_size, false))
+      goto fail;
+
+   db->index_fd = open(db->index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (db->index_fd == -1)
+      goto fail;
+
+   /* Hold the lock while the files are checked, so that no other process
+    * sees a half initialized database.
+    */
+   if (!db_lock(db))
+      goto fail;
+
+   if (fstat(db->index_fd, &sb) == -1)
+      goto fail_unlock;
+
+   /* Force the index file to be the expected size. */
+   size = sizeof(*db->header) + DB_INDEX_ENTRIES * sizeof(*db->entries);
+   if (sb.st_size != size) {
+      if (ftruncate(db->index_fd, size) == -1)
+         goto fail_unlock;
+   }
+
+   db->header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     db->index_fd, 0);
+   if (db->header == MAP_FAILED) {
+      db->header = NULL;
+      goto fail_unlock;
+   }
+   db->index_mmap_size = size;
+   db->entries = (struct disk_cache_db_index_entry *) (db->header + 1);
+
+   /* Start from scratch if either file is missing, from another version,
+    * or if the pack is shorter than the index expects.
+    */
+   bool valid = db->header->magic == DB_MAGIC &&
+                db->header->version == DB_VERSION &&
+                db_update_pack(db) &&
+                db->pack_generation == db->header->generation &&
+                fstat(db->pack_fd, &sb) == 0 &&
+                sb.st_size >= db->header->pack_size;
+
+   if (!valid && !db_reset(db))
+      goto fail_unlock;
+
+   db_unlock(db);
+
+   return true;
+
+ fail_unlock:
+   db_unlock(db);
+ fail:
+   disk_cache_db_close(db);
+
+   return false;
+}
+
+bool
+disk_cache_db_open_read_only(struct disk_cache_db *db, void *mem_ctx,
+                             const char *path)
+{
+   struct stat sb;
+   size_t size;
+
+   if (!db_init(db, mem_ctx, path, 0, true))
+      goto fail;
+
+   db->index_fd = open(db->index_path, O_RDONLY | O_CLOEXEC);
+   if (db->index_fd == -1)
+      goto fail;
+
+   size = sizeof(*db->header) + DB_INDEX_ENTRIES * sizeof(*db->entries);
+   if (fstat(db->index_fd, &sb) == -1 || sb.st_size != size)
+      goto fail;
+
+   db->header = mmap(NULL, size, PROT_READ, MAP_SHARED, db->index_fd, 0);
+   if (db->header == MAP_FAILED) {
+      db->header = NULL;
+      goto fail;
+   }
+   db->index_mmap_size = size;
+   db->entries = (struct disk_cache_db_index_entry *) (db->header + 1);
+
+   if (db->header->magic != DB_MAGIC ||
+       db->header->version != DB_VERSION ||
+       !db_update_pack(db) ||
+       db->pack_generation != db->header->generation)
+      goto fail;
+
+   return true;
+
+ fail:
+   disk_cache_db_close(db);
+
+   return false;
+}
+
+void
+disk_cache_db_close(struct disk_cache_db *db)
+{
+   if (db->header)
+      munmap(db->header, db->index_mmap_size);
+   if (db->pack_fd != -1)
+      close(db->pack_fd);
+   if (db->index_fd != -1)
+      close(db->index_fd);
+
+   db->header = NULL;
+   db->entries = NULL;
+   db->pack_fd = -1;
+   db->index_fd = -1;
+
+   simple_mtx_destroy(&db->mtx);
+}
+
+bool
+disk_cache_db_put(struct disk_cache_db *db, const uint8_t *key,
+                  const void *data, size_t size)
+{
+   struct disk_cache_db_index_entry *entry;
+   struct db_record_header record;
+   uint64_t record_size = sizeof(record) + size;
+   bool ret = false;
+
+   if (db->read_only || size > UINT32_MAX - sizeof(record) ||
+       sizeof(struct db_pack_header) + record_size > db->max_size)
+      return false;
+
+   if (!db_lock(db))
+      return false;
+
+   if (!db_update_pack(db))
+      goto done;
+
+   uint64_t index_key = db_index_key(key);
+
+   /* Another thread or process may have won the race to add this entry,
+    * in which case there is nothing left to do.
+    */
+   entry = db_find_slot(db, index_key);
+   if (entry && entry->key == index_key && entry->size) {
+      ret = true;
+      goto done;
+   }
+
+   /* If the pack or the index is too full, evict something first. The
+    * table can only be completely full if num_used is wrong, compaction
+    * rebuilds it.
+    */
+   if (entry == NULL ||
+       db->header->pack_size + record_size > db->max_size ||
+       (entry->key == 0 && db->header->num_used >= DB_INDEX_MAX_USED)) {
+      if (!db_compact(db, record_size))
+         goto done;
+
+      entry = db_find_slot(db, index_key);
+      if (entry == NULL)
+         goto done;
+   }
+
+   record.magic = DB_MAGIC;
+   record.size = size;
+   memcpy(record.key, key, CACHE_KEY_SIZE);
+
+   /* Append the record past the end recorded in the index. Whatever a
+    * failed or interrupted append may have left there is simply written
+    * over, the index only ever points at complete records.
+    */
+   uint64_t offset = db->header->pack_size;
+   if (pwrite_all(db->pack_fd, &record, sizeof(record), offset) == -1 ||
+       pwrite_all(db->pack_fd, data, size, offset + sizeof(record)) == -1)
+      goto done;
+
+   entry->offset = offset;
+   entry->size = record_size;
+   entry->atime = db_time();
+   if (entry->key == 0) {
+      db->header->num_used++;
+      entry->key = index_key;
+   }
+
+   db->header->pack_size = offset + record_size;
+
+   ret = true;
+
+ done:
+   db_unlock(db);
+
+   return ret;
+}
+
+void *
+disk_cache_db_get(struct disk_cache_db *db, const uint8_t *key,
+                  size_t *size)
+{
+   struct disk_cache_db_index_entry *entry;
+   struct db_record_header record;
+
+   uint64_t index_key = db_index_key(key);
+
+   entry = db_find_slot(db, index_key);
+   if (entry == NULL || entry->key != index_key)
+      return NULL;
+
+   uint64_t offset = entry->offset;
+   uint32_t record_size = entry->size;
+   if (record_size <= sizeof(record))
+      return NULL;
+
+   uint8_t *data = malloc(record_size);
+   if (data == NULL)
+      return NULL;
+
+   /* The lock only keeps another thread from replacing pack_fd under us.
+    * A compaction by another process is caught by the key check below.
+    */
+   simple_mtx_lock(&db->mtx);
+   bool read_ok = db_update_pack(db) &&
+                  pread_all(db->pack_fd, data, record_size, offset) != -1;
+   simple_mtx_unlock(&db->mtx);
+
+   if (!read_ok)
+      goto fail;
+
+   memcpy(&record, data, sizeof(record));
+   if (record.magic != DB_MAGIC ||
+       record.size != record_size - sizeof(record) ||
+       memcmp(record.key, key, CACHE_KEY_SIZE) != 0)
+      goto fail;
+
+   /* Only touch the index page when the time actually changes. */
+   uint32_t now = db_time();
+   if (!db->read_only && entry->atime != now)
+      entry->atime = now;
+
+   memmove(data, data + sizeof(record), record.size);
+   *size = record.size;
+
+   return data;
+
+ fail:
+   free(data);
+
+   return NULL;
+}
+
+void
+disk_cache_db_remove(struct disk_cache_db *db, const uint8_t *key)
+{
+   struct disk_cache_db_index_entry *entry;
+
+   if (db->read_only || !db_lock(db))
+      return;
+
+   uint64_t index_key = db_index_key(key);
+
+   /* The record stays in the pack until the next compaction. */
+   entry = db_find_slot(db, index_key);
+   if (entry && entry->key == index_key)
+      entry->size = 0;
+
+   db_unlock(db);
+}
+
+#endif /* ENABLE_SHADER_CACHE */
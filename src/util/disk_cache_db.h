@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2014 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* A single-file store for cache entries.
+ *
+ * Entries are appended to a pack file and located through a fixed-size,
+ * open-addressed hash table kept in a second, mmapped index file. Writers
+ * serialize on a lock of the index file, so several processes can share
+ * the same database. Readers take no file lock: every record in the pack
+ * carries its full key, which is checked before the data is returned.
+ *
+ * Space is reclaimed by compaction: the most recently used entries are
+ * copied into a fresh pack file that atomically replaces the old one.
+ *
+ * A database can also be opened read-only, which is how prebuilt cache
+ * bundles are used. Those are expected not to change while they are open.
+ */
+
+#ifndef DISK_CACHE_DB_H
+#define DISK_CACHE_DB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/simple_mtx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DISK_CACHE_DB_PACK_NAME  "mesa_cache.db"
+#define DISK_CACHE_DB_INDEX_NAME "mesa_cache.idx"
+
+struct disk_cache_db_index_header;
+struct disk_cache_db_index_entry;
+
+struct disk_cache_db {
+   char *pack_path;
+   char *index_path;
+
+   int pack_fd;
+   int index_fd;
+
+   /* Generation of the pack file behind pack_fd. The index records the
+    * current generation, which changes each time the pack is compacted.
+    */
+   uint64_t pack_generation;
+
+   /* The mmapped index file. */
+   struct disk_cache_db_index_header *header;
+   struct disk_cache_db_index_entry *entries;
+   size_t index_mmap_size;
+
+   /* Maximum size of the pack file (in bytes). */
+   uint64_t max_size;
+
+   bool read_only;
+
+   /* Serializes the threads of this process, flock() only works between
+    * processes.
+    */
+   simple_mtx_t mtx;
+};
+
+/* Open or create the database files within the directory 'path'. Strings
+ * are ralloc'ed off of 'mem_ctx'.
+ *
+ * Returns false if the database cannot be used.
+ */
+bool
+disk_cache_db_open(struct disk_cache_db *db, void *mem_ctx, const char *path,
+                   uint64_t max_size);
+
+/* Open an existing database within the directory 'path' for lookups only,
+ * without ever writing to it or taking its lock.
+ */
+bool
+disk_cache_db_open_read_only(struct disk_cache_db *db, void *mem_ctx,
+                             const char *path);
+
+void
+disk_cache_db_close(struct disk_cache_db *db);
+
+/* Append an entry, compacting the pack first if it would grow beyond
+ * max_size. Nothing is written if the key is already present.
+ */
+bool
+disk_cache_db_put(struct disk_cache_db *db, const uint8_t *key,
+                  const void *data, size_t size);
+
+/* Returns a malloc'ed copy of the entry data, or NULL if it is not in the
+ * database.
+ */
+void *
+disk_cache_db_get(struct disk_cache_db *db, const uint8_t *key,
+                  size_t *size);
+
+void
+disk_cache_db_remove(struct disk_cache_db *db, const uint8_t *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DISK_CACHE_DB_H */
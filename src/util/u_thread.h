@@ -113,6 +113,24 @@ util_pin_thread_to_L3(thrd_t thread, unsigned L3_index, unsigned cores_per_L3)
 #endif
 }
 
+/**
+ * Pin a thread to a single CPU.
+ *
+ * \param thread  thread
+ * \param cpu     CPU index
+ */
+static inline void
+util_pin_thread_to_cpu(thrd_t thread, unsigned cpu)
+{
+#if defined(HAVE_PTHREAD_SETAFFINITY)
+   cpu_set_t cpuset;
+
+   CPU_ZERO(&cpuset);
+   CPU_SET(cpu, &cpuset);
+   pthread_setaffinity_np(thread, sizeof(cpuset), &cpuset);
+#endif
+}
+
 /**
  * Return the index of L3 that the thread is pinned to. If the thread is
  * pinned to multiple L3 caches, return -1.